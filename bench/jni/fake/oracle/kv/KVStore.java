@@ -0,0 +1,106 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package oracle.kv;
+
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.Iterator;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.ConcurrentSkipListMap;
+
+/**
+ * In-memory stand-in for the KVStore methods used by put, get and
+ * multi-get, to measure the native side of the module without a network
+ * round trip. Not a faithful implementation: depth is only honoured for
+ * the parent record, and the sub-range applies to the first minor
+ * component.
+ */
+public class KVStore
+{
+  private final ConcurrentSkipListMap<Key, ValueVersion> data =
+      new ConcurrentSkipListMap<Key, ValueVersion>();
+  private long nextVersion = 1;
+
+  public synchronized Version put(Key key, Value value)
+  {
+    Version version = new Version(nextVersion++);
+    data.put(key, new ValueVersion(value, version));
+    return version;
+  }
+
+  public ValueVersion get(Key key)
+  {
+    return data.get(key);
+  }
+
+  public boolean delete(Key key)
+  {
+    return data.remove(key) != null;
+  }
+
+  private List<KeyValueVersion> select(Key parentKey, KeyRange subRange, Depth depth)
+  {
+    List<String> major = parentKey.getMajorPath();
+    List<String> minor = parentKey.getMinorPath();
+    Key from = Key.createKey(major, minor);
+    List<KeyValueVersion> result = new ArrayList<KeyValueVersion>();
+
+    for (Map.Entry<Key, ValueVersion> e : data.tailMap(from, true).entrySet())
+    {
+      Key key = e.getKey();
+      if (!key.getMajorPath().equals(major))
+        break;
+      List<String> keyMinor = key.getMinorPath();
+      if (keyMinor.size() < minor.size() ||
+          !keyMinor.subList(0, minor.size()).equals(minor))
+        break;
+
+      boolean isParent = keyMinor.size() == minor.size();
+      if (isParent)
+      {
+        if (depth == Depth.CHILDREN_ONLY || depth == Depth.DESCENDANTS_ONLY)
+          continue;
+      }
+      else if (subRange != null && !subRange.inRange(keyMinor.get(minor.size())))
+        continue;
+
+      ValueVersion vv = e.getValue();
+      result.add(new KeyValueVersion(key, vv.getValue(), vv.getVersion()));
+    }
+    return result;
+  }
+
+  public Iterator<KeyValueVersion> multiGetIterator(Direction direction,
+                                                    int batchSize,
+                                                    Key parentKey,
+                                                    KeyRange subRange,
+                                                    Depth depth)
+  {
+    List<KeyValueVersion> result = select(parentKey, subRange, depth);
+    if (direction == Direction.REVERSE)
+      Collections.reverse(result);
+    return result.iterator();
+  }
+
+  public int multiDelete(Key parentKey, KeyRange subRange, Depth depth)
+  {
+    List<KeyValueVersion> result = select(parentKey, subRange, depth);
+    for (KeyValueVersion kvv : result)
+      data.remove(kvv.getKey());
+    return result.size();
+  }
+}
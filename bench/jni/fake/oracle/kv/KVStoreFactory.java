@@ -0,0 +1,30 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package oracle.kv;
+
+/**
+ * Every getStore() returns the same in-memory store, so that connections
+ * of one benchmark process share their data.
+ */
+public class KVStoreFactory
+{
+  private static final KVStore store = new KVStore();
+
+  public static KVStore getStore(KVStoreConfig config)
+  {
+    return store;
+  }
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package oracle.kv;
+
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * Ordered by major path, then minor path, component by component.
+ */
+public class Key implements Comparable<Key>
+{
+  private final List<String> major;
+  private final List<String> minor;
+
+  private Key(List<String> major, List<String> minor)
+  {
+    this.major = major;
+    this.minor = minor;
+  }
+
+  public static Key createKey(List<String> major, List<String> minor)
+  {
+    return new Key(new ArrayList<String>(major),
+                   minor == null ? new ArrayList<String>() : new ArrayList<String>(minor));
+  }
+
+  public static Key createKey(List<String> major)
+  {
+    return createKey(major, null);
+  }
+
+  public List<String> getMajorPath()
+  {
+    return major;
+  }
+
+  public List<String> getMinorPath()
+  {
+    return minor;
+  }
+
+  private static int compare(List<String> a, List<String> b)
+  {
+    for (int i = 0; i < a.size() && i < b.size(); ++i)
+    {
+      int c = a.get(i).compareTo(b.get(i));
+      if (c != 0)
+        return c;
+    }
+    return a.size() - b.size();
+  }
+
+  public int compareTo(Key other)
+  {
+    int c = compare(major, other.major);
+    return c != 0 ? c : compare(minor, other.minor);
+  }
+
+  public boolean equals(Object other)
+  {
+    return other instanceof Key && compareTo((Key)other) == 0;
+  }
+
+  public int hashCode()
+  {
+    return major.hashCode() * 31 + minor.hashCode();
+  }
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package oracle.kv;
+
+public class KeyRange
+{
+  private final String start;
+  private final boolean startInclusive;
+  private final String end;
+  private final boolean endInclusive;
+  private final String prefix;
+
+  public KeyRange(String prefix)
+  {
+    this.prefix = prefix;
+    this.start = null;
+    this.startInclusive = true;
+    this.end = null;
+    this.endInclusive = true;
+  }
+
+  public KeyRange(String start, boolean startInclusive, String end, boolean endInclusive)
+  {
+    this.prefix = null;
+    this.start = start;
+    this.startInclusive = startInclusive;
+    this.end = end;
+    this.endInclusive = endInclusive;
+  }
+
+  public boolean inRange(String component)
+  {
+    if (prefix != null)
+      return component.startsWith(prefix);
+    int s = component.compareTo(start);
+    int e = component.compareTo(end);
+    return (s > 0 || (s == 0 && startInclusive)) && (e < 0 || (e == 0 && endInclusive));
+  }
+}
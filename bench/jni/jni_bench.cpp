@@ -0,0 +1,330 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Microbenchmark of the native side of put-binary, get-binary and
+ * multi-get-binary. The module library is loaded directly and its external
+ * functions are evaluated against the in-memory oracle.kv classes of
+ * fake/, so the numbers contain the argument parsing, the JNI calls and the
+ * result items but no network round trip.
+ *
+ *   jni_bench <module library> [iterations]
+ *
+ * CLASSPATH must contain the compiled fake classes, see Readme.txt. One JSON
+ * object is printed per measurement.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+
+#include <zorba/zorba.h>
+#include <zorba/store_manager.h>
+#include <zorba/external_module.h>
+#include <zorba/function.h>
+#include <zorba/item_factory.h>
+#include <zorba/singleton_item_sequence.h>
+#include <zorba/static_context.h>
+#include <zorba/dynamic_context.h>
+#include <zorba/zorba_exception.h>
+
+using namespace zorba;
+
+typedef std::chrono::steady_clock Clock_t;
+
+
+/*****************************************************************************
+ Argument helpers
+ *****************************************************************************/
+
+class Bench
+{
+  public:
+    ItemFactory* theFactory;
+    StaticContext_t theSctx;
+    XQuery_t theQuery;
+    DynamicContext* theDctx;
+    ExternalModule* theModule;
+    ContextualExternalFunction* theConnect;
+    ContextualExternalFunction* thePut;
+    ContextualExternalFunction* theGet;
+    ContextualExternalFunction* theMultiGet;
+    Item theDB;
+
+    ContextualExternalFunction*
+    function(const char* aName);
+
+    ItemSequence_t
+    call(ContextualExternalFunction* aFunction, const std::vector<Item>& aArgs);
+
+    Item
+    createKey(size_t aRun, size_t aDepth, size_t aMajor, size_t aMinor);
+
+    Item
+    createValue(size_t aSize);
+};
+
+
+ContextualExternalFunction*
+Bench::function(const char* aName)
+{
+  ContextualExternalFunction* lFunction =
+      dynamic_cast<ContextualExternalFunction*>(theModule->getExternalFunction(aName));
+  if (!lFunction)
+  {
+    std::cerr << "function " << aName << " not found in the module" << std::endl;
+    exit(1);
+  }
+  return lFunction;
+}
+
+
+ItemSequence_t
+Bench::call(ContextualExternalFunction* aFunction, const std::vector<Item>& aArgs)
+{
+  std::vector<SingletonItemSequence> lSequences;
+  lSequences.reserve(aArgs.size());
+  ExternalFunction::Arguments_t lArgs;
+  for (size_t i = 0; i < aArgs.size(); ++i)
+  {
+    lSequences.push_back(SingletonItemSequence(aArgs[i]));
+    lArgs.push_back(&lSequences.back());
+  }
+  return aFunction->evaluate(lArgs, theSctx.get(), theDctx);
+}
+
+
+/**
+ * A key with aDepth components, split evenly between the major and the
+ * minor path. All keys of one aMajor share their major path, so that
+ * multi-get returns aMinor siblings; keys of different runs never meet.
+ */
+Item
+Bench::createKey(size_t aRun, size_t aDepth, size_t aMajor, size_t aMinor)
+{
+  size_t lMajorDepth = (aDepth + 1) / 2;
+  std::vector<Item> lMajor;
+  std::vector<Item> lMinor;
+  for (size_t i = 0; i < lMajorDepth; ++i)
+  {
+    std::ostringstream lComponent;
+    lComponent << "m" << i << "-" << aRun << "-" << (i + 1 == lMajorDepth ? aMajor : 0);
+    lMajor.push_back(theFactory->createString(lComponent.str()));
+  }
+  for (size_t i = lMajorDepth; i < aDepth; ++i)
+  {
+    std::ostringstream lComponent;
+    lComponent << "n" << i << "-" << (i + 1 == aDepth ? aMinor : 0);
+    lMinor.push_back(theFactory->createString(lComponent.str()));
+  }
+
+  std::vector<std::pair<Item, Item> > lPairs;
+  lPairs.push_back(std::make_pair(theFactory->createString("major"),
+                                  theFactory->createJSONArray(lMajor)));
+  lPairs.push_back(std::make_pair(theFactory->createString("minor"),
+                                  theFactory->createJSONArray(lMinor)));
+  return theFactory->createJSONObject(lPairs);
+}
+
+
+Item
+Bench::createValue(size_t aSize)
+{
+  std::string lBytes(aSize, 'x');
+  return theFactory->createBase64Binary(lBytes.data(), lBytes.size(), false);
+}
+
+
+/*****************************************************************************
+ Measurements
+ *****************************************************************************/
+
+static size_t
+drain(const ItemSequence_t& aSequence)
+{
+  size_t lCount = 0;
+  Iterator_t lIter = aSequence->getIterator();
+  Item lItem;
+  lIter->open();
+  while (lIter->next(lItem))
+    ++lCount;
+  lIter->close();
+  return lCount;
+}
+
+
+static void
+report(const char* aOperation, size_t aDepth, size_t aValueSize, size_t aFanout,
+       size_t aCalls, size_t aRecords, Clock_t::duration aElapsed)
+{
+  double lNanos = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(aElapsed).count();
+  printf("{\"op\":\"%s\",\"depth\":%lu,\"value-size\":%lu,\"fanout\":%lu,"
+         "\"calls\":%lu,\"records\":%lu,\"ns-per-op\":%.0f,\"ns-per-record\":%.0f}\n",
+         aOperation, (unsigned long)aDepth, (unsigned long)aValueSize,
+         (unsigned long)aFanout, (unsigned long)aCalls, (unsigned long)aRecords,
+         lNanos / aCalls, aRecords ? lNanos / aRecords : 0.0);
+  fflush(stdout);
+}
+
+
+/**
+ * aIterations puts and gets of aFanout sibling keys each, then one multi-get
+ * of the siblings per major path.
+ */
+static void
+measure(Bench& b, size_t aRun, size_t aDepth, size_t aValueSize, size_t aFanout, size_t aIterations)
+{
+  size_t lMajors = aIterations / aFanout ? aIterations / aFanout : 1;
+  Item lValue = b.createValue(aValueSize);
+
+  std::vector<Item> lKeys;
+  for (size_t i = 0; i < lMajors; ++i)
+    for (size_t j = 0; j < aFanout; ++j)
+      lKeys.push_back(b.createKey(aRun, aDepth, i, j));
+
+  Clock_t::time_point lStart = Clock_t::now();
+  for (size_t i = 0; i < lKeys.size(); ++i)
+  {
+    std::vector<Item> lArgs;
+    lArgs.push_back(b.theDB);
+    lArgs.push_back(lKeys[i]);
+    lArgs.push_back(lValue);
+    drain(b.call(b.thePut, lArgs));
+  }
+  report("put", aDepth, aValueSize, aFanout, lKeys.size(), lKeys.size(),
+         Clock_t::now() - lStart);
+
+  size_t lRecords = 0;
+  lStart = Clock_t::now();
+  for (size_t i = 0; i < lKeys.size(); ++i)
+  {
+    std::vector<Item> lArgs;
+    lArgs.push_back(b.theDB);
+    lArgs.push_back(lKeys[i]);
+    lRecords += drain(b.call(b.theGet, lArgs));
+  }
+  report("get", aDepth, aValueSize, aFanout, lKeys.size(), lRecords,
+         Clock_t::now() - lStart);
+
+  // the parent of the siblings is the key without its last component
+  if (aDepth < 2)
+    return;
+
+  // every minor component starts with "n"
+  std::vector<std::pair<Item, Item> > lPrefix;
+  lPrefix.push_back(std::make_pair(b.theFactory->createString("prefix"),
+                                   b.theFactory->createString("n")));
+  Item lRange = b.theFactory->createJSONObject(lPrefix);
+  Item lDepth = b.theFactory->createString("CHILDREN_ONLY");
+  Item lDirection = b.theFactory->createString("FORWARD");
+
+  lRecords = 0;
+  lStart = Clock_t::now();
+  for (size_t i = 0; i < lMajors; ++i)
+  {
+    std::vector<Item> lArgs;
+    lArgs.push_back(b.theDB);
+    lArgs.push_back(b.createKey(aRun, aDepth - 1, i, 0));
+    lArgs.push_back(lRange);
+    lArgs.push_back(lDepth);
+    lArgs.push_back(lDirection);
+    lRecords += drain(b.call(b.theMultiGet, lArgs));
+  }
+  report("multi-get", aDepth, aValueSize, aFanout, lMajors, lRecords,
+         Clock_t::now() - lStart);
+}
+
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "usage: " << argv[0] << " <module library> [iterations]" << std::endl;
+    return 1;
+  }
+  size_t lIterations = argc > 2 ? strtoul(argv[2], 0, 10) : 10000;
+
+  void* lLibrary = dlopen(argv[1], RTLD_NOW | RTLD_GLOBAL);
+  if (!lLibrary)
+  {
+    std::cerr << dlerror() << std::endl;
+    return 1;
+  }
+  typedef ExternalModule* (*CreateModule_t)();
+  CreateModule_t lCreateModule = (CreateModule_t)dlsym(lLibrary, "createModule");
+  if (!lCreateModule)
+  {
+    std::cerr << "createModule not found in " << argv[1] << std::endl;
+    return 1;
+  }
+
+  void* lStore = StoreManager::getStore();
+  Zorba* lZorba = Zorba::getInstance(lStore);
+
+  try
+  {
+    Bench b;
+    b.theFactory = lZorba->getItemFactory();
+    b.theSctx = lZorba->createStaticContext();
+    // only the dynamic context of the query is used, to hold the connections
+    b.theQuery = lZorba->compileQuery("()", b.theSctx);
+    b.theDctx = b.theQuery->getDynamicContext();
+    b.theModule = lCreateModule();
+    b.theConnect = b.function("connect-internal");
+    b.thePut = b.function("put-binary");
+    b.theGet = b.function("get-binary");
+    b.theMultiGet = b.function("multi-get-binary");
+
+    std::vector<std::pair<Item, Item> > lNoOptions;
+    std::vector<Item> lArgs;
+    lArgs.push_back(b.theFactory->createString("bench"));
+    lArgs.push_back(b.theFactory->createString("localhost:5000"));
+    lArgs.push_back(b.theFactory->createJSONObject(lNoOptions));
+    Iterator_t lIter = b.call(b.theConnect, lArgs)->getIterator();
+    lIter->open();
+    lIter->next(b.theDB);
+    lIter->close();
+
+    const size_t lDepths[] = { 1, 2, 4, 8 };
+    const size_t lValueSizes[] = { 16, 1024, 65536 };
+    const size_t lFanouts[] = { 1, 10, 100 };
+
+    size_t lRun = 0;
+    for (size_t d = 0; d < sizeof(lDepths) / sizeof(lDepths[0]); ++d)
+      for (size_t v = 0; v < sizeof(lValueSizes) / sizeof(lValueSizes[0]); ++v)
+        for (size_t f = 0; f < sizeof(lFanouts) / sizeof(lFanouts[0]); ++f)
+          measure(b, ++lRun, lDepths[d], lValueSizes[v], lFanouts[f], lIterations);
+
+    b.theQuery->close();
+    b.theModule->destroy();
+  }
+  catch (ZorbaException& e)
+  {
+    std::cerr << e << std::endl;
+    return 1;
+  }
+
+  lZorba->shutdown();
+  StoreManager::shutdownStore(lStore);
+  return 0;
+}
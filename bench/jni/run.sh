@@ -0,0 +1,62 @@
+#!/bin/bash
+
+# Copyright 2006-2012 The FLWOR Foundation.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Compiles the fake oracle.kv classes and jni_bench.cpp, then runs the
+# microbenchmark against the given module library.
+
+set -e
+
+JNIDIR=$(cd "$(dirname "$0")" && pwd)
+ZORBA_PREFIX=/usr/local
+JAVA_HOME=${JAVA_HOME:-/usr/lib/jvm/default-java}
+MODULE=
+ITERATIONS=10000
+BUILDDIR=$JNIDIR/build
+
+while getopts z:j:m:i:b:h opt
+do
+  case "$opt" in
+        z)  ZORBA_PREFIX="$OPTARG" ;;
+        j)  JAVA_HOME="$OPTARG" ;;
+        m)  MODULE="$OPTARG" ;;
+        i)  ITERATIONS="$OPTARG" ;;
+        b)  BUILDDIR="$OPTARG" ;;
+        h|*)
+            echo "usage: $0 -m module-library [-z zorba-prefix] [-j java-home]"
+            echo "          [-i iterations] [-b build-dir]"
+            echo "       -m  the built oracle-nosqldb module library (.so)"
+            echo "       -z  prefix with include/zorba and lib/libzorba_simplestore (default $ZORBA_PREFIX)"
+            echo "       -j  JDK used to compile the fake store (default \$JAVA_HOME)"
+            echo "       -i  puts and gets per measurement (default $ITERATIONS)"
+            echo "       -b  directory for the compiled classes and binary"
+            exit 1 ;;
+  esac
+done
+
+if [ -z "$MODULE" ]
+then
+  echo "$0: -m module-library is required"
+  exit 1
+fi
+
+mkdir -p "$BUILDDIR/classes"
+"$JAVA_HOME/bin/javac" -d "$BUILDDIR/classes" "$JNIDIR"/fake/oracle/kv/*.java
+g++ -std=c++11 -O2 -o "$BUILDDIR/jni_bench" "$JNIDIR/jni_bench.cpp" \
+    -I"$ZORBA_PREFIX/include" -L"$ZORBA_PREFIX/lib" \
+    -Wl,-rpath,"$ZORBA_PREFIX/lib" -lzorba_simplestore -ldl
+
+# only the fake classes, kvclient.jar must not be on the classpath
+CLASSPATH="$BUILDDIR/classes" "$BUILDDIR/jni_bench" "$MODULE" "$ITERATIONS"
@@ -0,0 +1,110 @@
+#!/bin/bash
+
+# Copyright 2006-2012 The FLWOR Foundation.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Runs the YCSB-style workloads of ycsb.xq and appends one JSON line per
+# workload and key distribution to the results file.
+
+# the status of a run is the status of zorba, not of tr
+set -o pipefail
+
+BENCHDIR=$(cd "$(dirname "$0")" && pwd)
+TESTDIR=$BENCHDIR/../test
+
+ZORBA=${ZORBA:-zorba}
+MODULEPATH=
+CLASSPATH_OPT=
+START=0
+WORKLOADS="A B C E F"
+DISTRIBUTIONS="zipfian uniform"
+RECORDS=1000
+OPERATIONS=10000
+VALUESIZE=100
+SCANLENGTH=10
+RESULTS=results.jsonl
+
+while getopts z:m:c:sw:d:r:o:v:l:f:h opt
+do
+  case "$opt" in
+        z)  ZORBA="$OPTARG" ;;
+        m)  MODULEPATH="$OPTARG" ;;
+        c)  CLASSPATH_OPT="$OPTARG" ;;
+        s)  START=1 ;;
+        w)  WORKLOADS="$OPTARG" ;;
+        d)  DISTRIBUTIONS="$OPTARG" ;;
+        r)  RECORDS="$OPTARG" ;;
+        o)  OPERATIONS="$OPTARG" ;;
+        v)  VALUESIZE="$OPTARG" ;;
+        l)  SCANLENGTH="$OPTARG" ;;
+        f)  RESULTS="$OPTARG" ;;
+        h|*)
+            echo "usage: $0 [-z zorba] [-m module-path] [-c classpath] [-s] [-w workloads]"
+            echo "          [-d distributions] [-r records] [-o operations] [-v value-size]"
+            echo "          [-l scan-length] [-f results-file]"
+            echo "       -z  zorba executable (default \$ZORBA or zorba)"
+            echo "       -m  module path of the built oracle-nosqldb module"
+            echo "       -c  classpath with kvclient.jar"
+            echo "       -s  start KVLite with test/setup.sh before and stop it after"
+            echo "       -w  workloads, any of A B C E F (default \"$WORKLOADS\")"
+            echo "       -d  key distributions, zipfian and/or uniform (default \"$DISTRIBUTIONS\")"
+            echo "       -r  records loaded (default $RECORDS)"
+            echo "       -o  operations per run (default $OPERATIONS)"
+            echo "       -v  value size in bytes (default $VALUESIZE)"
+            echo "       -l  records per scan (default $SCANLENGTH)"
+            echo "       -f  results file, one JSON object per line (default $RESULTS)"
+            exit 2
+            ;;
+  esac
+done
+
+ZORBA_OPTS="-f -q $BENCHDIR/ycsb.xq"
+[ -n "$MODULEPATH" ] && ZORBA_OPTS="$ZORBA_OPTS --module-path $MODULEPATH"
+[ -n "$CLASSPATH_OPT" ] && ZORBA_OPTS="$ZORBA_OPTS --classpath $CLASSPATH_OPT"
+
+if [ $START = 1 ]
+then
+  (cd "$TESTDIR" && ./setup.sh -s)
+  # KVLite takes a while until it accepts requests
+  sleep 15
+fi
+
+LOAD=true
+STATUS=0
+for DIST in $DISTRIBUTIONS
+do
+  for WL in $WORKLOADS
+  do
+    echo "workload $WL, $DIST" >&2
+    # the records are loaded by the first run only
+    if $ZORBA $ZORBA_OPTS \
+        -e workload:=$WL -e distribution:=$DIST -e load:=$LOAD \
+        -e records:=$RECORDS -e operations:=$OPERATIONS \
+        -e value-size:=$VALUESIZE -e scan-length:=$SCANLENGTH \
+        | tr -d '\n' >> "$RESULTS"
+    then
+      echo >> "$RESULTS"
+      LOAD=false
+    else
+      STATUS=1
+    fi
+  done
+done
+
+if [ $START = 1 ]
+then
+  (cd "$TESTDIR" && ./setup.sh -t)
+fi
+
+exit $STATUS
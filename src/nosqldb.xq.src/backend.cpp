@@ -0,0 +1,454 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "backend.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+Depth
+parseDepth(const std::string& aDepth)
+{
+  if (aDepth == "CHILDREN_ONLY")
+    return CHILDREN_ONLY;
+  else if (aDepth == "PARENT_AND_CHILDREN")
+    return PARENT_AND_CHILDREN;
+  else if (aDepth == "DESCENDANTS_ONLY")
+    return DESCENDANTS_ONLY;
+  return PARENT_AND_DESCENDANTS;
+}
+
+
+Direction
+parseDirection(const std::string& aDirection)
+{
+  return aDirection == "REVERSE" ? REVERSE : FORWARD;
+}
+
+
+int
+compareToRange(const std::string& aComponent, const KeyRangeSpec& aRange)
+{
+  if (aRange.theIsPrefix)
+  {
+    if (aComponent.compare(0, aRange.thePrefix.size(), aRange.thePrefix) == 0)
+      return 0;
+    return aComponent < aRange.thePrefix ? -1 : 1;
+  }
+
+  int lStart = aComponent.compare(aRange.theStart);
+  if (lStart < 0 || (lStart == 0 && !aRange.theStartInclusive))
+    return -1;
+  if (!aRange.theHasEnd)
+    return 0;
+  int lEnd = aComponent.compare(aRange.theEnd);
+  if (lEnd > 0 || (lEnd == 0 && !aRange.theEndInclusive))
+    return 1;
+  return 0;
+}
+
+
+// split points are taken from the 3 bytes following the common start of
+// the bounds, read as digits of base 96 over the bytes 0x20 to 0x7F
+static const size_t theSplitDigits = 3;
+
+
+static unsigned long long
+readSplitDigits(const std::string& aBound, size_t aFrom)
+{
+  unsigned long long lValue = 0;
+  for (size_t i = aFrom; i < aFrom + theSplitDigits; ++i)
+  {
+    int c = i < aBound.size() ? (unsigned char)aBound[i] : 0x20;
+    lValue = lValue * 96 + (std::min(std::max(c, 0x20), 0x7F) - 0x20);
+  }
+  return lValue;
+}
+
+
+static std::string
+writeSplitDigits(unsigned long long aValue)
+{
+  std::string lDigits(theSplitDigits, ' ');
+  for (size_t i = theSplitDigits; i > 0; --i)
+  {
+    lDigits[i - 1] = (char)(0x20 + aValue % 96);
+    aValue /= 96;
+  }
+  return lDigits;
+}
+
+
+// the first string after those starting with the non-empty aPrefix, the
+// prefix with its last byte incremented; false if that is no valid ASCII
+// byte, as the store orders Java strings rather than bytes
+static bool
+prefixEnd(const std::string& aPrefix, std::string& aEnd)
+{
+  if ((unsigned char)aPrefix[aPrefix.size() - 1] >= 0x7F)
+    return false;
+  aEnd = aPrefix;
+  ++aEnd[aEnd.size() - 1];
+  return true;
+}
+
+
+std::vector<KeyRangeSpec>
+splitKeyRange(const KeyRangeSpec& aRange, unsigned aParts,
+              const std::vector<std::string>& aSplitPoints)
+{
+  std::vector<KeyRangeSpec> lParts;
+
+  // the selected components lie between lLower and lUpper, a prefix range
+  // ends at prefixEnd(), or nowhere for the empty prefix
+  std::string lLower = aRange.theIsPrefix ? aRange.thePrefix : aRange.theStart;
+  std::string lUpper = aRange.theEnd;
+  bool lHasUpper = true;
+  if (aRange.theIsPrefix)
+  {
+    if (lLower.empty())
+      lHasUpper = false;
+    else if (!prefixEnd(lLower, lUpper))
+    {
+      lParts.push_back(aRange);
+      return lParts;
+    }
+  }
+
+  std::vector<std::string> lPoints;
+  if (!aSplitPoints.empty())
+    lPoints = aSplitPoints;
+  else if (aParts > 1)
+  {
+    size_t lCommon = 0;
+    if (lHasUpper)
+      while (lCommon < lLower.size() && lCommon < lUpper.size() &&
+             lLower[lCommon] == lUpper[lCommon])
+        ++lCommon;
+
+    unsigned long long lFrom = readSplitDigits(lLower, lCommon);
+    unsigned long long lTo = lHasUpper ? readSplitDigits(lUpper, lCommon)
+                                       : 96 * 96 * 96;
+    for (unsigned i = 1; lTo > lFrom && i < aParts; ++i)
+      lPoints.push_back(lLower.substr(0, lCommon) +
+                        writeSplitDigits(lFrom + (lTo - lFrom) * i / aParts));
+  }
+
+  std::sort(lPoints.begin(), lPoints.end());
+  lPoints.erase(std::unique(lPoints.begin(), lPoints.end()), lPoints.end());
+
+  std::vector<std::string> lBounds(1, lLower);
+  for (size_t i = 0; i < lPoints.size(); ++i)
+    if (lPoints[i] > lLower && (!lHasUpper || lPoints[i] < lUpper))
+      lBounds.push_back(lPoints[i]);
+
+  if (lBounds.size() == 1)
+  {
+    lParts.push_back(aRange);
+    return lParts;
+  }
+
+  // each part starts at its split point and ends before the next one
+  for (size_t i = 0; i < lBounds.size(); ++i)
+  {
+    KeyRangeSpec lPart;
+    lPart.theIsPrefix = false;
+    lPart.theStart = lBounds[i];
+    lPart.theStartInclusive = i > 0 || aRange.theIsPrefix || aRange.theStartInclusive;
+    if (i + 1 < lBounds.size())
+    {
+      lPart.theEnd = lBounds[i + 1];
+      lPart.theEndInclusive = false;
+    }
+    else
+    {
+      lPart.theEnd = lUpper;
+      lPart.theEndInclusive = !aRange.theIsPrefix && aRange.theEndInclusive;
+      lPart.theHasEnd = lHasUpper;
+    }
+    lParts.push_back(lPart);
+  }
+  return lParts;
+}
+
+
+bool
+resumeKeyRange(const KeyRangeSpec& aRange, const std::string& aComponent,
+               bool aInclusive, Direction aDirection, KeyRangeSpec& aResult)
+{
+  aResult = KeyRangeSpec();
+  aResult.theIsPrefix = false;
+  if (aRange.theIsPrefix)
+  {
+    aResult.theStart = aRange.thePrefix;
+    aResult.theEndInclusive = false;
+    aResult.theHasEnd = !aRange.thePrefix.empty() &&
+                        prefixEnd(aRange.thePrefix, aResult.theEnd);
+  }
+  else
+  {
+    aResult.theStart = aRange.theStart;
+    aResult.theStartInclusive = aRange.theStartInclusive;
+    aResult.theEnd = aRange.theEnd;
+    aResult.theEndInclusive = aRange.theEndInclusive;
+    aResult.theHasEnd = aRange.theHasEnd;
+  }
+
+  // aComponent replaces the bound it is inside of
+  if (aDirection == REVERSE)
+  {
+    int lEnd = aResult.theHasEnd ? aComponent.compare(aResult.theEnd) : -1;
+    if (lEnd < 0 || (lEnd == 0 && !aInclusive))
+    {
+      aResult.theEnd = aComponent;
+      aResult.theEndInclusive = aInclusive;
+      aResult.theHasEnd = true;
+    }
+  }
+  else
+  {
+    int lStart = aComponent.compare(aResult.theStart);
+    if (lStart > 0 || (lStart == 0 && !aInclusive))
+    {
+      aResult.theStart = aComponent;
+      aResult.theStartInclusive = aInclusive;
+    }
+  }
+
+  if (!aResult.theHasEnd)
+    return true;
+  int lOrder = aResult.theStart.compare(aResult.theEnd);
+  return lOrder < 0 ||
+         (lOrder == 0 && aResult.theStartInclusive && aResult.theEndInclusive);
+}
+
+
+void
+Backend::getMany(const std::vector<KeyPath>& aKeys, unsigned /*aParallelism*/,
+                 RecordHandler& aHandler, PhaseClock& aClock)
+{
+  for (size_t i = 0; i < aKeys.size(); ++i)
+    if (get(aKeys[i], aHandler, aClock))
+      aClock.countRecord();
+}
+
+
+void
+Backend::multiGetPage(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                      Depth aDepth, Direction aDirection, size_t,
+                      RecordHandler& aHandler, PhaseClock& aClock)
+{
+  multiGet(aParentKey, aRange, aDepth, aDirection, aHandler, aClock);
+}
+
+
+namespace
+{
+
+// the records of a vector, in its order
+class VectorCursor : public RecordCursor
+{
+  private:
+    std::vector<Record> theRecords;
+    size_t thePosition;
+
+  public:
+    VectorCursor(std::vector<Record>& aRecords)
+      : thePosition(0)
+    {
+      theRecords.swap(aRecords);
+    }
+
+    virtual bool
+    next(Record& aRecord, PhaseClock&)
+    {
+      if (thePosition == theRecords.size())
+        return false;
+      std::swap(aRecord, theRecords[thePosition++]);
+      return true;
+    }
+};
+
+}
+
+
+std::unique_ptr<RecordCursor>
+Backend::openReadAhead(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                       Depth aDepth, Direction aDirection, unsigned, PhaseClock& aClock)
+{
+  std::vector<Record> lRecords;
+  RecordCollector lCollector(lRecords);
+  multiGet(aParentKey, aRange, aDepth, aDirection, lCollector, aClock);
+  return std::unique_ptr<RecordCursor>(new VectorCursor(lRecords));
+}
+
+
+void
+Backend::multiGetParts(const KeyPath& aParentKey, const std::vector<KeyRangeSpec>& aParts,
+                       Depth aDepth, Direction aDirection, bool,
+                       unsigned, RecordHandler& aHandler, PhaseClock& aClock)
+{
+  for (size_t i = 0; i < aParts.size(); ++i)
+  {
+    size_t lPart = aDirection == REVERSE ? aParts.size() - 1 - i : i;
+    multiGet(aParentKey, &aParts[lPart], aDepth, aDirection, aHandler, aClock);
+  }
+}
+
+
+std::unique_ptr<RecordCursor>
+Backend::openMerged(const std::vector<KeyPath>& aParentKeys, const KeyRangeSpec* aRange,
+                    Depth aDepth, Direction aDirection, unsigned, PhaseClock& aClock)
+{
+  std::vector<Record> lRecords;
+  RecordCollector lCollector(lRecords);
+  for (size_t i = 0; i < aParentKeys.size(); ++i)
+    multiGet(aParentKeys[i], aRange, aDepth, aDirection, lCollector, aClock);
+
+  std::vector<std::pair<std::string, size_t> > lOrder(lRecords.size());
+  for (size_t i = 0; i < lRecords.size(); ++i)
+    lOrder[i] = std::make_pair(encodeOrderedKey(lRecords[i].theKey), i);
+  std::sort(lOrder.begin(), lOrder.end());
+
+  std::vector<Record> lSorted(lRecords.size());
+  for (size_t i = 0; i < lOrder.size(); ++i)
+    std::swap(lSorted[i],
+        lRecords[lOrder[aDirection == REVERSE ? lOrder.size() - 1 - i : i].second]);
+  return std::unique_ptr<RecordCursor>(new VectorCursor(lSorted));
+}
+
+
+MergeCursor::MergeCursor(std::vector<std::unique_ptr<RecordCursor> >& aCursors,
+                         Direction aDirection)
+  : theDirection(aDirection),
+    theHeads(aCursors.size()),
+    theStarted(false)
+{
+  for (size_t i = 0; i < aCursors.size(); ++i)
+    theHeads[i].theCursor = std::move(aCursors[i]);
+}
+
+
+bool
+MergeCursor::advance(size_t aHead, PhaseClock& aClock)
+{
+  Head& lHead = theHeads[aHead];
+  if (!lHead.theCursor->next(lHead.theRecord, aClock))
+  {
+    // the iterators of a cursor at its end are not held any longer
+    lHead.theCursor.reset();
+    return false;
+  }
+  lHead.theOrder = encodeOrderedKey(lHead.theRecord.theKey);
+  return true;
+}
+
+
+bool
+MergeCursor::next(Record& aRecord, PhaseClock& aClock)
+{
+  auto lAfter = [this](size_t a, size_t b) -> bool
+  {
+    return theDirection == REVERSE ? theHeads[a].theOrder < theHeads[b].theOrder
+                                   : theHeads[a].theOrder > theHeads[b].theOrder;
+  };
+
+  if (!theStarted)
+  {
+    theStarted = true;
+    theHeap.reserve(theHeads.size());
+    for (size_t i = 0; i < theHeads.size(); ++i)
+      if (advance(i, aClock))
+        theHeap.push_back(i);
+    std::make_heap(theHeap.begin(), theHeap.end(), lAfter);
+  }
+  if (theHeap.empty())
+    return false;
+
+  std::pop_heap(theHeap.begin(), theHeap.end(), lAfter);
+  size_t lHead = theHeap.back();
+  std::swap(aRecord, theHeads[lHead].theRecord);
+  if (advance(lHead, aClock))
+    std::push_heap(theHeap.begin(), theHeap.end(), lAfter);
+  else
+    theHeap.pop_back();
+  return true;
+}
+
+
+void
+RecordCollector::record(const KeyPath& aKey, const char* aValue, size_t aSize,
+                        long long aVersion)
+{
+  theRecords.push_back(Record());
+  theRecords.back().theKey = aKey;
+  theRecords.back().theValue.assign(aValue, aSize);
+  theRecords.back().theVersion = aVersion;
+}
+
+
+RecordFilter::RecordFilter(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                           Depth aDepth)
+  : theLevel(aParentKey.theMinor.size()),
+    theRange(aRange),
+    theWithParent(!aRange &&
+        (aDepth == PARENT_AND_CHILDREN || aDepth == PARENT_AND_DESCENDANTS)),
+    theChildrenOnly(aDepth == CHILDREN_ONLY || aDepth == PARENT_AND_CHILDREN),
+    thePrefix(encodeOrderedKey(aParentKey)),
+    theParentApart(aRange &&
+        (aDepth == PARENT_AND_CHILDREN || aDepth == PARENT_AND_DESCENDANTS))
+{
+  if (aRange)
+  {
+    // the children are ordered by the component following the parent, the
+    // scan starts at the first one the range can contain
+    KeyPath lFirst = aParentKey;
+    lFirst.theMinor.push_back(aRange->theIsPrefix ? aRange->thePrefix : aRange->theStart);
+    theFirst = encodeOrderedKey(lFirst);
+  }
+  else
+  {
+    theFirst = thePrefix;
+  }
+}
+
+
+RecordFilter::Verdict
+RecordFilter::check(const KeyPath& aKey) const
+{
+  if (aKey.theMinor.size() == theLevel)
+    return theWithParent ? SELECT : SKIP;
+
+  if (theRange)
+  {
+    int lPosition = compareToRange(aKey.theMinor[theLevel], *theRange);
+    if (lPosition > 0)
+      return STOP;
+    if (lPosition < 0)
+      return SKIP;
+  }
+
+  if (theChildrenOnly && aKey.theMinor.size() > theLevel + 1)
+    return SKIP;
+  return SELECT;
+}
+
+
+}} // namespace zorba, nosqldb
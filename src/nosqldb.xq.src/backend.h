@@ -0,0 +1,343 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOSQLDB_BACKEND_H
+#define NOSQLDB_BACKEND_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "key_codec.h"
+#include "profile.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * The records below a parent key covered by a multi-key operation, as
+ * oracle.kv.Depth.
+ */
+enum Depth
+{
+  CHILDREN_ONLY,
+  PARENT_AND_CHILDREN,
+  DESCENDANTS_ONLY,
+  PARENT_AND_DESCENDANTS
+};
+
+/**
+ * Reads a $depth argument; unknown names mean PARENT_AND_DESCENDANTS.
+ */
+Depth
+parseDepth(const std::string& aDepth);
+
+enum Direction
+{
+  FORWARD,
+  REVERSE
+};
+
+/**
+ * Reads a $direction argument; anything but "REVERSE" means FORWARD.
+ */
+Direction
+parseDirection(const std::string& aDirection);
+
+/**
+ * Where aComponent, the path component following the parent key, lies
+ * relative to aRange: negative before it, 0 inside, positive after it.
+ * Components are compared bytewise as the store does.
+ */
+int
+compareToRange(const std::string& aComponent, const KeyRangeSpec& aRange);
+
+/**
+ * Splits the start/end or prefix range aRange into consecutive start/end
+ * ranges that together select the same components. The split points are
+ * those of aSplitPoints that lie inside aRange or, if aSplitPoints is
+ * empty, aParts - 1 points spread evenly over the printable ASCII strings
+ * between the bounds of aRange. Returns aRange alone if there is nothing
+ * to split, or if it is a prefix range whose end is not exactly expressible
+ * as a string because the prefix ends in a non-ASCII byte.
+ */
+std::vector<KeyRangeSpec>
+splitKeyRange(const KeyRangeSpec& aRange, unsigned aParts,
+              const std::vector<std::string>& aSplitPoints);
+
+/**
+ * aRange narrowed to the components after aComponent, or before it for
+ * REVERSE, with aComponent itself if aInclusive. The result is a
+ * start/end range; it has no end if aRange is a prefix range whose end is
+ * not expressible, see splitKeyRange(). Returns false if nothing is left.
+ */
+bool
+resumeKeyRange(const KeyRangeSpec& aRange, const std::string& aComponent,
+               bool aInclusive, Direction aDirection, KeyRangeSpec& aResult);
+
+/**
+ * The selection of a multi-get for the native backends, which keep their
+ * records ordered by encodeOrderedKey(): the selected records lie between
+ * theFirst and the end of the keys starting with thePrefix, and check()
+ * decides about each record met on the way.
+ */
+class RecordFilter
+{
+  private:
+    size_t theLevel;
+    const KeyRangeSpec* theRange;
+    bool theWithParent;
+    bool theChildrenOnly;
+
+  public:
+    enum Verdict
+    {
+      SKIP,
+      SELECT,
+      STOP
+    };
+
+    // the encoded parent key, every selected key starts with it
+    std::string thePrefix;
+    // the encoded key the scan starts at
+    std::string theFirst;
+    // the parent record is selected but lies before theFirst, a backend
+    // looks it up on its own
+    bool theParentApart;
+
+    RecordFilter(const KeyPath& aParentKey, const KeyRangeSpec* aRange, Depth aDepth);
+
+    /**
+     * aKey is a key starting with thePrefix, at or after theFirst. STOP
+     * means that no later key is selected.
+     */
+    Verdict
+    check(const KeyPath& aKey) const;
+};
+
+/**
+ * Receives the records read by a backend. The value is only valid during
+ * the call, which lets a backend hand out its own memory instead of a copy.
+ */
+class RecordHandler
+{
+  public:
+    virtual ~RecordHandler() {}
+
+    virtual void
+    record(const KeyPath& aKey, const char* aValue, size_t aSize, long long aVersion) = 0;
+
+    /**
+     * True once the handler needs no more records, only asked by
+     * Backend::multiGetPage().
+     */
+    virtual bool
+    done() const
+    { return false; }
+};
+
+/**
+ * A record copied out of a backend.
+ */
+class Record
+{
+  public:
+    KeyPath theKey;
+    std::string theValue;
+    long long theVersion;
+};
+
+/**
+ * Appends copies of the records it receives to theRecords.
+ */
+class RecordCollector : public RecordHandler
+{
+  public:
+    std::vector<Record>& theRecords;
+
+    RecordCollector(std::vector<Record>& aRecords)
+      : theRecords(aRecords)
+    {}
+
+    virtual void
+    record(const KeyPath& aKey, const char* aValue, size_t aSize, long long aVersion);
+};
+
+/**
+ * The records of a scan, read as they are asked for.
+ */
+class RecordCursor
+{
+  public:
+    virtual ~RecordCursor() {}
+
+    /**
+     * Copies the next record into aRecord; returns false at the end.
+     */
+    virtual bool
+    next(Record& aRecord, PhaseClock& aClock) = 0;
+};
+
+/**
+ * Merges cursors that each return their records in encodeOrderedKey()
+ * order, or in reverse, into one sequence in that order. A cursor is only
+ * asked for its next record once its current one has been passed on.
+ */
+class MergeCursor : public RecordCursor
+{
+  private:
+    class Head
+    {
+      public:
+        std::unique_ptr<RecordCursor> theCursor;
+        std::string theOrder;
+        Record theRecord;
+    };
+
+    Direction theDirection;
+    std::vector<Head> theHeads;
+    // the heads by their current record, the first record on top
+    std::vector<size_t> theHeap;
+    bool theStarted;
+
+    bool
+    advance(size_t aHead, PhaseClock& aClock);
+
+  public:
+    MergeCursor(std::vector<std::unique_ptr<RecordCursor> >& aCursors, Direction aDirection);
+
+    virtual bool
+    next(Record& aRecord, PhaseClock& aClock);
+};
+
+/**
+ * The store behind put, get, remove, multi-get and multi-remove. Chosen by
+ * the "backend" connect option: the KVStore through JNI, or a native store.
+ * Failures are raised as XQuery errors or, by the JNI backend, as
+ * JavaException with the Java exception left pending.
+ */
+class Backend
+{
+  public:
+    virtual ~Backend() {}
+
+    /**
+     * Stores aValue under aKey and returns the new version.
+     */
+    virtual long long
+    put(const KeyPath& aKey, const std::string& aValue, PhaseClock& aClock) = 0;
+
+    /**
+     * Passes the record of aKey to aHandler; returns false if there is none.
+     */
+    virtual bool
+    get(const KeyPath& aKey, RecordHandler& aHandler, PhaseClock& aClock) = 0;
+
+    /**
+     * Passes the records of those aKeys that exist to aHandler, in the order
+     * of aKeys. A backend may read up to aParallelism keys at a time; the
+     * default reads them one by one with get().
+     */
+    virtual void
+    getMany(const std::vector<KeyPath>& aKeys, unsigned aParallelism,
+            RecordHandler& aHandler, PhaseClock& aClock);
+
+    /**
+     * Returns false if there was no record to delete.
+     */
+    virtual bool
+    remove(const KeyPath& aKey, PhaseClock& aClock) = 0;
+
+    /**
+     * Passes the records below aParentKey to aHandler, in key order or in
+     * reverse. aParentKey needs its complete major path. aRange, if not 0,
+     * restricts the path component following aParentKey; as with KVStore,
+     * the parent record is passed for a depth that includes it,
+     * whatever the range.
+     */
+    virtual void
+    multiGet(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+             Depth aDepth, Direction aDirection,
+             RecordHandler& aHandler, PhaseClock& aClock) = 0;
+
+    /**
+     * multiGet() for a handler that may be done before the end of the
+     * range: a backend stops passing records once aHandler.done(). aLimit
+     * is the number of records the handler is expected to take, a backend
+     * may read that many at a time. The default is multiGet(), the handler
+     * then has to ignore the records it gets after it is done.
+     */
+    virtual void
+    multiGetPage(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                 Depth aDepth, Direction aDirection, size_t aLimit,
+                 RecordHandler& aHandler, PhaseClock& aClock);
+
+    /**
+     * A cursor over the records of multiGet() that reads up to aBatches
+     * batches ahead of the record asked for. The default reads them all
+     * at once.
+     */
+    virtual std::unique_ptr<RecordCursor>
+    openReadAhead(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                  Depth aDepth, Direction aDirection, unsigned aBatches,
+                  PhaseClock& aClock);
+
+    /**
+     * multiGet() over the union of aParts, consecutive ranges as made by
+     * splitKeyRange(). With aOrdered the records come in the order of
+     * multiGet(), otherwise in any order. A backend may scan up to
+     * aParallelism parts at a time; the default scans them one by one.
+     */
+    virtual void
+    multiGetParts(const KeyPath& aParentKey, const std::vector<KeyRangeSpec>& aParts,
+                  Depth aDepth, Direction aDirection, bool aOrdered,
+                  unsigned aParallelism, RecordHandler& aHandler, PhaseClock& aClock);
+
+    /**
+     * A cursor over the records multiGet() would return under each of
+     * aParentKeys, merged into one sequence in encodeOrderedKey() order, or
+     * in reverse. The parent keys must be distinct and none below another.
+     * A backend may open up to aParallelism parents at a time and read
+     * them as the cursor is asked for records; the default reads them one
+     * by one and sorts their records.
+     */
+    virtual std::unique_ptr<RecordCursor>
+    openMerged(const std::vector<KeyPath>& aParentKeys, const KeyRangeSpec* aRange,
+               Depth aDepth, Direction aDirection, unsigned aParallelism,
+               PhaseClock& aClock);
+
+    /**
+     * Deletes the records multiGet would return, returns their number.
+     */
+    virtual size_t
+    multiRemove(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                Depth aDepth, PhaseClock& aClock) = 0;
+
+    /**
+     * Passes every record whose major path starts with the major path of
+     * aParentKey, or every record if aParentKey is 0, to aHandler in no
+     * particular order. A failed scan is not retried.
+     */
+    virtual void
+    scan(const KeyPath* aParentKey, RecordHandler& aHandler, PhaseClock& aClock) = 0;
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_BACKEND_H
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <map>
+
+#include "batch_sizer.h"
+#include "nosqldb.h"
+#include "options.h"
+#include "statistics.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+// the weight of a new sample in the moving averages
+static const double theSampleWeight = 0.25;
+
+// the batch size until the first scan was observed, the default of the store
+static const size_t theDefaultBatchSize = 100;
+
+
+std::shared_ptr<BatchEstimates>
+BatchEstimates::open(const std::string& aStore)
+{
+  static std::mutex theStoresMutex;
+  static std::map<std::string, std::shared_ptr<BatchEstimates> > theStores;
+
+  std::lock_guard<std::mutex> lLock(theStoresMutex);
+  std::shared_ptr<BatchEstimates>& lEstimates = theStores[aStore];
+  if (!lEstimates)
+    lEstimates = std::make_shared<BatchEstimates>();
+  return lEstimates;
+}
+
+
+BatchSizer::BatchSizer(const Item& aOptions, const std::string& aStore)
+  : theEnabled(true),
+    theTargetBytes(1024 * 1024),
+    theLatencyBudget(100 * 1000),
+    theMinSize(10),
+    theMaxSize(10000)
+{
+  Item lSizing = getOption(aOptions, "batch-sizing");
+  if (!lSizing.isNull())
+  {
+    if (lSizing.isAtomic())
+      theEnabled = getBooleanOption(aOptions, "batch-sizing", true);
+    else
+    {
+      long long lTargetBytes = getIntegerOption(lSizing, "target-bytes", (long long)theTargetBytes);
+      long long lBudget = getIntegerOption(lSizing, "latency-budget-ms", 100);
+      long long lMin = getIntegerOption(lSizing, "min-batch-size", (long long)theMinSize);
+      long long lMax = getIntegerOption(lSizing, "max-batch-size", (long long)theMaxSize);
+      if (lTargetBytes < 1)
+        throwError("InvalidOption", "Option 'target-bytes' must be positive.");
+      if (lBudget < 1)
+        throwError("InvalidOption", "Option 'latency-budget-ms' must be positive.");
+      if (lMin < 1 || lMax < lMin || lMax > 1000000)
+        throwError("InvalidOption", "Options 'min-batch-size' and 'max-batch-size' must satisfy 1 <= min <= max <= 1000000.");
+
+      theTargetBytes = (double)lTargetBytes;
+      theLatencyBudget = (double)lBudget * 1000;
+      theMinSize = (size_t)lMin;
+      theMaxSize = (size_t)lMax;
+    }
+  }
+  theInitialSize = std::min(std::max(theDefaultBatchSize, theMinSize), theMaxSize);
+  if (theEnabled)
+    theEstimates = BatchEstimates::open(aStore);
+}
+
+
+size_t
+BatchSizer::size()
+{
+  if (!theEnabled)
+    return 0;
+
+  size_t lSize = theInitialSize;
+  {
+    BatchEstimates& lEstimates = *theEstimates;
+    std::lock_guard<std::mutex> lLock(lEstimates.theMutex);
+    if (lEstimates.theBytesPerRecord > 0)
+    {
+      double lEstimate = theTargetBytes / lEstimates.theBytesPerRecord;
+      if (lEstimates.theMicrosPerRecord > 0)
+        lEstimate = std::min(lEstimate, theLatencyBudget / lEstimates.theMicrosPerRecord);
+      lSize = (size_t)std::min(std::max(lEstimate, (double)theMinSize), (double)theMaxSize);
+    }
+  }
+
+  if (Statistics* lStatistics = Statistics::current())
+  {
+    ++lStatistics->theSizedScans;
+    lStatistics->theBatchSizeSum += lSize;
+    lStatistics->theLastBatchSize = lSize;
+  }
+  return lSize;
+}
+
+
+void
+BatchSizer::observe(size_t aBatchSize, size_t aRecords, size_t aBytes,
+                    Clock_t::duration aFetchTime)
+{
+  if (!theEnabled || aRecords == 0)
+    return;
+
+  // a record costs at least its key and a byte of value
+  double lBytes = std::max((double)aBytes / aRecords, 1.0);
+  double lMicros = std::chrono::duration<double, std::micro>(aFetchTime).count() / aRecords;
+
+  BatchEstimates& lEstimates = *theEstimates;
+  std::lock_guard<std::mutex> lLock(lEstimates.theMutex);
+  lEstimates.theBytesPerRecord = lEstimates.theBytesPerRecord > 0
+      ? lEstimates.theBytesPerRecord + theSampleWeight * (lBytes - lEstimates.theBytesPerRecord)
+      : lBytes;
+
+  if (aRecords < aBatchSize || lMicros <= 0)
+    return;
+  lEstimates.theMicrosPerRecord = lEstimates.theMicrosPerRecord > 0
+      ? lEstimates.theMicrosPerRecord + theSampleWeight * (lMicros - lEstimates.theMicrosPerRecord)
+      : lMicros;
+}
+
+
+}} // namespace zorba, nosqldb
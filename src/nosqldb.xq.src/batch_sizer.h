@@ -0,0 +1,165 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_BATCH_SIZER_H
+#define NOSQLDB_BATCH_SIZER_H
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <zorba/item.h>
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * The running estimates of the bytes per record and the fetch time per
+ * record of the scans of one store. They are shared by the connections of
+ * the process that size their batches, see open(), so that the scans of
+ * one query start from what the queries before it observed.
+ */
+class BatchEstimates
+{
+  public:
+    std::mutex theMutex;
+    // exponentially weighted moving averages, 0 until the first sample
+    double theBytesPerRecord;
+    double theMicrosPerRecord;
+
+    BatchEstimates()
+      : theBytesPerRecord(0),
+        theMicrosPerRecord(0)
+    {}
+
+    /**
+     * The estimates of the store aStore, created by the first connection
+     * to it.
+     */
+    static std::shared_ptr<BatchEstimates>
+    open(const std::string& aStore);
+
+  private:
+    BatchEstimates(const BatchEstimates&);
+    BatchEstimates& operator=(const BatchEstimates&);
+};
+
+
+/**
+ * Picks the batch size of the store iterators of a connection to one store
+ * from the BatchEstimates of that store, so that a batch holds about the
+ * target bytes and is fetched within the latency budget. Configured by
+ * the "batch-sizing" connect option; shared by the worker threads of the
+ * connection.
+ */
+class BatchSizer
+{
+  public:
+    typedef std::chrono::steady_clock Clock_t;
+
+  private:
+    bool theEnabled;
+    double theTargetBytes;
+    double theLatencyBudget;    // microseconds
+    size_t theMinSize;
+    size_t theMaxSize;
+    size_t theInitialSize;
+    std::shared_ptr<BatchEstimates> theEstimates;
+
+  public:
+    /**
+     * Reads "batch-sizing" : false or { "target-bytes" : 1048576,
+     * "latency-budget-ms" : 100, "min-batch-size" : 10,
+     * "max-batch-size" : 10000 } from the connect options, for the scans
+     * of the store aStore.
+     */
+    BatchSizer(const Item& aOptions, const std::string& aStore);
+
+    /**
+     * The batch size of the next store iterator, 0 (the store's default)
+     * if sizing is off. Counted in the statistics of the current operation.
+     */
+    size_t
+    size();
+
+    /**
+     * Feeds a completed scan of aRecords records of aBytes bytes in total,
+     * read in batches of aBatchSize, that spent aFetchTime in the iterator.
+     * The fetch time is only used once a scan filled a batch, shorter scans
+     * would count their whole round trip against a few records.
+     */
+    void
+    observe(size_t aBatchSize, size_t aRecords, size_t aBytes,
+            Clock_t::duration aFetchTime);
+
+  private:
+    BatchSizer(const BatchSizer&);
+    BatchSizer& operator=(const BatchSizer&);
+};
+
+
+/**
+ * Measures one scan with the batch size chosen by a BatchSizer, call
+ * fetched() after each record and finish() when the scan completed. A
+ * failed scan is not observed.
+ */
+class ScanSample
+{
+  private:
+    BatchSizer& theSizer;
+    size_t theBatchSize;
+    size_t theRecords;
+    size_t theBytes;
+    BatchSizer::Clock_t::duration theFetchTime;
+
+  public:
+    ScanSample(BatchSizer& aSizer)
+      : theSizer(aSizer),
+        theBatchSize(aSizer.size()),
+        theRecords(0),
+        theBytes(0),
+        theFetchTime(0)
+    {}
+
+    size_t
+    getBatchSize() const
+    { return theBatchSize; }
+
+    /**
+     * A record of aBytes was read, its hasNext() and next() calls started
+     * at aStart.
+     */
+    void
+    fetched(BatchSizer::Clock_t::time_point aStart, size_t aBytes)
+    {
+      ++theRecords;
+      theBytes += aBytes;
+      theFetchTime += BatchSizer::Clock_t::now() - aStart;
+    }
+
+    void
+    finish()
+    { theSizer.observe(theBatchSize, theRecords, theBytes, theFetchTime); }
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_BATCH_SIZER_H
@@ -0,0 +1,350 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <chrono>
+#include <climits>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include "bulk_transfer.h"
+#include "json_lines.h"
+#include "jvm_thread.h"
+#include "nosqldb.h"
+#include "statistics.h"
+#include "work_queue.h"
+#include "worker_pool.h"
+#include "write_buffer.h"
+
+#define RETURN_IF_EXCEPTION(env)  if ((COUNT_JNI_CALL(), env->ExceptionCheck())) return false
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/*****************************************************************************
+ import
+ *****************************************************************************/
+
+namespace
+{
+
+class ImportRecord
+{
+  public:
+    KeyPath theKey;
+    std::string theValue;
+};
+
+typedef std::vector<ImportRecord> ImportBatch;
+
+
+class Importer
+{
+  private:
+    // writer i sends through handle i modulo their number
+    std::vector<jobject> theStores;
+    ReadYourWrites& theReadYourWrites;
+    // a few batches in flight per writer bound the memory use
+    std::vector<std::unique_ptr<WorkQueue<ImportBatch> > > theQueues;
+    WorkerPool thePool;
+
+    void
+    run(JNIEnv* env, unsigned aWriter)
+    {
+      ImportBatch lBatch;
+      while (theQueues[aWriter]->pop(lBatch))
+      {
+        // keep draining so that the reader never blocks on a failed writer
+        if (thePool.failed())
+          continue;
+
+        WriteBuffer lBuffer(lBatch.size(), (size_t)-1, LONG_MAX, theReadYourWrites);
+        for (size_t i = 0; i < lBatch.size(); ++i)
+          lBuffer.put(lBatch[i].theKey, lBatch[i].theValue);
+
+        lBuffer.flush(env, theStores[aWriter % theStores.size()]);
+        if (env->ExceptionCheck())
+          thePool.fail(env);
+      }
+    }
+
+  public:
+    Importer(JavaVM* aVM, const std::vector<jobject>& aStores, unsigned aParallelism,
+             ReadYourWrites& aReadYourWrites)
+      : theStores(aStores),
+        theReadYourWrites(aReadYourWrites),
+        thePool(aVM)
+    {
+      for (unsigned i = 0; i < aParallelism; ++i)
+        theQueues.push_back(std::unique_ptr<WorkQueue<ImportBatch> >(
+            new WorkQueue<ImportBatch>(4)));
+      thePool.start(aParallelism, [this](JNIEnv* env, unsigned aWriter)
+      {
+        run(env, aWriter);
+      });
+    }
+
+    ~Importer()
+    {
+      finish();
+    }
+
+    size_t
+    size() const
+    { return theQueues.size(); }
+
+    bool
+    failed() const
+    { return thePool.failed(); }
+
+    void
+    submit(size_t aWriter, ImportBatch& aBatch)
+    {
+      theQueues[aWriter]->push(std::move(aBatch));
+      aBatch.clear();
+    }
+
+    /**
+     * Waits until all submitted batches are written.
+     */
+    void
+    finish()
+    {
+      for (size_t i = 0; i < theQueues.size(); ++i)
+        theQueues[i]->close();
+      thePool.join();
+    }
+
+    void
+    throwIfFailed(JNIEnv* env)
+    { thePool.throwIfFailed(env); }
+};
+
+} // anonymous namespace
+
+
+TransferStats
+importJSONLines(JNIEnv* env,
+                JavaVM* aVM,
+                const std::vector<jobject>& aStores,
+                const std::string& aPath,
+                unsigned aParallelism,
+                size_t aBatchSize,
+                ReadYourWrites& aReadYourWrites)
+{
+  std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+  TransferStats lStats;
+
+  std::ifstream lIn(aPath.c_str(), std::ios::in | std::ios::binary);
+  if (!lIn)
+    throwError("FileError", ("Could not open " + aPath + " for reading.").c_str());
+
+  Importer lImporter(aVM, aStores, aParallelism, aReadYourWrites);
+  std::vector<ImportBatch> lPending(lImporter.size());
+  std::hash<std::string> lHash;
+  std::string lLine;
+  std::string lError;
+  unsigned long long lLineNumber = 0;
+
+  while (!lImporter.failed() && std::getline(lIn, lLine))
+  {
+    ++lLineNumber;
+    lStats.theBytes += lLine.size() + 1;
+    if (lLine.find_first_not_of(" \t\r") == std::string::npos)
+      continue;
+
+    ImportRecord lRecord;
+    if (!parseJSONRecord(lLine, lRecord.theKey, lRecord.theValue, lError))
+    {
+      std::stringstream s;
+      s << aPath << ":" << lLineNumber << ": " << lError;
+      throwError("ImportError", s.str().c_str());
+    }
+
+    size_t lWriter = lHash(lRecord.theKey.majorToString()) % lPending.size();
+    lPending[lWriter].push_back(std::move(lRecord));
+    ++lStats.theRecords;
+
+    if (lPending[lWriter].size() >= aBatchSize)
+      lImporter.submit(lWriter, lPending[lWriter]);
+  }
+
+  if (lIn.bad())
+    throwError("FileError", ("Could not read " + aPath + ".").c_str());
+
+  for (size_t i = 0; i < lPending.size(); ++i)
+    if (!lPending[i].empty())
+      lImporter.submit(i, lPending[i]);
+
+  lImporter.finish();
+  lImporter.throwIfFailed(env);
+
+  lStats.theSeconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - lStart).count();
+  return lStats;
+}
+
+
+/*****************************************************************************
+ export
+ *****************************************************************************/
+
+static bool
+exportRecords(JNIEnv* env,
+              jobject aIterator,
+              std::ostream& aOut,
+              ScanSample& aSample,
+              TransferStats& aStats)
+{
+  jclass iterClass = env->FindClass("java/util/Iterator");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midIterHasNext = env->GetMethodID(iterClass, "hasNext", "()Z");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midIterNext = env->GetMethodID(iterClass, "next", "()Ljava/lang/Object;");
+  RETURN_IF_EXCEPTION(env);
+
+  jclass kvvClass = env->FindClass("oracle/kv/KeyValueVersion");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midkvvGetKey = env->GetMethodID(kvvClass, "getKey", "()Loracle/kv/Key;");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midkvvGetValue = env->GetMethodID(kvvClass, "getValue", "()Loracle/kv/Value;");
+  RETURN_IF_EXCEPTION(env);
+
+  jclass valueClass = env->FindClass("oracle/kv/Value");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midValGetVal = env->GetMethodID(valueClass, "getValue", "()[B");
+  RETURN_IF_EXCEPTION(env);
+
+  KeyPath lKey;
+  std::vector<char> lValue;
+
+  while (true)
+  {
+    // writing the file is not fetch time
+    BatchSizer::Clock_t::time_point lFetchStart = BatchSizer::Clock_t::now();
+
+    //    iterator.hasNext()
+    jboolean hasNext = env->CallBooleanMethod(aIterator, midIterHasNext);
+    RETURN_IF_EXCEPTION(env);
+    if (!hasNext)
+      return true;
+
+    // one frame per record, a full store scan must not pin local refs
+    if (env->PushLocalFrame(8) < 0)
+      return false;
+
+    //    KeyValueVersion kvv = iterator.next();
+    jobject kvv = env->CallObjectMethod(aIterator, midIterNext);
+    jobject keyObj = env->ExceptionCheck() ? NULL :
+        env->CallObjectMethod(kvv, midkvvGetKey);
+    bool lOk = !env->ExceptionCheck() && readJavaKey(env, keyObj, lKey);
+
+    //    byte[] value = kvv.getValue().getValue();
+    jbyteArray jbaValue = NULL;
+    if (lOk)
+    {
+      jobject valueObj = env->CallObjectMethod(kvv, midkvvGetValue);
+      if (!env->ExceptionCheck())
+        jbaValue = (jbyteArray)env->CallObjectMethod(valueObj, midValGetVal);
+      lOk = !env->ExceptionCheck();
+    }
+
+    if (lOk)
+    {
+      jsize jbaSize = env->GetArrayLength(jbaValue);
+      lValue.resize(jbaSize > 0 ? jbaSize : 1);
+      env->GetByteArrayRegion(jbaValue, 0, jbaSize, (jbyte*)&lValue[0]);
+      aSample.fetched(lFetchStart, jbaSize);
+      writeJSONRecord(aOut, lKey, &lValue[0], jbaSize);
+      ++aStats.theRecords;
+      if (Statistics* lStatistics = Statistics::current())
+      {
+        ++lStatistics->theRecordsScanned;
+        lStatistics->theBytesRead += jbaSize;
+      }
+    }
+
+    env->PopLocalFrame(NULL);
+    if (!lOk)
+      return false;
+  }
+}
+
+
+bool
+exportJSONLines(JNIEnv* env,
+                jobject aStore,
+                jobject aParentKey,
+                jobject aRange,
+                BatchSizer& aBatchSizer,
+                const std::string& aPath,
+                TransferStats& aStats)
+{
+  std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+
+  std::ofstream lOut(aPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!lOut)
+    throwError("FileError", ("Could not open " + aPath + " for writing.").c_str());
+
+  jclass dirClass = env->FindClass("oracle/kv/Direction");
+  RETURN_IF_EXCEPTION(env);
+  jfieldID fidDirUnordered = env->GetStaticFieldID(dirClass, "UNORDERED", "Loracle/kv/Direction;");
+  RETURN_IF_EXCEPTION(env);
+  jobject dir_UNORDERED = env->GetStaticObjectField(dirClass, fidDirUnordered);
+  RETURN_IF_EXCEPTION(env);
+
+  jclass depthClass = env->FindClass("oracle/kv/Depth");
+  RETURN_IF_EXCEPTION(env);
+  jfieldID fidDepth = env->GetStaticFieldID(depthClass, "PARENT_AND_DESCENDANTS", "Loracle/kv/Depth;");
+  RETURN_IF_EXCEPTION(env);
+  jobject depth_PARENT_AND_DESCENDANTS = env->GetStaticObjectField(depthClass, fidDepth);
+  RETURN_IF_EXCEPTION(env);
+
+  //    Iterator<KeyValueVersion> iterator = store.storeIterator(
+  //        Direction.UNORDERED, batchSize, parentKey, range, Depth.PARENT_AND_DESCENDANTS);
+  jclass kvsClass = env->FindClass("oracle/kv/KVStore");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midStoreIterator = env->GetMethodID(kvsClass, "storeIterator", "(Loracle/kv/Direction;ILoracle/kv/Key;Loracle/kv/KeyRange;Loracle/kv/Depth;)Ljava/util/Iterator;");
+  RETURN_IF_EXCEPTION(env);
+  ScanSample lSample(aBatchSizer);
+  jobject iterator = env->CallObjectMethod(aStore, midStoreIterator,
+      dir_UNORDERED, (jint)lSample.getBatchSize(), aParentKey, aRange,
+      depth_PARENT_AND_DESCENDANTS);
+  RETURN_IF_EXCEPTION(env);
+
+  bool lOk = exportRecords(env, iterator, lOut, lSample, aStats);
+  env->DeleteLocalRef(iterator);
+  if (!lOk)
+    return false;
+  lSample.finish();
+
+  lOut.flush();
+  if (!lOut)
+    throwError("FileError", ("Could not write " + aPath + ".").c_str());
+  aStats.theBytes = (unsigned long long)lOut.tellp();
+
+  aStats.theSeconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - lStart).count();
+  return true;
+}
+
+
+}} // namespace zorba, nosqldb
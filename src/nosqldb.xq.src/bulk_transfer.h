@@ -0,0 +1,83 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_BULK_TRANSFER_H
+#define NOSQLDB_BULK_TRANSFER_H
+
+#include <string>
+#include <vector>
+
+#include <jni.h>
+
+#include "batch_sizer.h"
+#include "read_your_writes.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+class TransferStats
+{
+  public:
+    unsigned long long theRecords;
+    unsigned long long theBytes;
+    double theSeconds;
+
+    TransferStats() : theRecords(0), theBytes(0), theSeconds(0) {}
+};
+
+
+/**
+ * Streams the JSON-lines file aPath into the store. The query thread parses
+ * the file, records are routed to aParallelism writer threads by major path
+ * (so writes to one key keep their order) and each writer sends batches of
+ * up to aBatchSize records, one KVStore.execute() per major path, whose
+ * versions go to aReadYourWrites. The writers take turns on the handles
+ * aStores.
+ * Raises nosql:FileError, nosql:ImportError for a malformed line, or the
+ * error of the first failed writer.
+ */
+TransferStats
+importJSONLines(JNIEnv* env,
+                JavaVM* aVM,
+                const std::vector<jobject>& aStores,
+                const std::string& aPath,
+                unsigned aParallelism,
+                size_t aBatchSize,
+                ReadYourWrites& aReadYourWrites);
+
+/**
+ * Writes the records found by KVStore.storeIterator(UNORDERED, batchSize,
+ * aParentKey, aRange, PARENT_AND_DESCENDANTS) to the JSON-lines file aPath,
+ * with the batch size chosen by aBatchSizer. aParentKey and aRange may be
+ * NULL. Raises nosql:FileError, returns false if a Java exception is
+ * pending.
+ */
+bool
+exportJSONLines(JNIEnv* env,
+                jobject aStore,
+                jobject aParentKey,
+                jobject aRange,
+                BatchSizer& aBatchSizer,
+                const std::string& aPath,
+                TransferStats& aStats);
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_BULK_TRANSFER_H
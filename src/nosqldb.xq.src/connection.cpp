@@ -0,0 +1,264 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "connection.h"
+#include "java_backend.h"
+#include "nosqldb.h"
+#include "options.h"
+#include "sharded_backend.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+// the stores a connection may be sharded over
+static const size_t theMaxShards = 64;
+
+
+Connection::Connection(const Item& aOptions)
+  : theBackendKind(KVSTORE),
+    theStores(aOptions),
+    theFetchParallelism(8),
+    theTypedKeys(getBooleanOption(aOptions, "typed-keys", false)),
+    theRetryPolicy(aOptions),
+    theReadYourWrites(aOptions),
+    theThrottle(aOptions),
+    theProfiling(getBooleanOption(aOptions, "profile", false))
+{
+  // "backend" : "kvstore", "memory" or "snapshot"
+  std::string lBackend = getStringOption(aOptions, "backend", "kvstore");
+  if (lBackend == "memory")
+    theBackendKind = MEMORY;
+  else if (lBackend == "snapshot")
+    theBackendKind = SNAPSHOT;
+  else if (lBackend != "kvstore")
+    throwError("InvalidOption", "Option 'backend' must be \"kvstore\", \"memory\" or \"snapshot\".");
+
+  // "store-handles" : the native backends run without a client
+  if (theStores.getCount() > 1 && theBackendKind != KVSTORE)
+    throwError("InvalidOption", "Option 'store-handles' requires the \"kvstore\" backend.");
+
+  // "read-your-writes" : the native backends have a single copy of a record
+  if (theReadYourWrites.isEnabled() && theBackendKind != KVSTORE)
+    throwError("InvalidOption", "Option 'read-your-writes' requires the \"kvstore\" backend.");
+
+  // "path" : the snapshot file
+  if (theBackendKind == SNAPSHOT)
+  {
+    theSnapshotPath = getStringOption(aOptions, "path", "");
+    if (theSnapshotPath.empty())
+      throwError("InvalidOption", "Option 'path' is required by the \"snapshot\" backend.");
+  }
+
+  // "shards" : [ { "store-name" : .., "helper-host-ports" : [..],
+  //                "joining" : .. }, .. ]
+  Item lShards = getOption(aOptions, "shards");
+  if (!lShards.isNull())
+  {
+    if (!lShards.isJSONItem() ||
+        lShards.getJSONItemKind() != store::StoreConsts::jsonArray)
+      throwError("InvalidOption", "Option 'shards' must be an array of objects.");
+    if (theBackendKind == SNAPSHOT)
+      throwError("InvalidOption", "Option 'shards' requires the \"kvstore\" or \"memory\" backend.");
+
+    // the store of the connect arguments is the first shard, the one the
+    // data is in before any other joined
+    theShards.push_back(ShardOption());
+    theShards.back().theStoreName = getStringOption(aOptions, "store-name", "");
+    theShards.back().theJoining = false;
+
+    uint64_t lSize = lShards.getArraySize();
+    for (uint64_t i = 1; i <= lSize; ++i)
+    {
+      Item lShard = lShards.getArrayValue(i);
+      ShardOption lOption;
+      lOption.theStoreName = getStringOption(lShard, "store-name", "");
+      lOption.theJoining = getBooleanOption(lShard, "joining", false);
+      if (lOption.theStoreName.empty())
+        throwError("InvalidOption", "Every shard requires a 'store-name'.");
+
+      Item lHostPorts = getOption(lShard, "helper-host-ports");
+      if (!lHostPorts.isNull())
+      {
+        if (!lHostPorts.isJSONItem() ||
+            lHostPorts.getJSONItemKind() != store::StoreConsts::jsonArray)
+          throwError("InvalidOption", "Option 'helper-host-ports' must be an array of strings.");
+        uint64_t lHostCount = lHostPorts.getArraySize();
+        for (uint64_t j = 1; j <= lHostCount; ++j)
+          lOption.theHelperHostPorts.push_back(lHostPorts.getArrayValue(j).getStringValue().str());
+      }
+      if (theBackendKind == KVSTORE && lOption.theHelperHostPorts.empty())
+        throwError("InvalidOption", "Every shard of the \"kvstore\" backend requires 'helper-host-ports'.");
+
+      // the records are placed by the store names
+      for (size_t j = 0; j < theShards.size(); ++j)
+        if (theShards[j].theStoreName == lOption.theStoreName)
+          throwError("InvalidOption", "The shards must have distinct store names.");
+      theShards.push_back(lOption);
+    }
+    if (theShards.size() > theMaxShards)
+      throwError("InvalidOption", ("A connection may be sharded over at most " +
+          std::to_string(theMaxShards) + " stores, the store of 'store-name' included.").c_str());
+  }
+
+  // "batch-sizing" : the estimates are kept per store, across the queries
+  // of the process
+  theBatchSizers.push_back(std::unique_ptr<BatchSizer>(
+      new BatchSizer(aOptions, getStringOption(aOptions, "store-name", ""))));
+  for (size_t i = 1; i < theShards.size(); ++i)
+    theBatchSizers.push_back(std::unique_ptr<BatchSizer>(
+        new BatchSizer(aOptions, theShards[i].theStoreName)));
+
+  // "fetch-parallelism" : keys read at a time by the index functions
+  long long lFetchParallelism = getIntegerOption(aOptions, "fetch-parallelism", 8);
+  if (lFetchParallelism < 1 || lFetchParallelism > 256)
+    throwError("InvalidOption", "Option 'fetch-parallelism' must be between 1 and 256.");
+  theFetchParallelism = (unsigned)lFetchParallelism;
+
+  // "write-buffer" : true or { "max-operations" : .., "max-bytes" : ..,
+  //                            "max-delay-ms" : .. }
+  Item lWriteBuffer = getOption(aOptions, "write-buffer");
+  if (!lWriteBuffer.isNull() &&
+      (!lWriteBuffer.isAtomic() || getBooleanOption(aOptions, "write-buffer", false)))
+  {
+    // batches are sent with KVStore.execute()
+    if (theBackendKind != KVSTORE)
+      throwError("InvalidOption", "Option 'write-buffer' requires the \"kvstore\" backend.");
+    // a batch is sent to a single store
+    if (!theShards.empty())
+      throwError("InvalidOption", "Option 'write-buffer' cannot be combined with 'shards'.");
+    if (lWriteBuffer.isAtomic())
+      lWriteBuffer = Item();
+
+    theWriteBuffer.reset(new WriteBuffer(
+        (size_t)getIntegerOption(lWriteBuffer, "max-operations", 1000),
+        (size_t)getIntegerOption(lWriteBuffer, "max-bytes", 4 * 1024 * 1024),
+        (long)getIntegerOption(lWriteBuffer, "max-delay-ms", 1000),
+        theReadYourWrites));
+  }
+
+  // "hot-keys" : number of counters per sketch, 0 for none
+  long long lHotKeys = getIntegerOption(aOptions, "hot-keys", 0);
+  if (lHotKeys < 0 || lHotKeys > 1000000)
+    throwError("InvalidOption", "Option 'hot-keys' must be between 0 and 1000000.");
+
+  // "trace" : { "path" : .., "sample-rate" : .., "buffer-size" : .. }
+  Item lTrace = getOption(aOptions, "trace");
+  if (!lTrace.isNull())
+  {
+    std::string lPath = getStringOption(lTrace, "path", "");
+    double lSampleRate = getDoubleOption(lTrace, "sample-rate", 1.0);
+    long long lBufferSize = getIntegerOption(lTrace, "buffer-size", 4096);
+    if (lPath.empty())
+      throwError("InvalidOption", "Option 'trace' requires a 'path'.");
+    if (lSampleRate < 0 || lSampleRate > 1)
+      throwError("InvalidOption", "Option 'sample-rate' must be between 0 and 1.");
+    if (lBufferSize < 2 || lBufferSize > (1 << 24))
+      throwError("InvalidOption", "Option 'buffer-size' must be between 2 and 16777216.");
+
+    theTraceLog.reset(new TraceLog(lPath, lSampleRate, (size_t)lBufferSize));
+  }
+
+  // "indexes" : { "index-name" : "field" or ["field", "nested-field"], .. }
+  Item lIndexes = getOption(aOptions, "indexes");
+  if (!lIndexes.isNull())
+    theIndexes.reset(new SecondaryIndexes(lIndexes));
+
+  // "hedge" : true or { "percentile" : .., "min-delay-ms" : .., "budget" : ..,
+  //                     "min-samples" : .., "max-threads" : .. }
+  Item lHedge = getOption(aOptions, "hedge");
+  if (!lHedge.isNull() &&
+      (!lHedge.isAtomic() || getBooleanOption(aOptions, "hedge", false)))
+  {
+    // the hedges read with Consistency.NONE_REQUIRED
+    if (theBackendKind != KVSTORE)
+      throwError("InvalidOption", "Option 'hedge' requires the \"kvstore\" backend.");
+    // the hedge of a read goes to another handle of the same store
+    if (!theShards.empty())
+      throwError("InvalidOption", "Option 'hedge' cannot be combined with 'shards'.");
+    if (lHedge.isAtomic())
+      lHedge = Item();
+
+    // the latencies the delay is derived from are kept per store, across
+    // the queries of the process
+    theHedgedReads.reset(new HedgedReads(lHedge,
+                                         getStringOption(aOptions, "store-name", ""),
+                                         theStatistics));
+  }
+
+  // the sketches are kept per store, across the queries of the process
+  if (lHotKeys > 0)
+    theHotKeys = HotKeys::open(lBackend + ":" + (theBackendKind == SNAPSHOT
+                                   ? theSnapshotPath
+                                   : getStringOption(aOptions, "store-name", "")),
+                               (size_t)lHotKeys);
+
+  // every shard opens as many handles as the first
+  for (size_t i = 1; i < theShards.size(); ++i)
+    theShardStores.push_back(std::unique_ptr<StoreHandles>(new StoreHandles(aOptions)));
+  theShardBackends.resize(theShards.size());
+}
+
+
+void
+Connection::connectShard(size_t aShard, const std::shared_ptr<Backend>& aBackend)
+{
+  if (theShards.empty())
+  {
+    theBackend = aBackend;
+    return;
+  }
+
+  theShardBackends[aShard] = aBackend;
+  if (aShard + 1 < theShards.size())
+    return;
+
+  std::vector<ShardedBackend::Shard> lShards(theShards.size());
+  for (size_t i = 0; i < theShards.size(); ++i)
+  {
+    lShards[i].theName = theShards[i].theStoreName;
+    lShards[i].theBackend = theShardBackends[i];
+    lShards[i].theJoining = theShards[i].theJoining;
+  }
+  theBackend = std::make_shared<ShardedBackend>(lShards);
+}
+
+
+void
+Connection::setStores(JNIEnv* env, size_t aShard, const std::vector<jobject>& aStores)
+{
+  StoreHandles& lHandles = getStoreHandles(aShard);
+  for (size_t i = 0; i < aStores.size(); ++i)
+    lHandles.add(aStores[i]);
+  if (theHedgedReads)
+    theHedgedReads->setStores(env, aStores);
+  connectShard(aShard, std::make_shared<JavaBackend>(env, lHandles, theRetryPolicy,
+                                                     getBatchSizer(aShard),
+                                                     theReadYourWrites, theHedgedReads.get()));
+}
+
+
+Connection::~Connection()
+{
+  // waits for the hedged reads still running, they use theReadYourWrites
+  // and theStatistics, which are destroyed before it
+  theHedgedReads.reset();
+}
+
+
+}} // namespace zorba, nosqldb
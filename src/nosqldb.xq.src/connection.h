@@ -0,0 +1,287 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_CONNECTION_H
+#define NOSQLDB_CONNECTION_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <jni.h>
+
+#include <zorba/item.h>
+
+#include "backend.h"
+#include "batch_sizer.h"
+#include "hedged_reads.h"
+#include "hot_keys.h"
+#include "profile.h"
+#include "read_your_writes.h"
+#include "retry_policy.h"
+#include "secondary_index.h"
+#include "statistics.h"
+#include "store_handles.h"
+#include "throttle.h"
+#include "trace_log.h"
+#include "write_buffer.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * A store of the "shards" connect option.
+ */
+class ShardOption
+{
+  public:
+    std::string theStoreName;
+    std::vector<std::string> theHelperHostPorts;
+    bool theJoining;
+};
+
+
+/**
+ * A connection returned by nosql:connect: the KVStore handle together with
+ * the per connection state configured by the connect $options.
+ */
+class Connection
+{
+  public:
+    enum BackendKind
+    {
+      KVSTORE,
+      MEMORY,
+      SNAPSHOT
+    };
+
+  private:
+    BackendKind theBackendKind;
+    std::string theSnapshotPath;
+    std::shared_ptr<Backend> theBackend;
+    StoreHandles theStores;
+    std::vector<ShardOption> theShards;
+    // the handles of the shards after the first
+    std::vector<std::unique_ptr<StoreHandles> > theShardStores;
+    std::vector<std::shared_ptr<Backend> > theShardBackends;
+    std::unique_ptr<WriteBuffer> theWriteBuffer;
+    std::unique_ptr<SecondaryIndexes> theIndexes;
+    unsigned theFetchParallelism;
+    bool theTypedKeys;
+    std::unique_ptr<TraceLog> theTraceLog;
+    std::shared_ptr<HotKeys> theHotKeys;
+    std::unique_ptr<HedgedReads> theHedgedReads;
+    RetryPolicy theRetryPolicy;
+    // one per store, the store of the connect arguments first
+    std::vector<std::unique_ptr<BatchSizer> > theBatchSizers;
+    ReadYourWrites theReadYourWrites;
+    Throttle theThrottle;
+    Statistics theStatistics;
+    bool theProfiling;
+    CallProfile theLastProfile;
+
+    // theBackend is aBackend, or the sharded backend once every shard is
+    // connected
+    void
+    connectShard(size_t aShard, const std::shared_ptr<Backend>& aBackend);
+
+  public:
+    /**
+     * Reads the connect $options, raises nosql:InvalidOption or, if the
+     * trace file cannot be opened, nosql:FileError.
+     */
+    Connection(const Item& aOptions);
+
+    ~Connection();
+
+    /**
+     * The "backend" option: "kvstore" (the default), "memory" or "snapshot".
+     */
+    BackendKind
+    getBackendKind() const
+    { return theBackendKind; }
+
+    /**
+     * The "path" option of a SNAPSHOT connection.
+     */
+    const std::string&
+    getSnapshotPath() const
+    { return theSnapshotPath; }
+
+    /**
+     * The stores of the "shards" option, the store of the connect
+     * arguments first; empty if the connection is not sharded.
+     */
+    const std::vector<ShardOption>&
+    getShards() const
+    { return theShards; }
+
+    bool
+    isSharded() const
+    { return !theShards.empty(); }
+
+    /**
+     * The number of stores the connection is connected to.
+     */
+    size_t
+    getShardCount() const
+    { return theShards.empty() ? 1 : theShards.size(); }
+
+    /**
+     * Connects the shard aShard of a KVSTORE connection, 0 if it is not
+     * sharded, through the handles aStores, getStoreHandles().getCount()
+     * global references the connection takes over.
+     */
+    void
+    setStores(JNIEnv* env, size_t aShard, const std::vector<jobject>& aStores);
+
+    /**
+     * Connects the shard aShard of a native connection, 0 if it is not
+     * sharded, to its store.
+     */
+    void
+    setBackend(size_t aShard, const std::shared_ptr<Backend>& aBackend)
+    { connectShard(aShard, aBackend); }
+
+    Backend&
+    getBackend()
+    { return *theBackend; }
+
+    /**
+     * Global reference to the first oracle.kv.KVStore handle of the first
+     * shard, the one of the operations that are not striped; 0 for native
+     * backends.
+     */
+    jobject
+    getStore() const
+    { return theStores.getFirst(); }
+
+    /**
+     * All the handles of the shard aShard, see "store-handles".
+     */
+    StoreHandles&
+    getStoreHandles(size_t aShard = 0)
+    { return aShard == 0 ? theStores : *theShardStores[aShard - 1]; }
+
+    /**
+     * The write-behind buffer, 0 unless "write-buffer" was requested.
+     */
+    WriteBuffer*
+    getWriteBuffer() const
+    { return theWriteBuffer.get(); }
+
+    /**
+     * The secondary indexes, 0 unless "indexes" were declared.
+     */
+    SecondaryIndexes*
+    getIndexes() const
+    { return theIndexes.get(); }
+
+    /**
+     * The "fetch-parallelism" option, see Backend::getMany().
+     */
+    unsigned
+    getFetchParallelism() const
+    { return theFetchParallelism; }
+
+    /**
+     * The "typed-keys" option: key components are written with the typed
+     * key encoding of encodeKeyComponent() and read back as typed items.
+     */
+    bool
+    hasTypedKeys() const
+    { return theTypedKeys; }
+
+    /**
+     * The operation trace sink, 0 unless "trace" was requested.
+     */
+    TraceLog*
+    getTraceLog() const
+    { return theTraceLog.get(); }
+
+    /**
+     * The hot-key sketches of the store, 0 unless "hot-keys" was set.
+     */
+    HotKeys*
+    getHotKeys() const
+    { return theHotKeys.get(); }
+
+    RetryPolicy&
+    getRetryPolicy()
+    { return theRetryPolicy; }
+
+    /**
+     * The batch size of the store iterators of shard aShard, see
+     * "batch-sizing".
+     */
+    BatchSizer&
+    getBatchSizer(size_t aShard = 0)
+    { return *theBatchSizers[aShard]; }
+
+    /**
+     * The versions of the writes reads wait for, see "read-your-writes".
+     */
+    ReadYourWrites&
+    getReadYourWrites()
+    { return theReadYourWrites; }
+
+    /**
+     * The admission of the calls to the store, see "rate-limit" and
+     * "priority".
+     */
+    Throttle&
+    getThrottle()
+    { return theThrottle; }
+
+    /**
+     * The hedged single-key reads, 0 unless "hedge" was requested.
+     */
+    HedgedReads*
+    getHedgedReads() const
+    { return theHedgedReads.get(); }
+
+    Statistics&
+    getStatistics()
+    { return theStatistics; }
+
+    void
+    setProfiling(bool aProfiling)
+    { theProfiling = aProfiling; }
+
+    /**
+     * Where the PhaseClock of the next call writes to, 0 unless profiling
+     * is on.
+     */
+    CallProfile*
+    getProfileTarget()
+    { return theProfiling ? &theLastProfile : 0; }
+
+    const CallProfile&
+    getLastProfile() const
+    { return theLastProfile; }
+
+  private:
+    Connection(const Connection&);
+    Connection& operator=(const Connection&);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_CONNECTION_H
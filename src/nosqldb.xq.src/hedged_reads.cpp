@@ -0,0 +1,343 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <map>
+#include <memory>
+
+#include "hedged_reads.h"
+#include "jvm_thread.h"
+#include "nosqldb.h"
+#include "options.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+// the hedge delay is derived again after this many reads
+static const unsigned theDelayRefresh = 64;
+
+// unused budget is kept for at most this many hedges
+static const double theMaxTokens = 10;
+
+
+namespace
+{
+
+// the primary read (0) and the hedge (1) of one hedged read, shared with
+// the threads running them so that a losing read can still complete
+class Race
+{
+  public:
+    JavaVM* theVM;
+    std::mutex theMutex;
+    std::condition_variable theCondition;
+    unsigned theStarted;
+    unsigned theCompleted;
+    int theWinner;
+    bool theFound[2];
+    HedgedReads::Result theResults[2];
+    bool theFailed[2];
+    jthrowable theExceptions[2];
+
+    Race(JavaVM* aVM)
+      : theVM(aVM),
+        theStarted(1),
+        theCompleted(0),
+        theWinner(-1)
+    {
+      theFound[0] = theFound[1] = false;
+      theFailed[0] = theFailed[1] = false;
+      theExceptions[0] = theExceptions[1] = 0;
+    }
+
+    ~Race()
+    {
+      JNIEnv* env;
+      if (theVM->GetEnv((void**)&env, JNI_VERSION_1_6) != JNI_OK)
+        return;
+      for (unsigned i = 0; i < 2; ++i)
+        if (theExceptions[i])
+          env->DeleteGlobalRef(theExceptions[i]);
+    }
+
+    // runs read aIndex on the calling thread, env is 0 if the thread could
+    // not be attached to the JVM
+    void
+    complete(JNIEnv* env, jobject aStore, unsigned aIndex, const HedgedReads::Read_t& aRead)
+    {
+      HedgedReads::Result lResult;
+      bool lFound = false;
+      bool lFailed = false;
+      jthrowable lException = 0;
+      try
+      {
+        if (!env)
+          lFailed = true;
+        else
+          lFound = aRead(env, aStore, aIndex == 1, lResult);
+      }
+      catch (JavaException&)
+      {
+        lFailed = true;
+        jthrowable lPending = env->ExceptionOccurred();
+        env->ExceptionClear();
+        if (lPending)
+        {
+          lException = (jthrowable)env->NewGlobalRef(lPending);
+          env->DeleteLocalRef(lPending);
+        }
+      }
+      catch (...)
+      {
+        lFailed = true;
+      }
+
+      std::lock_guard<std::mutex> lLock(theMutex);
+      theFound[aIndex] = lFound;
+      theResults[aIndex] = std::move(lResult);
+      theFailed[aIndex] = lFailed;
+      theExceptions[aIndex] = lException;
+      ++theCompleted;
+      if (!lFailed && theWinner < 0)
+        theWinner = (int)aIndex;
+      theCondition.notify_all();
+    }
+};
+
+}
+
+
+HedgedReads::HedgedReads(const Item& aHedge, const std::string& aStore,
+                         Statistics& aStatistics)
+  : thePercentile(getDoubleOption(aHedge, "percentile", 0.95)),
+    theMinDelay(std::chrono::microseconds(
+        (long long)(getDoubleOption(aHedge, "min-delay-ms", 1) * 1000))),
+    theBudget(getDoubleOption(aHedge, "budget", 0.05)),
+    theMinSamples(0),
+    theMaxThreads(0),
+    theStatistics(aStatistics),
+    theLatency(openLatency(aStore)),
+    theVM(0),
+    theIdle(0),
+    theStopping(false),
+    theTokens(0),
+    theReadsSinceDelay(theDelayRefresh),
+    theDelay(0)
+{
+  long long lMinSamples = getIntegerOption(aHedge, "min-samples", 100);
+  long long lMaxThreads = getIntegerOption(aHedge, "max-threads", 32);
+  if (thePercentile <= 0 || thePercentile >= 1)
+    throwError("InvalidOption", "Option 'percentile' must be between 0 and 1.");
+  if (theMinDelay.count() < 0)
+    throwError("InvalidOption", "Option 'min-delay-ms' must not be negative.");
+  if (theBudget < 0 || theBudget > 1)
+    throwError("InvalidOption", "Option 'budget' must be between 0 and 1.");
+  if (lMinSamples < 1)
+    throwError("InvalidOption", "Option 'min-samples' must be positive.");
+  if (lMaxThreads < 2 || lMaxThreads > 1024)
+    throwError("InvalidOption", "Option 'max-threads' must be between 2 and 1024.");
+  theMinSamples = (uint64_t)lMinSamples;
+  theMaxThreads = (size_t)lMaxThreads;
+}
+
+
+HedgedReads::~HedgedReads()
+{
+  {
+    std::lock_guard<std::mutex> lLock(theMutex);
+    theStopping = true;
+    theCondition.notify_all();
+  }
+  for (size_t i = 0; i < theThreads.size(); ++i)
+    theThreads[i].join();
+
+  JNIEnv* env;
+  if (theVM && theVM->GetEnv((void**)&env, JNI_VERSION_1_6) == JNI_OK)
+    for (size_t i = 0; i < theStores.size(); ++i)
+      env->DeleteGlobalRef(theStores[i]);
+}
+
+
+void
+HedgedReads::setStores(JNIEnv* env, const std::vector<jobject>& aStores)
+{
+  if (env->GetJavaVM(&theVM) != JNI_OK)
+    throwError("VM001", "Could not get the Java VM.");
+  for (size_t i = 0; i < aStores.size(); ++i)
+    theStores.push_back(env->NewGlobalRef(aStores[i]));
+}
+
+
+void
+HedgedReads::run()
+{
+  JVMThreadScope lScope(theVM);
+  JNIEnv* env = lScope.getEnv();
+  Statistics::setCurrent(&theStatistics);
+
+  std::unique_lock<std::mutex> lLock(theMutex);
+  while (true)
+  {
+    ++theIdle;
+    theCondition.wait(lLock, [&] { return theStopping || !theTasks.empty(); });
+    --theIdle;
+    if (theTasks.empty())
+      break;
+    Task_t lTask = std::move(theTasks.front());
+    theTasks.pop_front();
+    lLock.unlock();
+
+    // the thread never returns to Java, its local references are dropped
+    // with a frame per read
+    uint64_t lJNICalls = Statistics::theThreadJNICalls;
+    if (env && env->PushLocalFrame(16) == 0)
+    {
+      lTask(env);
+      env->PopLocalFrame(NULL);
+    }
+    else
+      lTask(0);
+    theStatistics.theJNICalls += Statistics::theThreadJNICalls - lJNICalls;
+
+    lLock.lock();
+  }
+  Statistics::setCurrent(0);
+}
+
+
+void
+HedgedReads::submit(const Task_t& aTask)
+{
+  std::lock_guard<std::mutex> lLock(theMutex);
+  theTasks.push_back(aTask);
+  if (theTasks.size() > theIdle && theThreads.size() < theMaxThreads)
+    theThreads.push_back(std::thread(&HedgedReads::run, this));
+  theCondition.notify_one();
+}
+
+
+std::shared_ptr<LatencyHistogram>
+HedgedReads::openLatency(const std::string& aStore)
+{
+  static std::mutex theLatenciesMutex;
+  static std::map<std::string, std::shared_ptr<LatencyHistogram> > theLatencies;
+
+  std::lock_guard<std::mutex> lLock(theLatenciesMutex);
+  std::shared_ptr<LatencyHistogram>& lLatency = theLatencies[aStore];
+  if (!lLatency)
+    lLatency = std::make_shared<LatencyHistogram>();
+  return lLatency;
+}
+
+
+bool
+HedgedReads::delay(std::chrono::microseconds& aDelay)
+{
+  const LatencyHistogram& lLatency = *theLatency;
+  std::lock_guard<std::mutex> lLock(theMutex);
+  if (++theReadsSinceDelay >= theDelayRefresh)
+  {
+    theReadsSinceDelay = 0;
+    if (lLatency.getCount() < theMinSamples)
+      theDelay = std::chrono::microseconds(0);
+    else
+      theDelay = std::max(theMinDelay, std::chrono::microseconds(
+          (long long)lLatency.getPercentile(thePercentile)));
+  }
+
+  // every read earns its share of a hedge
+  theTokens = std::min(theTokens + theBudget, theMaxTokens);
+  aDelay = theDelay;
+  return theDelay.count() > 0;
+}
+
+
+bool
+HedgedReads::takeHedge()
+{
+  std::lock_guard<std::mutex> lLock(theMutex);
+  if (theTokens < 1)
+    return false;
+  theTokens -= 1;
+  return true;
+}
+
+
+bool
+HedgedReads::read(JNIEnv* env, size_t aHandle, const Read_t& aRead, Result& aResult)
+{
+  // the delay is derived from the reads as the caller sees them, hedged or
+  // not
+  std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+  bool lFound = race(env, aHandle, aRead, aResult);
+  theLatency->record((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - lStart).count());
+  return lFound;
+}
+
+
+bool
+HedgedReads::race(JNIEnv* env, size_t aHandle, const Read_t& aRead, Result& aResult)
+{
+  // until the delay is known the read runs on the calling thread
+  std::chrono::microseconds lDelay;
+  if (!delay(lDelay))
+    return aRead(env, theStores[aHandle], false, aResult);
+
+  jobject lStore = theStores[aHandle];
+  jobject lHedgeStore = theStores[(aHandle + 1) % theStores.size()];
+  std::shared_ptr<Race> lRace = std::make_shared<Race>(theVM);
+  submit([lRace, lStore, aRead](JNIEnv* aEnv) { lRace->complete(aEnv, lStore, 0, aRead); });
+
+  std::unique_lock<std::mutex> lLock(lRace->theMutex);
+  if (!lRace->theCondition.wait_for(lLock, lDelay, [&] { return lRace->theCompleted > 0; }) &&
+      takeHedge())
+  {
+    ++theStatistics.theHedges;
+    lRace->theStarted = 2;
+    lLock.unlock();
+    submit([lRace, lHedgeStore, aRead](JNIEnv* aEnv) { lRace->complete(aEnv, lHedgeStore, 1, aRead); });
+    lLock.lock();
+  }
+
+  // the first read to succeed wins, a failed one waits for the other
+  lRace->theCondition.wait(lLock, [&]
+  {
+    return lRace->theWinner >= 0 || lRace->theCompleted == lRace->theStarted;
+  });
+
+  int lWinner = lRace->theWinner;
+  if (lWinner < 0)
+  {
+    for (unsigned i = 0; i < lRace->theStarted; ++i)
+      if (lRace->theExceptions[i])
+      {
+        env->Throw((jthrowable)env->NewLocalRef(lRace->theExceptions[i]));
+        throw JavaException();
+      }
+    throwError("VM001", "Could not attach a thread for a hedged read to the Java VM.");
+  }
+
+  if (lWinner == 1)
+    ++theStatistics.theHedgeWins;
+  aResult = std::move(lRace->theResults[lWinner]);
+  return lRace->theFound[lWinner];
+}
+
+
+}} // namespace zorba, nosqldb
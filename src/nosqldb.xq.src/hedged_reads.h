@@ -0,0 +1,161 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_HEDGED_READS_H
+#define NOSQLDB_HEDGED_READS_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <jni.h>
+
+#include <zorba/item.h>
+
+#include "statistics.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Hedged single-key reads of a connection, "hedge" connect option. A read
+ * runs on a thread of the connection; if it has not completed after the
+ * hedge delay, the latency percentile of the store's reads, a second read
+ * with relaxed consistency is started and the first read to succeed
+ * wins. The hedges are paid from a budget that each read adds a fraction
+ * of a hedge to. The threads are attached to the JVM when first needed and
+ * kept until the connection is closed; a losing read keeps running until
+ * it completes, so the reads use store references of their own. With
+ * several store handles the hedge goes to the handle after the primary's.
+ */
+class HedgedReads
+{
+  public:
+    // the outcome of one read
+    class Result
+    {
+      public:
+        std::string theValue;
+        jlong theVersion;
+
+        Result() : theVersion(0) {}
+    };
+
+    /**
+     * Reads from aStore into aResult, with relaxed consistency if aHedge;
+     * returns false if there is no record. Raises JavaException with the
+     * exception pending on env. A read may outlive the call that started
+     * it, so it must not refer to the caller's stack.
+     */
+    typedef std::function<bool(JNIEnv* env, jobject aStore, bool aHedge,
+                               Result& aResult)> Read_t;
+
+  private:
+    typedef std::function<void(JNIEnv*)> Task_t;
+
+    double thePercentile;
+    std::chrono::microseconds theMinDelay;
+    double theBudget;
+    uint64_t theMinSamples;
+    size_t theMaxThreads;
+    Statistics& theStatistics;
+    std::shared_ptr<LatencyHistogram> theLatency;
+
+    JavaVM* theVM;
+    std::vector<jobject> theStores;
+
+    std::mutex theMutex;
+    std::condition_variable theCondition;
+    std::deque<Task_t> theTasks;
+    std::vector<std::thread> theThreads;
+    size_t theIdle;
+    bool theStopping;
+    double theTokens;
+    unsigned theReadsSinceDelay;
+    std::chrono::microseconds theDelay;
+
+    void
+    run();
+
+    void
+    submit(const Task_t& aTask);
+
+    // the hedge delay, false while the gets are too few to derive it
+    bool
+    delay(std::chrono::microseconds& aDelay);
+
+    // takes one hedge from the budget
+    bool
+    takeHedge();
+
+    // runs aRead, hedged once the delay is known
+    bool
+    race(JNIEnv* env, size_t aHandle, const Read_t& aRead, Result& aResult);
+
+    // the latencies of the reads of aStore, shared by the connections of
+    // the process so that a query starts with the delay known
+    static std::shared_ptr<LatencyHistogram>
+    openLatency(const std::string& aStore);
+
+  public:
+    /**
+     * Reads "hedge" : true or { "percentile" : 0.95, "min-delay-ms" : 1,
+     * "budget" : 0.05, "min-samples" : 100, "max-threads" : 32 }. The delay
+     * is derived from the latencies of the reads of aStore in the process;
+     * aStatistics counts the hedges.
+     */
+    HedgedReads(const Item& aHedge, const std::string& aStore,
+                Statistics& aStatistics);
+
+    /**
+     * Waits for the reads still running, then stops the threads.
+     */
+    ~HedgedReads();
+
+    /**
+     * Takes global references of its own to the oracle.kv.KVStore handles
+     * aStores. Raises nosql:VM001.
+     */
+    void
+    setStores(JNIEnv* env, const std::vector<jobject>& aStores);
+
+    /**
+     * Runs aRead hedged on the handle aHandle, see the class comment;
+     * returns false if there is no record. Call setStores() first. If all
+     * reads started fail, the Java exception of the first is raised as
+     * JavaException on env.
+     */
+    bool
+    read(JNIEnv* env, size_t aHandle, const Read_t& aRead, Result& aResult);
+
+  private:
+    HedgedReads(const HedgedReads&);
+    HedgedReads& operator=(const HedgedReads&);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_HEDGED_READS_H
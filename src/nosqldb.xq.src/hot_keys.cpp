@@ -0,0 +1,217 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <algorithm>
+#include <map>
+
+#include "hot_keys.h"
+#include "nosqldb.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/*****************************************************************************
+ SpaceSaving
+ *****************************************************************************/
+
+void
+SpaceSaving::swapCounters(size_t aPos1, size_t aPos2)
+{
+  std::swap(theHeap[aPos1], theHeap[aPos2]);
+  theIndex[theHeap[aPos1].theId] = aPos1;
+  theIndex[theHeap[aPos2].theId] = aPos2;
+}
+
+
+void
+SpaceSaving::siftDown(size_t aPos)
+{
+  for (;;)
+  {
+    size_t lSmallest = aPos;
+    size_t lLeft = 2 * aPos + 1;
+    size_t lRight = lLeft + 1;
+    if (lLeft < theHeap.size() && theHeap[lLeft].theCount < theHeap[lSmallest].theCount)
+      lSmallest = lLeft;
+    if (lRight < theHeap.size() && theHeap[lRight].theCount < theHeap[lSmallest].theCount)
+      lSmallest = lRight;
+    if (lSmallest == aPos)
+      return;
+    swapCounters(aPos, lSmallest);
+    aPos = lSmallest;
+  }
+}
+
+
+void
+SpaceSaving::add(const KeyPath& aKey, const std::string& aId)
+{
+  ++theTotal;
+
+  std::unordered_map<std::string, size_t>::iterator lIter = theIndex.find(aId);
+  if (lIter != theIndex.end())
+  {
+    ++theHeap[lIter->second].theCount;
+    siftDown(lIter->second);
+    return;
+  }
+
+  if (theHeap.size() < theCapacity)
+  {
+    // a new counter has the smallest possible count, sift it up
+    Counter lCounter;
+    lCounter.theId = aId;
+    lCounter.theKey = aKey;
+    lCounter.theCount = 1;
+    lCounter.theError = 0;
+    theHeap.push_back(lCounter);
+    size_t lPos = theHeap.size() - 1;
+    theIndex[aId] = lPos;
+    while (lPos > 0 && theHeap[(lPos - 1) / 2].theCount > theHeap[lPos].theCount)
+    {
+      swapCounters(lPos, (lPos - 1) / 2);
+      lPos = (lPos - 1) / 2;
+    }
+    return;
+  }
+
+  if (theCapacity == 0)
+    return;
+
+  // take over the smallest counter, its count becomes the error bound
+  Counter& lMin = theHeap[0];
+  theIndex.erase(lMin.theId);
+  lMin.theError = lMin.theCount;
+  ++lMin.theCount;
+  lMin.theId = aId;
+  lMin.theKey = aKey;
+  theIndex[aId] = 0;
+  siftDown(0);
+}
+
+
+static bool
+isHotter(const SpaceSaving::Counter& aCounter1, const SpaceSaving::Counter& aCounter2)
+{
+  return aCounter1.theCount > aCounter2.theCount;
+}
+
+
+std::vector<SpaceSaving::Counter>
+SpaceSaving::top(size_t aCount) const
+{
+  std::vector<Counter> lResult(theHeap);
+  aCount = std::min(aCount, lResult.size());
+  std::partial_sort(lResult.begin(), lResult.begin() + aCount, lResult.end(), isHotter);
+  lResult.resize(aCount);
+  return lResult;
+}
+
+
+/*****************************************************************************
+ HotKeys
+ *****************************************************************************/
+
+std::shared_ptr<HotKeys>
+HotKeys::open(const std::string& aStore, size_t aCapacity)
+{
+  static std::mutex theSketchesMutex;
+  static std::map<std::string, std::shared_ptr<HotKeys> > theSketches;
+
+  std::lock_guard<std::mutex> lLock(theSketchesMutex);
+  std::shared_ptr<HotKeys>& lSketches = theSketches[aStore];
+  if (!lSketches)
+    lSketches = std::make_shared<HotKeys>(aCapacity);
+  return lSketches;
+}
+
+
+void
+HotKeys::recordKey(const KeyPath& aKey)
+{
+  std::string lMajor = aKey.majorToString();
+  std::string lKey = aKey.toString();
+
+  std::lock_guard<std::mutex> lLock(theMutex);
+  theKeys.add(aKey, lKey);
+
+  KeyPath lParent;
+  lParent.theMajor = aKey.theMajor;
+  theParents.add(lParent, lMajor);
+}
+
+
+void
+HotKeys::recordParent(const KeyPath& aParent)
+{
+  KeyPath lParent;
+  lParent.theMajor = aParent.theMajor;
+  std::string lMajor = lParent.majorToString();
+
+  std::lock_guard<std::mutex> lLock(theMutex);
+  theParents.add(lParent, lMajor);
+}
+
+
+static Item
+createCountersItem(const std::vector<SpaceSaving::Counter>& aCounters, bool aTypedKeys)
+{
+  ItemFactory* lFactory = NoSqlDBModule::getItemFactory();
+  std::vector<Item> lItems;
+  for (size_t i = 0; i < aCounters.size(); ++i)
+  {
+    std::vector<std::pair<Item, Item> > lPairs;
+    lPairs.push_back(std::pair<Item, Item>(
+        lFactory->createString("key"), createKeyItem(aCounters[i].theKey, aTypedKeys)));
+    lPairs.push_back(std::pair<Item, Item>(
+        lFactory->createString("count"), lFactory->createInteger((long long)aCounters[i].theCount)));
+    lPairs.push_back(std::pair<Item, Item>(
+        lFactory->createString("error"), lFactory->createInteger((long long)aCounters[i].theError)));
+    lItems.push_back(lFactory->createJSONObject(lPairs));
+  }
+  return lFactory->createJSONArray(lItems);
+}
+
+
+Item
+HotKeys::toJSON(size_t aCount, bool aTypedKeys)
+{
+  std::vector<SpaceSaving::Counter> lKeys;
+  std::vector<SpaceSaving::Counter> lParents;
+  uint64_t lAccesses;
+  {
+    std::lock_guard<std::mutex> lLock(theMutex);
+    lKeys = theKeys.top(aCount);
+    lParents = theParents.top(aCount);
+    lAccesses = theParents.getTotal();
+  }
+
+  ItemFactory* lFactory = NoSqlDBModule::getItemFactory();
+  std::vector<std::pair<Item, Item> > lPairs;
+  lPairs.push_back(std::pair<Item, Item>(
+      lFactory->createString("accesses"), lFactory->createInteger((long long)lAccesses)));
+  lPairs.push_back(std::pair<Item, Item>(
+      lFactory->createString("keys"), createCountersItem(lKeys, aTypedKeys)));
+  lPairs.push_back(std::pair<Item, Item>(
+      lFactory->createString("parent-keys"), createCountersItem(lParents, aTypedKeys)));
+  return lFactory->createJSONObject(lPairs);
+}
+
+
+}} // namespace zorba, nosqldb
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_HOT_KEYS_H
+#define NOSQLDB_HOT_KEYS_H
+
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <zorba/item.h>
+
+#include "key_codec.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Space-saving heavy-hitters sketch: at most aCapacity counters, a key
+ * without a counter takes over the smallest one. Every key accessed more
+ * than total/capacity times is guaranteed to have a counter, and its count
+ * overestimates the true count by at most the counter's error.
+ */
+class SpaceSaving
+{
+  public:
+    class Counter
+    {
+      public:
+        std::string theId;
+        KeyPath theKey;
+        uint64_t theCount;
+        uint64_t theError;
+    };
+
+  private:
+    size_t theCapacity;
+    // min-heap on theCount, theIndex maps a key to its heap position
+    std::vector<Counter> theHeap;
+    std::unordered_map<std::string, size_t> theIndex;
+    uint64_t theTotal;
+
+    void
+    siftDown(size_t aPos);
+
+    void
+    swapCounters(size_t aPos1, size_t aPos2);
+
+  public:
+    SpaceSaving(size_t aCapacity)
+      : theCapacity(aCapacity),
+        theTotal(0)
+    {}
+
+    /**
+     * Counts one access to aKey, aId being its string form.
+     */
+    void
+    add(const KeyPath& aKey, const std::string& aId);
+
+    /**
+     * The aCount counters with the highest counts, highest first.
+     */
+    std::vector<Counter>
+    top(size_t aCount) const;
+
+    uint64_t
+    getTotal() const
+    { return theTotal; }
+};
+
+
+/**
+ * The hot keys of a store: one sketch over the keys accessed by single key
+ * operations and one over the major paths, which decide the partition and
+ * thus the replication node serving a request. The sketches of a store are
+ * shared by the connections of the process that enable them, see open().
+ */
+class HotKeys
+{
+  private:
+    std::mutex theMutex;
+    SpaceSaving theKeys;
+    SpaceSaving theParents;
+
+  public:
+    HotKeys(size_t aCapacity)
+      : theKeys(aCapacity),
+        theParents(aCapacity)
+    {}
+
+    /**
+     * The sketches of the store aStore, created with aCapacity counters
+     * each by the first connection to it.
+     */
+    static std::shared_ptr<HotKeys>
+    open(const std::string& aStore, size_t aCapacity);
+
+    /**
+     * An access to the single key aKey, also counted for its major path.
+     */
+    void
+    recordKey(const KeyPath& aKey);
+
+    /**
+     * An access to the keys under the major path of aParent.
+     */
+    void
+    recordParent(const KeyPath& aParent);
+
+    /**
+     * { "accesses" : n, "keys" : [ { "key" : .., "count" : .., "error" : .. } ],
+     *   "parent-keys" : [ .. ] } with the aCount hottest entries of each,
+     * the keys decoded as by createKeyItem().
+     */
+    Item
+    toJSON(size_t aCount, bool aTypedKeys);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_HOT_KEYS_H
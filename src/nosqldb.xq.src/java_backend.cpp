@@ -0,0 +1,1196 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "java_backend.h"
+#include "nosqldb.h"
+#include "work_queue.h"
+#include "worker_pool.h"
+
+// the Java exception stays pending, the function's JavaException handler
+// raises it
+#define THROW_IF_EXCEPTION(env)  if ((COUNT_JNI_CALL(), env->ExceptionCheck())) throw JavaException()
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+// the records of a batch handed from the read-ahead thread to the query
+// thread if batch sizing is off, the default batch size of multiGetIterator
+static const size_t theReadAheadBatchSize = 100;
+
+
+jobject
+JavaBackend::createJavaDepth(Depth aDepth)
+{
+  static const char* const theDepthNames[] =
+  {
+    "CHILDREN_ONLY",
+    "PARENT_AND_CHILDREN",
+    "DESCENDANTS_ONLY",
+    "PARENT_AND_DESCENDANTS"
+  };
+
+  //    Depth depth = Depth.PARENT_AND_DESCENDANTS;
+  jclass depthClass = theEnv->FindClass("oracle/kv/Depth");
+  THROW_IF_EXCEPTION(theEnv);
+  jfieldID fidDepth = theEnv->GetStaticFieldID(depthClass, theDepthNames[aDepth], "Loracle/kv/Depth;");
+  THROW_IF_EXCEPTION(theEnv);
+  jobject depthObj = theEnv->GetStaticObjectField(depthClass, fidDepth);
+  THROW_IF_EXCEPTION(theEnv);
+  return depthObj;
+}
+
+
+long long
+JavaBackend::put(const KeyPath& aKey, const std::string& aValue, PhaseClock& aClock)
+{
+  JNIEnv* env = theEnv;
+
+  //    Key k = Key.createKey(majorList, minorList);
+  jobject k = createJavaKey(env, aKey);
+  THROW_IF_EXCEPTION(env);
+
+  //    Value v = Value.createValue(p.getBytes())
+  jclass valueClass = env->FindClass("oracle/kv/Value");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midValueCreate = env->GetStaticMethodID(valueClass, "createValue", "([B)Loracle/kv/Value;");
+  THROW_IF_EXCEPTION(env);
+
+  //fill out the byte[]
+  jsize bufSize = aValue.size();
+  aClock.lap(CallProfile::JNI);
+  jbyteArray jbyteArrayValue = env->NewByteArray(bufSize);
+  THROW_IF_EXCEPTION(env);
+  env->SetByteArrayRegion(jbyteArrayValue, 0, bufSize, (const jbyte*)aValue.data());
+  THROW_IF_EXCEPTION(env);
+  aClock.lap(CallProfile::COPY);
+
+  jobject v = env->CallStaticObjectMethod(valueClass, midValueCreate, jbyteArrayValue);
+  THROW_IF_EXCEPTION(env);
+
+  //    Version version = store.put(k, v);
+  jclass kvsClass = env->FindClass("oracle/kv/KVStore");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midkvsPut = env->GetMethodID(kvsClass, "put", "(Loracle/kv/Key;Loracle/kv/Value;)Loracle/kv/Version;");
+  THROW_IF_EXCEPTION(env);
+  aClock.lap(CallProfile::JNI);
+  jobject version;
+  {
+    StoreCall lCall(theStores, &aKey);
+    for (unsigned lAttempt = 1; ; ++lAttempt)
+    {
+      version = env->CallObjectMethod(lCall.getStore(), midkvsPut, k, v);
+      if (!theRetryPolicy.retry(env, lAttempt, RetryPolicy::IDEMPOTENT))
+        break;
+    }
+  }
+  THROW_IF_EXCEPTION(env);
+  aClock.lap(CallProfile::STORE);
+
+  //    long versionLong = version.getVersion();
+  jclass versionClass = env->FindClass("oracle/kv/Version");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midVersionGetVerion = env->GetMethodID(versionClass, "getVersion", "()J");
+  THROW_IF_EXCEPTION(env);
+  jlong versionLong = env->CallLongMethod(version, midVersionGetVerion);
+  THROW_IF_EXCEPTION(env);
+  theReadYourWrites.written(env, aKey, version);
+  aClock.lap(CallProfile::JNI);
+
+  env->DeleteLocalRef(version);
+  env->DeleteLocalRef(v);
+  env->DeleteLocalRef(jbyteArrayValue);
+  env->DeleteLocalRef(k);
+  return versionLong;
+}
+
+
+// the value and version of aKey, false if there is none; shared by get and
+// the worker threads of getMany. A major path written by the connection is
+// read with the Consistency.Version of aReadYourWrites; otherwise aRelaxed
+// reads from any replica, for the hedges of HedgedReads.
+static bool
+readValue(JNIEnv* env, jobject aStore, RetryPolicy& aRetryPolicy,
+          ReadYourWrites& aReadYourWrites, const KeyPath& aKey, bool aRelaxed,
+          std::string& aValue, jlong& aVersion, PhaseClock& aClock)
+{
+  //    Key k = Key.createKey(majorList, minorList);
+  jobject k = createJavaKey(env, aKey);
+  THROW_IF_EXCEPTION(env);
+
+  //    ValueVersion valueVersion = store.get(k);
+  // or
+  //    ValueVersion valueVersion = store.get(k, consistency, 0, TimeUnit.MILLISECONDS);
+  jclass kvsClass = env->FindClass("oracle/kv/KVStore");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midkvsGet;
+  jobject lConsistency = aReadYourWrites.createConsistency(env, aKey);
+  jobject lTimeUnit = NULL;
+  if (!lConsistency && aRelaxed)
+  {
+    //    Consistency consistency = Consistency.NONE_REQUIRED;
+    jclass consistencyClass = env->FindClass("oracle/kv/Consistency");
+    THROW_IF_EXCEPTION(env);
+    jfieldID fidNoneRequired = env->GetStaticFieldID(consistencyClass, "NONE_REQUIRED",
+                                                     "Loracle/kv/Consistency;");
+    THROW_IF_EXCEPTION(env);
+    lConsistency = env->GetStaticObjectField(consistencyClass, fidNoneRequired);
+    THROW_IF_EXCEPTION(env);
+  }
+  if (lConsistency)
+  {
+    midkvsGet = env->GetMethodID(kvsClass, "get",
+        "(Loracle/kv/Key;Loracle/kv/Consistency;JLjava/util/concurrent/TimeUnit;)Loracle/kv/ValueVersion;");
+    THROW_IF_EXCEPTION(env);
+    jclass timeUnitClass = env->FindClass("java/util/concurrent/TimeUnit");
+    THROW_IF_EXCEPTION(env);
+    jfieldID fidMilliseconds = env->GetStaticFieldID(timeUnitClass, "MILLISECONDS",
+                                                     "Ljava/util/concurrent/TimeUnit;");
+    THROW_IF_EXCEPTION(env);
+    lTimeUnit = env->GetStaticObjectField(timeUnitClass, fidMilliseconds);
+    THROW_IF_EXCEPTION(env);
+  }
+  else
+  {
+    midkvsGet = env->GetMethodID(kvsClass, "get", "(Loracle/kv/Key;)Loracle/kv/ValueVersion;");
+    THROW_IF_EXCEPTION(env);
+  }
+  aClock.lap(CallProfile::JNI);
+  jobject valueVersion;
+  for (unsigned lAttempt = 1; ; ++lAttempt)
+  {
+    // a timeout of 0 is the store's default
+    valueVersion = lConsistency
+        ? env->CallObjectMethod(aStore, midkvsGet, k, lConsistency, (jlong)0, lTimeUnit)
+        : env->CallObjectMethod(aStore, midkvsGet, k);
+    if (!aRetryPolicy.retry(env, lAttempt, RetryPolicy::IDEMPOTENT))
+      break;
+  }
+  THROW_IF_EXCEPTION(env);
+  aClock.lap(CallProfile::STORE);
+  env->DeleteLocalRef(k);
+  if (lConsistency)
+  {
+    env->DeleteLocalRef(lConsistency);
+    env->DeleteLocalRef(lTimeUnit);
+  }
+
+  if (valueVersion == NULL)
+    return false;
+
+  // Value v = valueVersion.getValue();
+  jclass vvClass = env->FindClass("oracle/kv/ValueVersion");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midvvGetValue = env->GetMethodID(vvClass, "getValue", "()Loracle/kv/Value;");
+  THROW_IF_EXCEPTION(env);
+  jobject v = env->CallObjectMethod(valueVersion, midvvGetValue);
+  THROW_IF_EXCEPTION(env);
+
+  // byte[] value = v.getValue();
+  jclass valueClass = env->FindClass("oracle/kv/Value");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midValueGetValue = env->GetMethodID(valueClass, "getValue", "()[B");
+  THROW_IF_EXCEPTION(env);
+  jbyteArray jbaValue = (jbyteArray) env->CallObjectMethod(v, midValueGetValue);
+  THROW_IF_EXCEPTION(env);
+  jsize jbaSize = env->GetArrayLength(jbaValue);
+  THROW_IF_EXCEPTION(env);
+  aClock.lap(CallProfile::JNI);
+  aValue.resize(jbaSize);
+  if (jbaSize)
+    env->GetByteArrayRegion(jbaValue, 0, jbaSize, (jbyte*)&aValue[0]);
+  THROW_IF_EXCEPTION(env);
+  aClock.lap(CallProfile::COPY);
+
+  // Version version = valueVersion.getVersion();
+  jmethodID midvvGetVersion = env->GetMethodID(vvClass, "getVersion", "()Loracle/kv/Version;");
+  THROW_IF_EXCEPTION(env);
+  jobject version = env->CallObjectMethod(valueVersion, midvvGetVersion);
+  THROW_IF_EXCEPTION(env);
+
+  //    long versionLong = version.getVersion();
+  jclass versionClass = env->FindClass("oracle/kv/Version");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midVersionGetVerion = env->GetMethodID(versionClass, "getVersion", "()J");
+  THROW_IF_EXCEPTION(env);
+  aVersion = env->CallLongMethod(version, midVersionGetVerion);
+  THROW_IF_EXCEPTION(env);
+  aClock.lap(CallProfile::JNI);
+
+  env->DeleteLocalRef(version);
+  env->DeleteLocalRef(jbaValue);
+  env->DeleteLocalRef(v);
+  env->DeleteLocalRef(valueVersion);
+  return true;
+}
+
+
+// readValue() on the handle of aStores for aKey, hedged if aHedgedReads
+// is not 0
+static bool
+readRecord(JNIEnv* env, StoreHandles& aStores, RetryPolicy& aRetryPolicy,
+           ReadYourWrites& aReadYourWrites, HedgedReads* aHedgedReads,
+           const KeyPath& aKey, std::string& aValue, jlong& aVersion,
+           PhaseClock& aClock)
+{
+  StoreCall lCall(aStores, &aKey);
+  if (!aHedgedReads)
+    return readValue(env, lCall.getStore(), aRetryPolicy, aReadYourWrites, aKey, false,
+                     aValue, aVersion, aClock);
+
+  // the reads may outlive this call, they work on copies; the connection
+  // stops the hedged reads before it drops aReadYourWrites
+  RetryPolicy lRetryPolicy(aRetryPolicy);
+  ReadYourWrites* lReadYourWrites = &aReadYourWrites;
+  KeyPath lKey(aKey);
+  HedgedReads::Result lResult;
+  bool lFound = aHedgedReads->read(env, lCall.getHandle(),
+      [lRetryPolicy, lReadYourWrites, lKey](JNIEnv* aEnv, jobject aStore, bool aHedge,
+                                            HedgedReads::Result& aResult) mutable
+      {
+        PhaseClock lClock(0, Statistics::GET);
+        return readValue(aEnv, aStore, lRetryPolicy, *lReadYourWrites, lKey, aHedge,
+                         aResult.theValue, aResult.theVersion, lClock);
+      },
+      lResult);
+  aClock.lap(CallProfile::STORE);
+  aValue.swap(lResult.theValue);
+  aVersion = lResult.theVersion;
+  return lFound;
+}
+
+
+bool
+JavaBackend::get(const KeyPath& aKey, RecordHandler& aHandler, PhaseClock& aClock)
+{
+  std::string lValue;
+  jlong lVersion;
+  if (!readRecord(theEnv, theStores, theRetryPolicy, theReadYourWrites,
+                  theHedgedReads, aKey, lValue, lVersion, aClock))
+    return false;
+
+  aHandler.record(aKey, lValue.data(), lValue.size(), lVersion);
+  return true;
+}
+
+
+void
+JavaBackend::getMany(const std::vector<KeyPath>& aKeys, unsigned aParallelism,
+                     RecordHandler& aHandler, PhaseClock& aClock)
+{
+  if (aParallelism < 2 || aKeys.size() < 2)
+  {
+    Backend::getMany(aKeys, aParallelism, aHandler, aClock);
+    return;
+  }
+
+  JavaVM* lVM;
+  if (theEnv->GetJavaVM(&lVM) != JNI_OK)
+    throwError("VM001", "Could not get the Java VM.");
+
+  // worker i reads the keys i, i + lThreads, ... into their slots, the
+  // handler sees them in order once all are read
+  unsigned lThreads = (unsigned)std::min<size_t>(aParallelism, aKeys.size());
+  std::vector<std::string> lValues(aKeys.size());
+  std::vector<jlong> lVersions(aKeys.size());
+  std::vector<char> lFound(aKeys.size(), 0);
+  {
+    WorkerPool lPool(lVM);
+    lPool.start(lThreads, [&](JNIEnv* env, unsigned aIndex)
+    {
+      // every worker has its own backoff random generator
+      RetryPolicy lRetryPolicy(theRetryPolicy);
+      PhaseClock lClock(0, Statistics::GET);
+      for (size_t i = aIndex; i < aKeys.size() && !lPool.failed(); i += lThreads)
+      {
+        if (env->PushLocalFrame(16) < 0)
+        {
+          lPool.fail(env);
+          return;
+        }
+        try
+        {
+          lFound[i] = readRecord(env, theStores, lRetryPolicy, theReadYourWrites,
+                                 theHedgedReads, aKeys[i], lValues[i], lVersions[i],
+                                 lClock);
+        }
+        catch (JavaException&)
+        {
+          lPool.fail(env);
+        }
+        env->PopLocalFrame(NULL);
+      }
+    });
+    lPool.join();
+    lPool.throwIfFailed(theEnv);
+  }
+  aClock.lap(CallProfile::STORE);
+
+  for (size_t i = 0; i < aKeys.size(); ++i)
+  {
+    if (!lFound[i])
+      continue;
+    aClock.countRecord();
+    aHandler.record(aKeys[i], lValues[i].data(), lValues[i].size(), lVersions[i]);
+  }
+}
+
+
+bool
+JavaBackend::remove(const KeyPath& aKey, PhaseClock& aClock)
+{
+  JNIEnv* env = theEnv;
+
+  //    Key k = Key.createKey(majorList, minorList);
+  jobject k = createJavaKey(env, aKey);
+  THROW_IF_EXCEPTION(env);
+
+  //    boolean result = store.delete(k);
+  jclass kvsClass = env->FindClass("oracle/kv/KVStore");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midkvsDelete = env->GetMethodID(kvsClass, "delete", "(Loracle/kv/Key;)Z");
+  THROW_IF_EXCEPTION(env);
+  aClock.lap(CallProfile::JNI);
+  jboolean result;
+  {
+    StoreCall lCall(theStores, &aKey);
+    for (unsigned lAttempt = 1; ; ++lAttempt)
+    {
+      result = env->CallBooleanMethod(lCall.getStore(), midkvsDelete, k);
+      if (!theRetryPolicy.retry(env, lAttempt, RetryPolicy::NON_IDEMPOTENT))
+        break;
+    }
+  }
+  THROW_IF_EXCEPTION(env);
+  aClock.lap(CallProfile::STORE);
+
+  env->DeleteLocalRef(k);
+  return result;
+}
+
+
+namespace
+{
+
+// the methods reading the KeyValueVersion objects of a store iterator;
+// method IDs are valid on every thread
+class IteratorMethods
+{
+  public:
+    jmethodID theHasNext;
+    jmethodID theNext;
+    jmethodID theGetKey;
+    jmethodID theGetValue;
+    jmethodID theGetVersion;
+    jmethodID theValueGetValue;
+    jmethodID theVersionGetVersion;
+
+    IteratorMethods(JNIEnv* env)
+    {
+      jclass iterClass = env->FindClass("java/util/Iterator");
+      THROW_IF_EXCEPTION(env);
+      theHasNext = env->GetMethodID(iterClass, "hasNext", "()Z");
+      THROW_IF_EXCEPTION(env);
+      theNext = env->GetMethodID(iterClass, "next", "()Ljava/lang/Object;");
+      THROW_IF_EXCEPTION(env);
+
+      jclass kvvClass = env->FindClass("oracle/kv/KeyValueVersion");
+      THROW_IF_EXCEPTION(env);
+      theGetKey = env->GetMethodID(kvvClass, "getKey", "()Loracle/kv/Key;");
+      THROW_IF_EXCEPTION(env);
+      theGetValue = env->GetMethodID(kvvClass, "getValue", "()Loracle/kv/Value;");
+      THROW_IF_EXCEPTION(env);
+      theGetVersion = env->GetMethodID(kvvClass, "getVersion", "()Loracle/kv/Version;");
+      THROW_IF_EXCEPTION(env);
+
+      jclass valueClass = env->FindClass("oracle/kv/Value");
+      THROW_IF_EXCEPTION(env);
+      theValueGetValue = env->GetMethodID(valueClass, "getValue", "()[B");
+      THROW_IF_EXCEPTION(env);
+
+      jclass versionClass = env->FindClass("oracle/kv/Version");
+      THROW_IF_EXCEPTION(env);
+      theVersionGetVersion = env->GetMethodID(versionClass, "getVersion", "()J");
+      THROW_IF_EXCEPTION(env);
+    }
+
+    bool
+    hasNext(JNIEnv* env, jobject aIterator, PhaseClock& aClock) const
+    {
+      //    iterator.hasNext()
+      jboolean hasNext = env->CallBooleanMethod(aIterator, theHasNext);
+      THROW_IF_EXCEPTION(env);
+      aClock.lap(CallProfile::STORE);
+      return hasNext;
+    }
+
+    // copies the next KeyValueVersion of aIterator into aRecord
+    void
+    next(JNIEnv* env, jobject aIterator, Record& aRecord, PhaseClock& aClock) const
+    {
+      //    KeyValueVersion kvv = iterator.next()
+      jobject kvv = env->CallObjectMethod(aIterator, theNext);
+      THROW_IF_EXCEPTION(env);
+      aClock.lap(CallProfile::STORE);
+
+      //    Key keyObj = kvv.getKey();
+      jobject keyObj = env->CallObjectMethod(kvv, theGetKey);
+      THROW_IF_EXCEPTION(env);
+      readJavaKey(env, keyObj, aRecord.theKey);
+      THROW_IF_EXCEPTION(env);
+
+      //    byte[] valueBA = kvv.getValue().getValue();
+      jobject valueObj = env->CallObjectMethod(kvv, theGetValue);
+      THROW_IF_EXCEPTION(env);
+      jbyteArray jbaValue = (jbyteArray) env->CallObjectMethod(valueObj, theValueGetValue);
+      THROW_IF_EXCEPTION(env);
+      jsize jbaSize = env->GetArrayLength(jbaValue);
+      THROW_IF_EXCEPTION(env);
+      aClock.lap(CallProfile::JNI);
+      aRecord.theValue.resize(jbaSize);
+      if (jbaSize)
+        env->GetByteArrayRegion(jbaValue, 0, jbaSize, (jbyte*)&aRecord.theValue[0]);
+      THROW_IF_EXCEPTION(env);
+      aClock.lap(CallProfile::COPY);
+
+      //    long version = kvv.getVersion().getVersion();
+      jobject versionObj = env->CallObjectMethod(kvv, theGetVersion);
+      THROW_IF_EXCEPTION(env);
+      aRecord.theVersion = env->CallLongMethod(versionObj, theVersionGetVersion);
+      THROW_IF_EXCEPTION(env);
+      aClock.lap(CallProfile::JNI);
+
+      env->DeleteLocalRef(versionObj);
+      env->DeleteLocalRef(jbaValue);
+      env->DeleteLocalRef(valueObj);
+      env->DeleteLocalRef(keyObj);
+      env->DeleteLocalRef(kvv);
+    }
+};
+
+}
+
+
+jobject
+JavaBackend::openMultiGetIterator(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                                  Depth aDepth, Direction aDirection, size_t aBatchSize)
+{
+  JNIEnv* env = theEnv;
+
+  //    Key k = Key.createKey(majorList, minorList);
+  jobject k = createJavaKey(env, aParentKey);
+  THROW_IF_EXCEPTION(env);
+
+  jobject keyRangeObj = NULL;
+  if (aRange)
+  {
+    keyRangeObj = createJavaKeyRange(env, *aRange);
+    THROW_IF_EXCEPTION(env);
+  }
+
+  jobject depthObj = createJavaDepth(aDepth);
+
+  //    Direction dir = Direction.FORWARD;
+  jclass dirClass = env->FindClass("oracle/kv/Direction");
+  THROW_IF_EXCEPTION(env);
+  jfieldID fidDir = env->GetStaticFieldID(dirClass,
+      aDirection == REVERSE ? "REVERSE" : "FORWARD", "Loracle/kv/Direction;");
+  THROW_IF_EXCEPTION(env);
+  jobject dirObj = env->GetStaticObjectField(dirClass, fidDir);
+  THROW_IF_EXCEPTION(env);
+
+  jclass kvsClass = env->FindClass("oracle/kv/KVStore");
+  THROW_IF_EXCEPTION(env);
+  jobject iterator;
+  StoreCall lCall(theStores, &aParentKey);
+  jobject consistencyObj = theReadYourWrites.createConsistency(env, aParentKey);
+  if (consistencyObj)
+  {
+    //    TimeUnit unit = TimeUnit.MILLISECONDS;
+    jclass timeUnitClass = env->FindClass("java/util/concurrent/TimeUnit");
+    THROW_IF_EXCEPTION(env);
+    jfieldID fidMillis = env->GetStaticFieldID(timeUnitClass, "MILLISECONDS", "Ljava/util/concurrent/TimeUnit;");
+    THROW_IF_EXCEPTION(env);
+    jobject unit = env->GetStaticObjectField(timeUnitClass, fidMillis);
+    THROW_IF_EXCEPTION(env);
+    jmethodID midkvsMultiGetIter = env->GetMethodID(kvsClass, "multiGetIterator", "(Loracle/kv/Direction;ILoracle/kv/Key;Loracle/kv/KeyRange;Loracle/kv/Depth;Loracle/kv/Consistency;JLjava/util/concurrent/TimeUnit;)Ljava/util/Iterator;");
+    THROW_IF_EXCEPTION(env);
+
+    //    Iterator<KeyValueVersion> iterator = store.multiGetIterator(dir, batchSize, k, keyRange, depth,
+    //                                                                consistency, 0, unit);
+    iterator = env->CallObjectMethod(lCall.getStore(), midkvsMultiGetIter, dirObj, (jint)aBatchSize,
+                                     k, keyRangeObj, depthObj, consistencyObj, (jlong)0, unit);
+    THROW_IF_EXCEPTION(env);
+    env->DeleteLocalRef(unit);
+    env->DeleteLocalRef(consistencyObj);
+  }
+  else
+  {
+    jmethodID midkvsMultiGetIter = env->GetMethodID(kvsClass, "multiGetIterator", "(Loracle/kv/Direction;ILoracle/kv/Key;Loracle/kv/KeyRange;Loracle/kv/Depth;)Ljava/util/Iterator;");
+    THROW_IF_EXCEPTION(env);
+
+    //    Iterator<KeyValueVersion> iterator = store.multiGetIterator(dir, batchSize, k, keyRange, depth);
+    iterator = env->CallObjectMethod(lCall.getStore(), midkvsMultiGetIter, dirObj,
+                                     (jint)aBatchSize, k, keyRangeObj, depthObj);
+    THROW_IF_EXCEPTION(env);
+  }
+
+  env->DeleteLocalRef(dirObj);
+  env->DeleteLocalRef(depthObj);
+  if (keyRangeObj)
+    env->DeleteLocalRef(keyRangeObj);
+  env->DeleteLocalRef(k);
+  return iterator;
+}
+
+
+void
+JavaBackend::multiGet(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                      Depth aDepth, Direction aDirection,
+                      RecordHandler& aHandler, PhaseClock& aClock)
+{
+  JNIEnv* env = theEnv;
+  IteratorMethods lMethods(env);
+  aClock.lap(CallProfile::JNI);
+
+  // the records are passed on as they are read; records handed out can't
+  // be taken back, so a failed scan is only repeated before its first one
+  Record lRecord;
+  bool lHandedOut = false;
+  for (unsigned lAttempt = 1; ; ++lAttempt)
+  {
+    try
+    {
+      ScanSample lSample(theBatchSizer);
+      jobject iterator = openMultiGetIterator(aParentKey, aRange, aDepth, aDirection,
+                                              lSample.getBatchSize());
+      aClock.lap(CallProfile::STORE);
+
+      BatchSizer::Clock_t::time_point lFetchStart = BatchSizer::Clock_t::now();
+      while (lMethods.hasNext(env, iterator, aClock))
+      {
+        lMethods.next(env, iterator, lRecord, aClock);
+        lSample.fetched(lFetchStart, lRecord.theValue.size());
+        lHandedOut = true;
+        aClock.countRecord();
+        aHandler.record(lRecord.theKey, lRecord.theValue.data(), lRecord.theValue.size(),
+                        lRecord.theVersion);
+        lFetchStart = BatchSizer::Clock_t::now();
+      }
+      env->DeleteLocalRef(iterator);
+      lSample.finish();
+      break;
+    }
+    catch (JavaException&)
+    {
+      if (lHandedOut || !theRetryPolicy.retry(env, lAttempt, RetryPolicy::IDEMPOTENT))
+        throw;
+    }
+  }
+}
+
+
+void
+JavaBackend::multiGetPage(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                          Depth aDepth, Direction aDirection, size_t aLimit,
+                          RecordHandler& aHandler, PhaseClock& aClock)
+{
+  JNIEnv* env = theEnv;
+  IteratorMethods lMethods(env);
+  aClock.lap(CallProfile::JNI);
+
+  // a page usually comes with the first batch; the records are passed on
+  // as they are read, so that the rest of the range is never fetched
+  Record lRecord;
+  bool lHandedOut = false;
+  for (unsigned lAttempt = 1; ; ++lAttempt)
+  {
+    try
+    {
+      jobject iterator = openMultiGetIterator(aParentKey, aRange, aDepth, aDirection,
+                                              std::max<size_t>(aLimit, 1));
+      aClock.lap(CallProfile::STORE);
+
+      while (!aHandler.done() && lMethods.hasNext(env, iterator, aClock))
+      {
+        lMethods.next(env, iterator, lRecord, aClock);
+        lHandedOut = true;
+        aClock.countRecord();
+        aHandler.record(lRecord.theKey, lRecord.theValue.data(), lRecord.theValue.size(),
+                        lRecord.theVersion);
+      }
+      env->DeleteLocalRef(iterator);
+      break;
+    }
+    catch (JavaException&)
+    {
+      if (lHandedOut || !theRetryPolicy.retry(env, lAttempt, RetryPolicy::IDEMPOTENT))
+        throw;
+    }
+  }
+}
+
+
+namespace
+{
+
+// the batches of records a worker reads ahead of the query thread; the
+// cursor owns the copies of the scan parameters the worker reads from.
+// Dropping it closes the queue and waits for the worker, which gives up
+// at its next batch.
+class ReadAheadCursor : public RecordCursor
+{
+  public:
+    JNIEnv* theEnv;
+    IteratorMethods theMethods;
+    KeyPath theParentKey;
+    bool theHasRange;
+    KeyRangeSpec theRange;
+    WorkQueue<std::vector<Record> > theQueue;
+    WorkerPool thePool;
+    std::vector<Record> theBatch;
+    size_t thePosition;
+    bool theEnd;
+
+    ReadAheadCursor(JNIEnv* env, JavaVM* aVM, const KeyPath& aParentKey,
+                    const KeyRangeSpec* aRange, unsigned aBatches)
+      : theEnv(env),
+        theMethods(env),
+        theParentKey(aParentKey),
+        theHasRange(aRange != 0),
+        theQueue(aBatches),
+        thePool(aVM),
+        thePosition(0),
+        theEnd(false)
+    {
+      if (aRange)
+        theRange = *aRange;
+    }
+
+    ~ReadAheadCursor()
+    {
+      theQueue.close();
+      thePool.join();
+    }
+
+    virtual bool
+    next(Record& aRecord, PhaseClock& aClock)
+    {
+      while (thePosition == theBatch.size())
+      {
+        if (theEnd)
+          return false;
+        if (!theQueue.pop(theBatch))
+        {
+          theEnd = true;
+          thePool.join();
+          thePool.throwIfFailed(theEnv);
+          return false;
+        }
+        thePosition = 0;
+        aClock.lap(CallProfile::STORE);
+      }
+      std::swap(aRecord, theBatch[thePosition++]);
+      aClock.countRecord();
+      return true;
+    }
+};
+
+}
+
+
+std::unique_ptr<RecordCursor>
+JavaBackend::openReadAhead(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                           Depth aDepth, Direction aDirection, unsigned aBatches,
+                           PhaseClock& aClock)
+{
+  JavaVM* lVM;
+  if (theEnv->GetJavaVM(&lVM) != JNI_OK)
+    throwError("VM001", "Could not get the Java VM.");
+  ReadAheadCursor* lCursor = new ReadAheadCursor(theEnv, lVM, aParentKey, aRange,
+                                                 std::max(aBatches, 1u));
+  std::unique_ptr<RecordCursor> lResult(lCursor);
+  aClock.lap(CallProfile::JNI);
+
+  // the worker reads batches of records into the queue while the query
+  // thread turns the previous ones into items
+  lCursor->thePool.start(1, [this, lCursor, aDepth, aDirection](JNIEnv* env, unsigned)
+  {
+    // every worker has its own backoff random generator
+    RetryPolicy lRetryPolicy(theRetryPolicy);
+    JavaBackend lBackend(env, theStores, lRetryPolicy, theBatchSizer,
+                         theReadYourWrites, theHedgedReads);
+    PhaseClock lClock(0, Statistics::MULTI_GET);
+    const KeyRangeSpec* lRange = lCursor->theHasRange ? &lCursor->theRange : 0;
+    WorkQueue<std::vector<Record> >& lQueue = lCursor->theQueue;
+    bool lHandedOut = false;
+    for (unsigned lAttempt = 1; ; ++lAttempt)
+    {
+      if (env->PushLocalFrame(16) < 0)
+      {
+        lCursor->thePool.fail(env);
+        break;
+      }
+      try
+      {
+        // the batches handed over are the batches of the iterator
+        ScanSample lSample(theBatchSizer);
+        size_t lBatchSize = lSample.getBatchSize() ? lSample.getBatchSize() : theReadAheadBatchSize;
+        jobject iterator = lBackend.openMultiGetIterator(lCursor->theParentKey, lRange,
+                                                         aDepth, aDirection,
+                                                         lSample.getBatchSize());
+        std::vector<Record> lBatch;
+        bool lOpen = true;
+        BatchSizer::Clock_t::time_point lFetchStart = BatchSizer::Clock_t::now();
+        while (lOpen && lCursor->theMethods.hasNext(env, iterator, lClock))
+        {
+          lBatch.push_back(Record());
+          lCursor->theMethods.next(env, iterator, lBatch.back(), lClock);
+          lSample.fetched(lFetchStart, lBatch.back().theValue.size());
+          if (lBatch.size() >= lBatchSize)
+          {
+            lHandedOut = true;
+            lOpen = lQueue.push(std::move(lBatch));
+            lBatch.clear();
+          }
+          lFetchStart = BatchSizer::Clock_t::now();
+        }
+        if (lOpen && !lBatch.empty())
+          lQueue.push(std::move(lBatch));
+        if (lOpen)
+          lSample.finish();
+        env->PopLocalFrame(NULL);
+        break;
+      }
+      catch (JavaException&)
+      {
+        // batches handed out can't be taken back, so a scan is only
+        // repeated before its first batch
+        if (lHandedOut || !lRetryPolicy.retry(env, lAttempt, RetryPolicy::IDEMPOTENT))
+        {
+          lCursor->thePool.fail(env);
+          env->PopLocalFrame(NULL);
+          break;
+        }
+        env->PopLocalFrame(NULL);
+      }
+    }
+    lQueue.close();
+  });
+  return lResult;
+}
+
+
+void
+JavaBackend::multiGetParts(const KeyPath& aParentKey, const std::vector<KeyRangeSpec>& aParts,
+                           Depth aDepth, Direction aDirection, bool aOrdered,
+                           unsigned aParallelism, RecordHandler& aHandler, PhaseClock& aClock)
+{
+  if (aParallelism < 2 || aParts.size() < 2)
+  {
+    Backend::multiGetParts(aParentKey, aParts, aDepth, aDirection, aOrdered,
+                           aParallelism, aHandler, aClock);
+    return;
+  }
+
+  JavaVM* lVM;
+  if (theEnv->GetJavaVM(&lVM) != JNI_OK)
+    throwError("VM001", "Could not get the Java VM.");
+
+  // the parts in scan order, worker i scans the parts i, i + lThreads, ...
+  size_t lCount = aParts.size();
+  std::vector<size_t> lOrder(lCount);
+  for (size_t i = 0; i < lCount; ++i)
+    lOrder[i] = aDirection == REVERSE ? lCount - 1 - i : i;
+
+  unsigned lThreads = (unsigned)std::min<size_t>(aParallelism, lCount);
+  std::vector<std::vector<Record> > lRecords(lCount);
+  std::vector<char> lScanned(lCount, 0);
+  std::mutex lMutex;
+  std::condition_variable lCondition;
+
+  WorkerPool lPool(lVM);
+  lPool.start(lThreads, [&](JNIEnv* env, unsigned aIndex)
+  {
+    // every worker has its own backoff random generator
+    RetryPolicy lRetryPolicy(theRetryPolicy);
+    JavaBackend lBackend(env, theStores, lRetryPolicy, theBatchSizer,
+                         theReadYourWrites, theHedgedReads);
+    PhaseClock lClock(0, Statistics::MULTI_GET);
+    for (size_t i = aIndex; i < lCount && !lPool.failed(); i += lThreads)
+    {
+      if (env->PushLocalFrame(64) < 0)
+        lPool.fail(env);
+      else
+      {
+        RecordCollector lCollector(lRecords[lOrder[i]]);
+        try
+        {
+          lBackend.multiGet(aParentKey, &aParts[lOrder[i]], aDepth, aDirection,
+                            lCollector, lClock);
+        }
+        catch (JavaException&)
+        {
+          lPool.fail(env);
+        }
+        env->PopLocalFrame(NULL);
+      }
+
+      std::lock_guard<std::mutex> lLock(lMutex);
+      lScanned[lOrder[i]] = 1;
+      lCondition.notify_one();
+    }
+  });
+
+  // the query thread creates the items, one part at a time
+  std::vector<char> lHanded(lCount, 0);
+  for (size_t lNext = 0; lNext < lCount; ++lNext)
+  {
+    size_t lPart = lCount;
+    {
+      std::unique_lock<std::mutex> lLock(lMutex);
+      lCondition.wait(lLock, [&]
+      {
+        if (lPool.failed())
+          return true;
+        if (aOrdered)
+          lPart = lScanned[lOrder[lNext]] ? lOrder[lNext] : lCount;
+        else
+          for (lPart = 0; lPart < lCount && (!lScanned[lPart] || lHanded[lPart]); ++lPart)
+            ;
+        return lPart < lCount;
+      });
+    }
+    if (lPool.failed())
+      break;
+    aClock.lap(CallProfile::STORE);
+
+    lHanded[lPart] = 1;
+    std::vector<Record> lPartRecords;
+    lPartRecords.swap(lRecords[lPart]);
+    for (size_t i = 0; i < lPartRecords.size(); ++i)
+    {
+      const Record& lRecord = lPartRecords[i];
+      aClock.countRecord();
+      aHandler.record(lRecord.theKey, lRecord.theValue.data(), lRecord.theValue.size(),
+                      lRecord.theVersion);
+    }
+  }
+
+  lPool.join();
+  lPool.throwIfFailed(theEnv);
+}
+
+
+namespace
+{
+
+// the records of a store iterator, which the cursor holds a global
+// reference of; the next batch is fetched by hasNext() when it is needed
+class IteratorCursor : public RecordCursor
+{
+  private:
+    JNIEnv* theEnv;
+    IteratorMethods theMethods;
+    jobject theIterator;
+    bool theHasNext;
+
+  public:
+    IteratorCursor(JNIEnv* env, const IteratorMethods& aMethods, jobject aIterator,
+                   bool aHasNext)
+      : theEnv(env),
+        theMethods(aMethods),
+        theIterator(aIterator),
+        theHasNext(aHasNext)
+    {}
+
+    ~IteratorCursor()
+    {
+      theEnv->DeleteGlobalRef(theIterator);
+    }
+
+    virtual bool
+    next(Record& aRecord, PhaseClock& aClock)
+    {
+      if (!theHasNext)
+        return false;
+      theMethods.next(theEnv, theIterator, aRecord, aClock);
+      theHasNext = theMethods.hasNext(theEnv, theIterator, aClock);
+      return true;
+    }
+};
+
+
+}
+
+
+std::unique_ptr<RecordCursor>
+JavaBackend::openMerged(const std::vector<KeyPath>& aParentKeys, const KeyRangeSpec* aRange,
+                        Depth aDepth, Direction aDirection, unsigned aParallelism,
+                        PhaseClock& aClock)
+{
+  JNIEnv* env = theEnv;
+  IteratorMethods lMethods(env);
+  aClock.lap(CallProfile::JNI);
+
+  JavaVM* lVM;
+  if (env->GetJavaVM(&lVM) != JNI_OK)
+    throwError("VM001", "Could not get the Java VM.");
+
+  // the iterators are opened and their first batches fetched on the
+  // workers; a parent whose iterator could not be opened is retried, a
+  // failure while merging is not
+  size_t lCount = aParentKeys.size();
+  unsigned lThreads = (unsigned)std::max<size_t>(1, std::min<size_t>(aParallelism, lCount));
+  std::vector<jobject> lIterators(lCount, (jobject)NULL);
+  std::vector<char> lHasNext(lCount, 0);
+  std::vector<std::unique_ptr<RecordCursor> > lCursors;
+  {
+    WorkerPool lPool(lVM);
+    lPool.start(lThreads, [&](JNIEnv* aEnv, unsigned aIndex)
+    {
+      // every worker has its own backoff random generator
+      RetryPolicy lRetryPolicy(theRetryPolicy);
+      JavaBackend lBackend(aEnv, theStores, lRetryPolicy, theBatchSizer,
+                           theReadYourWrites, theHedgedReads);
+      PhaseClock lClock(0, Statistics::MULTI_GET_MANY);
+      for (size_t i = aIndex; i < lCount && !lPool.failed(); i += lThreads)
+      {
+        if (aEnv->PushLocalFrame(16) < 0)
+        {
+          lPool.fail(aEnv);
+          return;
+        }
+        for (unsigned lAttempt = 1; ; ++lAttempt)
+        {
+          try
+          {
+            jobject iterator = lBackend.openMultiGetIterator(aParentKeys[i], aRange,
+                                                             aDepth, aDirection,
+                                                             theBatchSizer.size());
+            lHasNext[i] = lMethods.hasNext(aEnv, iterator, lClock);
+            lIterators[i] = aEnv->NewGlobalRef(iterator);
+            break;
+          }
+          catch (JavaException&)
+          {
+            if (!lRetryPolicy.retry(aEnv, lAttempt, RetryPolicy::IDEMPOTENT))
+            {
+              lPool.fail(aEnv);
+              break;
+            }
+          }
+        }
+        aEnv->PopLocalFrame(NULL);
+      }
+    });
+    lPool.join();
+    for (size_t i = 0; i < lCount; ++i)
+      if (lIterators[i])
+        lCursors.push_back(std::unique_ptr<RecordCursor>(
+            new IteratorCursor(env, lMethods, lIterators[i], lHasNext[i] != 0)));
+    lPool.throwIfFailed(env);
+  }
+  aClock.lap(CallProfile::STORE);
+
+  return std::unique_ptr<RecordCursor>(new MergeCursor(lCursors, aDirection));
+}
+
+
+size_t
+JavaBackend::multiRemove(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                         Depth aDepth, PhaseClock& aClock)
+{
+  JNIEnv* env = theEnv;
+
+  //    Key k = Key.createKey(majorList, minorList);
+  jobject k = createJavaKey(env, aParentKey);
+  THROW_IF_EXCEPTION(env);
+
+  jobject keyRangeObj = NULL;
+  if (aRange)
+  {
+    keyRangeObj = createJavaKeyRange(env, *aRange);
+    THROW_IF_EXCEPTION(env);
+  }
+
+  jobject depthObj = createJavaDepth(aDepth);
+
+  //    int result = store.multiDelete(k, keyRange, depth);
+  jclass kvsClass = env->FindClass("oracle/kv/KVStore");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midkvsMultiDelete = env->GetMethodID(kvsClass, "multiDelete", "(Loracle/kv/Key;Loracle/kv/KeyRange;Loracle/kv/Depth;)I");
+  THROW_IF_EXCEPTION(env);
+  aClock.lap(CallProfile::JNI);
+  jint result;
+  {
+    StoreCall lCall(theStores, &aParentKey);
+    for (unsigned lAttempt = 1; ; ++lAttempt)
+    {
+      result = env->CallIntMethod(lCall.getStore(), midkvsMultiDelete, k, keyRangeObj, depthObj);
+      if (!theRetryPolicy.retry(env, lAttempt, RetryPolicy::NON_IDEMPOTENT))
+        break;
+    }
+  }
+  THROW_IF_EXCEPTION(env);
+  aClock.lap(CallProfile::STORE);
+
+  env->DeleteLocalRef(k);
+  return (size_t)result;
+}
+
+
+void
+JavaBackend::scan(const KeyPath* aParentKey, RecordHandler& aHandler, PhaseClock& aClock)
+{
+  JNIEnv* env = theEnv;
+
+  // storeIterator takes a partial major path without minor path
+  jobject k = NULL;
+  if (aParentKey)
+  {
+    KeyPath lMajor;
+    lMajor.theMajor = aParentKey->theMajor;
+    k = createJavaKey(env, lMajor);
+    THROW_IF_EXCEPTION(env);
+  }
+
+  jobject depthObj = createJavaDepth(PARENT_AND_DESCENDANTS);
+
+  //    Direction dir = Direction.UNORDERED;
+  jclass dirClass = env->FindClass("oracle/kv/Direction");
+  THROW_IF_EXCEPTION(env);
+  jfieldID fidDir = env->GetStaticFieldID(dirClass, "UNORDERED", "Loracle/kv/Direction;");
+  THROW_IF_EXCEPTION(env);
+  jobject dirObj = env->GetStaticObjectField(dirClass, fidDir);
+  THROW_IF_EXCEPTION(env);
+
+  jclass kvsClass = env->FindClass("oracle/kv/KVStore");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midStoreIterator = env->GetMethodID(kvsClass, "storeIterator", "(Loracle/kv/Direction;ILoracle/kv/Key;Loracle/kv/KeyRange;Loracle/kv/Depth;)Ljava/util/Iterator;");
+  THROW_IF_EXCEPTION(env);
+
+  jclass iterClass = env->FindClass("java/util/Iterator");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midIterHasNext = env->GetMethodID(iterClass, "hasNext", "()Z");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midIterNext = env->GetMethodID(iterClass, "next", "()Ljava/lang/Object;");
+  THROW_IF_EXCEPTION(env);
+
+  jclass kvvClass = env->FindClass("oracle/kv/KeyValueVersion");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midkvvGetKey = env->GetMethodID(kvvClass, "getKey", "()Loracle/kv/Key;");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midkvvGetValue = env->GetMethodID(kvvClass, "getValue", "()Loracle/kv/Value;");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midkvvGetVersion = env->GetMethodID(kvvClass, "getVersion", "()Loracle/kv/Version;");
+  THROW_IF_EXCEPTION(env);
+
+  jclass valueClass = env->FindClass("oracle/kv/Value");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midValGetVal = env->GetMethodID(valueClass, "getValue", "()[B");
+  THROW_IF_EXCEPTION(env);
+
+  jclass versionClass = env->FindClass("oracle/kv/Version");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midVerGetVer = env->GetMethodID(versionClass, "getVersion", "()J");
+  THROW_IF_EXCEPTION(env);
+  aClock.lap(CallProfile::JNI);
+
+  //    Iterator<KeyValueVersion> iterator = store.storeIterator(
+  //        Direction.UNORDERED, batchSize, parentKey, null, Depth.PARENT_AND_DESCENDANTS);
+  ScanSample lSample(theBatchSizer);
+  jobject iterator;
+  {
+    StoreCall lCall(theStores, aParentKey);
+    iterator = env->CallObjectMethod(lCall.getStore(), midStoreIterator, dirObj,
+                                     (jint)lSample.getBatchSize(), k, NULL, depthObj);
+  }
+  THROW_IF_EXCEPTION(env);
+  aClock.lap(CallProfile::STORE);
+
+  KeyPath lKey;
+  std::string lValue;
+  while (true)
+  {
+    // the handler's time is not fetch time
+    BatchSizer::Clock_t::time_point lFetchStart = BatchSizer::Clock_t::now();
+
+    //    iterator.hasNext()
+    jboolean hasNext = env->CallBooleanMethod(iterator, midIterHasNext);
+    THROW_IF_EXCEPTION(env);
+    if (!hasNext)
+    {
+      aClock.lap(CallProfile::STORE);
+      break;
+    }
+
+    //    KeyValueVersion kvv = iterator.next()
+    jobject kvv = env->CallObjectMethod(iterator, midIterNext);
+    THROW_IF_EXCEPTION(env);
+    aClock.lap(CallProfile::STORE);
+
+    //    Key keyObj = kvv.getKey();
+    jobject keyObj = env->CallObjectMethod(kvv, midkvvGetKey);
+    THROW_IF_EXCEPTION(env);
+    readJavaKey(env, keyObj, lKey);
+    THROW_IF_EXCEPTION(env);
+
+    //    byte[] valueBA = kvv.getValue().getValue();
+    jobject valueObj = env->CallObjectMethod(kvv, midkvvGetValue);
+    THROW_IF_EXCEPTION(env);
+    jbyteArray jbaValue = (jbyteArray) env->CallObjectMethod(valueObj, midValGetVal);
+    THROW_IF_EXCEPTION(env);
+    jsize jbaSize = env->GetArrayLength(jbaValue);
+    THROW_IF_EXCEPTION(env);
+    aClock.lap(CallProfile::JNI);
+    lValue.resize(jbaSize);
+    if (jbaSize)
+      env->GetByteArrayRegion(jbaValue, 0, jbaSize, (jbyte*)&lValue[0]);
+    THROW_IF_EXCEPTION(env);
+    aClock.lap(CallProfile::COPY);
+
+    //    long version = kvv.getVersion().getVersion();
+    jobject versionObj = env->CallObjectMethod(kvv, midkvvGetVersion);
+    THROW_IF_EXCEPTION(env);
+    jlong version = env->CallLongMethod(versionObj, midVerGetVer);
+    THROW_IF_EXCEPTION(env);
+    aClock.lap(CallProfile::JNI);
+
+    env->DeleteLocalRef(versionObj);
+    env->DeleteLocalRef(jbaValue);
+    env->DeleteLocalRef(valueObj);
+    env->DeleteLocalRef(keyObj);
+    env->DeleteLocalRef(kvv);
+    lSample.fetched(lFetchStart, lValue.size());
+
+    aClock.countRecord();
+    aHandler.record(lKey, lValue.data(), lValue.size(), version);
+  }
+  env->DeleteLocalRef(iterator);
+  lSample.finish();
+  if (k)
+    env->DeleteLocalRef(k);
+}
+
+
+}} // namespace zorba, nosqldb
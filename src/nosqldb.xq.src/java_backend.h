@@ -0,0 +1,151 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOSQLDB_JAVA_BACKEND_H
+#define NOSQLDB_JAVA_BACKEND_H
+
+#include <jni.h>
+
+#include "backend.h"
+#include "batch_sizer.h"
+#include "hedged_reads.h"
+#include "read_your_writes.h"
+#include "retry_policy.h"
+#include "store_handles.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * The oracle.kv.KVStore through JNI, "backend" : "kvstore". Transient
+ * faults are retried according to the connection's RetryPolicy.
+ */
+class JavaBackend : public Backend
+{
+  private:
+    JNIEnv* theEnv;
+    StoreHandles& theStores;
+    RetryPolicy& theRetryPolicy;
+    BatchSizer& theBatchSizer;
+    ReadYourWrites& theReadYourWrites;
+    HedgedReads* theHedgedReads;
+
+    jobject
+    createJavaDepth(Depth aDepth);
+
+    /**
+     * store.multiGetIterator() with batches of aBatchSize records, 0 for the
+     * store's default. Raises JavaException.
+     */
+    jobject
+    openMultiGetIterator(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                         Depth aDepth, Direction aDirection, size_t aBatchSize);
+
+  public:
+    /**
+     * aStores are the handles of the connection, each request goes to the
+     * one StoreHandles::select() picks. The store iterators take their batch size from aBatchSizer. Puts are recorded
+     * in and reads take their consistency from aReadYourWrites; single-key
+     * reads are hedged by aHedgedReads if not 0.
+     */
+    JavaBackend(JNIEnv* env, StoreHandles& aStores, RetryPolicy& aRetryPolicy,
+                BatchSizer& aBatchSizer, ReadYourWrites& aReadYourWrites,
+                HedgedReads* aHedgedReads = 0)
+      : theEnv(env),
+        theStores(aStores),
+        theRetryPolicy(aRetryPolicy),
+        theBatchSizer(aBatchSizer),
+        theReadYourWrites(aReadYourWrites),
+        theHedgedReads(aHedgedReads)
+    {}
+
+    virtual long long
+    put(const KeyPath& aKey, const std::string& aValue, PhaseClock& aClock);
+
+    virtual bool
+    get(const KeyPath& aKey, RecordHandler& aHandler, PhaseClock& aClock);
+
+    /**
+     * Reads the keys on up to aParallelism worker threads attached to the
+     * JVM, each with its own copy of the retry policy.
+     */
+    virtual void
+    getMany(const std::vector<KeyPath>& aKeys, unsigned aParallelism,
+            RecordHandler& aHandler, PhaseClock& aClock);
+
+    virtual bool
+    remove(const KeyPath& aKey, PhaseClock& aClock);
+
+    virtual void
+    multiGet(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+             Depth aDepth, Direction aDirection,
+             RecordHandler& aHandler, PhaseClock& aClock);
+
+    /**
+     * Reads batches of aLimit records and stops once aHandler is done. A
+     * failed scan is only retried before its first record was passed on.
+     */
+    virtual void
+    multiGetPage(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                 Depth aDepth, Direction aDirection, size_t aLimit,
+                 RecordHandler& aHandler, PhaseClock& aClock);
+
+    /**
+     * Reads the records on a worker thread attached to the JVM while the
+     * cursor hands out the batches read before; dropping the cursor stops
+     * the worker. A failed scan is only retried before its first batch was
+     * handed out.
+     */
+    virtual std::unique_ptr<RecordCursor>
+    openReadAhead(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                  Depth aDepth, Direction aDirection, unsigned aBatches,
+                  PhaseClock& aClock);
+
+    /**
+     * Scans the parts on up to aParallelism worker threads attached to the
+     * JVM. A part is handed to aHandler as soon as its scan and, with
+     * aOrdered, the scans of the parts before it are complete.
+     */
+    virtual void
+    multiGetParts(const KeyPath& aParentKey, const std::vector<KeyRangeSpec>& aParts,
+                  Depth aDepth, Direction aDirection, bool aOrdered,
+                  unsigned aParallelism, RecordHandler& aHandler, PhaseClock& aClock);
+
+    /**
+     * Opens the iterators of up to aParallelism parents at a time on worker
+     * threads; the cursor merges them on the query thread and holds them
+     * until it is dropped. Only the current batch of each iterator is held
+     * in memory.
+     */
+    virtual std::unique_ptr<RecordCursor>
+    openMerged(const std::vector<KeyPath>& aParentKeys, const KeyRangeSpec* aRange,
+               Depth aDepth, Direction aDirection, unsigned aParallelism,
+               PhaseClock& aClock);
+
+    virtual size_t
+    multiRemove(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                Depth aDepth, PhaseClock& aClock);
+
+    virtual void
+    scan(const KeyPath* aParentKey, RecordHandler& aHandler, PhaseClock& aClock);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_JAVA_BACKEND_H
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "java_exception.h"
+#include "nosqldb.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+namespace
+{
+
+class KnownException
+{
+  public:
+    const char* theClassName;
+    const char* theErrorName;
+    bool theIsTransient;
+};
+
+// subclasses before their superclasses, the first match wins
+const KnownException theKnownExceptions[] =
+{
+  { "oracle/kv/RequestTimeoutException",   "RequestTimeout",   true  },
+  { "oracle/kv/RequestLimitException",     "RequestLimit",     true  },
+  { "oracle/kv/ConsistencyException",      "ConsistencyError", true  },
+  { "oracle/kv/DurabilityException",       "DurabilityError",  true  },
+  { "oracle/kv/StaleStoreHandleException", "StaleStoreHandle", false },
+  { "oracle/kv/FaultException",            "FaultException",   true  },
+  { "java/lang/IllegalArgumentException",  "InvalidArgument",  false }
+};
+
+const size_t theKnownExceptionCount =
+    sizeof(theKnownExceptions) / sizeof(theKnownExceptions[0]);
+
+std::once_flag theClassesLoaded;
+jclass theKnownClasses[sizeof(theKnownExceptions) / sizeof(theKnownExceptions[0])];
+
+
+// global references, looked up once; classes missing from the client
+// version in use stay NULL
+void
+loadKnownClasses(JNIEnv* env)
+{
+  std::call_once(theClassesLoaded, [env]()
+  {
+    for (size_t i = 0; i < theKnownExceptionCount; ++i)
+    {
+      jclass lClass = env->FindClass(theKnownExceptions[i].theClassName);
+      if (env->ExceptionCheck())
+      {
+        env->ExceptionClear();
+        theKnownClasses[i] = NULL;
+        continue;
+      }
+      theKnownClasses[i] = (jclass)env->NewGlobalRef(lClass);
+      env->DeleteLocalRef(lClass);
+    }
+  });
+}
+
+
+const KnownException*
+findKnownException(JNIEnv* env, jthrowable aException)
+{
+  loadKnownClasses(env);
+  for (size_t i = 0; i < theKnownExceptionCount; ++i)
+    if (theKnownClasses[i] && env->IsInstanceOf(aException, theKnownClasses[i]))
+      return &theKnownExceptions[i];
+  return NULL;
+}
+
+
+std::string
+javaToString(JNIEnv* env, jobject aObject, bool aWithStackTrace)
+{
+  jstring lString;
+  if (aWithStackTrace)
+  {
+    //    StringWriter sw = new StringWriter();
+    //    e.printStackTrace(new PrintWriter(sw));
+    jclass stringWriterClass = env->FindClass("java/io/StringWriter");
+    jclass printWriterClass = env->FindClass("java/io/PrintWriter");
+    jclass throwableClass = env->FindClass("java/lang/Throwable");
+    jobject stringWriter = env->NewObject(
+              stringWriterClass,
+              env->GetMethodID(stringWriterClass, "<init>", "()V"));
+    jobject printWriter = env->NewObject(
+              printWriterClass,
+              env->GetMethodID(printWriterClass, "<init>", "(Ljava/io/Writer;)V"),
+              stringWriter);
+    env->CallVoidMethod(aObject,
+              env->GetMethodID(throwableClass, "printStackTrace", "(Ljava/io/PrintWriter;)V"),
+              printWriter);
+    lString = (jstring)env->CallObjectMethod(stringWriter,
+              env->GetMethodID(stringWriterClass, "toString", "()Ljava/lang/String;"));
+    env->DeleteLocalRef(printWriter);
+    env->DeleteLocalRef(stringWriter);
+  }
+  else
+  {
+    //    e.toString();
+    jclass objectClass = env->FindClass("java/lang/Object");
+    lString = (jstring)env->CallObjectMethod(aObject,
+              env->GetMethodID(objectClass, "toString", "()Ljava/lang/String;"));
+  }
+
+  if (env->ExceptionCheck() || !lString)
+  {
+    env->ExceptionClear();
+    return std::string("unknown Java exception");
+  }
+
+  const char* lChars = env->GetStringUTFChars(lString, NULL);
+  std::string lResult(lChars);
+  env->ReleaseStringUTFChars(lString, lChars);
+  env->DeleteLocalRef(lString);
+  return lResult;
+}
+
+} // anonymous namespace
+
+
+void
+throwJavaException(JNIEnv* env, jthrowable aException)
+{
+  env->ExceptionClear();
+  if (!aException)
+    throwError("JAVA-EXCEPTION", "A Java Exception was thrown.");
+
+  const KnownException* lKnown = findKnownException(env, aException);
+  if (lKnown)
+    throwError(lKnown->theErrorName, javaToString(env, aException, false).c_str());
+
+  std::stringstream s;
+  s << "A Java Exception was thrown:" << std::endl
+    << javaToString(env, aException, true);
+  throwError("JAVA-EXCEPTION", s.str().c_str());
+}
+
+
+bool
+isTransientJavaException(JNIEnv* env, jthrowable aException)
+{
+  const KnownException* lKnown = findKnownException(env, aException);
+  return lKnown && lKnown->theIsTransient;
+}
+
+
+}} // namespace zorba, nosqldb
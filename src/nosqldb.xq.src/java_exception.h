@@ -0,0 +1,50 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_JAVA_EXCEPTION_H
+#define NOSQLDB_JAVA_EXCEPTION_H
+
+#include <jni.h>
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Raises aException, which must be the pending Java exception, as an XQuery
+ * error and clears it. Exceptions of the KV client are mapped to specific
+ * error QNames carrying only the exception's toString(), e.g.
+ * nosql:RequestTimeout or nosql:FaultException; no stack trace is formatted
+ * for them. Any other exception is raised as nosql:JAVA-EXCEPTION with its
+ * full stack trace, as before.
+ */
+void
+throwJavaException(JNIEnv* env, jthrowable aException);
+
+/**
+ * True if aException is a KV client fault that may go away when the
+ * operation is repeated (timeouts, request limits, consistency or durability
+ * not met, other FaultExceptions).
+ */
+bool
+isTransientJavaException(JNIEnv* env, jthrowable aException);
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_JAVA_EXCEPTION_H
@@ -0,0 +1,629 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <cstdio>
+
+#include "json_lines.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+static const char theBase64Chars[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+
+/*****************************************************************************
+ parsing
+ *****************************************************************************/
+
+namespace
+{
+
+class ParseError
+{
+  public:
+    std::string theMessage;
+    ParseError(const std::string& aMessage) : theMessage(aMessage) {}
+};
+
+
+class RecordParser
+{
+  private:
+    const std::string& theLine;
+    size_t thePos;
+
+    void
+    fail(const char* aMessage)
+    {
+      char lPos[32];
+      snprintf(lPos, sizeof(lPos), " at column %lu", (unsigned long)thePos + 1);
+      throw ParseError(std::string(aMessage) + lPos);
+    }
+
+    void
+    skipWhitespace()
+    {
+      while (thePos < theLine.size() &&
+             (theLine[thePos] == ' ' || theLine[thePos] == '\t' ||
+              theLine[thePos] == '\r' || theLine[thePos] == '\n'))
+        ++thePos;
+    }
+
+    char
+    peek()
+    {
+      skipWhitespace();
+      if (thePos >= theLine.size())
+        fail("unexpected end of line");
+      return theLine[thePos];
+    }
+
+    void
+    expect(char c)
+    {
+      if (peek() != c)
+      {
+        std::string lMessage("expected '");
+        lMessage += c;
+        lMessage += "'";
+        fail(lMessage.c_str());
+      }
+      ++thePos;
+    }
+
+    unsigned long
+    readHex4()
+    {
+      if (thePos + 4 > theLine.size())
+        fail("truncated \\u escape");
+      unsigned long lResult = 0;
+      for (int i = 0; i < 4; ++i)
+      {
+        char c = theLine[thePos++];
+        lResult <<= 4;
+        if (c >= '0' && c <= '9') lResult |= c - '0';
+        else if (c >= 'a' && c <= 'f') lResult |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') lResult |= c - 'A' + 10;
+        else fail("invalid \\u escape");
+      }
+      return lResult;
+    }
+
+    static void
+    appendCodePoint(std::string& aResult, unsigned long c)
+    {
+      if (c < 0x80)
+        aResult += (char)c;
+      else if (c < 0x800)
+      {
+        aResult += (char)(0xC0 | (c >> 6));
+        aResult += (char)(0x80 | (c & 0x3F));
+      }
+      else if (c < 0x10000)
+      {
+        aResult += (char)(0xE0 | (c >> 12));
+        aResult += (char)(0x80 | ((c >> 6) & 0x3F));
+        aResult += (char)(0x80 | (c & 0x3F));
+      }
+      else
+      {
+        aResult += (char)(0xF0 | (c >> 18));
+        aResult += (char)(0x80 | ((c >> 12) & 0x3F));
+        aResult += (char)(0x80 | ((c >> 6) & 0x3F));
+        aResult += (char)(0x80 | (c & 0x3F));
+      }
+    }
+
+  public:
+    RecordParser(const std::string& aLine) : theLine(aLine), thePos(0)
+    {}
+
+    void
+    parseString(std::string& aResult)
+    {
+      expect('"');
+      aResult.clear();
+      while (true)
+      {
+        if (thePos >= theLine.size())
+          fail("unterminated string");
+        char c = theLine[thePos++];
+        if (c == '"')
+          return;
+        if (c != '\\')
+        {
+          aResult += c;
+          continue;
+        }
+        if (thePos >= theLine.size())
+          fail("unterminated string");
+        switch (theLine[thePos++])
+        {
+          case '"':  aResult += '"'; break;
+          case '\\': aResult += '\\'; break;
+          case '/':  aResult += '/'; break;
+          case 'b':  aResult += '\b'; break;
+          case 'f':  aResult += '\f'; break;
+          case 'n':  aResult += '\n'; break;
+          case 'r':  aResult += '\r'; break;
+          case 't':  aResult += '\t'; break;
+          case 'u':
+          {
+            unsigned long lCode = readHex4();
+            if (lCode >= 0xD800 && lCode < 0xDC00 &&
+                theLine.compare(thePos, 2, "\\u") == 0)
+            {
+              thePos += 2;
+              unsigned long lLow = readHex4();
+              if (lLow < 0xDC00 || lLow >= 0xE000)
+                fail("invalid surrogate pair");
+              lCode = 0x10000 + ((lCode - 0xD800) << 10) + (lLow - 0xDC00);
+            }
+            appendCodePoint(aResult, lCode);
+            break;
+          }
+          default:
+            fail("invalid escape");
+        }
+      }
+    }
+
+    // a string or an array of strings, as in the "major" and "minor" of keys
+    void
+    parseComponents(std::vector<std::string>& aComponents)
+    {
+      aComponents.clear();
+      if (peek() == '"')
+      {
+        aComponents.push_back(std::string());
+        parseString(aComponents.back());
+        return;
+      }
+      expect('[');
+      if (peek() == ']')
+      {
+        ++thePos;
+        return;
+      }
+      while (true)
+      {
+        aComponents.push_back(std::string());
+        parseString(aComponents.back());
+        if (peek() == ']')
+        {
+          ++thePos;
+          return;
+        }
+        expect(',');
+      }
+    }
+
+    void
+    skipValue()
+    {
+      char c = peek();
+      if (c == '"')
+      {
+        std::string lIgnored;
+        parseString(lIgnored);
+      }
+      else if (c == '{' || c == '[')
+      {
+        char lClose = (c == '{' ? '}' : ']');
+        ++thePos;
+        if (peek() == lClose)
+        {
+          ++thePos;
+          return;
+        }
+        while (true)
+        {
+          if (c == '{')
+          {
+            std::string lIgnored;
+            parseString(lIgnored);
+            expect(':');
+          }
+          skipValue();
+          if (peek() == lClose)
+          {
+            ++thePos;
+            return;
+          }
+          expect(',');
+        }
+      }
+      else
+      {
+        // number, true, false, null
+        size_t lStart = thePos;
+        while (thePos < theLine.size() &&
+               theLine[thePos] != ',' && theLine[thePos] != '}' &&
+               theLine[thePos] != ']' && theLine[thePos] != ' ')
+          ++thePos;
+        if (lStart == thePos)
+          fail("value expected");
+      }
+    }
+
+    // calls aMember(name) for every property, which must consume the value
+    template <class F>
+    void
+    parseObject(F aMember)
+    {
+      expect('{');
+      if (peek() == '}')
+      {
+        ++thePos;
+        return;
+      }
+      std::string lName;
+      while (true)
+      {
+        parseString(lName);
+        expect(':');
+        aMember(lName);
+        if (peek() == '}')
+        {
+          ++thePos;
+          return;
+        }
+        expect(',');
+      }
+    }
+
+    // a string, number or boolean as its text; false for null, objects and
+    // arrays, which are skipped
+    bool
+    parseScalar(std::string& aResult)
+    {
+      char c = peek();
+      if (c == '"')
+      {
+        parseString(aResult);
+        return true;
+      }
+      size_t lStart = thePos;
+      skipValue();
+      if (c == '{' || c == '[')
+        return false;
+      aResult = theLine.substr(lStart, thePos - lStart);
+      return aResult != "null";
+    }
+
+    // the scalar at aPath[aLevel..] inside the object at the current position
+    bool
+    parseField(const std::vector<std::string>& aPath, size_t aLevel, std::string& aResult)
+    {
+      bool lFound = false;
+      parseObject([&](const std::string& aName)
+      {
+        if (lFound || aName != aPath[aLevel])
+          skipValue();
+        else if (aLevel + 1 == aPath.size())
+          lFound = parseScalar(aResult);
+        else if (peek() == '{')
+          lFound = parseField(aPath, aLevel + 1, aResult);
+        else
+          skipValue();
+      });
+      return lFound;
+    }
+
+    void
+    parseEnd()
+    {
+      skipWhitespace();
+      if (thePos != theLine.size())
+        fail("trailing characters");
+    }
+};
+
+
+bool
+decodeBase64(const std::string& aIn, std::string& aOut)
+{
+  static signed char theTable[256];
+  static bool theInitialized = false;
+  if (!theInitialized)
+  {
+    for (int i = 0; i < 256; ++i)
+      theTable[i] = -1;
+    for (int i = 0; i < 64; ++i)
+      theTable[(unsigned char)theBase64Chars[i]] = (signed char)i;
+    theInitialized = true;
+  }
+
+  aOut.clear();
+  aOut.reserve(aIn.size() / 4 * 3);
+  unsigned long lBits = 0;
+  int lCount = 0;
+  for (size_t i = 0; i < aIn.size(); ++i)
+  {
+    unsigned char c = aIn[i];
+    if (c == '=')
+      break;
+    if (theTable[c] < 0)
+      return false;
+    lBits = (lBits << 6) | theTable[c];
+    if (++lCount == 4)
+    {
+      aOut += (char)(lBits >> 16);
+      aOut += (char)(lBits >> 8);
+      aOut += (char)lBits;
+      lBits = 0;
+      lCount = 0;
+    }
+  }
+  if (lCount == 1)
+    return false;
+  if (lCount == 2)
+    aOut += (char)(lBits >> 4);
+  else if (lCount == 3)
+  {
+    aOut += (char)(lBits >> 10);
+    aOut += (char)(lBits >> 2);
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+
+bool
+parseJSONRecord(const std::string& aLine,
+                KeyPath& aKey,
+                std::string& aValue,
+                std::string& aError)
+{
+  RecordParser lParser(aLine);
+  bool lHasKey = false;
+  bool lHasMajor = false;
+  bool lHasValue = false;
+  bool lIsBase64 = false;
+
+  aKey.theMajor.clear();
+  aKey.theMinor.clear();
+
+  try
+  {
+    lParser.parseObject([&](const std::string& aName)
+    {
+      if (aName == "key")
+      {
+        lHasKey = true;
+        lParser.parseObject([&](const std::string& aKeyName)
+        {
+          if (aKeyName == "major")
+          {
+            lHasMajor = true;
+            lParser.parseComponents(aKey.theMajor);
+          }
+          else if (aKeyName == "minor")
+            lParser.parseComponents(aKey.theMinor);
+          else
+            lParser.skipValue();
+        });
+      }
+      else if (aName == "value" || aName == "value-base64")
+      {
+        lHasValue = true;
+        lIsBase64 = (aName == "value-base64");
+        lParser.parseString(aValue);
+      }
+      else
+        lParser.skipValue();
+    });
+    lParser.parseEnd();
+  }
+  catch (ParseError& e)
+  {
+    aError = e.theMessage;
+    return false;
+  }
+
+  if (!lHasKey || !lHasMajor || aKey.theMajor.empty())
+  {
+    aError = "the record has no \"key\" with a \"major\" path";
+    return false;
+  }
+  if (!lHasValue)
+  {
+    aError = "the record has no \"value\" or \"value-base64\"";
+    return false;
+  }
+  if (lIsBase64)
+  {
+    std::string lDecoded;
+    if (!decodeBase64(aValue, lDecoded))
+    {
+      aError = "invalid \"value-base64\"";
+      return false;
+    }
+    aValue.swap(lDecoded);
+  }
+  return true;
+}
+
+
+/*****************************************************************************
+ writing
+ *****************************************************************************/
+
+static bool
+isValidUTF8(const char* aData, size_t aLength)
+{
+  const unsigned char* p = (const unsigned char*)aData;
+  const unsigned char* lEnd = p + aLength;
+  while (p < lEnd)
+  {
+    unsigned char c = *p++;
+    int lFollow;
+    if (c < 0x80) continue;
+    else if (c >= 0xC2 && c < 0xE0) lFollow = 1;
+    else if (c >= 0xE0 && c < 0xF0) lFollow = 2;
+    else if (c >= 0xF0 && c < 0xF5) lFollow = 3;
+    else return false;
+    if (lEnd - p < lFollow)
+      return false;
+    for (int i = 0; i < lFollow; ++i)
+      if ((*p++ & 0xC0) != 0x80)
+        return false;
+  }
+  return true;
+}
+
+
+void
+writeJSONString(std::ostream& aOut, const char* aData, size_t aLength)
+{
+  aOut.put('"');
+  const char* lRun = aData;
+  const char* lEnd = aData + aLength;
+  for (const char* p = aData; p < lEnd; ++p)
+  {
+    unsigned char c = *p;
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+
+    aOut.write(lRun, p - lRun);
+    lRun = p + 1;
+    switch (c)
+    {
+      case '"':  aOut.write("\\\"", 2); break;
+      case '\\': aOut.write("\\\\", 2); break;
+      case '\n': aOut.write("\\n", 2); break;
+      case '\r': aOut.write("\\r", 2); break;
+      case '\t': aOut.write("\\t", 2); break;
+      default:
+      {
+        char lEscape[8];
+        snprintf(lEscape, sizeof(lEscape), "\\u%04x", c);
+        aOut.write(lEscape, 6);
+      }
+    }
+  }
+  aOut.write(lRun, lEnd - lRun);
+  aOut.put('"');
+}
+
+
+static void
+writeComponents(std::ostream& aOut, const std::vector<std::string>& aComponents)
+{
+  aOut.put('[');
+  for (size_t i = 0; i < aComponents.size(); ++i)
+  {
+    if (i > 0)
+      aOut.put(',');
+    writeJSONString(aOut, aComponents[i].data(), aComponents[i].size());
+  }
+  aOut.put(']');
+}
+
+
+static void
+writeBase64(std::ostream& aOut, const char* aData, size_t aLength)
+{
+  const unsigned char* p = (const unsigned char*)aData;
+  char lQuad[4];
+  aOut.put('"');
+  size_t i = 0;
+  for (; i + 3 <= aLength; i += 3)
+  {
+    unsigned long lBits = (p[i] << 16) | (p[i + 1] << 8) | p[i + 2];
+    lQuad[0] = theBase64Chars[(lBits >> 18) & 0x3F];
+    lQuad[1] = theBase64Chars[(lBits >> 12) & 0x3F];
+    lQuad[2] = theBase64Chars[(lBits >> 6) & 0x3F];
+    lQuad[3] = theBase64Chars[lBits & 0x3F];
+    aOut.write(lQuad, 4);
+  }
+  if (i < aLength)
+  {
+    unsigned long lBits = p[i] << 16;
+    if (i + 1 < aLength)
+      lBits |= p[i + 1] << 8;
+    lQuad[0] = theBase64Chars[(lBits >> 18) & 0x3F];
+    lQuad[1] = theBase64Chars[(lBits >> 12) & 0x3F];
+    lQuad[2] = (i + 1 < aLength) ? theBase64Chars[(lBits >> 6) & 0x3F] : '=';
+    lQuad[3] = '=';
+    aOut.write(lQuad, 4);
+  }
+  aOut.put('"');
+}
+
+
+void
+writeJSONKey(std::ostream& aOut, const KeyPath& aKey)
+{
+  aOut << "{\"major\":";
+  writeComponents(aOut, aKey.theMajor);
+  if (!aKey.theMinor.empty())
+  {
+    aOut << ",\"minor\":";
+    writeComponents(aOut, aKey.theMinor);
+  }
+  aOut.put('}');
+}
+
+
+void
+writeJSONRecord(std::ostream& aOut,
+                const KeyPath& aKey,
+                const char* aValue,
+                size_t aLength)
+{
+  aOut << "{\"key\":";
+  writeJSONKey(aOut, aKey);
+
+  if (isValidUTF8(aValue, aLength))
+  {
+    aOut << ",\"value\":";
+    writeJSONString(aOut, aValue, aLength);
+  }
+  else
+  {
+    aOut << ",\"value-base64\":";
+    writeBase64(aOut, aValue, aLength);
+  }
+  aOut << "}\n";
+}
+
+
+bool
+readJSONField(const std::string& aDocument,
+              const std::vector<std::string>& aField,
+              std::string& aValue)
+{
+  RecordParser lParser(aDocument);
+  try
+  {
+    bool lFound = lParser.parseField(aField, 0, aValue);
+    lParser.parseEnd();
+    return lFound;
+  }
+  catch (ParseError&)
+  {
+    return false;
+  }
+}
+
+
+}} // namespace zorba, nosqldb
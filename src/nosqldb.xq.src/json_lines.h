@@ -0,0 +1,86 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_JSON_LINES_H
+#define NOSQLDB_JSON_LINES_H
+
+#include <ostream>
+#include <string>
+
+#include "key_codec.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * The record format of nosql:import and nosql:export, one JSON object per
+ * line:
+ *   {"key":{"major":["a","b"],"minor":["c"]},"value":"text"}
+ * Values that are not valid UTF-8 are written as "value-base64" instead of
+ * "value". These functions do not depend on the XQuery engine so that bulk
+ * transfers do not create items.
+ */
+
+/**
+ * Parses one record. Returns false and sets aError if the line is malformed.
+ */
+bool
+parseJSONRecord(const std::string& aLine,
+                KeyPath& aKey,
+                std::string& aValue,
+                std::string& aError);
+
+/**
+ * Writes aData as a quoted JSON string, escaping as needed. aData is
+ * expected to be UTF-8.
+ */
+void
+writeJSONString(std::ostream& aOut, const char* aData, size_t aLength);
+
+/**
+ * Writes aKey in the { "major" : [..], "minor" : [..] } form of key
+ * parameters.
+ */
+void
+writeJSONKey(std::ostream& aOut, const KeyPath& aKey);
+
+/**
+ * Writes one record including the trailing newline.
+ */
+void
+writeJSONRecord(std::ostream& aOut,
+                const KeyPath& aKey,
+                const char* aValue,
+                size_t aLength);
+
+/**
+ * Reads the field at the path aField, one property name per level, of the
+ * JSON object aDocument. Strings are returned unescaped, numbers and
+ * booleans as written. Returns false if aDocument is not a JSON object or
+ * the field is missing, null, an object or an array.
+ */
+bool
+readJSONField(const std::string& aDocument,
+              const std::vector<std::string>& aField,
+              std::string& aValue);
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_JSON_LINES_H
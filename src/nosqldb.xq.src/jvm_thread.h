@@ -0,0 +1,67 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOSQLDB_JVM_THREAD_H
+#define NOSQLDB_JVM_THREAD_H
+
+#include <jni.h>
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Attaches the calling native thread to the JVM for the lifetime of the
+ * object. Threads that were already attached are left attached.
+ */
+class JVMThreadScope
+{
+  private:
+    JavaVM* theVM;
+    JNIEnv* theEnv;
+    bool theAttached;
+
+  public:
+    JVMThreadScope(JavaVM* aVM) : theVM(aVM), theEnv(0), theAttached(false)
+    {
+      if (theVM->GetEnv((void**)&theEnv, JNI_VERSION_1_6) == JNI_EDETACHED)
+      {
+        if (theVM->AttachCurrentThread((void**)&theEnv, NULL) == JNI_OK)
+          theAttached = true;
+        else
+          theEnv = 0;
+      }
+    }
+
+    ~JVMThreadScope()
+    {
+      if (theAttached)
+        theVM->DetachCurrentThread();
+    }
+
+    JNIEnv* getEnv() const
+    { return theEnv; }
+
+  private:
+    JVMThreadScope(const JVMThreadScope&);
+    JVMThreadScope& operator=(const JVMThreadScope&);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_JVM_THREAD_H
@@ -0,0 +1,883 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "key_codec.h"
+#include "nosqldb.h"
+
+#define RETURN_IF_EXCEPTION(env)  if ((COUNT_JNI_CALL(), env->ExceptionCheck())) return NULL
+#define RETURN_FALSE_IF_EXCEPTION(env)  if ((COUNT_JNI_CALL(), env->ExceptionCheck())) return false
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+static void
+appendComponent(std::string& aResult, const std::string& aComponent)
+{
+  aResult += '/';
+  if (aComponent == "-")
+  {
+    aResult += "%2D";
+    return;
+  }
+  for (std::string::const_iterator lIter = aComponent.begin();
+       lIter != aComponent.end(); ++lIter)
+  {
+    if (*lIter == '%')
+      aResult += "%25";
+    else if (*lIter == '/')
+      aResult += "%2F";
+    else
+      aResult += *lIter;
+  }
+}
+
+
+std::string
+KeyPath::majorToString() const
+{
+  std::string lResult;
+  for (size_t i = 0; i < theMajor.size(); ++i)
+    appendComponent(lResult, theMajor[i]);
+  return lResult;
+}
+
+
+std::string
+KeyPath::toString() const
+{
+  std::string lResult = majorToString();
+  if (!theMinor.empty())
+  {
+    lResult += "/-";
+    for (size_t i = 0; i < theMinor.size(); ++i)
+      appendComponent(lResult, theMinor[i]);
+  }
+  return lResult;
+}
+
+
+// a component ends with 0x00 0x02 and the major path with 0x00 0x01, so that
+// a shorter path sorts first; 0x00 inside a component becomes 0x00 0xFF
+static void
+appendOrderedComponent(std::string& aResult, const std::string& aComponent)
+{
+  for (std::string::const_iterator lIter = aComponent.begin();
+       lIter != aComponent.end(); ++lIter)
+  {
+    aResult += *lIter;
+    if (*lIter == '\0')
+      aResult += '\xFF';
+  }
+  aResult += '\0';
+  aResult += '\2';
+}
+
+
+std::string
+encodeOrderedKey(const KeyPath& aKey)
+{
+  std::string lResult;
+  for (size_t i = 0; i < aKey.theMajor.size(); ++i)
+    appendOrderedComponent(lResult, aKey.theMajor[i]);
+  lResult += '\0';
+  lResult += '\1';
+  for (size_t i = 0; i < aKey.theMinor.size(); ++i)
+    appendOrderedComponent(lResult, aKey.theMinor[i]);
+  return lResult;
+}
+
+
+std::string
+encodeOrderedMajorPrefix(const KeyPath& aKey)
+{
+  std::string lResult;
+  for (size_t i = 0; i < aKey.theMajor.size(); ++i)
+    appendOrderedComponent(lResult, aKey.theMajor[i]);
+  return lResult;
+}
+
+
+bool
+decodeOrderedKey(const char* aData, size_t aSize, KeyPath& aResult)
+{
+  aResult.theMajor.clear();
+  aResult.theMinor.clear();
+
+  std::vector<std::string>* lPath = &aResult.theMajor;
+  std::string lComponent;
+  for (size_t i = 0; i < aSize; ++i)
+  {
+    if (aData[i] != '\0')
+    {
+      lComponent += aData[i];
+      continue;
+    }
+    if (++i == aSize)
+      return false;
+
+    switch (aData[i])
+    {
+      case '\xFF':
+        lComponent += '\0';
+        break;
+      case '\2':
+        lPath->push_back(lComponent);
+        lComponent.clear();
+        break;
+      case '\1':
+        if (lPath != &aResult.theMajor || !lComponent.empty())
+          return false;
+        lPath = &aResult.theMinor;
+        break;
+      default:
+        return false;
+    }
+  }
+  return lPath == &aResult.theMinor && lComponent.empty();
+}
+
+
+/*****************************************************************************
+ Typed key components
+ *****************************************************************************/
+
+// A typed component is '\1', a type tag and an ASCII body whose string order
+// is the order of the values, so that it also holds for the UTF-8 bytes the
+// store compares. A plain string starting with '\1' gets the 's' tag.
+static const char theTypedMark = '\1';
+
+
+static bool
+isIntegerType(store::SchemaTypeCode aType)
+{
+  switch (aType)
+  {
+    case store::XS_INTEGER:
+    case store::XS_LONG:
+    case store::XS_INT:
+    case store::XS_SHORT:
+    case store::XS_BYTE:
+    case store::XS_NON_NEGATIVE_INTEGER:
+    case store::XS_POSITIVE_INTEGER:
+    case store::XS_NON_POSITIVE_INTEGER:
+    case store::XS_NEGATIVE_INTEGER:
+    case store::XS_UNSIGNED_LONG:
+    case store::XS_UNSIGNED_INT:
+    case store::XS_UNSIGNED_SHORT:
+    case store::XS_UNSIGNED_BYTE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+// "-12.50" as '0' (negative), '1' (zero) or '2' (positive), the decimal
+// exponent biased by 50000 in 5 digits and the significant digits. For a
+// negative number the exponent and the digits are complemented and '~' ends
+// the digits, so that -1.23 sorts before -1.2.
+static bool
+encodeNumber(const std::string& aLexical, std::string& aResult)
+{
+  size_t lPos = 0;
+  bool lNegative = false;
+  if (lPos < aLexical.size() && (aLexical[lPos] == '-' || aLexical[lPos] == '+'))
+    lNegative = aLexical[lPos++] == '-';
+
+  std::string lDigits;
+  long lExponent = 0;
+  bool lFraction = false;
+  for (; lPos < aLexical.size(); ++lPos)
+  {
+    char c = aLexical[lPos];
+    if (c == '.' && !lFraction)
+    {
+      lFraction = true;
+      continue;
+    }
+    if (c < '0' || c > '9')
+      return false;
+    if (lDigits.empty() && c == '0')
+    {
+      // leading zeros only move the exponent behind the point
+      if (lFraction)
+        --lExponent;
+      continue;
+    }
+    lDigits += c;
+    if (!lFraction)
+      ++lExponent;
+  }
+
+  while (!lDigits.empty() && lDigits[lDigits.size() - 1] == '0')
+    lDigits.erase(lDigits.size() - 1);
+
+  if (lDigits.empty())
+  {
+    aResult += '1';
+    return true;
+  }
+  if (lExponent < -49999 || lExponent > 49999)
+    return false;
+
+  char lExponentDigits[8];
+  long lBiased = lExponent + 50000;
+  snprintf(lExponentDigits, sizeof(lExponentDigits), "%05ld",
+           lNegative ? 99999 - lBiased : lBiased);
+
+  aResult += lNegative ? '0' : '2';
+  aResult += lExponentDigits;
+  for (size_t i = 0; i < lDigits.size(); ++i)
+    aResult += lNegative ? (char)('9' - lDigits[i] + '0') : lDigits[i];
+  if (lNegative)
+    aResult += '~';
+  return true;
+}
+
+
+static bool
+decodeNumber(const std::string& aBody, bool aInteger, std::string& aLexical)
+{
+  if (aBody == "1")
+  {
+    aLexical = "0";
+    return true;
+  }
+  if (aBody.size() < 7 || (aBody[0] != '0' && aBody[0] != '2'))
+    return false;
+
+  bool lNegative = aBody[0] == '0';
+  std::string lDigits = aBody.substr(6);
+  if (lNegative)
+  {
+    if (lDigits[lDigits.size() - 1] != '~')
+      return false;
+    lDigits.erase(lDigits.size() - 1);
+  }
+  for (size_t i = 0; i < lDigits.size(); ++i)
+  {
+    if (lDigits[i] < '0' || lDigits[i] > '9')
+      return false;
+    if (lNegative)
+      lDigits[i] = (char)('9' - lDigits[i] + '0');
+  }
+
+  long lBiased = strtol(aBody.substr(1, 5).c_str(), 0, 10);
+  long lExponent = (lNegative ? 99999 - lBiased : lBiased) - 50000;
+
+  aLexical = lNegative ? "-" : "";
+  if (lExponent <= 0)
+  {
+    if (aInteger)
+      return false;
+    aLexical += "0." + std::string(-lExponent, '0') + lDigits;
+  }
+  else if ((size_t)lExponent >= lDigits.size())
+    aLexical += lDigits + std::string(lExponent - lDigits.size(), '0');
+  else if (aInteger)
+    return false;
+  else
+    aLexical += lDigits.substr(0, lExponent) + "." + lDigits.substr(lExponent);
+  return true;
+}
+
+
+// the IEEE 754 bits as 16 hex digits, with the sign bit flipped for
+// positive numbers and all bits flipped for negative ones
+static void
+encodeDouble(double aValue, std::string& aResult)
+{
+  if (aValue == 0)
+    aValue = 0; // -0 and 0 are the same key
+  uint64_t lBits;
+  memcpy(&lBits, &aValue, sizeof(lBits));
+  if (lBits & 0x8000000000000000ULL)
+    lBits = ~lBits;
+  else
+    lBits |= 0x8000000000000000ULL;
+
+  static const char theHexDigits[] = "0123456789ABCDEF";
+  for (int i = 60; i >= 0; i -= 4)
+    aResult += theHexDigits[(lBits >> i) & 0xF];
+}
+
+
+static bool
+decodeDouble(const std::string& aBody, double& aValue)
+{
+  if (aBody.size() != 16)
+    return false;
+  uint64_t lBits = 0;
+  for (size_t i = 0; i < aBody.size(); ++i)
+  {
+    char c = aBody[i];
+    if (c >= '0' && c <= '9')
+      lBits = (lBits << 4) | (c - '0');
+    else if (c >= 'A' && c <= 'F')
+      lBits = (lBits << 4) | (c - 'A' + 10);
+    else
+      return false;
+  }
+  if (lBits & 0x8000000000000000ULL)
+    lBits &= ~0x8000000000000000ULL;
+  else
+    lBits = ~lBits;
+  memcpy(&aValue, &lBits, sizeof(aValue));
+  return true;
+}
+
+
+// days since 1970-01-01 of a proleptic Gregorian date
+static long
+daysFromCivil(long aYear, unsigned aMonth, unsigned aDay)
+{
+  aYear -= aMonth <= 2;
+  long lEra = (aYear >= 0 ? aYear : aYear - 399) / 400;
+  unsigned lYearOfEra = (unsigned)(aYear - lEra * 400);
+  unsigned lDayOfYear = (153 * (aMonth + (aMonth > 2 ? -3 : 9)) + 2) / 5 + aDay - 1;
+  unsigned lDayOfEra = lYearOfEra * 365 + lYearOfEra / 4 - lYearOfEra / 100 + lDayOfYear;
+  return lEra * 146097 + (long)lDayOfEra - 719468;
+}
+
+
+static void
+civilFromDays(long aDays, long& aYear, unsigned& aMonth, unsigned& aDay)
+{
+  aDays += 719468;
+  long lEra = (aDays >= 0 ? aDays : aDays - 146096) / 146097;
+  unsigned lDayOfEra = (unsigned)(aDays - lEra * 146097);
+  unsigned lYearOfEra = (lDayOfEra - lDayOfEra / 1460 + lDayOfEra / 36524 - lDayOfEra / 146096) / 365;
+  unsigned lDayOfYear = lDayOfEra - (365 * lYearOfEra + lYearOfEra / 4 - lYearOfEra / 100);
+  unsigned lMonthIndex = (5 * lDayOfYear + 2) / 153;
+  aDay = lDayOfYear - (153 * lMonthIndex + 2) / 5 + 1;
+  aMonth = lMonthIndex < 10 ? lMonthIndex + 3 : lMonthIndex - 9;
+  aYear = (long)lYearOfEra + lEra * 400 + (aMonth <= 2);
+}
+
+
+static bool
+readDigits(const std::string& aLexical, size_t aPos, size_t aCount, unsigned& aValue)
+{
+  if (aPos + aCount > aLexical.size())
+    return false;
+  aValue = 0;
+  for (size_t i = aPos; i < aPos + aCount; ++i)
+  {
+    if (aLexical[i] < '0' || aLexical[i] > '9')
+      return false;
+    aValue = aValue * 10 + (aLexical[i] - '0');
+  }
+  return true;
+}
+
+
+// "YYYY-MM-DDThh:mm:ss" in UTC followed by the fractional seconds without
+// trailing zeros; a dateTime without timezone is taken as UTC. Only years
+// 0001 to 9999 have this form.
+static bool
+encodeDateTime(const std::string& aLexical, std::string& aResult)
+{
+  unsigned lYear, lMonth, lDay, lHour, lMinute, lSecond;
+  if (!readDigits(aLexical, 0, 4, lYear) || aLexical[4] != '-' ||
+      !readDigits(aLexical, 5, 2, lMonth) || aLexical[7] != '-' ||
+      !readDigits(aLexical, 8, 2, lDay) || aLexical[10] != 'T' ||
+      !readDigits(aLexical, 11, 2, lHour) || aLexical[13] != ':' ||
+      !readDigits(aLexical, 14, 2, lMinute) || aLexical[16] != ':' ||
+      !readDigits(aLexical, 17, 2, lSecond))
+    return false;
+
+  size_t lPos = 19;
+  std::string lFraction;
+  if (lPos < aLexical.size() && aLexical[lPos] == '.')
+  {
+    while (++lPos < aLexical.size() && aLexical[lPos] >= '0' && aLexical[lPos] <= '9')
+      lFraction += aLexical[lPos];
+  }
+  while (!lFraction.empty() && lFraction[lFraction.size() - 1] == '0')
+    lFraction.erase(lFraction.size() - 1);
+
+  long lOffset = 0;
+  if (lPos < aLexical.size() && aLexical[lPos] != 'Z')
+  {
+    unsigned lOffsetHours, lOffsetMinutes;
+    if (!readDigits(aLexical, lPos + 1, 2, lOffsetHours) ||
+        !readDigits(aLexical, lPos + 4, 2, lOffsetMinutes))
+      return false;
+    lOffset = lOffsetHours * 60 + lOffsetMinutes;
+    if (aLexical[lPos] == '-')
+      lOffset = -lOffset;
+  }
+
+  long lMinutes = (daysFromCivil(lYear, lMonth, lDay) * 24 + lHour) * 60 + lMinute - lOffset;
+  long lDays = lMinutes >= 0 ? lMinutes / 1440 : (lMinutes - 1439) / 1440;
+  lMinutes -= lDays * 1440;
+
+  long lUTCYear;
+  unsigned lUTCMonth, lUTCDay;
+  civilFromDays(lDays, lUTCYear, lUTCMonth, lUTCDay);
+  if (lUTCYear < 1 || lUTCYear > 9999)
+    return false;
+
+  char lBuffer[32];
+  snprintf(lBuffer, sizeof(lBuffer), "%04ld-%02u-%02uT%02ld:%02ld:%02u",
+           lUTCYear, lUTCMonth, lUTCDay, lMinutes / 60, lMinutes % 60, lSecond);
+  aResult += lBuffer;
+  if (!lFraction.empty())
+    aResult += "." + lFraction;
+  return true;
+}
+
+
+// "YYYY-MM-DD", the timezone of a date is not kept
+static bool
+encodeDate(const std::string& aLexical, std::string& aResult)
+{
+  unsigned lYear, lMonth, lDay;
+  if (!readDigits(aLexical, 0, 4, lYear) || aLexical[4] != '-' ||
+      !readDigits(aLexical, 5, 2, lMonth) || aLexical[7] != '-' ||
+      !readDigits(aLexical, 8, 2, lDay) || lYear == 0 ||
+      (aLexical.size() > 10 && aLexical[10] >= '0' && aLexical[10] <= '9'))
+    return false;
+  aResult += aLexical.substr(0, 10);
+  return true;
+}
+
+
+bool
+encodeKeyComponent(const Item& aComponent, bool aTyped, std::string& aResult)
+{
+  std::string lLexical = aComponent.getStringValue().str();
+  if (!aTyped)
+  {
+    aResult = lLexical;
+    return true;
+  }
+
+  store::SchemaTypeCode lType = aComponent.getTypeCode();
+  aResult = theTypedMark;
+  if (isIntegerType(lType))
+  {
+    aResult += 'i';
+    return encodeNumber(lLexical, aResult);
+  }
+  switch (lType)
+  {
+    case store::XS_DECIMAL:
+      aResult += 'd';
+      return encodeNumber(lLexical, aResult);
+    case store::XS_DOUBLE:
+    case store::XS_FLOAT:
+      aResult += 'f';
+      encodeDouble(strtod(lLexical.c_str(), 0), aResult);
+      return true;
+    case store::XS_DATETIME:
+      aResult += 't';
+      return encodeDateTime(lLexical, aResult);
+    case store::XS_DATE:
+      aResult += 'D';
+      return encodeDate(lLexical, aResult);
+    default:
+      break;
+  }
+
+  if (!lLexical.empty() && lLexical[0] == theTypedMark)
+    aResult += 's' + lLexical;
+  else
+    aResult = lLexical;
+  return true;
+}
+
+
+Item
+createKeyComponentItem(const std::string& aComponent, bool aTyped)
+{
+  ItemFactory* lFactory = NoSqlDBModule::getItemFactory();
+  if (!aTyped || aComponent.size() < 2 || aComponent[0] != theTypedMark)
+    return lFactory->createString(aComponent);
+
+  std::string lBody = aComponent.substr(2);
+  std::string lLexical;
+  double lDouble;
+  Item lResult;
+  switch (aComponent[1])
+  {
+    case 's':
+      return lFactory->createString(lBody);
+    case 'i':
+      if (decodeNumber(lBody, true, lLexical))
+        lResult = lFactory->createInteger(lLexical);
+      break;
+    case 'd':
+      if (decodeNumber(lBody, false, lLexical))
+        lResult = lFactory->createDecimal(lLexical);
+      break;
+    case 'f':
+      if (decodeDouble(lBody, lDouble))
+        lResult = lFactory->createDouble(lDouble);
+      break;
+    case 't':
+      lResult = lFactory->createDateTime(lBody + "Z");
+      break;
+    case 'D':
+      lResult = lFactory->createDate(lBody);
+      break;
+    default:
+      break;
+  }
+  // a component this codec did not write is returned as it is
+  if (lResult.isNull())
+    return lFactory->createString(aComponent);
+  return lResult;
+}
+
+
+// the type tag of a typed component, 0 for strings
+static char
+typedKeyTag(const std::string& aComponent)
+{
+  if (aComponent.size() < 2 || aComponent[0] != theTypedMark || aComponent[1] == 's')
+    return 0;
+  return aComponent[1];
+}
+
+
+static std::string
+readKeyComponent(const Item& aValue, bool aTyped, const char* aErrorName)
+{
+  std::string lComponent;
+  if ( !encodeKeyComponent(aValue, aTyped, lComponent) )
+  {
+    std::string lMessage = "Key component '" + aValue.getStringValue().str() +
+        "' has no typed key encoding.";
+    throwError(aErrorName, lMessage.c_str());
+  }
+  return lComponent;
+}
+
+
+static void
+readKeyComponents(const Item& aValues,
+                  bool aTyped,
+                  std::vector<std::string>& aComponents,
+                  const char* aErrorName,
+                  const char* aErrorMessage)
+{
+  if ( aValues.isJSONItem() &&
+       aValues.getJSONItemKind() == store::StoreConsts::jsonArray )
+  {
+    uint64_t lSize = aValues.getArraySize();
+    aComponents.reserve(lSize);
+    for (uint64_t i = 1; i<=lSize; i++)
+    {
+      Item lComponent = aValues.getArrayValue(i);
+      if ( !lComponent.isAtomic() )
+        throwError(aErrorName, aErrorMessage);
+      aComponents.push_back(readKeyComponent(lComponent, aTyped, aErrorName));
+    }
+  }
+  else if ( aValues.isAtomic() )
+  {
+    aComponents.push_back(readKeyComponent(aValues, aTyped, aErrorName));
+  }
+  else
+    throwError(aErrorName, aErrorMessage);
+}
+
+
+KeyPath
+parseKeyItem(const Item& aKeyItem, bool aTyped)
+{
+  if (!aKeyItem.isJSONItem())
+    throwError("InvalidKeyParam", "$key param must be a JSON object");
+
+  KeyPath lKey;
+
+  Item majorValues = aKeyItem.getObjectValue("major");
+  if ( majorValues.isNull() )
+    throwError("NoMajorKeyComponent", "JSON 'major' property must be specified as string or array.");
+
+  readKeyComponents(majorValues, aTyped, lKey.theMajor, "InvalidMajorKeyComponent",
+      "JSON 'major' property must be specified as string or array.");
+
+  // it's perfectly fine to have "minor" missing
+  Item minorValues = aKeyItem.getObjectValue("minor");
+  if ( !minorValues.isNull() )
+    readKeyComponents(minorValues, aTyped, lKey.theMinor, "InvalidMinorKeyComponent",
+        "JSON 'minor' property, if specified, must be a string or an array.");
+
+  return lKey;
+}
+
+
+KeyRangeSpec
+parseKeyRangeItem(const Item& aRangeItem, bool aTyped)
+{
+  if (!aRangeItem.isJSONItem())
+    throwError("NoKeyRange", "$subRange param must be a JSON object");
+
+  KeyRangeSpec lRange;
+
+  Item prefix = aRangeItem.getObjectValue("prefix");
+  Item start = aRangeItem.getObjectValue("start");
+  Item end = aRangeItem.getObjectValue("end");
+
+  if ( !prefix.isNull() && start.isNull() && end.isNull() )
+  {
+    lRange.theIsPrefix = true;
+    lRange.thePrefix = prefix.getStringValue().str();
+  }
+  else if ( !start.isNull() && !end.isNull() && prefix.isNull() )
+  {
+    lRange.theIsPrefix = false;
+    lRange.theStart = readKeyComponent(start, aTyped, "InvalidKeyRange");
+    lRange.theEnd = readKeyComponent(end, aTyped, "InvalidKeyRange");
+    if ( typedKeyTag(lRange.theStart) != typedKeyTag(lRange.theEnd) )
+      throwError("InvalidKeyRange", "'start' and 'end' must be of the same type with typed keys.");
+
+    Item startI = aRangeItem.getObjectValue("start-inclusive");
+    if ( !startI.isNull() )
+      lRange.theStartInclusive = startI.getBooleanValue();
+
+    Item endI = aRangeItem.getObjectValue("end-inclusive");
+    if ( !endI.isNull() )
+      lRange.theEndInclusive = endI.getBooleanValue();
+  }
+  else
+  {
+    throwError("InvalidKeyRange", "$subRange param must contain either 'prefix' or 'start' and 'end' properties.");
+  }
+
+  return lRange;
+}
+
+
+Item
+createKeyComponentsItem(const std::vector<std::string>& aComponents, bool aTyped)
+{
+  std::vector<Item> lItems;
+  lItems.reserve(aComponents.size());
+  for (size_t i = 0; i < aComponents.size(); ++i)
+    lItems.push_back(createKeyComponentItem(aComponents[i], aTyped));
+  return NoSqlDBModule::getItemFactory()->createJSONArray(lItems);
+}
+
+
+Item
+createKeyItem(const KeyPath& aKey, bool aTyped)
+{
+  ItemFactory* lFactory = NoSqlDBModule::getItemFactory();
+  std::vector<std::pair<Item, Item> > lPairs;
+  lPairs.push_back(std::pair<Item, Item>(
+      lFactory->createString("major"), createKeyComponentsItem(aKey.theMajor, aTyped)));
+  if (!aKey.theMinor.empty())
+    lPairs.push_back(std::pair<Item, Item>(
+        lFactory->createString("minor"), createKeyComponentsItem(aKey.theMinor, aTyped)));
+  return lFactory->createJSONObject(lPairs);
+}
+
+
+static jobject
+createJavaList(JNIEnv* env, const std::vector<std::string>& aComponents)
+{
+  //    List list = new ArrayList();
+  jclass arrayListClass = env->FindClass("java/util/ArrayList");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midALCons = env->GetMethodID(arrayListClass, "<init>", "(I)V");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midALAdd = env->GetMethodID(arrayListClass, "add", "(Ljava/lang/Object;)Z");
+  RETURN_IF_EXCEPTION(env);
+  jobject list = env->NewObject(arrayListClass, midALCons, (jint)aComponents.size());
+  RETURN_IF_EXCEPTION(env);
+
+  //    list.add("mk1");
+  for (size_t i = 0; i < aComponents.size(); ++i)
+  {
+    jstring jStrMk = env->NewStringUTF(aComponents[i].c_str());
+    RETURN_IF_EXCEPTION(env);
+    env->CallBooleanMethod(list, midALAdd, jStrMk);
+    RETURN_IF_EXCEPTION(env);
+    env->DeleteLocalRef(jStrMk);
+  }
+  return list;
+}
+
+
+jobject
+createJavaKey(JNIEnv* env, const KeyPath& aKey)
+{
+  jobject majorList = createJavaList(env, aKey.theMajor);
+  RETURN_IF_EXCEPTION(env);
+  jobject minorList = createJavaList(env, aKey.theMinor);
+  RETURN_IF_EXCEPTION(env);
+
+  //    Key k = Key.createKey(majorList, minorList);
+  jclass keyClass = env->FindClass("oracle/kv/Key");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midKeyCreate = env->GetStaticMethodID(keyClass, "createKey", "(Ljava/util/List;Ljava/util/List;)Loracle/kv/Key;");
+  RETURN_IF_EXCEPTION(env);
+  jobject k = env->CallStaticObjectMethod(keyClass, midKeyCreate, majorList, minorList);
+  RETURN_IF_EXCEPTION(env);
+
+  env->DeleteLocalRef(majorList);
+  env->DeleteLocalRef(minorList);
+  return k;
+}
+
+
+jobject
+createJavaKeyRange(JNIEnv* env, const KeyRangeSpec& aRange)
+{
+  jclass keyRangeClass = env->FindClass("oracle/kv/KeyRange");
+  RETURN_IF_EXCEPTION(env);
+
+  jobject keyRangeObj;
+  if (aRange.theIsPrefix)
+  {
+    //    KeyRange keyRange = new KeyRange(prefix);
+    jmethodID midKrCons = env->GetMethodID(keyRangeClass, "<init>", "(Ljava/lang/String;)V");
+    RETURN_IF_EXCEPTION(env);
+    jstring jStrPrefix = env->NewStringUTF(aRange.thePrefix.c_str());
+    RETURN_IF_EXCEPTION(env);
+    keyRangeObj = env->NewObject(keyRangeClass, midKrCons, jStrPrefix);
+    RETURN_IF_EXCEPTION(env);
+    env->DeleteLocalRef(jStrPrefix);
+  }
+  else
+  {
+    //    KeyRange keyRange = new KeyRange(start, startIncl, end, endIncl);
+    //    (end is null for no upper bound)
+    jmethodID midKrCons = env->GetMethodID(keyRangeClass, "<init>", "(Ljava/lang/String;ZLjava/lang/String;Z)V");
+    RETURN_IF_EXCEPTION(env);
+    jstring jStrStart = env->NewStringUTF(aRange.theStart.c_str());
+    RETURN_IF_EXCEPTION(env);
+    jstring jStrEnd = NULL;
+    if (aRange.theHasEnd)
+    {
+      jStrEnd = env->NewStringUTF(aRange.theEnd.c_str());
+      RETURN_IF_EXCEPTION(env);
+    }
+    keyRangeObj = env->NewObject(keyRangeClass, midKrCons,
+        jStrStart, (jboolean)aRange.theStartInclusive,
+        jStrEnd, (jboolean)aRange.theEndInclusive);
+    RETURN_IF_EXCEPTION(env);
+    env->DeleteLocalRef(jStrStart);
+    env->DeleteLocalRef(jStrEnd);
+  }
+  return keyRangeObj;
+}
+
+
+// Java strings are UTF-16, GetStringUTFChars would give modified UTF-8
+static void
+appendUTF8(std::string& aResult, const jchar* aChars, jsize aLength)
+{
+  for (jsize i = 0; i < aLength; ++i)
+  {
+    unsigned long c = aChars[i];
+    if (c >= 0xD800 && c < 0xDC00 && i + 1 < aLength &&
+        aChars[i + 1] >= 0xDC00 && aChars[i + 1] < 0xE000)
+    {
+      c = 0x10000 + ((c - 0xD800) << 10) + (aChars[i + 1] - 0xDC00);
+      ++i;
+    }
+
+    if (c < 0x80)
+      aResult += (char)c;
+    else if (c < 0x800)
+    {
+      aResult += (char)(0xC0 | (c >> 6));
+      aResult += (char)(0x80 | (c & 0x3F));
+    }
+    else if (c < 0x10000)
+    {
+      aResult += (char)(0xE0 | (c >> 12));
+      aResult += (char)(0x80 | ((c >> 6) & 0x3F));
+      aResult += (char)(0x80 | (c & 0x3F));
+    }
+    else
+    {
+      aResult += (char)(0xF0 | (c >> 18));
+      aResult += (char)(0x80 | ((c >> 12) & 0x3F));
+      aResult += (char)(0x80 | ((c >> 6) & 0x3F));
+      aResult += (char)(0x80 | (c & 0x3F));
+    }
+  }
+}
+
+
+static bool
+readJavaList(JNIEnv* env, jobject aList, std::vector<std::string>& aComponents)
+{
+  jclass listClass = env->FindClass("java/util/List");
+  RETURN_FALSE_IF_EXCEPTION(env);
+  jmethodID midListSize = env->GetMethodID(listClass, "size", "()I");
+  RETURN_FALSE_IF_EXCEPTION(env);
+  jmethodID midListGet = env->GetMethodID(listClass, "get", "(I)Ljava/lang/Object;");
+  RETURN_FALSE_IF_EXCEPTION(env);
+
+  jint lSize = env->CallIntMethod(aList, midListSize);
+  RETURN_FALSE_IF_EXCEPTION(env);
+
+  aComponents.resize(lSize);
+  for (jint i = 0; i < lSize; ++i)
+  {
+    jstring jStr = (jstring)env->CallObjectMethod(aList, midListGet, i);
+    RETURN_FALSE_IF_EXCEPTION(env);
+    jsize lLength = env->GetStringLength(jStr);
+    const jchar* lChars = env->GetStringChars(jStr, NULL);
+    if (!lChars) return false;
+    aComponents[i].clear();
+    appendUTF8(aComponents[i], lChars, lLength);
+    env->ReleaseStringChars(jStr, lChars);
+    env->DeleteLocalRef(jStr);
+  }
+  return true;
+}
+
+
+bool
+readJavaKey(JNIEnv* env, jobject aKey, KeyPath& aResult)
+{
+  jclass keyClass = env->FindClass("oracle/kv/Key");
+  RETURN_FALSE_IF_EXCEPTION(env);
+  jmethodID midKeyGetMajorPath = env->GetMethodID(keyClass, "getMajorPath", "()Ljava/util/List;");
+  RETURN_FALSE_IF_EXCEPTION(env);
+  jmethodID midKeyGetMinorPath = env->GetMethodID(keyClass, "getMinorPath", "()Ljava/util/List;");
+  RETURN_FALSE_IF_EXCEPTION(env);
+
+  //    List<String> majorList = key.getMajorPath();
+  jobject majorList = env->CallObjectMethod(aKey, midKeyGetMajorPath);
+  RETURN_FALSE_IF_EXCEPTION(env);
+  bool lOk = readJavaList(env, majorList, aResult.theMajor);
+  env->DeleteLocalRef(majorList);
+  if (!lOk) return false;
+
+  //    List<String> minorList = key.getMinorPath();
+  jobject minorList = env->CallObjectMethod(aKey, midKeyGetMinorPath);
+  RETURN_FALSE_IF_EXCEPTION(env);
+  lOk = readJavaList(env, minorList, aResult.theMinor);
+  env->DeleteLocalRef(minorList);
+  return lOk;
+}
+
+
+}} // namespace zorba, nosqldb
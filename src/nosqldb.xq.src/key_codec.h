@@ -0,0 +1,178 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOSQLDB_KEY_CODEC_H
+#define NOSQLDB_KEY_CODEC_H
+
+#include <string>
+#include <vector>
+
+#include <jni.h>
+
+#include <zorba/item.h>
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * The major and minor path components of a key, independent of the JVM.
+ */
+class KeyPath
+{
+  public:
+    std::vector<std::string> theMajor;
+    std::vector<std::string> theMinor;
+
+    /**
+     * The path in the "/major1/major2/-/minor1" form. Components are
+     * %-escaped so that distinct keys always give distinct strings.
+     */
+    std::string
+    toString() const;
+
+    /**
+     * Same as toString() restricted to the major path.
+     */
+    std::string
+    majorToString() const;
+};
+
+
+/**
+ * A KeyRange given either by a prefix or by start and end components.
+ */
+class KeyRangeSpec
+{
+  public:
+    bool theIsPrefix;
+    std::string thePrefix;
+    std::string theStart;
+    std::string theEnd;
+    bool theStartInclusive;
+    bool theEndInclusive;
+    // false for a start/end range without upper bound, only made by
+    // splitKeyRange()
+    bool theHasEnd;
+
+    KeyRangeSpec()
+      : theIsPrefix(true),
+        theStartInclusive(true),
+        theEndInclusive(true),
+        theHasEnd(true)
+    {}
+};
+
+
+/**
+ * The key component of the atomic aComponent. Without aTyped this is its
+ * string value. With aTyped, xs:integer, xs:decimal, xs:double, xs:dateTime
+ * and xs:date values (and their subtypes) get a form whose string order is
+ * the order of the values; strings stay as they are. Returns false if the
+ * value has no such form, e.g. a dateTime outside the years 0001 to 9999.
+ */
+bool
+encodeKeyComponent(const Item& aComponent, bool aTyped, std::string& aResult);
+
+/**
+ * The item of a key component written by encodeKeyComponent(), a typed
+ * value if aTyped and the component has a typed form, a string otherwise.
+ */
+Item
+createKeyComponentItem(const std::string& aComponent, bool aTyped);
+
+/**
+ * The JSON array of the createKeyComponentItem() of aComponents.
+ */
+Item
+createKeyComponentsItem(const std::vector<std::string>& aComponents, bool aTyped);
+
+/**
+ * Reads a JSON key object of the form
+ * { "major" : atomic or array, "minor" : atomic or array }, with the typed
+ * key encoding if aTyped.
+ * Raises nosql:InvalidKeyParam, nosql:NoMajorKeyComponent,
+ * nosql:InvalidMajorKeyComponent or nosql:InvalidMinorKeyComponent.
+ */
+KeyPath
+parseKeyItem(const Item& aKeyItem, bool aTyped = false);
+
+/**
+ * Reads a JSON sub-range object of the form { "prefix" : string } or
+ * { "start" : atomic, "end" : atomic, "start-inclusive" : boolean,
+ *   "end-inclusive" : boolean }. With aTyped, "start" and "end" use the
+ * typed key encoding and must be of the same type; "prefix" is always
+ * matched as a string.
+ * Raises nosql:NoKeyRange or nosql:InvalidKeyRange.
+ */
+KeyRangeSpec
+parseKeyRangeItem(const Item& aRangeItem, bool aTyped = false);
+
+/**
+ * The JSON key object of aKey, in the form read by parseKeyItem. The
+ * "minor" array is left out if the minor path is empty.
+ */
+Item
+createKeyItem(const KeyPath& aKey, bool aTyped = false);
+
+/**
+ * A binary form of aKey whose byte order is the key order of the store: the
+ * keys of one major path are contiguous, and a parent key sorts before and
+ * is a prefix of every key below it. Used by the native backends.
+ */
+std::string
+encodeOrderedKey(const KeyPath& aKey);
+
+/**
+ * The common start of the encodeOrderedKey() of all keys whose major path
+ * begins with the major path of aKey; the minor path of aKey is ignored.
+ */
+std::string
+encodeOrderedMajorPrefix(const KeyPath& aKey);
+
+/**
+ * Reads back a key written by encodeOrderedKey(). Returns false if the
+ * aSize bytes at aData are not such a key.
+ */
+bool
+decodeOrderedKey(const char* aData, size_t aSize, KeyPath& aResult);
+
+/**
+ * Builds the oracle.kv.Key for aKey. Returns NULL if a Java exception is
+ * pending, the caller is expected to CHECK_EXCEPTION right after.
+ */
+jobject
+createJavaKey(JNIEnv* env, const KeyPath& aKey);
+
+/**
+ * Builds the oracle.kv.KeyRange for aRange. Returns NULL if a Java exception
+ * is pending.
+ */
+jobject
+createJavaKeyRange(JNIEnv* env, const KeyRangeSpec& aRange);
+
+/**
+ * Reads the major and minor path of the oracle.kv.Key aKey into aResult.
+ * Returns false if a Java exception is pending.
+ */
+bool
+readJavaKey(JNIEnv* env, jobject aKey, KeyPath& aResult);
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_KEY_CODEC_H
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "lob_stream.h"
+#include "jvm_thread.h"
+#include "nosqldb.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/*****************************************************************************
+ JavaInputStreamBuf
+ *****************************************************************************/
+
+JavaInputStreamBuf::JavaInputStreamBuf(JavaVM* aVM, JNIEnv* env, jobject aStream,
+                                       size_t aChunkSize)
+  : theVM(aVM),
+    theStream(env->NewGlobalRef(aStream)),
+    theChunk(0),
+    theBuffer(aChunkSize)
+{
+  jclass isClass = env->FindClass("java/io/InputStream");
+  theReadMethod = env->GetMethodID(isClass, "read", "([BII)I");
+  theCloseMethod = env->GetMethodID(isClass, "close", "()V");
+
+  jbyteArray chunk = env->NewByteArray((jsize)aChunkSize);
+  theChunk = (jbyteArray)env->NewGlobalRef(chunk);
+  env->DeleteLocalRef(chunk);
+
+  setg(&theBuffer[0], &theBuffer[0], &theBuffer[0]);
+}
+
+
+JavaInputStreamBuf::~JavaInputStreamBuf()
+{
+  JVMThreadScope lScope(theVM);
+  JNIEnv* env = lScope.getEnv();
+  if (!env)
+    return;
+
+  //    stream.close();
+  env->CallVoidMethod(theStream, theCloseMethod);
+  if (env->ExceptionCheck())
+    env->ExceptionClear();
+
+  env->DeleteGlobalRef(theChunk);
+  env->DeleteGlobalRef(theStream);
+}
+
+
+JavaInputStreamBuf::int_type
+JavaInputStreamBuf::underflow()
+{
+  if (gptr() < egptr())
+    return traits_type::to_int_type(*gptr());
+
+  JVMThreadScope lScope(theVM);
+  JNIEnv* env = lScope.getEnv();
+  if (!env)
+    throwError("LOBStreamError", "Reading the LOB value from the store failed.");
+
+  //    int n = stream.read(chunk, 0, chunk.length);
+  jint n = env->CallIntMethod(theStream, theReadMethod, theChunk, 0,
+                              (jint)theBuffer.size());
+  if (env->ExceptionCheck())
+  {
+    env->ExceptionClear();
+    throwError("LOBStreamError", "Reading the LOB value from the store failed.");
+  }
+
+  if (n <= 0)
+    return traits_type::eof();
+
+  env->GetByteArrayRegion(theChunk, 0, n, (jbyte*)&theBuffer[0]);
+  setg(&theBuffer[0], &theBuffer[0], &theBuffer[0] + n);
+  return traits_type::to_int_type(*gptr());
+}
+
+
+/*****************************************************************************
+ StreamPump
+ *****************************************************************************/
+
+StreamPump::StreamPump(JavaVM* aVM, JNIEnv* env, std::istream& aStream,
+                       jobject aOutput, size_t aChunkSize)
+  : theVM(aVM),
+    theStream(aStream),
+    theOutput(env->NewGlobalRef(aOutput)),
+    theChunkSize(aChunkSize),
+    theFailed(false)
+{
+  theThread = std::thread(&StreamPump::run, this);
+}
+
+
+StreamPump::~StreamPump()
+{
+  join();
+
+  JNIEnv* env = 0;
+  theVM->GetEnv((void**)&env, JNI_VERSION_1_6);
+  if (env)
+    env->DeleteGlobalRef(theOutput);
+}
+
+
+void
+StreamPump::join()
+{
+  if (theThread.joinable())
+    theThread.join();
+}
+
+
+void
+StreamPump::run()
+{
+  JVMThreadScope lScope(theVM);
+  JNIEnv* env = lScope.getEnv();
+  if (!env)
+  {
+    theFailed = true;
+    return;
+  }
+
+  jclass osClass = env->FindClass("java/io/OutputStream");
+  jmethodID midWrite = env->GetMethodID(osClass, "write", "([BII)V");
+  jmethodID midClose = env->GetMethodID(osClass, "close", "()V");
+  jbyteArray chunk = env->NewByteArray((jsize)theChunkSize);
+  if (env->ExceptionCheck())
+  {
+    env->ExceptionClear();
+    theFailed = true;
+  }
+
+  std::vector<char> lBuffer(theChunkSize);
+  bool lComplete = false;
+
+  try
+  {
+    while (!theFailed)
+    {
+      theStream.read(&lBuffer[0], lBuffer.size());
+      std::streamsize n = theStream.gcount();
+
+      if (theStream.bad())
+      {
+        theFailed = true;
+        break;
+      }
+
+      if (n > 0)
+      {
+        //    out.write(chunk, 0, n);
+        env->SetByteArrayRegion(chunk, 0, (jsize)n, (jbyte*)&lBuffer[0]);
+        env->CallVoidMethod(theOutput, midWrite, chunk, 0, (jint)n);
+        if (env->ExceptionCheck())
+        {
+          // the reading side was closed, putLOB already gave up
+          env->ExceptionClear();
+          break;
+        }
+      }
+
+      if (theStream.eof())
+      {
+        lComplete = true;
+        break;
+      }
+    }
+  }
+  catch (...)
+  {
+    theFailed = true;
+  }
+
+  if (lComplete || theFailed)
+  {
+    //    out.close();  the reader sees the end of the LOB, a failed pump
+    //    leaves theFailed for the caller to find the value truncated
+    env->CallVoidMethod(theOutput, midClose);
+    if (env->ExceptionCheck())
+      env->ExceptionClear();
+  }
+
+  if (chunk)
+    env->DeleteLocalRef(chunk);
+}
+
+
+}} // namespace zorba, nosqldb
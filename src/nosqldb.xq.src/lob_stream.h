@@ -0,0 +1,128 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOSQLDB_LOB_STREAM_H
+#define NOSQLDB_LOB_STREAM_H
+
+#include <istream>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+#include <jni.h>
+
+
+#define NOSQLDB_LOB_CHUNK_SIZE (64 * 1024)
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * std::streambuf over a java.io.InputStream. Data is pulled one chunk at a
+ * time through a single reused byte[], so only one chunk is ever held in
+ * native memory. Zorba may read it after the module function returned and
+ * on another thread, so every read gets the JNIEnv of the reading thread.
+ */
+class JavaInputStreamBuf : public std::streambuf
+{
+  private:
+    JavaVM* theVM;
+    jobject theStream;
+    jbyteArray theChunk;
+    jmethodID theReadMethod;
+    jmethodID theCloseMethod;
+    std::vector<char> theBuffer;
+
+  protected:
+    virtual int_type underflow();
+
+  public:
+    JavaInputStreamBuf(JavaVM* aVM, JNIEnv* env, jobject aStream, size_t aChunkSize);
+    ~JavaInputStreamBuf();
+};
+
+
+/**
+ * The istream handed to ItemFactory::createStreamableBase64Binary for
+ * nosql:get-lob. Closes the Java stream when Zorba releases it.
+ */
+class JavaInputStream : public std::istream
+{
+  private:
+    JavaInputStreamBuf theBuf;
+
+  public:
+    JavaInputStream(JavaVM* aVM, JNIEnv* env, jobject aStream,
+                    size_t aChunkSize = NOSQLDB_LOB_CHUNK_SIZE)
+      : std::istream(0),
+        theBuf(aVM, env, aStream, aChunkSize)
+    {
+      rdbuf(&theBuf);
+    }
+
+    static void
+    release(std::istream* aStream)
+    { delete aStream; }
+};
+
+
+/**
+ * Copies a native std::istream into a java.io.PipedOutputStream on a JVM
+ * attached thread, while the calling thread hands the connected
+ * PipedInputStream to KVStore.putLOB.
+ *
+ * If the native stream fails, the pipe is closed as if the stream had
+ * ended and failed() is set; the caller then removes the truncated value
+ * that putLOB stored.
+ */
+class StreamPump
+{
+  private:
+    JavaVM* theVM;
+    std::istream& theStream;
+    jobject theOutput;
+    size_t theChunkSize;
+    bool theFailed;
+    std::thread theThread;
+
+    void
+    run();
+
+  public:
+    StreamPump(JavaVM* aVM, JNIEnv* env, std::istream& aStream,
+               jobject aOutput,
+               size_t aChunkSize = NOSQLDB_LOB_CHUNK_SIZE);
+
+    ~StreamPump();
+
+    void
+    join();
+
+    bool
+    failed() const
+    { return theFailed; }
+
+  private:
+    StreamPump(const StreamPump&);
+    StreamPump& operator=(const StreamPump&);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_LOB_STREAM_H
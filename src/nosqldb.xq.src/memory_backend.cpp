@@ -0,0 +1,165 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "memory_backend.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+std::shared_ptr<MemoryBackend>
+MemoryBackend::open(const std::string& aName)
+{
+  static std::mutex theStoresMutex;
+  static std::map<std::string, std::shared_ptr<MemoryBackend> > theStores;
+
+  std::lock_guard<std::mutex> lLock(theStoresMutex);
+  std::shared_ptr<MemoryBackend>& lStore = theStores[aName];
+  if (!lStore)
+    lStore = std::make_shared<MemoryBackend>();
+  return lStore;
+}
+
+
+long long
+MemoryBackend::put(const KeyPath& aKey, const std::string& aValue, PhaseClock& aClock)
+{
+  std::string lEncoded = encodeOrderedKey(aKey);
+
+  std::lock_guard<std::mutex> lLock(theMutex);
+  Entry& lEntry = theEntries[lEncoded];
+  lEntry.theKey = aKey;
+  lEntry.theValue = aValue;
+  lEntry.theVersion = ++theLastVersion;
+  aClock.lap(CallProfile::STORE);
+  return lEntry.theVersion;
+}
+
+
+bool
+MemoryBackend::get(const KeyPath& aKey, RecordHandler& aHandler, PhaseClock& aClock)
+{
+  std::string lEncoded = encodeOrderedKey(aKey);
+
+  std::lock_guard<std::mutex> lLock(theMutex);
+  Entries_t::const_iterator lIter = theEntries.find(lEncoded);
+  aClock.lap(CallProfile::STORE);
+  if (lIter == theEntries.end())
+    return false;
+
+  const Entry& lEntry = lIter->second;
+  aHandler.record(lEntry.theKey, lEntry.theValue.data(), lEntry.theValue.size(),
+                  lEntry.theVersion);
+  return true;
+}
+
+
+bool
+MemoryBackend::remove(const KeyPath& aKey, PhaseClock& aClock)
+{
+  std::string lEncoded = encodeOrderedKey(aKey);
+
+  std::lock_guard<std::mutex> lLock(theMutex);
+  bool lRemoved = theEntries.erase(lEncoded) > 0;
+  aClock.lap(CallProfile::STORE);
+  return lRemoved;
+}
+
+
+void
+MemoryBackend::select(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                      Depth aDepth, std::vector<Entries_t::iterator>& aResult)
+{
+  RecordFilter lFilter(aParentKey, aRange, aDepth);
+  const std::string& lPrefix = lFilter.thePrefix;
+
+  if (lFilter.theParentApart)
+  {
+    Entries_t::iterator lParent = theEntries.find(lPrefix);
+    if (lParent != theEntries.end())
+      aResult.push_back(lParent);
+  }
+
+  for (Entries_t::iterator lIter = theEntries.lower_bound(lFilter.theFirst);
+       lIter != theEntries.end() &&
+       lIter->first.compare(0, lPrefix.size(), lPrefix) == 0; ++lIter)
+  {
+    RecordFilter::Verdict lVerdict = lFilter.check(lIter->second.theKey);
+    if (lVerdict == RecordFilter::STOP)
+      break;
+    if (lVerdict == RecordFilter::SELECT)
+      aResult.push_back(lIter);
+  }
+}
+
+
+void
+MemoryBackend::multiGet(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                        Depth aDepth, Direction aDirection,
+                        RecordHandler& aHandler, PhaseClock& aClock)
+{
+  std::lock_guard<std::mutex> lLock(theMutex);
+  std::vector<Entries_t::iterator> lSelected;
+  select(aParentKey, aRange, aDepth, lSelected);
+  aClock.lap(CallProfile::STORE);
+
+  for (size_t i = 0; i < lSelected.size(); ++i)
+  {
+    const Entry& lEntry =
+        lSelected[aDirection == REVERSE ? lSelected.size() - 1 - i : i]->second;
+    aClock.countRecord();
+    aHandler.record(lEntry.theKey, lEntry.theValue.data(), lEntry.theValue.size(),
+                    lEntry.theVersion);
+  }
+}
+
+
+size_t
+MemoryBackend::multiRemove(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                           Depth aDepth, PhaseClock& aClock)
+{
+  std::lock_guard<std::mutex> lLock(theMutex);
+  std::vector<Entries_t::iterator> lSelected;
+  select(aParentKey, aRange, aDepth, lSelected);
+
+  for (size_t i = 0; i < lSelected.size(); ++i)
+    theEntries.erase(lSelected[i]);
+  aClock.lap(CallProfile::STORE);
+  return lSelected.size();
+}
+
+
+void
+MemoryBackend::scan(const KeyPath* aParentKey, RecordHandler& aHandler, PhaseClock& aClock)
+{
+  std::string lPrefix = aParentKey ? encodeOrderedMajorPrefix(*aParentKey) : std::string();
+
+  std::lock_guard<std::mutex> lLock(theMutex);
+  for (Entries_t::const_iterator lIter = theEntries.lower_bound(lPrefix);
+       lIter != theEntries.end() &&
+       lIter->first.compare(0, lPrefix.size(), lPrefix) == 0; ++lIter)
+  {
+    const Entry& lEntry = lIter->second;
+    aClock.countRecord();
+    aHandler.record(lEntry.theKey, lEntry.theValue.data(), lEntry.theValue.size(),
+                    lEntry.theVersion);
+  }
+  aClock.lap(CallProfile::STORE);
+}
+
+
+}} // namespace zorba, nosqldb
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOSQLDB_MEMORY_BACKEND_H
+#define NOSQLDB_MEMORY_BACKEND_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "backend.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Native in-memory store, "backend" : "memory". Records are kept in one
+ * ordered map over encodeOrderedKey(), so a multi-get is a single range
+ * scan. Stores are shared by name between the connections of the process
+ * and live until it exits; nothing is persisted.
+ */
+class MemoryBackend : public Backend
+{
+  private:
+    class Entry
+    {
+      public:
+        KeyPath theKey;
+        std::string theValue;
+        long long theVersion;
+    };
+
+    typedef std::map<std::string, Entry> Entries_t;
+
+    std::mutex theMutex;
+    Entries_t theEntries;
+    long long theLastVersion;
+
+    // the records of a multi-get in key order, theMutex must be held
+    void
+    select(const KeyPath& aParentKey, const KeyRangeSpec* aRange, Depth aDepth,
+           std::vector<Entries_t::iterator>& aResult);
+
+  public:
+    MemoryBackend()
+      : theLastVersion(0)
+    {}
+
+    /**
+     * The store named aName, created empty on first use.
+     */
+    static std::shared_ptr<MemoryBackend>
+    open(const std::string& aName);
+
+    virtual long long
+    put(const KeyPath& aKey, const std::string& aValue, PhaseClock& aClock);
+
+    virtual bool
+    get(const KeyPath& aKey, RecordHandler& aHandler, PhaseClock& aClock);
+
+    virtual bool
+    remove(const KeyPath& aKey, PhaseClock& aClock);
+
+    virtual void
+    multiGet(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+             Depth aDepth, Direction aDirection,
+             RecordHandler& aHandler, PhaseClock& aClock);
+
+    virtual size_t
+    multiRemove(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                Depth aDepth, PhaseClock& aClock);
+
+    virtual void
+    scan(const KeyPath* aParentKey, RecordHandler& aHandler, PhaseClock& aClock);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_MEMORY_BACKEND_H
@@ -14,9 +14,24 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <memory>
+#include <set>
 #include <sstream>
 
 #include "nosqldb.h"
+#include "key_codec.h"
+#include "lob_stream.h"
+#include "bulk_transfer.h"
+#include "options.h"
+#include "purge.h"
+#include "java_exception.h"
+#include "memory_backend.h"
+#include "sharded_backend.h"
+#include "snapshot_backend.h"
+#include "secondary_index.h"
+#include "json_lines.h"
+#include "throttle.h"
 
 namespace zorba
 {
@@ -64,6 +79,522 @@ throwError(const char *aLocalName, const char* aErrorMessage)
   throw USER_EXCEPTION(errQName, errDescription);
 }
 
+// { "value" : base64Binary, "version" : xs:long }
+Item
+createValueVersionItem(const std::string& aValue, jlong aVersion)
+{
+  return createValueVersionItem(aValue.data(), aValue.size(), aVersion);
+}
+
+Item
+createValueVersionItem(const char* aValue, size_t aSize, jlong aVersion)
+{
+  Item val( NoSqlDBModule::getItemFactory()->createBase64Binary(aValue, aSize, false) );
+  Item vers = NoSqlDBModule::getItemFactory()->createLong(aVersion);
+
+  std::vector<std::pair<Item, Item> > pairs;
+  pairs.reserve(2);
+  pairs.push_back(std::pair<Item, Item>(
+    NoSqlDBModule::getItemFactory()->createString(String("value")), val));
+  pairs.push_back(std::pair<Item, Item>(
+    NoSqlDBModule::getItemFactory()->createString(String("version")), vers));
+
+  return NoSqlDBModule::getItemFactory()->createJSONObject(pairs);
+}
+
+// { "records" : n, "bytes" : n, "seconds" : d,
+//   "records-per-second" : d, "bytes-per-second" : d }
+static Item
+createTransferStatsItem(const TransferStats& aStats)
+{
+  ItemFactory* lFactory = NoSqlDBModule::getItemFactory();
+  double lSeconds = aStats.theSeconds > 0 ? aStats.theSeconds : 1e-9;
+
+  std::vector<std::pair<Item, Item> > pairs;
+  pairs.reserve(5);
+  pairs.push_back(std::pair<Item, Item>(lFactory->createString("records"),
+      lFactory->createInteger((long long)aStats.theRecords)));
+  pairs.push_back(std::pair<Item, Item>(lFactory->createString("bytes"),
+      lFactory->createInteger((long long)aStats.theBytes)));
+  pairs.push_back(std::pair<Item, Item>(lFactory->createString("seconds"),
+      lFactory->createDouble(aStats.theSeconds)));
+  pairs.push_back(std::pair<Item, Item>(lFactory->createString("records-per-second"),
+      lFactory->createDouble(aStats.theRecords / lSeconds)));
+  pairs.push_back(std::pair<Item, Item>(lFactory->createString("bytes-per-second"),
+      lFactory->createDouble(aStats.theBytes / lSeconds)));
+
+  return lFactory->createJSONObject(pairs);
+}
+
+
+// the connection of param 0 $db
+static Connection*
+getConnectionArgument(const ExternalFunction::Arguments_t& aArgs,
+                      const zorba::DynamicContext* aDynamicContext)
+{
+  String lInstanceID = getOneStringArgument(aArgs, 0);
+
+  InstanceMap* lInstanceMap;
+  if (!(lInstanceMap = dynamic_cast<InstanceMap*>(aDynamicContext->getExternalFunctionParameter("nosqldbInstanceMap"))))
+  {
+    throwError("NoInstanceMatch", "Not a NoSQL DB identifier.");
+  }
+
+  Connection* lConnection = lInstanceMap->getConnection(lInstanceID);
+  if (!lConnection)
+  {
+    throwError("NoInstanceMatch", "No instance of NoSQL DB with the given identifier was found.");
+  }
+  return lConnection;
+}
+
+// 0 for native backends, which must run without a JVM
+static JNIEnv*
+getEnv(Connection* aConnection, const zorba::StaticContext* aStaticContext)
+{
+  if (!aConnection->getStore())
+    return 0;
+  return zorba::jvm::JavaVMSingleton::getInstance(aStaticContext)->getEnv();
+}
+
+// for the functions only the "kvstore" backend provides, they talk to a
+// single store
+static void
+requireKVStore(Connection* aConnection)
+{
+  if (!aConnection->getStore())
+    throwError("UnsupportedOperation", "This function requires a connection with the \"kvstore\" backend.");
+  if (aConnection->isSharded())
+    throwError("UnsupportedOperation", "This function is not available on a connection with 'shards'.");
+}
+
+
+/*****************************************************************************
+ Record handlers
+ *****************************************************************************/
+
+namespace
+{
+
+// the { "value" : .., "version" : .. } of a get
+class ValueVersionHandler : public RecordHandler
+{
+  public:
+    Item theResult;
+    size_t theBytes;
+
+    ValueVersionHandler()
+      : theBytes(0)
+    {}
+
+    virtual void
+    record(const KeyPath&, const char* aValue, size_t aSize, long long aVersion)
+    {
+      theResult = createValueVersionItem(aValue, aSize, aVersion);
+      theBytes = aSize;
+    }
+};
+
+
+// one { "key" : { "major" : [..], "minor" : [..] }, "value" : ..,
+// "version" : .. } per record of a multi-get
+class RecordItemsHandler : public RecordHandler
+{
+  private:
+    std::vector<Item>& theItems;
+    Statistics& theStatistics;
+    TraceScope& theTrace;
+    PhaseClock& theClock;
+    bool theTypedKeys;
+    Admission* theAdmission;
+
+  public:
+    // the bytes read are charged to aAdmission if it is given
+    RecordItemsHandler(std::vector<Item>& aItems, Statistics& aStatistics,
+                       TraceScope& aTrace, PhaseClock& aClock, bool aTypedKeys,
+                       Admission* aAdmission = 0)
+      : theItems(aItems),
+        theStatistics(aStatistics),
+        theTrace(aTrace),
+        theClock(aClock),
+        theTypedKeys(aTypedKeys),
+        theAdmission(aAdmission)
+    {}
+
+    virtual void
+    record(const KeyPath& aKey, const char* aValue, size_t aSize, long long aVersion)
+    {
+      ItemFactory* lFactory = NoSqlDBModule::getItemFactory();
+      ++theStatistics.theRecordsScanned;
+      theStatistics.theBytesRead += aSize;
+      theTrace.addBytes(aSize);
+      if (theAdmission)
+        theAdmission->addBytes(aSize);
+
+      std::vector<std::pair<Item, Item> > keyPairs;
+      keyPairs.reserve(2);
+      keyPairs.push_back(std::pair<Item, Item>(
+        lFactory->createString(String("major")), createKeyComponentsItem(aKey.theMajor, theTypedKeys)));
+      keyPairs.push_back(std::pair<Item, Item>(
+        lFactory->createString(String("minor")), createKeyComponentsItem(aKey.theMinor, theTypedKeys)));
+
+      std::vector<std::pair<Item, Item> > pairs;
+      pairs.reserve(3);
+      pairs.push_back(std::pair<Item, Item>(
+        lFactory->createString(String("key")), lFactory->createJSONObject(keyPairs)));
+      pairs.push_back(std::pair<Item, Item>(
+        lFactory->createString(String("value")), lFactory->createBase64Binary(aValue, aSize, false)));
+      pairs.push_back(std::pair<Item, Item>(
+        lFactory->createString(String("version")), lFactory->createLong(aVersion)));
+
+      theItems.push_back(lFactory->createJSONObject(pairs));
+      theClock.lap(CallProfile::ITEMS);
+    }
+};
+
+
+// the records of a multi-get as items made when they are asked for. The
+// sequence owns the cursor, and with it the open iterators of the store,
+// and the trace record of the call, which is submitted with the number of
+// records read once the sequence is dropped. The bytes read are charged to
+// the rate buckets of the call as they are read.
+class CursorItemSequence : public ItemSequence
+{
+  private:
+    class CursorIterator : public Iterator
+    {
+      private:
+        CursorItemSequence& theSequence;
+        bool theOpen;
+
+      public:
+        CursorIterator(CursorItemSequence& aSequence)
+          : theSequence(aSequence),
+            theOpen(false)
+        {}
+
+        virtual void
+        open()
+        { theOpen = true; }
+
+        virtual bool
+        next(Item& aItem)
+        { return theSequence.next(aItem); }
+
+        virtual void
+        close()
+        { theOpen = false; }
+
+        virtual bool
+        isOpen() const
+        { return theOpen; }
+    };
+
+    JNIEnv* theEnv;
+    std::unique_ptr<RecordCursor> theCursor;
+    std::unique_ptr<TraceScope> theTrace;
+    std::shared_ptr<RateBuckets> theBuckets;
+    PhaseClock theClock;
+    std::vector<Item> theItems;
+    RecordItemsHandler theHandler;
+    Record theRecord;
+    uint64_t theCount;
+
+  public:
+    CursorItemSequence(JNIEnv* env, std::unique_ptr<RecordCursor> aCursor,
+                       std::unique_ptr<TraceScope> aTrace, Statistics& aStatistics,
+                       const std::shared_ptr<RateBuckets>& aBuckets,
+                       Statistics::Operation aOperation,
+                       bool aTypedKeys)
+      : theEnv(env),
+        theCursor(std::move(aCursor)),
+        theTrace(std::move(aTrace)),
+        theBuckets(aBuckets),
+        theClock(0, aOperation),
+        theHandler(theItems, aStatistics, *theTrace, theClock, aTypedKeys),
+        theCount(0)
+    {}
+
+    virtual Iterator_t
+    getIterator()
+    { return new CursorIterator(*this); }
+
+    bool
+    next(Item& aItem)
+    {
+      try
+      {
+        // the iterators are closed as soon as the end is reached
+        if (!theCursor)
+          return false;
+        if (!theCursor->next(theRecord, theClock))
+        {
+          theCursor.reset();
+          return false;
+        }
+      }
+      catch (JavaException&)
+      {
+        theCursor.reset();
+        throwJavaException(theEnv, theEnv->ExceptionOccurred());
+      }
+
+      theHandler.record(theRecord.theKey, theRecord.theValue.data(), theRecord.theValue.size(),
+                        theRecord.theVersion);
+      aItem = theItems.back();
+      theItems.clear();
+      theTrace->setResults(++theCount);
+      theBuckets->theBytes.take((double)theRecord.theValue.size());
+      return true;
+    }
+};
+
+
+// passes the first aLimit records of a multi-get page on to aHandler and
+// notes whether more follow; the records outside the $sub-range end the
+// page when the range of the scan is wider
+class PageHandler : public RecordHandler
+{
+  private:
+    RecordHandler& theHandler;
+    size_t theLimit;
+    size_t theLevel;
+    const KeyRangeSpec& theRange;
+    size_t theCount;
+    bool theMore;
+    bool theOutside;
+
+  public:
+    KeyPath theLast;
+
+    PageHandler(RecordHandler& aHandler, size_t aLimit, const KeyPath& aParentKey,
+                const KeyRangeSpec& aRange)
+      : theHandler(aHandler),
+        theLimit(aLimit),
+        theLevel(aParentKey.theMinor.size()),
+        theRange(aRange),
+        theCount(0),
+        theMore(false),
+        theOutside(false)
+    {}
+
+    // the records a scan still has to read, one more tells whether the
+    // page is the last one
+    size_t
+    left() const
+    { return theLimit - theCount + 1; }
+
+    bool
+    hasMore() const
+    { return theMore; }
+
+    virtual bool
+    done() const
+    { return theMore || theOutside; }
+
+    virtual void
+    record(const KeyPath& aKey, const char* aValue, size_t aSize, long long aVersion)
+    {
+      if (done())
+        return;
+
+      // the range is contiguous, the first record outside ends the page
+      if (aKey.theMinor.size() > theLevel &&
+          compareToRange(aKey.theMinor[theLevel], theRange) != 0)
+      {
+        theOutside = true;
+        return;
+      }
+
+      if (theCount == theLimit)
+      {
+        theMore = true;
+        return;
+      }
+      ++theCount;
+      theLast = aKey;
+      theHandler.record(aKey, aValue, aSize, aVersion);
+    }
+};
+
+
+// copies the value of a get
+class ValueHandler : public RecordHandler
+{
+  public:
+    std::string& theValue;
+
+    ValueHandler(std::string& aValue)
+      : theValue(aValue)
+    {}
+
+    virtual void
+    record(const KeyPath&, const char* aValue, size_t aSize, long long)
+    {
+      theValue.assign(aValue, aSize);
+    }
+};
+
+
+// the primary keys of the index entries of a lookup, once each
+class PrimaryKeysHandler : public RecordHandler
+{
+  private:
+    std::set<std::string> theSeen;
+
+  public:
+    std::vector<KeyPath> theKeys;
+
+    virtual void
+    record(const KeyPath&, const char* aValue, size_t aSize, long long)
+    {
+      KeyPath lKey;
+      if (theSeen.insert(std::string(aValue, aSize)).second &&
+          decodeOrderedKey(aValue, aSize, lKey))
+        theKeys.push_back(lKey);
+    }
+};
+
+
+// passes on the records whose indexed field is still in the range of the
+// lookup, entries left behind by writes that bypass the index are skipped
+class IndexMatchHandler : public RecordHandler
+{
+  private:
+    const SecondaryIndexes::Index& theIndex;
+    const KeyRangeSpec& theRange;
+    RecordHandler& theHandler;
+    std::string theDocument;
+    std::string theFieldValue;
+
+  public:
+    IndexMatchHandler(const SecondaryIndexes::Index& aIndex,
+                      const KeyRangeSpec& aRange,
+                      RecordHandler& aHandler)
+      : theIndex(aIndex),
+        theRange(aRange),
+        theHandler(aHandler)
+    {}
+
+    virtual void
+    record(const KeyPath& aKey, const char* aValue, size_t aSize, long long aVersion)
+    {
+      theDocument.assign(aValue, aSize);
+      if (readJSONField(theDocument, theIndex.theField, theFieldValue) &&
+          compareToRange(theFieldValue, theRange) == 0)
+        theHandler.record(aKey, aValue, aSize, aVersion);
+    }
+};
+
+
+// Keeps the secondary indexes of the connection in step with a put or
+// remove of aKey. The entries for the new value are written before the
+// record and the stale ones deleted after it, so that a lookup never misses
+// a record; it skips entries whose record no longer matches instead.
+class IndexUpdate
+{
+  private:
+    Connection* theConnection;
+    std::string thePrimaryKey;
+    std::vector<KeyPath> theAdded;
+    std::vector<KeyPath> theRemoved;
+
+    // the value of aKey as the connection sees it, buffered writes included
+    bool
+    readCurrentValue(const KeyPath& aKey, std::string& aValue, PhaseClock& aClock)
+    {
+      if (WriteBuffer* lWriteBuffer = theConnection->getWriteBuffer())
+      {
+        WriteBuffer::Lookup lLookup = lWriteBuffer->lookup(aKey, aValue);
+        if (lLookup != WriteBuffer::NOT_BUFFERED)
+          return lLookup == WriteBuffer::BUFFERED_PUT;
+      }
+      ValueHandler lHandler(aValue);
+      return theConnection->getBackend().get(aKey, lHandler, aClock);
+    }
+
+    // entries go through the write buffer if there is one, where the entries
+    // of one index share a batch
+    void
+    write(const std::vector<KeyPath>& aEntries, bool aRemove, PhaseClock& aClock)
+    {
+      WriteBuffer* lWriteBuffer = theConnection->getWriteBuffer();
+      for (size_t i = 0; i < aEntries.size(); ++i)
+      {
+        if (lWriteBuffer && aRemove)
+          lWriteBuffer->remove(aEntries[i]);
+        else if (lWriteBuffer)
+          lWriteBuffer->put(aEntries[i], thePrimaryKey);
+        else if (aRemove)
+          theConnection->getBackend().remove(aEntries[i], aClock);
+        else
+          theConnection->getBackend().put(aEntries[i], thePrimaryKey, aClock);
+      }
+    }
+
+  public:
+    /**
+     * aNewValue is 0 for a remove. Writes the new entries.
+     */
+    IndexUpdate(Connection* aConnection, const KeyPath& aKey,
+                const std::string* aNewValue, PhaseClock& aClock)
+      : theConnection(aConnection)
+    {
+      SecondaryIndexes* lIndexes = aConnection->getIndexes();
+      if (!lIndexes)
+        return;
+
+      std::string lOldValue;
+      bool lHasOld = readCurrentValue(aKey, lOldValue, aClock);
+      lIndexes->diff(aKey, lHasOld ? &lOldValue : 0, aNewValue, theAdded, theRemoved);
+      thePrimaryKey = encodeOrderedKey(aKey);
+      write(theAdded, false, aClock);
+    }
+
+    /**
+     * Deletes the stale entries, call once the record is written.
+     */
+    void
+    finish(PhaseClock& aClock)
+    {
+      write(theRemoved, true, aClock);
+    }
+};
+
+}
+
+
+/*****************************************************************************
+ Secondary index lookups
+ *****************************************************************************/
+
+static const SecondaryIndexes::Index&
+getIndex(Connection* aConnection, const std::string& aName)
+{
+  const SecondaryIndexes::Index* lIndex = 0;
+  if (aConnection->getIndexes())
+    lIndex = aConnection->getIndexes()->find(aName);
+  if (!lIndex)
+    throwError("UnknownIndex", ("No index '" + aName + "' is declared on the connection.").c_str());
+  return *lIndex;
+}
+
+// the records whose aIndex field lies in aRange, in the order of the field;
+// the entries are read with one multi-get, the records with getMany()
+static void
+readIndex(Connection* aConnection, const SecondaryIndexes::Index& aIndex,
+          const KeyRangeSpec& aRange, RecordHandler& aHandler, PhaseClock& aClock)
+{
+  Backend& lBackend = aConnection->getBackend();
+
+  PrimaryKeysHandler lKeys;
+  lBackend.multiGet(SecondaryIndexes::parentKey(aIndex), &aRange, DESCENDANTS_ONLY,
+                    FORWARD, lKeys, aClock);
+
+  IndexMatchHandler lMatches(aIndex, aRange, aHandler);
+  lBackend.getMany(lKeys.theKeys, aConnection->getFetchParallelism(), lMatches, aClock);
+}
+
 
 /*****************************************************************************
  Method implementations
@@ -95,10 +626,70 @@ ExternalFunction* NoSqlDBModule::getExternalFunction(const String& localName)
   {
       return multiGet;
   }
+  else if (localName == "multi-get-many")
+  {
+      return multiGetMany;
+  }
   else if (localName == "multi-remove")
   {
       return multiDel;
   }
+  else if (localName == "put-lob")
+  {
+      return putLOB;
+  }
+  else if (localName == "get-lob")
+  {
+      return getLOB;
+  }
+  else if (localName == "flush")
+  {
+      return flush;
+  }
+  else if (localName == "import")
+  {
+      return bulkImport;
+  }
+  else if (localName == "export")
+  {
+      return bulkExport;
+  }
+  else if (localName == "purge")
+  {
+      return purge;
+  }
+  else if (localName == "snapshot")
+  {
+      return snapshot;
+  }
+  else if (localName == "rebalance")
+  {
+      return rebalance;
+  }
+  else if (localName == "index-lookup")
+  {
+      return indexLookup;
+  }
+  else if (localName == "index-range")
+  {
+      return indexRange;
+  }
+  else if (localName == "statistics")
+  {
+      return statistics;
+  }
+  else if (localName == "profile")
+  {
+      return profile;
+  }
+  else if (localName == "last-profile")
+  {
+      return lastProfile;
+  }
+  else if (localName == "hot-keys")
+  {
+      return hotKeys;
+  }
 
   return 0;
 }
@@ -106,6 +697,91 @@ ExternalFunction* NoSqlDBModule::getExternalFunction(const String& localName)
 
 // connect code
 
+// stores aConnection in the dynamic context, returns its $db identifier
+static ItemSequence_t
+registerConnection(const zorba::DynamicContext* aDynamicContext, JNIEnv* env,
+                   std::unique_ptr<Connection>& aConnection)
+{
+  uuid lUUID;
+  uuid::create(&lUUID);
+  std::stringstream lStream;
+  lStream << lUUID;
+  String lStrUUID = lStream.str();
+
+  InstanceMap* lInstanceMap;
+  DynamicContext* lDctx = const_cast<DynamicContext*>(aDynamicContext);
+  if (!(lInstanceMap = dynamic_cast<InstanceMap*>(
+            lDctx->getExternalFunctionParameter("nosqldbInstanceMap"))))
+  {
+    lInstanceMap = new InstanceMap(env);
+    lDctx->addExternalFunctionParameter("nosqldbInstanceMap", lInstanceMap);
+  }
+  if (env)
+    lInstanceMap->setEnv(env);
+  lInstanceMap->storeInstance(lStrUUID, aConnection.release());
+
+  return ItemSequence_t(new SingletonItemSequence(
+      NoSqlDBModule::getItemFactory()->createAnyURI(lStrUUID)));
+}
+
+
+// opens aCount handles of the store aStoreName, appends global references
+// to them to aStores; raises JavaException with the Java exception pending
+static void
+openStore(JNIEnv* env, const std::string& aStoreName,
+          const std::vector<std::string>& aHelperHostPorts, size_t aCount,
+          std::vector<jobject>& aStores)
+{
+  jthrowable lException = 0;
+
+  jstring jStrParam1 = env->NewStringUTF(aStoreName.c_str());
+  CHECK_EXCEPTION(env);
+
+  // String[] hhosts = {"n1.example.org:5088", "n2.example.org:4129"};
+  jclass strCls = env->FindClass("Ljava/lang/String;");
+  CHECK_EXCEPTION(env);
+  jobjectArray jStrArray = env->NewObjectArray(aHelperHostPorts.size(), strCls, NULL);
+  CHECK_EXCEPTION(env);
+
+  for ( jsize i = 0; i<(jsize)aHelperHostPorts.size(); i++)
+  {
+    jstring jHostPort = env->NewStringUTF(aHelperHostPorts[i].c_str());
+    CHECK_EXCEPTION(env);
+    env->SetObjectArrayElement(jStrArray, i, jHostPort);
+    CHECK_EXCEPTION(env);
+    env->DeleteLocalRef(jHostPort);
+    CHECK_EXCEPTION(env);
+  }
+
+  // oracle.kv.KVStoreConfig kvsConfigObj = new oracle.kv.KVStoreConfig("storeName", String[] hhosts);
+  jclass kvsConfigClass = env->FindClass("oracle/kv/KVStoreConfig");
+  CHECK_EXCEPTION(env);
+  jmethodID kvsConfigCons = env->GetMethodID(kvsConfigClass, "<init>", "(Ljava/lang/String;[Ljava/lang/String;)V");
+  CHECK_EXCEPTION(env);
+  jobject kvsConfigObj = env->NewObject(kvsConfigClass, kvsConfigCons, jStrParam1, jStrArray);
+  CHECK_EXCEPTION(env);
+
+  //KVStore kvstore = KVStoreFactory.getStore(kvsConfigObj);
+  jclass kvsFactoryClass = env->FindClass("oracle/kv/KVStoreFactory");
+  CHECK_EXCEPTION(env);
+  jmethodID midGetStore = env->GetStaticMethodID(kvsFactoryClass, "getStore", "(Loracle/kv/KVStoreConfig;)Loracle/kv/KVStore;");
+  CHECK_EXCEPTION(env);
+
+  // every getStore() gives a handle with a request dispatcher of its own,
+  // one per "store-handles"
+  for (size_t i = 0; i < aCount; ++i)
+  {
+    jobject kvsObject = env->CallStaticObjectMethod(kvsFactoryClass, midGetStore, kvsConfigObj);
+    CHECK_EXCEPTION(env);
+    jobject kvsObjRef = env->NewGlobalRef(kvsObject);
+    CHECK_EXCEPTION(env);
+    env->DeleteLocalRef(kvsObject);
+    CHECK_EXCEPTION(env);
+    aStores.push_back(kvsObjRef);
+  }
+}
+
+
 ItemSequence_t
 ConnectFunction::evaluate(const ExternalFunction::Arguments_t& args,
                            const zorba::StaticContext* aStaticContext,
@@ -116,6 +792,25 @@ ConnectFunction::evaluate(const ExternalFunction::Arguments_t& args,
 
   try
   {
+    // read input param 2: $options as object(), the per connection settings
+    std::unique_ptr<Connection> lConnection(new Connection(getOneItemArgument(args, 2)));
+    const std::vector<ShardOption>& lShards = lConnection->getShards();
+
+    if (lConnection->getBackendKind() == Connection::MEMORY)
+    {
+      // read input param 0: $store-name as xs:string, names the native store
+      lConnection->setBackend(0, MemoryBackend::open(getOneStringArgument(args, 0).str()));
+      for (size_t i = 1; i < lShards.size(); ++i)
+        lConnection->setBackend(i, MemoryBackend::open(lShards[i].theStoreName));
+      return registerConnection(aDynamincContext, 0, lConnection);
+    }
+
+    if (lConnection->getBackendKind() == Connection::SNAPSHOT)
+    {
+      lConnection->setBackend(0, std::make_shared<SnapshotBackend>(lConnection->getSnapshotPath()));
+      return registerConnection(aDynamincContext, 0, lConnection);
+    }
+
     env = zorba::jvm::JavaVMSingleton::getInstance(aStaticContext)->getEnv();
     Item item;
     std::ostringstream os;
@@ -132,13 +827,11 @@ ConnectFunction::evaluate(const ExternalFunction::Arguments_t& args,
     Serializer_t lSerializer = Serializer::createSerializer(lOptions);
     lSerializer->serialize(&lSequence, os);
     std::string p0String = os.str();
-    const char* p0Str = p0String.c_str();
-    jstring jStrParam1 = env->NewStringUTF(p0Str);
 
     // read input param 1: $helperHostPorts as xs:string+
     lIter = args[1]->getIterator();
     lIter->open();
-    std::vector<jstring> jstringVec;
+    std::vector<std::string> lHostPorts;
 
     while( lIter->next(item) )
     {
@@ -146,68 +839,44 @@ ConnectFunction::evaluate(const ExternalFunction::Arguments_t& args,
       std::ostringstream os;
       SingletonItemSequence lSequence(item);
       lSerializer->serialize(&lSequence, os);
-      std::string p1String = os.str();
-      const char* p1Str = p1String.c_str();
-      jstringVec.push_back( env->NewStringUTF(p1Str) );
-      CHECK_EXCEPTION(env);
+      lHostPorts.push_back(os.str());
     }
     lIter->close();
 
-    // call java to make a new connection
-
-    // String[] hhosts = {"n1.example.org:5088", "n2.example.org:4129"};
-    jclass strCls = env->FindClass("Ljava/lang/String;");
-    CHECK_EXCEPTION(env);
-    jobjectArray jStrArray = env->NewObjectArray(jstringVec.size(), strCls, NULL);
-    CHECK_EXCEPTION(env);
-
-    for ( jsize i = 0; i<(jsize)jstringVec.size(); i++)
+    // call java to make a new connection for every shard, the store of
+    // the arguments is the first
+    std::vector<std::vector<jobject> > lStores(lConnection->getShardCount());
+    try
     {
-      env->SetObjectArrayElement(jStrArray, i, jstringVec[i]);
-      CHECK_EXCEPTION(env);
-      env->DeleteLocalRef((jstring)jstringVec[i]);
-      CHECK_EXCEPTION(env);
+      openStore(env, p0String, lHostPorts, lConnection->getStoreHandles(0).getCount(),
+                lStores[0]);
+      for (size_t i = 1; i < lStores.size(); ++i)
+        openStore(env, lShards[i].theStoreName, lShards[i].theHelperHostPorts,
+                  lConnection->getStoreHandles(i).getCount(), lStores[i]);
     }
-
-    // oracle.kv.KVStoreConfig kvsConfigObj = new oracle.kv.KVStoreConfig("storeName", String[] hhosts);
-    jclass kvsConfigClass = env->FindClass("oracle/kv/KVStoreConfig");
-    CHECK_EXCEPTION(env);
-    jmethodID kvsConfigCons = env->GetMethodID(kvsConfigClass, "<init>", "(Ljava/lang/String;[Ljava/lang/String;)V");
-    CHECK_EXCEPTION(env);
-    jobject kvsConfigObj = env->NewObject(kvsConfigClass, kvsConfigCons, jStrParam1, jStrArray);
-    CHECK_EXCEPTION(env);
-
-    //KVStore kvstore = KVStoreFactory.getStore(kvsConfigObj);
-    jclass kvsFactoryClass = env->FindClass("oracle/kv/KVStoreFactory");
-    CHECK_EXCEPTION(env);
-    jmethodID midGetStore = env->GetStaticMethodID(kvsFactoryClass, "getStore", "(Loracle/kv/KVStoreConfig;)Loracle/kv/KVStore;");
-    CHECK_EXCEPTION(env);
-    jobject kvsObject = env->CallStaticObjectMethod(kvsFactoryClass, midGetStore, kvsConfigObj);
-    CHECK_EXCEPTION(env);
-    jobject kvsObjRef = env->NewGlobalRef(kvsObject);
-    CHECK_EXCEPTION(env);
-    env->DeleteLocalRef(kvsObject);
-    CHECK_EXCEPTION(env);
-
-    // store connection in dynamic context
-    uuid lUUID;
-    uuid::create(&lUUID);
-    std::stringstream lStream;
-    lStream << lUUID;
-    String lStrUUID = lStream.str();
-
-    InstanceMap* lInstanceMap;
-    DynamicContext* lDctx = const_cast<DynamicContext*>(aDynamincContext);
-    if (!(lInstanceMap = dynamic_cast<InstanceMap*>(
-              lDctx->getExternalFunctionParameter("nosqldbInstanceMap"))))
+    catch (JavaException&)
     {
-      lInstanceMap = new InstanceMap(env);
-      lDctx->addExternalFunctionParameter("nosqldbInstanceMap", lInstanceMap);
+      // kvstore.close() for the handles opened so far, lException is
+      // raised below
+      lException = env->ExceptionOccurred();
+      env->ExceptionClear();
+      jclass kvsClass = env->FindClass("oracle/kv/KVStore");
+      jmethodID midClose = kvsClass ? env->GetMethodID(kvsClass, "close", "()V") : 0;
+      env->ExceptionClear();
+      for (size_t i = 0; i < lStores.size(); ++i)
+        for (size_t j = 0; j < lStores[i].size(); ++j)
+        {
+          if (midClose)
+            env->CallVoidMethod(lStores[i][j], midClose);
+          env->ExceptionClear();
+          env->DeleteGlobalRef(lStores[i][j]);
+        }
+      throw;
     }
-    lInstanceMap->storeInstance(lStrUUID, kvsObjRef);
 
-    return ItemSequence_t(new SingletonItemSequence(
-        NoSqlDBModule::getItemFactory()->createAnyURI(lStrUUID)));
+    for (size_t i = 0; i < lStores.size(); ++i)
+      lConnection->setStores(env, i, lStores[i]);
+    return registerConnection(aDynamincContext, env, lConnection);
   }
   catch (zorba::jvm::VMOpenException&)
   {
@@ -217,45 +886,7 @@ ConnectFunction::evaluate(const ExternalFunction::Arguments_t& args,
   }
   catch (JavaException&)
   {
-      // prints out to std err the stacktrace
-      // env->ExceptionDescribe();
-      env->ExceptionClear();
-
-      jclass stringWriterClass = env->FindClass("java/io/StringWriter");
-      jclass printWriterClass = env->FindClass("java/io/PrintWriter");
-      jclass throwableClass = env->FindClass("java/lang/Throwable");
-      jobject stringWriter = env->NewObject(
-                stringWriterClass,
-                env->GetMethodID(stringWriterClass, "<init>", "()V"));
-
-      jobject printWriter = env->NewObject(
-                printWriterClass,
-                env->GetMethodID(printWriterClass, "<init>", "(Ljava/io/Writer;)V"),
-                stringWriter);
-
-      env->CallObjectMethod(lException,
-                env->GetMethodID(throwableClass, "printStackTrace",
-                        "(Ljava/io/PrintWriter;)V"),
-                printWriter);
-
-//      env->CallObjectMethod(printWriter, env->GetMethodID(printWriterClass, "flush", "()V"));
-      jmethodID toStringMethod =
-            env->GetMethodID(stringWriterClass, "toString", "()Ljava/lang/String;");
-      jobject errorMessageObj = env->CallObjectMethod( stringWriter, toStringMethod);
-      jstring errorMessage = (jstring) errorMessageObj;
-      const char *errMsg = env->GetStringUTFChars(errorMessage, NULL);
-      std::stringstream s;
-      s << "A Java Exception was thrown:" << std::endl << errMsg;
-      String errDescription;
-      errDescription += s.str();
-      env->ReleaseStringUTFChars(errorMessage, errMsg);
-
-      Item errQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
-                "JAVA-EXCEPTION");
-
-      //std::cout << "  java exception:'" << errDescription << "'" << std::endl; std::cout.flush();
-
-      throw USER_EXCEPTION(errQName, errDescription );
+    throwJavaException(env, lException);
   }
 
   return ItemSequence_t(new EmptySequence());
@@ -383,42 +1014,35 @@ void InstanceMap::closeConnection(jobject kvsObjRef)
     }
     catch (JavaException&)
     {
-      // prints out to std err the stacktrace
-      // env->ExceptionDescribe();
-
-      jclass stringWriterClass = env->FindClass("java/io/StringWriter");
-      jclass printWriterClass = env->FindClass("java/io/PrintWriter");
-      jclass throwableClass = env->FindClass("java/lang/Throwable");
-      jobject stringWriter = env->NewObject(
-                stringWriterClass,
-                env->GetMethodID(stringWriterClass, "<init>", "()V"));
-
-      jobject printWriter = env->NewObject(
-                printWriterClass,
-                env->GetMethodID(printWriterClass, "<init>", "(Ljava/io/Writer;)V"),
-                stringWriter);
-
-      env->CallObjectMethod(lException,
-                env->GetMethodID(throwableClass, "printStackTrace",
-                        "(Ljava/io/PrintWriter;)V"),
-                printWriter);
-
-      //env->CallObjectMethod(printWriter, env->GetMethodID(printWriterClass, "flush", "()V"));
-      jmethodID toStringMethod =
-            env->GetMethodID(stringWriterClass, "toString", "()Ljava/lang/String;");
-      jobject errorMessageObj = env->CallObjectMethod(
-                stringWriter, toStringMethod);
-      jstring errorMessage = (jstring) errorMessageObj;
-      const char *errMsg = env->GetStringUTFChars(errorMessage, 0);
-      std::stringstream s;
-      s << "A Java Exception was thrown:" << std::endl << errMsg;
-      env->ReleaseStringUTFChars(errorMessage, errMsg);
-      std::string err("");
-      err += s.str();
+      throwJavaException(env, lException);
+    }
+}
+
+void InstanceMap::flushConnection(Connection* aConnection) throw()
+{
+    WriteBuffer* lWriteBuffer = aConnection->getWriteBuffer();
+    if (!lWriteBuffer || lWriteBuffer->empty())
+      return;
+
+    TraceRecord lRecord;
+    lRecord.theOperation = Statistics::FLUSH;
+    lRecord.theTimestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    lRecord.theResults = lWriteBuffer->flush(env, aConnection->getStore());
+    if (env->ExceptionCheck())
+    {
+      // there is no query left to raise the error in, the writes still
+      // buffered are lost; the statistics of the process and the trace
+      // record the failed flush
       env->ExceptionClear();
-      Item lQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
-                "JAVA-EXCEPTION");
-      throw USER_EXCEPTION(lQName, err);
+      ++Statistics::theFailedFlushes;
+      Statistics::theLostWrites += lWriteBuffer->size();
+      if (TraceLog* lTraceLog = aConnection->getTraceLog())
+      {
+        lRecord.theFailed = true;
+        lTraceLog->submit(lRecord);
+      }
     }
 }
 
@@ -435,27 +1059,17 @@ PutFunction::evaluate(const ExternalFunction::Arguments_t& args,
 
   try
   {
-    env = zorba::jvm::JavaVMSingleton::getInstance(aStaticContext)->getEnv();
-
     // read input param 0
-    String lInstanceID = getOneStringArgument(args, 0);
-
-    InstanceMap* lInstanceMap;
-    if (!(lInstanceMap = dynamic_cast<InstanceMap*>(aDynamicContext->getExternalFunctionParameter("nosqldbInstanceMap"))))
-    {
-      throwError("NoInstanceMatch", "Not a NoSQL DB identifier.");
-    }
+    Connection* lConnection = getConnectionArgument(args, aDynamicContext);
+    env = getEnv(lConnection, aStaticContext);
 
-    jobject kvsObjRef = lInstanceMap->getInstance(lInstanceID);
-    if (!kvsObjRef)
-    {
-        throwError("NoInstanceMatch", "No instance of NoSQL DB with the given identifier was found.");
-    }
+    Statistics& lStatistics = lConnection->getStatistics();
+    OperationTimer lTimer(env, lStatistics, Statistics::PUT);
+    PhaseClock lClock(lConnection->getProfileTarget(), Statistics::PUT);
+    TraceScope lTrace(lConnection->getTraceLog(), Statistics::PUT);
 
     // read input param 1
-    Item keyParam = getOneItemArgument(args, 1);
-    if(!keyParam.isJSONItem())
-      throwError("InvalidKeyParam", "$key param must be a JSON object");
+    KeyPath lKey = parseKeyItem(getOneItemArgument(args, 1), lConnection->hasTypedKeys());
 
     // read input param 2
     Item valueItem = getOneItemArgument(args, 2);
@@ -494,131 +1108,42 @@ PutFunction::evaluate(const ExternalFunction::Arguments_t& args,
       }
     }
 
-    //    List majorList = new ArrayList();
-    jclass arrayListClass = env->FindClass("java/util/ArrayList");
-    CHECK_EXCEPTION(env);
-    jmethodID midALCons = env->GetMethodID(arrayListClass, "<init>", "()V");
-    CHECK_EXCEPTION(env);
-    jmethodID midALAdd = env->GetMethodID(arrayListClass, "add", "(Ljava/lang/Object;)Z");
-    CHECK_EXCEPTION(env);
-    jobject majorList = env->NewObject(arrayListClass, midALCons);
-    CHECK_EXCEPTION(env);
-    //    List minorList = new ArrayList();
-    jobject minorList = env->NewObject(arrayListClass, midALCons);
-    CHECK_EXCEPTION(env);
-
-    //    majorList.add("Mk1");
-    Item majorValues = keyParam.getObjectValue("major");
-
-    if ( majorValues.isNull() )
-    {
-        throwError("NoMajorKeyComponent", "JSON 'major' property must be specified as string or array.");
-    }
-    else if ( majorValues.isJSONItem() &&
-         majorValues.getJSONItemKind() == store::StoreConsts::jsonArray )
+    lClock.lap(CallProfile::PARSE);
+    lTrace.setKey(lKey);
+    if (HotKeys* lHotKeys = lConnection->getHotKeys())
+      lHotKeys->recordKey(lKey);
+    lTrace.addBytes(valueString.size());
+    lTrace.setResults(1);
+
+    Admission lAdmission(lConnection->getThrottle(), lStatistics, lClock);
+    // a buffered value is charged when it is put, not when it is flushed
+    lAdmission.addBytes(valueString.size());
+    IndexUpdate lIndexUpdate(lConnection, lKey, &valueString, lClock);
+
+    // buffered connections defer the write, see nosql:flush
+    WriteBuffer* lWriteBuffer = lConnection->getWriteBuffer();
+    if (lWriteBuffer)
     {
-        uint64_t majorValueSize = majorValues.getArraySize();
-        for (uint64_t i = 1; i<=majorValueSize; i++)
-        {
-           Item mkItem = majorValues.getArrayValue(i);
-           if ( !mkItem.isAtomic() )
-               throwError("InvalidMajorKeyComponent", "JSON 'major' property must be a string or an array.");
-           String mk = mkItem.getStringValue();
-           jstring jStrMk = env->NewStringUTF(mk.c_str());
-           CHECK_EXCEPTION(env);
-           env->CallBooleanMethod(majorList, midALAdd, jStrMk);
-           CHECK_EXCEPTION(env);
-        }
-    }
-    else if ( majorValues.isAtomic() )
-    {
-        String mk = majorValues.getStringValue();
-        jstring jStrMk = env->NewStringUTF(mk.c_str());
-        CHECK_EXCEPTION(env);
-        env->CallBooleanMethod(majorList, midALAdd, jStrMk);
-        CHECK_EXCEPTION(env);
-    }
-    else
-        throwError("InvalidMajorKeyComponent", "JSON 'major' property must be specified as string or array.");
-
-    //    minorList.add("mk1");
-    Item minorValues = keyParam.getObjectValue("minor");
-
-    if ( minorValues.isNull() )
-    {
-        // do nothing it's perfectly fine to have "minor" missing
-    }
-    else if ( minorValues.isJSONItem() &&
-         minorValues.getJSONItemKind() == store::StoreConsts::jsonArray )
-    {
-        uint64_t minorValueSize = minorValues.getArraySize();
-        for (uint64_t i = 1; i<=minorValueSize; i++)
-        {
-           Item mkItem = minorValues.getArrayValue(i);
-           if ( !mkItem.isAtomic() )
-              throwError("InvalidMinorKeyComponent", "JSON 'minor' property, if specified, must be a string or an array.");
-           String mk = mkItem.getStringValue();
-           jstring jStrMk = env->NewStringUTF(mk.c_str());
-           CHECK_EXCEPTION(env);
-           env->CallBooleanMethod(minorList, midALAdd, jStrMk);
-           CHECK_EXCEPTION(env);
-        }
-    }
-    else if ( minorValues.isAtomic() )
-    {
-        String mk = minorValues.getStringValue();
-        jstring jStrMk = env->NewStringUTF(mk.c_str());
-        CHECK_EXCEPTION(env);
-        env->CallBooleanMethod(majorList, midALAdd, jStrMk);
+      lWriteBuffer->put(lKey, valueString);
+      lIndexUpdate.finish(lClock);
+      if (lWriteBuffer->needsFlush())
+      {
+        lWriteBuffer->flush(env, lConnection->getStore());
         CHECK_EXCEPTION(env);
+      }
+      lClock.lap(CallProfile::STORE);
+      return ItemSequence_t(new SingletonItemSequence(
+          NoSqlDBModule::getItemFactory()->createLong(0)));
     }
-    else
-        throwError("InvalidMinorKeyComponent", "JSON 'minor' property, if specified, must be a string or an array.");
-
-    //    Key k = Key.createKey(majorList, minorList);
-    jclass keyClass = env->FindClass("oracle/kv/Key");
-    CHECK_EXCEPTION(env);
-    jmethodID midKeyCreate = env->GetStaticMethodID(keyClass, "createKey", "(Ljava/util/List;Ljava/util/List;)Loracle/kv/Key;");
-    CHECK_EXCEPTION(env);
-    jobject k = env->CallStaticObjectMethod(keyClass, midKeyCreate, majorList, minorList);
-    CHECK_EXCEPTION(env);
-
-    //    Value v = Value.createValue(p.getBytes())
-    jclass valueClass = env->FindClass("oracle/kv/Value");
-    CHECK_EXCEPTION(env);
-    jmethodID midValueCreate = env->GetStaticMethodID(valueClass, "createValue", "([B)Loracle/kv/Value;");
-    CHECK_EXCEPTION(env);
-
-    //fill out the byte[]
-    const char * buf = valueString.c_str();
-    jsize bufSize = valueString.size();
-    jbyteArray jbyteArrayValue = env->NewByteArray(bufSize);
-    CHECK_EXCEPTION(env);
-
-    env->SetByteArrayRegion(jbyteArrayValue, 0, bufSize, (jbyte *)buf);
-    CHECK_EXCEPTION(env);
-
-    jobject v = env->CallStaticObjectMethod(valueClass, midValueCreate, jbyteArrayValue);
-    CHECK_EXCEPTION(env);
 
     //    Version version = store.put(k, v);
-    jclass kvsClass = env->FindClass("oracle/kv/KVStore");
-    CHECK_EXCEPTION(env);
-    jmethodID midkvsPut = env->GetMethodID(kvsClass, "put", "(Loracle/kv/Key;Loracle/kv/Value;)Loracle/kv/Version;");
-    CHECK_EXCEPTION(env);
-    jobject version = env->CallObjectMethod(kvsObjRef, midkvsPut, k, v);
-    CHECK_EXCEPTION(env);
-
-    //    long versionLong = version.getVersion();
-    jclass versionClass = env->FindClass("oracle/kv/Version");
-    CHECK_EXCEPTION(env);
-    jmethodID midVersionGetVerion = env->GetMethodID(versionClass, "getVersion", "()J");
-    CHECK_EXCEPTION(env);
-    jlong versionLong = env->CallLongMethod(version, midVersionGetVerion);
-    CHECK_EXCEPTION(env);
+    long long lVersion = lConnection->getBackend().put(lKey, valueString, lClock);
+    lStatistics.theBytesWritten += valueString.size();
+    lIndexUpdate.finish(lClock);
 
-    return ItemSequence_t(new SingletonItemSequence(
-        NoSqlDBModule::getItemFactory()->createLong(versionLong)));
+    Item lResult = NoSqlDBModule::getItemFactory()->createLong(lVersion);
+    lClock.lap(CallProfile::ITEMS);
+    return ItemSequence_t(new SingletonItemSequence(lResult));
   }
   catch (zorba::jvm::VMOpenException&)
   {
@@ -628,45 +1153,8 @@ PutFunction::evaluate(const ExternalFunction::Arguments_t& args,
   }
   catch (JavaException&)
   {
-      // prints out to std err the stacktrace
-      // env->ExceptionDescribe();
-
-      jclass stringWriterClass = env->FindClass("java/io/StringWriter");
-      jclass printWriterClass = env->FindClass("java/io/PrintWriter");
-      jclass throwableClass = env->FindClass("java/lang/Throwable");
-      jobject stringWriter = env->NewObject(
-                stringWriterClass,
-                env->GetMethodID(stringWriterClass, "<init>", "()V"));
-
-      jobject printWriter = env->NewObject(
-                printWriterClass,
-                env->GetMethodID(printWriterClass, "<init>", "(Ljava/io/Writer;)V"),
-                stringWriter);
-
-      env->CallObjectMethod(lException,
-                env->GetMethodID(throwableClass, "printStackTrace",
-                        "(Ljava/io/PrintWriter;)V"),
-                printWriter);
-
-//      env->CallObjectMethod(printWriter, env->GetMethodID(printWriterClass, "flush", "()V"));
-      jmethodID toStringMethod =
-            env->GetMethodID(stringWriterClass, "toString", "()Ljava/lang/String;");
-      jobject errorMessageObj = env->CallObjectMethod( stringWriter, toStringMethod);
-      jstring errorMessage = (jstring) errorMessageObj;
-      const char *errMsg = env->GetStringUTFChars(errorMessage, NULL);
-      std::stringstream s;
-      s << "A Java Exception was thrown:" << std::endl << errMsg;
-      String errDescription;
-      errDescription += s.str();
-      env->ExceptionClear();
-      env->ReleaseStringUTFChars(errorMessage, errMsg);
-
-      Item errQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
-                "JAVA-EXCEPTION");
-
-      //std::cout << "  java exception:'" << errDescription << "'" << std::endl; std::cout.flush();
-
-      throw USER_EXCEPTION(errQName, errDescription );
+    // raised by CHECK_EXCEPTION or by the backend, still pending
+    throwJavaException(env, env->ExceptionOccurred());
   }
 }
 
@@ -676,186 +1164,57 @@ GetFunction::evaluate(const ExternalFunction::Arguments_t& args,
                            const zorba::StaticContext* aStaticContext,
                            const zorba::DynamicContext* aDynamicContext) const
 {
-    jthrowable lException = 0;
     static JNIEnv* env;
 
     try
     {
-      env = zorba::jvm::JavaVMSingleton::getInstance(aStaticContext)->getEnv();
-
       // read input param 0
-      String lInstanceID = getOneStringArgument(args, 0);
-
-      InstanceMap* lInstanceMap;
-      if (!(lInstanceMap = dynamic_cast<InstanceMap*>(aDynamicContext->getExternalFunctionParameter("nosqldbInstanceMap"))))
-      {
-        throwError("NoInstanceMatch", "Not a NoSQL DB identifier.");
-      }
+      Connection* lConnection = getConnectionArgument(args, aDynamicContext);
+      env = getEnv(lConnection, aStaticContext);
 
-      jobject kvsObjRef = lInstanceMap->getInstance(lInstanceID);
-      if (!kvsObjRef)
-      {
-          throwError("NoInstanceMatch", "No instance of NoSQL DB with the given identifier was found.");
-      }
+      Statistics& lStatistics = lConnection->getStatistics();
+      OperationTimer lTimer(env, lStatistics, Statistics::GET);
+      PhaseClock lClock(lConnection->getProfileTarget(), Statistics::GET);
+      TraceScope lTrace(lConnection->getTraceLog(), Statistics::GET);
 
       // read input param 1
-      Item keyParam = getOneItemArgument(args, 1);
-      if(!keyParam.isJSONItem())
-        throwError("InvalidKeyParam", "$key param must be a JSON object");
-
-      //    List majorList = new ArrayList();
-      jclass arrayListClass = env->FindClass("java/util/ArrayList");
-      CHECK_EXCEPTION(env);
-      jmethodID midALCons = env->GetMethodID(arrayListClass, "<init>", "()V");
-      CHECK_EXCEPTION(env);
-      jmethodID midALAdd = env->GetMethodID(arrayListClass, "add", "(Ljava/lang/Object;)Z");
-      CHECK_EXCEPTION(env);
-      jobject majorList = env->NewObject(arrayListClass, midALCons);
-      CHECK_EXCEPTION(env);
-      //    List minorList = new ArrayList();
-      jobject minorList = env->NewObject(arrayListClass, midALCons);
-      CHECK_EXCEPTION(env);
-
-      //    majorList.add("Mk1");
-      Item majorValues = keyParam.getObjectValue("major");
-
-      if ( majorValues.isNull() )
-      {
-          throwError("NoMajorKeyComponent", "JSON 'major' property must be specified as string or array.");
-      }
-      else if ( majorValues.isJSONItem() &&
-           majorValues.getJSONItemKind() == store::StoreConsts::jsonArray )
-      {
-          uint64_t majorValueSize = majorValues.getArraySize();
-          for (uint64_t i = 1; i<=majorValueSize; i++)
-          {
-             Item mkItem = majorValues.getArrayValue(i);
-             if ( !mkItem.isAtomic() )
-                 throwError("InvalidMajorKeyComponent", "JSON 'major' property must be a string or an array.");
-             String mk = mkItem.getStringValue();
-             jstring jStrMk = env->NewStringUTF(mk.c_str());
-             CHECK_EXCEPTION(env);
-             env->CallBooleanMethod(majorList, midALAdd, jStrMk);
-             CHECK_EXCEPTION(env);
-          }
-      }
-      else if ( majorValues.isAtomic() )
-      {
-          String mk = majorValues.getStringValue();
-          jstring jStrMk = env->NewStringUTF(mk.c_str());
-          CHECK_EXCEPTION(env);
-          env->CallBooleanMethod(majorList, midALAdd, jStrMk);
-          CHECK_EXCEPTION(env);
-      }
-      else
-          throwError("InvalidMajorKeyComponent", "JSON 'major' property must be specified as string or array.");
-
-
-      //    minorList.add("mk1");
-      Item minorValues = keyParam.getObjectValue("minor");
-
-      if ( minorValues.isNull() )
-      {
-          // do nothing it's perfectly fine to have "minor" missing
-      }
-      else if ( minorValues.isJSONItem() &&
-           minorValues.getJSONItemKind() == store::StoreConsts::jsonArray )
-      {
-          uint64_t minorValueSize = minorValues.getArraySize();
-          for (uint64_t i = 1; i<=minorValueSize; i++)
-          {
-             Item mkItem = minorValues.getArrayValue(i);
-             if ( !mkItem.isAtomic() )
-                throwError("InvalidMinorKeyComponent", "JSON 'minor' property, if specified, must be a string or an array.");
-             String mk = mkItem.getStringValue();
-             jstring jStrMk = env->NewStringUTF(mk.c_str());
-             CHECK_EXCEPTION(env);
-             env->CallBooleanMethod(minorList, midALAdd, jStrMk);
-             CHECK_EXCEPTION(env);
-          }
-      }
-      else if ( minorValues.isAtomic() )
+      KeyPath lKey = parseKeyItem(getOneItemArgument(args, 1), lConnection->hasTypedKeys());
+      lClock.lap(CallProfile::PARSE);
+      lTrace.setKey(lKey);
+      if (HotKeys* lHotKeys = lConnection->getHotKeys())
+        lHotKeys->recordKey(lKey);
+
+      // read-your-writes through the write buffer
+      WriteBuffer* lWriteBuffer = lConnection->getWriteBuffer();
+      if (lWriteBuffer)
       {
-          String mk = minorValues.getStringValue();
-          jstring jStrMk = env->NewStringUTF(mk.c_str());
-          CHECK_EXCEPTION(env);
-          env->CallBooleanMethod(majorList, midALAdd, jStrMk);
-          CHECK_EXCEPTION(env);
+        std::string lBufferedValue;
+        switch (lWriteBuffer->lookup(lKey, lBufferedValue))
+        {
+          case WriteBuffer::BUFFERED_DELETE:
+            return ItemSequence_t(new EmptySequence());
+          case WriteBuffer::BUFFERED_PUT:
+            lTrace.setResults(1);
+            lTrace.addBytes(lBufferedValue.size());
+            return ItemSequence_t(new SingletonItemSequence(
+                createValueVersionItem(lBufferedValue, 0)));
+          case WriteBuffer::NOT_BUFFERED:
+            break;
+        }
       }
-      else
-          throwError("InvalidMinorKeyComponent", "JSON 'minor' property, if specified, must be a string or an array.");
-
-      //    Key k = Key.createKey(majorList, minorList);
-      jclass keyClass = env->FindClass("oracle/kv/Key");
-      CHECK_EXCEPTION(env);
-      jmethodID midKeyCreate = env->GetStaticMethodID(keyClass, "createKey", "(Ljava/util/List;Ljava/util/List;)Loracle/kv/Key;");
-      CHECK_EXCEPTION(env);
-      jobject k = env->CallStaticObjectMethod(keyClass, midKeyCreate, majorList, minorList);
-      CHECK_EXCEPTION(env);
 
       //    ValueVersion valueVersion = store.get(k);
-      jclass kvsClass = env->FindClass("oracle/kv/KVStore");
-      CHECK_EXCEPTION(env);
-      jmethodID midkvsGet = env->GetMethodID(kvsClass, "get", "(Loracle/kv/Key;)Loracle/kv/ValueVersion;");
-      CHECK_EXCEPTION(env);
-      jobject valueVersion = env->CallObjectMethod(kvsObjRef, midkvsGet, k);
-      CHECK_EXCEPTION(env);
-
-      // if no result return empty sequence
-      if ( valueVersion==NULL )
-          return ItemSequence_t(new EmptySequence());
-
-      // Value v = valueVersion.getValue();
-      jclass vvClass = env->FindClass("oracle/kv/ValueVersion");
-      CHECK_EXCEPTION(env);
-      jmethodID midvvGetValue = env->GetMethodID(vvClass, "getValue", "()Loracle/kv/Value;");
-      CHECK_EXCEPTION(env);
-      jobject v = env->CallObjectMethod(valueVersion, midvvGetValue);
-      CHECK_EXCEPTION(env);
-
-      // byte[] value = v.getValue();
-      jclass valueClass = env->FindClass("oracle/kv/Value");
-      CHECK_EXCEPTION(env);
-      jmethodID midValueGetValue = env->GetMethodID(valueClass, "getValue", "()[B");
-      CHECK_EXCEPTION(env);
-      // todo move the data in the array env->GetByteArrayRegion(ba, off, len, (jbyte *)buf);
-      jbyteArray jbaValue = (jbyteArray) env->CallObjectMethod(v, midValueGetValue);
-      CHECK_EXCEPTION(env);
-      jsize jbaSize = env->GetArrayLength(jbaValue);
-      CHECK_EXCEPTION(env);
-      char * buf = new char[jbaSize];
-      env->GetByteArrayRegion(jbaValue, 0, jbaSize, (jbyte *)buf);
-      CHECK_EXCEPTION(env);
-
-      // Version version = valueVersion.getVersion();
-      jmethodID midvvGetVersion = env->GetMethodID(vvClass, "getVersion", "()Loracle/kv/Version;");
-      CHECK_EXCEPTION(env);
-      jobject version = env->CallObjectMethod(valueVersion, midvvGetVersion);
-      CHECK_EXCEPTION(env);
-
-      //    long versionLong = version.getVersion();
-      jclass versionClass = env->FindClass("oracle/kv/Version");
-      CHECK_EXCEPTION(env);
-      jmethodID midVersionGetVerion = env->GetMethodID(versionClass, "getVersion", "()J");
-      CHECK_EXCEPTION(env);
-      jlong versionLong = env->CallLongMethod(version, midVersionGetVerion);
-      CHECK_EXCEPTION(env);
-
-      // assemble result { "value" : "the value" , "version" : 123 }
-      std::string ssString(buf, jbaSize);
-      Item val( NoSqlDBModule::getItemFactory()->createBase64Binary(ssString.c_str(), ssString.size(), false) );
-      Item vers = NoSqlDBModule::getItemFactory()->createLong(versionLong);
-
-      std::vector<std::pair<Item, Item> > pairs;
-      pairs.reserve(2);
-      pairs.push_back(std::pair<Item, Item>(
-        NoSqlDBModule::getItemFactory()->createString(String("value")), val));
-      pairs.push_back(std::pair<Item, Item>(
-        NoSqlDBModule::getItemFactory()->createString(String("version")), vers));
-
-      Item jsonObj = NoSqlDBModule::getItemFactory()->createJSONObject(pairs);
-
-      return ItemSequence_t(new SingletonItemSequence(jsonObj));
+      Admission lAdmission(lConnection->getThrottle(), lStatistics, lClock);
+      ValueVersionHandler lHandler;
+      if (!lConnection->getBackend().get(lKey, lHandler, lClock))
+        return ItemSequence_t(new EmptySequence());
+
+      lStatistics.theBytesRead += lHandler.theBytes;
+      lAdmission.addBytes(lHandler.theBytes);
+      lTrace.setResults(1);
+      lTrace.addBytes(lHandler.theBytes);
+      lClock.lap(CallProfile::ITEMS);
+      return ItemSequence_t(new SingletonItemSequence(lHandler.theResult));
     }
     catch (zorba::jvm::VMOpenException&)
     {
@@ -865,45 +1224,7 @@ GetFunction::evaluate(const ExternalFunction::Arguments_t& args,
     }
     catch (JavaException&)
     {
-        // prints out to std err the stacktrace
-        //env->ExceptionDescribe();
-
-        jclass stringWriterClass = env->FindClass("java/io/StringWriter");
-        jclass printWriterClass = env->FindClass("java/io/PrintWriter");
-        jclass throwableClass = env->FindClass("java/lang/Throwable");
-        jobject stringWriter = env->NewObject(
-                  stringWriterClass,
-                  env->GetMethodID(stringWriterClass, "<init>", "()V"));
-
-        jobject printWriter = env->NewObject(
-                  printWriterClass,
-                  env->GetMethodID(printWriterClass, "<init>", "(Ljava/io/Writer;)V"),
-                  stringWriter);
-
-        env->CallObjectMethod(lException,
-                  env->GetMethodID(throwableClass, "printStackTrace",
-                          "(Ljava/io/PrintWriter;)V"),
-                  printWriter);
-
-  //      env->CallObjectMethod(printWriter, env->GetMethodID(printWriterClass, "flush", "()V"));
-        jmethodID toStringMethod =
-              env->GetMethodID(stringWriterClass, "toString", "()Ljava/lang/String;");
-        jobject errorMessageObj = env->CallObjectMethod( stringWriter, toStringMethod);
-        jstring errorMessage = (jstring) errorMessageObj;
-        const char *errMsg = env->GetStringUTFChars(errorMessage, NULL);
-        std::stringstream s;
-        s << "A Java Exception was thrown:" << std::endl << errMsg;
-        String errDescription;
-        errDescription += s.str();
-        env->ExceptionClear();
-        env->ReleaseStringUTFChars(errorMessage, errMsg);
-
-        Item errQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
-                  "JAVA-EXCEPTION");
-
-        //std::cout << "  java exception:'" << errDescription << "'" << std::endl; std::cout.flush();
-
-        throw USER_EXCEPTION(errQName, errDescription );
+      throwJavaException(env, env->ExceptionOccurred());
     }
 }
 
@@ -917,127 +1238,48 @@ DelFunction::evaluate(const ExternalFunction::Arguments_t& args,
 
     try
     {
-      env = zorba::jvm::JavaVMSingleton::getInstance(aStaticContext)->getEnv();
-
       // read input param 0
-      String lInstanceID = getOneStringArgument(args, 0);
-
-      InstanceMap* lInstanceMap;
-      if (!(lInstanceMap = dynamic_cast<InstanceMap*>(aDynamicContext->getExternalFunctionParameter("nosqldbInstanceMap"))))
-      {
-        throwError("NoInstanceMatch", "Not a NoSQL DB identifier.");
-      }
+      Connection* lConnection = getConnectionArgument(args, aDynamicContext);
+      env = getEnv(lConnection, aStaticContext);
 
-      jobject kvsObjRef = lInstanceMap->getInstance(lInstanceID);
-      if (!kvsObjRef)
-      {
-          throwError("NoInstanceMatch", "No instance of NoSQL DB with the given identifier was found.");
-      }
+      Statistics& lStatistics = lConnection->getStatistics();
+      OperationTimer lTimer(env, lStatistics, Statistics::REMOVE);
+      PhaseClock lClock(lConnection->getProfileTarget(), Statistics::REMOVE);
+      TraceScope lTrace(lConnection->getTraceLog(), Statistics::REMOVE);
 
       // read input param 1
-      Item keyParam = getOneItemArgument(args, 1);
-      if(!keyParam.isJSONItem())
-        throwError("InvalidKeyParam", "$key param must be a JSON object");
-
-      //    List majorList = new ArrayList();
-      jclass arrayListClass = env->FindClass("java/util/ArrayList");
-      CHECK_EXCEPTION(env);
-      jmethodID midALCons = env->GetMethodID(arrayListClass, "<init>", "()V");
-      CHECK_EXCEPTION(env);
-      jmethodID midALAdd = env->GetMethodID(arrayListClass, "add", "(Ljava/lang/Object;)Z");
-      CHECK_EXCEPTION(env);
-      jobject majorList = env->NewObject(arrayListClass, midALCons);
-      CHECK_EXCEPTION(env);
-      //    List minorList = new ArrayList();
-      jobject minorList = env->NewObject(arrayListClass, midALCons);
-      CHECK_EXCEPTION(env);
-
-      //    majorList.add("Mk1");
-      Item majorValues = keyParam.getObjectValue("major");
-
-      if ( majorValues.isNull() )
-      {
-          throwError("NoMajorKeyComponent", "JSON 'major' property must be specified as string or array.");
-      }
-      else if ( majorValues.isJSONItem() &&
-           majorValues.getJSONItemKind() == store::StoreConsts::jsonArray )
-      {
-          uint64_t majorValueSize = majorValues.getArraySize();
-          for (uint64_t i = 1; i<=majorValueSize; i++)
-          {
-             Item mkItem = majorValues.getArrayValue(i);
-             if ( !mkItem.isAtomic() )
-                 throwError("InvalidMajorKeyComponent", "JSON 'major' property must be a string or an array.");
-             String mk = mkItem.getStringValue();
-             jstring jStrMk = env->NewStringUTF(mk.c_str());
-             CHECK_EXCEPTION(env);
-             env->CallBooleanMethod(majorList, midALAdd, jStrMk);
-             CHECK_EXCEPTION(env);
-          }
-      }
-      else if ( majorValues.isAtomic() )
+      KeyPath lKey = parseKeyItem(getOneItemArgument(args, 1), lConnection->hasTypedKeys());
+      lClock.lap(CallProfile::PARSE);
+      lTrace.setKey(lKey);
+      if (HotKeys* lHotKeys = lConnection->getHotKeys())
+        lHotKeys->recordKey(lKey);
+
+      Admission lAdmission(lConnection->getThrottle(), lStatistics, lClock);
+      IndexUpdate lIndexUpdate(lConnection, lKey, 0, lClock);
+
+      // buffered connections defer the delete, see nosql:flush
+      WriteBuffer* lWriteBuffer = lConnection->getWriteBuffer();
+      if (lWriteBuffer)
       {
-          String mk = majorValues.getStringValue();
-          jstring jStrMk = env->NewStringUTF(mk.c_str());
-          CHECK_EXCEPTION(env);
-          env->CallBooleanMethod(majorList, midALAdd, jStrMk);
-          CHECK_EXCEPTION(env);
-      }
-      else
-          throwError("InvalidMajorKeyComponent", "JSON 'major' property must be specified as string or array.");
-
-      //    minorList.add("mk1");
-      Item minorValues = keyParam.getObjectValue("minor");
-
-      if ( minorValues.isNull() )
-      {
-          // do nothing it's perfectly fine to have "minor" missing
-      }
-      else if ( minorValues.isJSONItem() &&
-           minorValues.getJSONItemKind() == store::StoreConsts::jsonArray )
-      {
-          uint64_t minorValueSize = minorValues.getArraySize();
-          for (uint64_t i = 1; i<=minorValueSize; i++)
-          {
-             Item mkItem = minorValues.getArrayValue(i);
-             if ( !mkItem.isAtomic() )
-                throwError("InvalidMinorKeyComponent", "JSON 'minor' property, if specified, must be a string or an array.");
-             String mk = mkItem.getStringValue();
-             jstring jStrMk = env->NewStringUTF(mk.c_str());
-             CHECK_EXCEPTION(env);
-             env->CallBooleanMethod(minorList, midALAdd, jStrMk);
-             CHECK_EXCEPTION(env);
-          }
-      }
-      else if ( minorValues.isAtomic() )
-      {
-          String mk = minorValues.getStringValue();
-          jstring jStrMk = env->NewStringUTF(mk.c_str());
-          CHECK_EXCEPTION(env);
-          env->CallBooleanMethod(majorList, midALAdd, jStrMk);
+        lWriteBuffer->remove(lKey);
+        lIndexUpdate.finish(lClock);
+        if (lWriteBuffer->needsFlush())
+        {
+          lWriteBuffer->flush(env, lConnection->getStore());
           CHECK_EXCEPTION(env);
+        }
+        lClock.lap(CallProfile::STORE);
+        return ItemSequence_t(new SingletonItemSequence(
+            NoSqlDBModule::getItemFactory()->createBoolean(true)));
       }
-      else
-          throwError("InvalidMinorKeyComponent", "JSON 'minor' property, if specified, must be a string or an array.");
-
-      //    Key k = Key.createKey(majorList, minorList);
-      jclass keyClass = env->FindClass("oracle/kv/Key");
-      CHECK_EXCEPTION(env);
-      jmethodID midKeyCreate = env->GetStaticMethodID(keyClass, "createKey", "(Ljava/util/List;Ljava/util/List;)Loracle/kv/Key;");
-      CHECK_EXCEPTION(env);
-      jobject k = env->CallStaticObjectMethod(keyClass, midKeyCreate, majorList, minorList);
-      CHECK_EXCEPTION(env);
 
-      //    ValueVersion valueVersion = store.delete(k);
-      jclass kvsClass = env->FindClass("oracle/kv/KVStore");
-      CHECK_EXCEPTION(env);
-      jmethodID midkvsGet = env->GetMethodID(kvsClass, "delete", "(Loracle/kv/Key;)Z");
-      CHECK_EXCEPTION(env);
-      jboolean result = env->CallBooleanMethod(kvsObjRef, midkvsGet, k);
-      CHECK_EXCEPTION(env);
+      //    boolean result = store.delete(k);
+      bool lResult = lConnection->getBackend().remove(lKey, lClock);
+      lIndexUpdate.finish(lClock);
+      lTrace.setResults(lResult ? 1 : 0);
 
       return ItemSequence_t(new SingletonItemSequence(
-          NoSqlDBModule::getItemFactory()->createBoolean(result)));
+          NoSqlDBModule::getItemFactory()->createBoolean(lResult)));
     }
     catch (zorba::jvm::VMOpenException&)
     {
@@ -1047,46 +1289,151 @@ DelFunction::evaluate(const ExternalFunction::Arguments_t& args,
     }
     catch (JavaException&)
     {
-        // prints out to std err the stacktrace
-        //env->ExceptionDescribe();
-
-        jclass stringWriterClass = env->FindClass("java/io/StringWriter");
-        jclass printWriterClass = env->FindClass("java/io/PrintWriter");
-        jclass throwableClass = env->FindClass("java/lang/Throwable");
-        jobject stringWriter = env->NewObject(
-                  stringWriterClass,
-                  env->GetMethodID(stringWriterClass, "<init>", "()V"));
-
-        jobject printWriter = env->NewObject(
-                  printWriterClass,
-                  env->GetMethodID(printWriterClass, "<init>", "(Ljava/io/Writer;)V"),
-                  stringWriter);
-
-        env->CallObjectMethod(lException,
-                  env->GetMethodID(throwableClass, "printStackTrace",
-                          "(Ljava/io/PrintWriter;)V"),
-                  printWriter);
-
-        env->CallObjectMethod(printWriter, env->GetMethodID(printWriterClass, "flush", "()V"));
-        jmethodID toStringMethod =
-              env->GetMethodID(stringWriterClass, "toString", "()Ljava/lang/String;");
-        jobject errorMessageObj = env->CallObjectMethod( stringWriter, toStringMethod);
-        jstring errorMessage = (jstring) errorMessageObj;
-        const char *errMsg = env->GetStringUTFChars(errorMessage, NULL);
-        std::stringstream s;
-        s << "A Java Exception was thrown:" << std::endl << errMsg;
-        String errDescription;
-        errDescription += s.str();
-        env->ExceptionClear();
-        env->ReleaseStringUTFChars(errorMessage, errMsg);
+      throwJavaException(env, env->ExceptionOccurred());
+    }
+}
+
+
+// the "split-points" of a $sub-range, encoded like its "start" and "end"
+static std::vector<std::string>
+readSplitPoints(const Item& aRangeItem, bool aTyped)
+{
+  std::vector<std::string> lPoints;
+  Item lArray = getOption(aRangeItem, "split-points");
+  if (lArray.isNull())
+    return lPoints;
+  if (!lArray.isJSONItem() ||
+      lArray.getJSONItemKind() != store::StoreConsts::jsonArray)
+    throwError("InvalidKeyRange", "'split-points' must be an array of key components.");
+
+  uint64_t lSize = lArray.getArraySize();
+  for (uint64_t i = 1; i <= lSize; ++i)
+  {
+    Item lPoint = lArray.getArrayValue(i);
+    std::string lComponent;
+    if (!lPoint.isAtomic() || !encodeKeyComponent(lPoint, aTyped, lComponent))
+      throwError("InvalidKeyRange", "'split-points' must be an array of key components.");
+    lPoints.push_back(lComponent);
+  }
+  return lPoints;
+}
+
 
-        Item errQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
-                  "JAVA-EXCEPTION");
+// a continuation token: a format version, the direction and the hex digits
+// of the encodeOrderedKey() of the last record of the page
+static std::string
+createContinuation(const KeyPath& aKey, Direction aDirection)
+{
+  static const char theHexDigits[] = "0123456789abcdef";
+  std::string lKey = encodeOrderedKey(aKey);
+  std::string lToken(aDirection == REVERSE ? "1R" : "1F");
+  lToken.reserve(2 + 2 * lKey.size());
+  for (size_t i = 0; i < lKey.size(); ++i)
+  {
+    lToken += theHexDigits[(unsigned char)lKey[i] >> 4];
+    lToken += theHexDigits[(unsigned char)lKey[i] & 0xF];
+  }
+  return lToken;
+}
 
-        //std::cout << "  java exception:'" << errDescription << "'" << std::endl; std::cout.flush();
 
-        throw USER_EXCEPTION(errQName, errDescription );
+// the key a token of createContinuation() resumes after; it must be
+// aParentKey or lie below it and be made for aDirection
+static KeyPath
+parseContinuation(const std::string& aToken, const KeyPath& aParentKey,
+                  Direction aDirection)
+{
+  const char* lError = "'continuation' is not a token of this parent key and direction.";
+  if (aToken.size() < 2 || aToken.size() % 2 != 0 || aToken[0] != '1' ||
+      aToken[1] != (aDirection == REVERSE ? 'R' : 'F'))
+    throwError("InvalidKeyRange", lError);
+
+  std::string lKey;
+  lKey.reserve(aToken.size() / 2 - 1);
+  for (size_t i = 2; i < aToken.size(); i += 2)
+  {
+    int lByte = 0;
+    for (size_t j = i; j < i + 2; ++j)
+    {
+      char c = aToken[j];
+      if (c >= '0' && c <= '9')
+        lByte = lByte * 16 + (c - '0');
+      else if (c >= 'a' && c <= 'f')
+        lByte = lByte * 16 + (c - 'a' + 10);
+      else
+        throwError("InvalidKeyRange", lError);
     }
+    lKey += (char)lByte;
+  }
+
+  KeyPath lResult;
+  if (!decodeOrderedKey(lKey.data(), lKey.size(), lResult) ||
+      lResult.theMajor != aParentKey.theMajor ||
+      lResult.theMinor.size() < aParentKey.theMinor.size() ||
+      !std::equal(aParentKey.theMinor.begin(), aParentKey.theMinor.end(),
+                  lResult.theMinor.begin()))
+    throwError("InvalidKeyRange", lError);
+  return lResult;
+}
+
+
+// aDepth without the parent record
+static Depth
+withoutParent(Depth aDepth)
+{
+  if (aDepth == PARENT_AND_CHILDREN)
+    return CHILDREN_ONLY;
+  if (aDepth == PARENT_AND_DESCENDANTS)
+    return DESCENDANTS_ONLY;
+  return aDepth;
+}
+
+
+// reads the records of a page of descendants that follow aAfter inside
+// the child of the parent key at aLevel it lies in: forward, the records
+// below aAfter, then for each ancestor of aAfter up to that child the
+// records after the component of aAfter; in reverse, the records before
+// that component and then the ancestor itself. Every scan starts past
+// aAfter, so nothing of the child is read twice.
+static void
+resumeInChild(Backend& aBackend, const KeyPath& aAfter, size_t aLevel,
+              Direction aDirection, PageHandler& aPage, PhaseClock& aClock)
+{
+  if (aDirection == FORWARD)
+    aBackend.multiGetPage(aAfter, 0, DESCENDANTS_ONLY, FORWARD, aPage.left(), aPage, aClock);
+
+  KeyRangeSpec lAll;
+  KeyPath lAncestor = aAfter;
+  while (lAncestor.theMinor.size() > aLevel + 1 && !aPage.done())
+  {
+    std::string lComponent = lAncestor.theMinor.back();
+    lAncestor.theMinor.pop_back();
+
+    KeyRangeSpec lRest;
+    if (resumeKeyRange(lAll, lComponent, false, aDirection, lRest))
+      aBackend.multiGetPage(lAncestor, &lRest, DESCENDANTS_ONLY, aDirection,
+                            aPage.left(), aPage, aClock);
+    if (aDirection == REVERSE && !aPage.done())
+      aBackend.get(lAncestor, aPage, aClock);
+  }
+}
+
+
+// aRecord, a record object of a multi-get, with a "continuation" field
+static Item
+addContinuation(const Item& aRecord, const std::string& aToken)
+{
+  ItemFactory* lFactory = NoSqlDBModule::getItemFactory();
+  static const char* const theFields[] = { "key", "value", "version" };
+
+  std::vector<std::pair<Item, Item> > lPairs;
+  for (size_t i = 0; i < sizeof(theFields) / sizeof(theFields[0]); ++i)
+    lPairs.push_back(std::pair<Item, Item>(
+        lFactory->createString(String(theFields[i])),
+        aRecord.getObjectValue(String(theFields[i]))));
+  lPairs.push_back(std::pair<Item, Item>(
+      lFactory->createString(String("continuation")), lFactory->createString(String(aToken))));
+  return lFactory->createJSONObject(lPairs);
 }
 
 
@@ -1095,354 +1442,843 @@ MultiGetFunction::evaluate(const ExternalFunction::Arguments_t& args,
                            const zorba::StaticContext* aStaticContext,
                            const zorba::DynamicContext* aDynamicContext) const
 {
-std::cout << "  mg: start" << std::endl; std::cout.flush();
     jthrowable lException = 0;
     static JNIEnv* env;
 
     try
     {
-      env = zorba::jvm::JavaVMSingleton::getInstance(aStaticContext)->getEnv();
-
       // read input param 0 $db
-      String lInstanceID = getOneStringArgument(args, 0);
+      Connection* lConnection = getConnectionArgument(args, aDynamicContext);
+      env = getEnv(lConnection, aStaticContext);
 
-      InstanceMap* lInstanceMap;
-      if (!(lInstanceMap = dynamic_cast<InstanceMap*>(aDynamicContext->getExternalFunctionParameter("nosqldbInstanceMap"))))
+      Statistics& lStatistics = lConnection->getStatistics();
+      OperationTimer lTimer(env, lStatistics, Statistics::MULTI_GET);
+      PhaseClock lClock(lConnection->getProfileTarget(), Statistics::MULTI_GET);
+      // a scan read ahead submits its trace record when its result has
+      // been read
+      std::unique_ptr<TraceScope> lTrace(
+          new TraceScope(lConnection->getTraceLog(), Statistics::MULTI_GET));
+
+      // read input param 1 $parentKey
+      KeyPath lKey = parseKeyItem(getOneItemArgument(args, 1), lConnection->hasTypedKeys());
+      lClock.lap(CallProfile::PARSE);
+      lTrace->setKey(lKey);
+      if (HotKeys* lHotKeys = lConnection->getHotKeys())
+        lHotKeys->recordParent(lKey);
+
+      // pending writes under this major path must be visible to the scan
+      WriteBuffer* lWriteBuffer = lConnection->getWriteBuffer();
+      if (lWriteBuffer)
       {
-        throwError("NoInstanceMatch", "Not a NoSQL DB identifier.");
+        lWriteBuffer->flushMajor(env, lConnection->getStore(), lKey);
+        CHECK_EXCEPTION(env);
+        lClock.lap(CallProfile::STORE);
       }
 
-      jobject kvsObjRef = lInstanceMap->getInstance(lInstanceID);
-      if (!kvsObjRef)
+      // read input param 2 $subRange
+      Item lRangeItem = getOneItemArgument(args, 2);
+      KeyRangeSpec lRange = parseKeyRangeItem(lRangeItem, lConnection->hasTypedKeys());
+      lTrace->setRange(lRange);
+
+      // "parallel" : n splits the range into n parts scanned at a time, at
+      // the "split-points" if given; "ordered" : false hands out the parts
+      // as they complete
+      long long lParallel = getIntegerOption(lRangeItem, "parallel", 1);
+      if (lParallel < 1 || lParallel > 256)
+        throwError("InvalidKeyRange", "'parallel' must be between 1 and 256.");
+      std::vector<std::string> lSplitPoints =
+          readSplitPoints(lRangeItem, lConnection->hasTypedKeys());
+      bool lOrdered = getBooleanOption(lRangeItem, "ordered", true);
+
+      // "read-ahead" : n batches of a serial scan are read by a background
+      // thread while the records before them become items
+      long long lReadAhead = getIntegerOption(lRangeItem, "read-ahead", 0);
+      if (lReadAhead < 0 || lReadAhead > 1024)
+        throwError("InvalidKeyRange", "'read-ahead' must be between 0 and 1024.");
+
+      // "limit" : n returns a page of at most n records, the last record of
+      // a page that more records follow carries a "continuation" token; the
+      // "continuation" of the next call resumes after that record
+      long long lLimit = 0;
+      if (!getOption(lRangeItem, "limit").isNull())
       {
-          throwError("NoInstanceMatch", "No instance of NoSQL DB with the given identifier was found.");
+        lLimit = getIntegerOption(lRangeItem, "limit", 0);
+        if (lLimit < 1 || lLimit > 1000000)
+          throwError("InvalidKeyRange", "'limit' must be between 1 and 1000000.");
+        if (lParallel > 1 || !lSplitPoints.empty() || lReadAhead > 0)
+          throwError("InvalidKeyRange", "'limit' cannot be combined with 'parallel', 'split-points' or 'read-ahead'.");
       }
+      std::string lContinuation = getStringOption(lRangeItem, "continuation", "");
+      if (!lContinuation.empty() && lLimit == 0)
+        throwError("InvalidKeyRange", "'continuation' requires a 'limit'.");
 
-      // read input param 1 $parentKey
-      Item keyParam = getOneItemArgument(args, 1);
-      if(!keyParam.isJSONItem())
-        throwError("InvalidKeyParam", "$key param must be a JSON object");
+      // get param 3 $depth as xs:string
+      std::string depthStr = getOneStringArgument(args, 3).str();
+      lTrace->setDepth(depthStr);
 
-      //    List majorList = new ArrayList();
-      jclass arrayListClass = env->FindClass("java/util/ArrayList");
-      CHECK_EXCEPTION(env);
-      jmethodID midALCons = env->GetMethodID(arrayListClass, "<init>", "()V");
-      CHECK_EXCEPTION(env);
-      jmethodID midALAdd = env->GetMethodID(arrayListClass, "add", "(Ljava/lang/Object;)Z");
-      CHECK_EXCEPTION(env);
-      jobject majorList = env->NewObject(arrayListClass, midALCons);
-      CHECK_EXCEPTION(env);
-      //    List minorList = new ArrayList();
-      jobject minorList = env->NewObject(arrayListClass, midALCons);
-      CHECK_EXCEPTION(env);
+      // get param 4 $direction as xs:string
+      std::string dirStr = getOneStringArgument(args, 4).str();
+      lTrace->setDirection(dirStr);
+      lClock.lap(CallProfile::PARSE);
 
-      //    majorList.add("Mk1");
-      Item majorValues = keyParam.getObjectValue("major");
+      // a "rate-limit" of the $subRange replaces that of the connection
+      Admission lAdmission(lConnection->getThrottle(), lStatistics, lClock,
+                           getOption(lRangeItem, "rate-limit"));
 
-      if ( majorValues.isNull() )
+      // a scan read ahead is handed out as its batches arrive
+      if (lReadAhead > 0 && lParallel == 1 && lSplitPoints.empty())
       {
-          throwError("NoMajorKeyComponent", "JSON 'major' property must be specified as string or array.");
+        std::unique_ptr<RecordCursor> lCursor = lConnection->getBackend().openReadAhead(
+            lKey, &lRange, parseDepth(depthStr), parseDirection(dirStr),
+            (unsigned)lReadAhead, lClock);
+        return ItemSequence_t(new CursorItemSequence(env, std::move(lCursor), std::move(lTrace),
+            lStatistics, lConnection->getThrottle().getBuckets(getOption(lRangeItem, "rate-limit")),
+            Statistics::MULTI_GET, lConnection->hasTypedKeys()));
       }
-      else if ( majorValues.isJSONItem() &&
-           majorValues.getJSONItemKind() == store::StoreConsts::jsonArray )
+
+      std::vector<Item> vec;
+      RecordItemsHandler lHandler(vec, lStatistics, *lTrace, lClock,
+                                  lConnection->hasTypedKeys(), &lAdmission);
+      if (lLimit > 0)
       {
-          uint64_t majorValueSize = majorValues.getArraySize();
-          for (uint64_t i = 1; i<=majorValueSize; i++)
+        Depth lDepth = parseDepth(depthStr);
+        Direction lDirection = parseDirection(dirStr);
+        PageHandler lPage(lHandler, (size_t)lLimit, lKey, lRange);
+
+        // a page resumes after the child the last record lies in, a page of
+        // descendants first reads the rest of that child; the parent record
+        // comes first forward and is left out of the pages that follow
+        KeyRangeSpec lResumed = lRange;
+        bool lLeft = true;
+        KeyPath lAfter;
+        bool lInChild = false;
+        if (!lContinuation.empty())
+        {
+          size_t lLevel = lKey.theMinor.size();
+          lAfter = parseContinuation(lContinuation, lKey, lDirection);
+          if (lDirection == FORWARD)
+            lDepth = withoutParent(lDepth);
+          if (lAfter.theMinor.size() == lLevel)
+            lLeft = lDirection == FORWARD;
+          else
           {
-             Item mkItem = majorValues.getArrayValue(i);
-             if ( !mkItem.isAtomic() )
-                 throwError("InvalidMajorKeyComponent", "JSON 'major' property must be a string or an array.");
-             String mk = mkItem.getStringValue();
-             jstring jStrMk = env->NewStringUTF(mk.c_str());
-             CHECK_EXCEPTION(env);
-             env->CallBooleanMethod(majorList, midALAdd, jStrMk);
-             CHECK_EXCEPTION(env);
+            lInChild = lDepth == DESCENDANTS_ONLY || lDepth == PARENT_AND_DESCENDANTS;
+            lLeft = resumeKeyRange(lRange, lAfter.theMinor[lLevel], false, lDirection, lResumed);
           }
+        }
+        lClock.lap(CallProfile::PARSE);
+
+        Backend& lBackend = lConnection->getBackend();
+        if (lInChild)
+          resumeInChild(lBackend, lAfter, lKey.theMinor.size(), lDirection, lPage, lClock);
+        if (lLeft && !lPage.done())
+          lBackend.multiGetPage(lKey, &lResumed, lDepth, lDirection, lPage.left(), lPage, lClock);
+        if (lPage.hasMore())
+          vec.back() = addContinuation(vec.back(), createContinuation(lPage.theLast, lDirection));
       }
-      else if ( majorValues.isAtomic() )
+      else if (lParallel > 1 || !lSplitPoints.empty())
       {
-          String mk = majorValues.getStringValue();
-          jstring jStrMk = env->NewStringUTF(mk.c_str());
-          CHECK_EXCEPTION(env);
-          env->CallBooleanMethod(majorList, midALAdd, jStrMk);
-          CHECK_EXCEPTION(env);
+        std::vector<KeyRangeSpec> lParts =
+            splitKeyRange(lRange, (unsigned)lParallel, lSplitPoints);
+        lConnection->getBackend().multiGetParts(lKey, lParts, parseDepth(depthStr),
+            parseDirection(dirStr), lOrdered, (unsigned)lParallel, lHandler, lClock);
       }
       else
-          throwError("InvalidMajorKeyComponent", "JSON 'major' property must be specified as string or array.");
+        lConnection->getBackend().multiGet(lKey, &lRange, parseDepth(depthStr),
+            parseDirection(dirStr), lHandler, lClock);
+
+      lTrace->setResults(vec.size());
+      return ItemSequence_t(new VectorItemSequence(vec));
+    }
+    catch (zorba::jvm::VMOpenException&)
+    {
+        Item lQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
+                  "VM001");
+        throw USER_EXCEPTION(lQName, "Could not start the Java VM (is the classpath set?)");
+    }
+    catch (JavaException&)
+    {
+      throwJavaException(env, env->ExceptionOccurred());
+    }
+}
+
 
-      //    minorList.add("mk1");
-      Item minorValues = keyParam.getObjectValue("minor");
+ItemSequence_t
+MultiGetManyFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                               const zorba::StaticContext* aStaticContext,
+                               const zorba::DynamicContext* aDynamicContext) const
+{
+    jthrowable lException = 0;
+    static JNIEnv* env;
 
-      if ( minorValues.isNull() )
+    try
+    {
+      // read input param 0 $db
+      Connection* lConnection = getConnectionArgument(args, aDynamicContext);
+      env = getEnv(lConnection, aStaticContext);
+
+      Statistics& lStatistics = lConnection->getStatistics();
+      OperationTimer lTimer(env, lStatistics, Statistics::MULTI_GET_MANY);
+      PhaseClock lClock(lConnection->getProfileTarget(), Statistics::MULTI_GET_MANY);
+      // the trace record is submitted when the result has been read
+      std::unique_ptr<TraceScope> lTrace(
+          new TraceScope(lConnection->getTraceLog(), Statistics::MULTI_GET_MANY));
+
+      // read input param 1 $parentKeys, a parent given twice is read once
+      std::vector<KeyPath> lKeys;
+      std::set<std::string> lSeen;
+      Iterator_t lIter = getIterArgument(args, 1);
+      Item lKeyItem;
+      lIter->open();
+      while (lIter->next(lKeyItem))
       {
-          // do nothing it's perfectly fine to have "minor" missing
+        KeyPath lKey = parseKeyItem(lKeyItem, lConnection->hasTypedKeys());
+        if (!lSeen.insert(lKey.toString()).second)
+          continue;
+        if (HotKeys* lHotKeys = lConnection->getHotKeys())
+          lHotKeys->recordParent(lKey);
+        lKeys.push_back(lKey);
       }
-      else if ( minorValues.isJSONItem() &&
-           minorValues.getJSONItemKind() == store::StoreConsts::jsonArray )
+      lIter->close();
+      lClock.lap(CallProfile::PARSE);
+
+      // pending writes under these major paths must be visible to the scans
+      WriteBuffer* lWriteBuffer = lConnection->getWriteBuffer();
+      if (lWriteBuffer)
       {
-          uint64_t minorValueSize = minorValues.getArraySize();
-          for (uint64_t i = 1; i<=minorValueSize; i++)
-          {
-             Item mkItem = minorValues.getArrayValue(i);
-             if ( !mkItem.isAtomic() )
-                throwError("InvalidMinorKeyComponent", "JSON 'minor' property, if specified, must be a string or an array.");
-             String mk = mkItem.getStringValue();
-             jstring jStrMk = env->NewStringUTF(mk.c_str());
-             CHECK_EXCEPTION(env);
-             env->CallBooleanMethod(minorList, midALAdd, jStrMk);
-             CHECK_EXCEPTION(env);
-          }
+        for (size_t i = 0; i < lKeys.size(); ++i)
+        {
+          lWriteBuffer->flushMajor(env, lConnection->getStore(), lKeys[i]);
+          CHECK_EXCEPTION(env);
+        }
+        lClock.lap(CallProfile::STORE);
       }
-      else if ( minorValues.isAtomic() )
+
+      // read input param 2 $subRange, which may be empty
+      KeyRangeSpec lRange;
+      Item lRangeItem = getOneItemArgument(args, 2);
+      if (!lRangeItem.isNull())
       {
-          String mk = minorValues.getStringValue();
-          jstring jStrMk = env->NewStringUTF(mk.c_str());
-          CHECK_EXCEPTION(env);
-          env->CallBooleanMethod(majorList, midALAdd, jStrMk);
-          CHECK_EXCEPTION(env);
+        lRange = parseKeyRangeItem(lRangeItem, lConnection->hasTypedKeys());
+        lTrace->setRange(lRange);
       }
-      else
-          throwError("InvalidMinorKeyComponent", "JSON 'minor' property, if specified, must be a string or an array.");
 
-      //    Key k = Key.createKey(majorList, minorList);
-      jclass keyClass = env->FindClass("oracle/kv/Key");
-      CHECK_EXCEPTION(env);
-      jmethodID midKeyCreate = env->GetStaticMethodID(keyClass, "createKey", "(Ljava/util/List;Ljava/util/List;)Loracle/kv/Key;");
-      CHECK_EXCEPTION(env);
-      jobject k = env->CallStaticObjectMethod(keyClass, midKeyCreate, majorList, minorList);
-      CHECK_EXCEPTION(env);
+      // get param 3 $depth as xs:string
+      std::string depthStr = getOneStringArgument(args, 3).str();
+      lTrace->setDepth(depthStr);
 
-      // read input param 2 $subRange
-      Item subRangeParam = getOneItemArgument(args, 2);
-      if(!subRangeParam.isJSONItem())
-        throwError("NoKeyRange", "$subRange param must be a JSON object");
+      // get param 4 $direction as xs:string
+      std::string dirStr = getOneStringArgument(args, 4).str();
+      lTrace->setDirection(dirStr);
+      lClock.lap(CallProfile::PARSE);
+
+      // the scans are opened here, their records are read as the result
+      // is consumed
+      Item lCallLimit = getOption(lRangeItem, "rate-limit");
+      Admission lAdmission(lConnection->getThrottle(), lStatistics, lClock, lCallLimit);
+      std::unique_ptr<RecordCursor> lCursor = lConnection->getBackend().openMerged(
+          lKeys, lRangeItem.isNull() ? 0 : &lRange,
+          parseDepth(depthStr), parseDirection(dirStr),
+          lConnection->getFetchParallelism(), lClock);
+
+      return ItemSequence_t(new CursorItemSequence(env, std::move(lCursor), std::move(lTrace),
+          lStatistics, lConnection->getThrottle().getBuckets(lCallLimit),
+          Statistics::MULTI_GET_MANY, lConnection->hasTypedKeys()));
+    }
+    catch (zorba::jvm::VMOpenException&)
+    {
+        Item lQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
+                  "VM001");
+        throw USER_EXCEPTION(lQName, "Could not start the Java VM (is the classpath set?)");
+    }
+    catch (JavaException&)
+    {
+      throwJavaException(env, env->ExceptionOccurred());
+    }
+}
+
+
+ItemSequence_t
+MultiDelFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                           const zorba::StaticContext* aStaticContext,
+                           const zorba::DynamicContext* aDynamicContext) const
+{
+    jthrowable lException = 0;
+    static JNIEnv* env;
+
+    try
+    {
+      // read input param 0
+      Connection* lConnection = getConnectionArgument(args, aDynamicContext);
+      env = getEnv(lConnection, aStaticContext);
 
-      Item prefix = subRangeParam.getObjectValue("prefix");
-      Item start = subRangeParam.getObjectValue("start");
-      Item end = subRangeParam.getObjectValue("end");
-      jobject keyRangeObj;
+      Statistics& lStatistics = lConnection->getStatistics();
+      OperationTimer lTimer(env, lStatistics, Statistics::MULTI_REMOVE);
+      PhaseClock lClock(lConnection->getProfileTarget(), Statistics::MULTI_REMOVE);
+      TraceScope lTrace(lConnection->getTraceLog(), Statistics::MULTI_REMOVE);
 
-      if ( !prefix.isNull() && start.isNull() && end.isNull() )
+      // read input param 1
+      KeyPath lKey = parseKeyItem(getOneItemArgument(args, 1), lConnection->hasTypedKeys());
+      lClock.lap(CallProfile::PARSE);
+      lTrace.setKey(lKey);
+      if (HotKeys* lHotKeys = lConnection->getHotKeys())
+        lHotKeys->recordParent(lKey);
+
+      // pending writes under this major path are sent first so that they
+      // are deleted as well
+      WriteBuffer* lWriteBuffer = lConnection->getWriteBuffer();
+      if (lWriteBuffer)
       {
-          String prefixValue = prefix.getStringValue();
-          // create keyRange from prefix
-          // KeyRange keyRange = new KeyRange(prefix);
-          jclass keyRangeClass = env->FindClass("oracle/kv/KeyRange");
-          CHECK_EXCEPTION(env);
-          jmethodID midKrCons = env->GetMethodID(keyRangeClass, "<init>", "(Ljava/lang/String;)V");
-          CHECK_EXCEPTION(env);
-          jstring jStrPrefix = env->NewStringUTF(prefixValue.c_str());
-          keyRangeObj = env->NewObject(keyRangeClass, midKrCons, jStrPrefix);
-          CHECK_EXCEPTION(env);
+        lWriteBuffer->flushMajor(env, lConnection->getStore(), lKey);
+        CHECK_EXCEPTION(env);
+        lClock.lap(CallProfile::STORE);
       }
-      else if (!start.isNull() && !end.isNull() && prefix.isNull() )
+
+      // read input param 2 $subRange
+      Item lRangeItem = getOneItemArgument(args, 2);
+      KeyRangeSpec lRange = parseKeyRangeItem(lRangeItem, lConnection->hasTypedKeys());
+      lTrace.setRange(lRange);
+
+      // get param 3 $depth as xs:string
+      std::string depthStr = getOneStringArgument(args, 3).str();
+      lTrace.setDepth(depthStr);
+      lClock.lap(CallProfile::PARSE);
+
+      Admission lAdmission(lConnection->getThrottle(), lStatistics, lClock,
+                           getOption(lRangeItem, "rate-limit"));
+
+      //    int result = store.multiDelete(k, keyRange, depth);
+      size_t lResult = lConnection->getBackend().multiRemove(lKey, &lRange,
+                                                             parseDepth(depthStr), lClock);
+      lTrace.setResults(lResult);
+
+      return ItemSequence_t(new SingletonItemSequence(
+          NoSqlDBModule::getItemFactory()->createInt((int)lResult)));
+    }
+    catch (zorba::jvm::VMOpenException&)
+    {
+        Item lQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
+                  "VM001");
+        throw USER_EXCEPTION(lQName, "Could not start the Java VM (is the classpath set?)");
+    }
+    catch (JavaException&)
+    {
+      throwJavaException(env, env->ExceptionOccurred());
+    }
+}
+
+// LOB code
+
+ItemSequence_t
+PutLOBFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                           const zorba::StaticContext* aStaticContext,
+                           const zorba::DynamicContext* aDynamicContext) const
+{
+  jthrowable lException = 0;
+  static JNIEnv* env;
+
+  try
+  {
+    zorba::jvm::JavaVMSingleton* lJVM = zorba::jvm::JavaVMSingleton::getInstance(aStaticContext);
+    env = lJVM->getEnv();
+
+    // read input param 0
+    String lInstanceID = getOneStringArgument(args, 0);
+
+    InstanceMap* lInstanceMap;
+    if (!(lInstanceMap = dynamic_cast<InstanceMap*>(aDynamicContext->getExternalFunctionParameter("nosqldbInstanceMap"))))
+    {
+      throwError("NoInstanceMatch", "Not a NoSQL DB identifier.");
+    }
+
+    Connection* lConnection = lInstanceMap->getConnection(lInstanceID);
+    if (!lConnection)
+    {
+        throwError("NoInstanceMatch", "No instance of NoSQL DB with the given identifier was found.");
+    }
+    requireKVStore(lConnection);
+    jobject kvsObjRef = lConnection->getStore();
+
+    Statistics& lStatistics = lInstanceMap->getConnection(lInstanceID)->getStatistics();
+    OperationTimer lTimer(env, lStatistics, Statistics::PUT_LOB);
+    TraceScope lTrace(lInstanceMap->getConnection(lInstanceID)->getTraceLog(), Statistics::PUT_LOB);
+
+    // read input param 1
+    KeyPath lKey = parseKeyItem(getOneItemArgument(args, 1), lConnection->hasTypedKeys());
+    lTrace.setKey(lKey);
+    if (HotKeys* lHotKeys = lInstanceMap->getConnection(lInstanceID)->getHotKeys())
+      lHotKeys->recordKey(lKey);
+
+    // read input param 2, it is streamed to the store and never copied as a
+    // whole unless Zorba already holds it in memory
+    Item valueItem = getOneItemArgument(args, 2);
+    std::unique_ptr<std::istringstream> lMemoryStream;
+    std::istream* lStream;
+    bool lDecoderAttached = false;
+
+    if (valueItem.isStreamable())
+    {
+      lStream = &valueItem.getStream();
+      if (valueItem.isEncoded())
       {
-          String startValue = start.getStringValue();
-          String endValue = end.getStringValue();
-          bool startIncl = true;
-          bool endIncl = true;
-
-          Item startI = subRangeParam.getObjectValue("start-inclusive");
-          if ( !startI.isNull() )
-              startIncl = startI.getBooleanValue();
-
-          Item endI = subRangeParam.getObjectValue("end-inclusive");
-          if ( !endI.isNull() )
-              endIncl = endI.getBooleanValue();
-
-          // create keyRange from start end
-          // KeyRange keyRange = new KeyRange(start, startIncl, end, endIncl);
-          jclass keyRangeClass = env->FindClass("oracle/kv/KeyRange");
-          CHECK_EXCEPTION(env);
-          jmethodID midKrCons = env->GetMethodID(keyRangeClass, "<init>", "(Ljava/lang/String;ZLjava/lang/String;Z)V");
-          CHECK_EXCEPTION(env);
-          jstring jStrStart = env->NewStringUTF(startValue.c_str());
-          jstring jStrEnd = env->NewStringUTF(endValue.c_str());
-          keyRangeObj = env->NewObject(keyRangeClass, midKrCons, jStrStart, startIncl, jStrEnd, endIncl);
-          CHECK_EXCEPTION(env);
+        base64::attach(*lStream);
+        lDecoderAttached = true;
       }
+    }
+    else
+    {
+      size_t lSize;
+      std::string valueString;
+      const char* lMsg = valueItem.getBase64BinaryValue(lSize);
+      if (valueItem.isEncoded())
+        base64::decode(lMsg, lSize, &valueString);
       else
+        valueString = std::string(lMsg, lSize);
+      lMemoryStream.reset(new std::istringstream(valueString));
+      lStream = lMemoryStream.get();
+    }
+
+    //    Key k = Key.createKey(majorList, minorList);
+    jobject k = createJavaKey(env, lKey);
+    CHECK_EXCEPTION(env);
+
+    //    PipedInputStream in = new PipedInputStream(chunkSize);
+    jclass pisClass = env->FindClass("java/io/PipedInputStream");
+    CHECK_EXCEPTION(env);
+    jmethodID midPisCons = env->GetMethodID(pisClass, "<init>", "(I)V");
+    CHECK_EXCEPTION(env);
+    jmethodID midPisClose = env->GetMethodID(pisClass, "close", "()V");
+    CHECK_EXCEPTION(env);
+    jobject in = env->NewObject(pisClass, midPisCons, (jint)NOSQLDB_LOB_CHUNK_SIZE);
+    CHECK_EXCEPTION(env);
+
+    //    PipedOutputStream out = new PipedOutputStream(in);
+    jclass posClass = env->FindClass("java/io/PipedOutputStream");
+    CHECK_EXCEPTION(env);
+    jmethodID midPosCons = env->GetMethodID(posClass, "<init>", "(Ljava/io/PipedInputStream;)V");
+    CHECK_EXCEPTION(env);
+    jobject out = env->NewObject(posClass, midPosCons, in);
+    CHECK_EXCEPTION(env);
+
+    //    TimeUnit unit = TimeUnit.MILLISECONDS;
+    jclass timeUnitClass = env->FindClass("java/util/concurrent/TimeUnit");
+    CHECK_EXCEPTION(env);
+    jfieldID fidMillis = env->GetStaticFieldID(timeUnitClass, "MILLISECONDS", "Ljava/util/concurrent/TimeUnit;");
+    CHECK_EXCEPTION(env);
+    jobject unit = env->GetStaticObjectField(timeUnitClass, fidMillis);
+    CHECK_EXCEPTION(env);
+
+    jclass kvsClass = env->FindClass("oracle/kv/KVStore");
+    CHECK_EXCEPTION(env);
+    jmethodID midkvsPutLOB = env->GetMethodID(kvsClass, "putLOB", "(Loracle/kv/Key;Ljava/io/InputStream;Loracle/kv/Durability;JLjava/util/concurrent/TimeUnit;)Loracle/kv/Version;");
+    CHECK_EXCEPTION(env);
+    jmethodID midkvsDeleteLOB = env->GetMethodID(kvsClass, "deleteLOB", "(Loracle/kv/Key;Loracle/kv/Durability;JLjava/util/concurrent/TimeUnit;)Z");
+    CHECK_EXCEPTION(env);
+
+    jobject version;
+    bool lPumpFailed;
+    {
+      // the pump thread feeds the pipe while putLOB drains it on this thread
+      StreamPump lPump(lJVM->getVM(), env, *lStream, out);
+
+      //    Version version = store.putLOB(k, in, null, 0, unit);
+      version = env->CallObjectMethod(kvsObjRef, midkvsPutLOB, k, in, NULL, (jlong)0, unit);
+      jthrowable lPutException = env->ExceptionOccurred();
+      if (lPutException)
+        env->ExceptionClear();
+
+      //    in.close();  unblocks the pump if putLOB gave up early
+      env->CallVoidMethod(in, midPisClose);
+      if (env->ExceptionCheck())
+        env->ExceptionClear();
+      lPump.join();
+      lPumpFailed = lPump.failed();
+
+      if (lDecoderAttached)
+        base64::detach(*lStream);
+
+      if (lPumpFailed)
       {
-          throwError("InvalidKeyRange", "$subRange param must contain either 'prefix' or 'start' and 'end' properties.");
+        //    store.deleteLOB(k, null, 0, unit);  putLOB saw the end of a
+        //    truncated value
+        if (!lPutException)
+        {
+          env->CallBooleanMethod(kvsObjRef, midkvsDeleteLOB, k, NULL, (jlong)0, unit);
+          if (env->ExceptionCheck())
+            env->ExceptionClear();
+        }
+        throwError("LOBStreamError", "Reading the $value stream failed, the LOB was not stored.");
       }
 
-      // get param 3 $depth as xs:string
-      Item depthParam = getOneItemArgument(args, 3);
-      String depthStr = depthParam.getStringValue();
-      jclass depthClass = env->FindClass("oracle/kv/Depth");
+      if (lPutException)
+        env->Throw(lPutException);
       CHECK_EXCEPTION(env);
-      jobject depth_CHILDREN_ONLY = env-> GetStaticObjectField(depthClass, env->GetStaticFieldID(depthClass,"CHILDREN_ONLY", "Loracle/kv/Depth;"));
-      jobject depth_PARENT_AND_CHILDREN = env-> GetStaticObjectField(depthClass, env->GetStaticFieldID(depthClass,"PARENT_AND_CHILDREN", "Loracle/kv/Depth;"));
-      jobject depth_DESCENDANTS_ONLY = env-> GetStaticObjectField(depthClass, env->GetStaticFieldID(depthClass,"DESCENDANTS_ONLY", "Loracle/kv/Depth;"));
-      jobject depth_PARENT_AND_DESCENDANTS = env-> GetStaticObjectField(depthClass, env->GetStaticFieldID(depthClass,"PARENT_AND_DESCENDANTS", "Loracle/kv/Depth;"));
-      jobject depthObj = depth_PARENT_AND_DESCENDANTS;
-
-      if ( depthStr.compare("CHILDREN_ONLY")==0 )
-          depthObj = depth_CHILDREN_ONLY;
-      else if ( depthStr.compare("PARENT_AND_CHILDREN")==0 )
-          depthObj = depth_PARENT_AND_CHILDREN;
-      else if ( depthStr.compare("DESCENDANTS_ONLY")==0 )
-          depthObj = depth_DESCENDANTS_ONLY;
-      else if ( depthStr.compare("PARENT_AND_DESCENDANTS")==0 )
-          depthObj = depth_PARENT_AND_DESCENDANTS;
+    }
 
-      // get param 4 $direction as xs:string
-      Item dirParam = getOneItemArgument(args, 4);
-      String dirStr = dirParam.getStringValue();
-      jclass dirClass = env->FindClass("oracle/kv/Direction");
-      CHECK_EXCEPTION(env);
-      jfieldID fidDirForward = env->GetStaticFieldID(dirClass,"FORWARD", "Loracle/kv/Direction;");
+    //    long versionLong = version.getVersion();
+    jclass versionClass = env->FindClass("oracle/kv/Version");
+    CHECK_EXCEPTION(env);
+    jmethodID midVersionGetVerion = env->GetMethodID(versionClass, "getVersion", "()J");
+    CHECK_EXCEPTION(env);
+    jlong versionLong = env->CallLongMethod(version, midVersionGetVerion);
+    CHECK_EXCEPTION(env);
+    lConnection->getReadYourWrites().written(env, lKey, version);
+    CHECK_EXCEPTION(env);
+
+    return ItemSequence_t(new SingletonItemSequence(
+        NoSqlDBModule::getItemFactory()->createLong(versionLong)));
+  }
+  catch (zorba::jvm::VMOpenException&)
+  {
+      Item lQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
+                "VM001");
+      throw USER_EXCEPTION(lQName, "Could not start the Java VM (is the classpath set?)");
+  }
+  catch (JavaException&)
+  {
+    throwJavaException(env, lException);
+  }
+}
+
+
+ItemSequence_t
+GetLOBFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                           const zorba::StaticContext* aStaticContext,
+                           const zorba::DynamicContext* aDynamicContext) const
+{
+    jthrowable lException = 0;
+    static JNIEnv* env;
+
+    try
+    {
+      env = zorba::jvm::JavaVMSingleton::getInstance(aStaticContext)->getEnv();
+
+      // read input param 0
+      String lInstanceID = getOneStringArgument(args, 0);
+
+      InstanceMap* lInstanceMap;
+      if (!(lInstanceMap = dynamic_cast<InstanceMap*>(aDynamicContext->getExternalFunctionParameter("nosqldbInstanceMap"))))
+      {
+        throwError("NoInstanceMatch", "Not a NoSQL DB identifier.");
+      }
+
+      Connection* lConnection = lInstanceMap->getConnection(lInstanceID);
+      if (!lConnection)
+      {
+          throwError("NoInstanceMatch", "No instance of NoSQL DB with the given identifier was found.");
+      }
+      requireKVStore(lConnection);
+      jobject kvsObjRef = lConnection->getStore();
+
+      Statistics& lStatistics = lInstanceMap->getConnection(lInstanceID)->getStatistics();
+      OperationTimer lTimer(env, lStatistics, Statistics::GET_LOB);
+      TraceScope lTrace(lInstanceMap->getConnection(lInstanceID)->getTraceLog(), Statistics::GET_LOB);
+
+      // read input param 1
+      KeyPath lKey = parseKeyItem(getOneItemArgument(args, 1), lConnection->hasTypedKeys());
+      lTrace.setKey(lKey);
+      if (HotKeys* lHotKeys = lInstanceMap->getConnection(lInstanceID)->getHotKeys())
+        lHotKeys->recordKey(lKey);
+
+      //    Key k = Key.createKey(majorList, minorList);
+      jobject k = createJavaKey(env, lKey);
       CHECK_EXCEPTION(env);
-      jobject dir_FORWARD = env-> GetStaticObjectField(dirClass, fidDirForward);
+
+      //    TimeUnit unit = TimeUnit.MILLISECONDS;
+      jclass timeUnitClass = env->FindClass("java/util/concurrent/TimeUnit");
       CHECK_EXCEPTION(env);
-      jfieldID fidDirReverse = env->GetStaticFieldID(dirClass,"REVERSE", "Loracle/kv/Direction;");
+      jfieldID fidMillis = env->GetStaticFieldID(timeUnitClass, "MILLISECONDS", "Ljava/util/concurrent/TimeUnit;");
       CHECK_EXCEPTION(env);
-      jobject dir_REVERSE = env-> GetStaticObjectField(dirClass, fidDirReverse);
+      jobject unit = env->GetStaticObjectField(timeUnitClass, fidMillis);
       CHECK_EXCEPTION(env);
 
-      jobject dirObj = dir_FORWARD;
-      if ( dirStr.compare("REVERSE")==0 )
-          dirObj = dir_REVERSE;
-
-      //    java.util.Iterator<oracle.kv.KeyValueVersion> iterator = store.multiGetIterator(dirObj, 0, k, keyRangeObj, depthObj);
+      //    InputStreamVersion isv = store.getLOB(k, consistency, 0, unit);
+      // with the Consistency.Version of a put-lob of the connection, if any
+      jobject consistency = lConnection->getReadYourWrites().createConsistency(env, lKey);
       jclass kvsClass = env->FindClass("oracle/kv/KVStore");
       CHECK_EXCEPTION(env);
-      jmethodID midkvsMultiGetIter = env->GetMethodID(kvsClass, "multiGetIterator", "(Loracle/kv/Direction;ILoracle/kv/Key;Loracle/kv/KeyRange;Loracle/kv/Depth;)Ljava/util/Iterator;");
+      jmethodID midkvsGetLOB = env->GetMethodID(kvsClass, "getLOB", "(Loracle/kv/Key;Loracle/kv/Consistency;JLjava/util/concurrent/TimeUnit;)Loracle/kv/lob/InputStreamVersion;");
       CHECK_EXCEPTION(env);
-      jobject iterator = env->CallObjectMethod(kvsObjRef, midkvsMultiGetIter, dirObj, 0, k, keyRangeObj, depthObj);
+      RetryPolicy& lRetry = lInstanceMap->getConnection(lInstanceID)->getRetryPolicy();
+      jobject isv;
+      for (unsigned lAttempt = 1; ; ++lAttempt)
+      {
+        isv = env->CallObjectMethod(kvsObjRef, midkvsGetLOB, k, consistency, (jlong)0, unit);
+        if (!lRetry.retry(env, lAttempt, RetryPolicy::IDEMPOTENT))
+          break;
+      }
       CHECK_EXCEPTION(env);
 
-      // use the iterator
-      jclass iterClass = env->FindClass("java/util/Iterator");
+      // if no result return empty sequence
+      if ( isv==NULL )
+          return ItemSequence_t(new EmptySequence());
+
+      //    InputStream in = isv.getInputStream();
+      jclass isvClass = env->FindClass("oracle/kv/lob/InputStreamVersion");
       CHECK_EXCEPTION(env);
-      jmethodID midIterHasNext = env->GetMethodID(iterClass, "hasNext", "()Z");
+      jmethodID midIsvGetInputStream = env->GetMethodID(isvClass, "getInputStream", "()Ljava/io/InputStream;");
       CHECK_EXCEPTION(env);
-      jmethodID midIterNext = env->GetMethodID(iterClass, "next", "()Ljava/lang/Object;");
+      jobject in = env->CallObjectMethod(isv, midIsvGetInputStream);
       CHECK_EXCEPTION(env);
 
-      jclass listClass = env->FindClass("java/util/List");
+      //    Version version = isv.getVersion();
+      jmethodID midIsvGetVersion = env->GetMethodID(isvClass, "getVersion", "()Loracle/kv/Version;");
       CHECK_EXCEPTION(env);
-      jmethodID midListSize = env->GetMethodID(listClass, "size", "()I");
-      CHECK_EXCEPTION(env);
-      jmethodID midListGet = env->GetMethodID(listClass, "get", "(I)Ljava/lang/Object;");
+      jobject version = env->CallObjectMethod(isv, midIsvGetVersion);
       CHECK_EXCEPTION(env);
 
-      jclass kvvClass = env->FindClass("oracle/kv/KeyValueVersion");
-      CHECK_EXCEPTION(env);
-      jmethodID midkvvGetKey = env->GetMethodID(kvvClass, "getKey", "()Loracle/kv/Key;");
+      //    long versionLong = version.getVersion();
+      jclass versionClass = env->FindClass("oracle/kv/Version");
       CHECK_EXCEPTION(env);
-      jmethodID midkvvGetValue = env->GetMethodID(kvvClass, "getValue", "()Loracle/kv/Value;");
+      jmethodID midVersionGetVerion = env->GetMethodID(versionClass, "getVersion", "()J");
       CHECK_EXCEPTION(env);
-      jmethodID midkvvGetVersion = env->GetMethodID(kvvClass, "getVersion", "()Loracle/kv/Version;");
+      jlong versionLong = env->CallLongMethod(version, midVersionGetVerion);
       CHECK_EXCEPTION(env);
 
-      jmethodID midKeyGetMajorPath = env->GetMethodID(keyClass, "getMajorPath", "()Ljava/util/List;");
-      CHECK_EXCEPTION(env);
-      jmethodID midKeyGetMinorPath = env->GetMethodID(keyClass, "getMinorPath", "()Ljava/util/List;");
+      // the value is pulled from the store chunk by chunk while Zorba reads
+      // it, the stream is closed when Zorba releases the item
+      JavaInputStream* lStream = new JavaInputStream(
+          zorba::jvm::JavaVMSingleton::getInstance(aStaticContext)->getVM(), env, in);
       CHECK_EXCEPTION(env);
+      Item val( NoSqlDBModule::getItemFactory()->createStreamableBase64Binary(
+          *lStream, &JavaInputStream::release, false, false) );
+      Item vers = NoSqlDBModule::getItemFactory()->createLong(versionLong);
 
-      jclass valueClass = env->FindClass("oracle/kv/Value");
-      CHECK_EXCEPTION(env);
-      jmethodID midValGetVal = env->GetMethodID(valueClass, "getValue", "()[B");
-      CHECK_EXCEPTION(env);
+      std::vector<std::pair<Item, Item> > pairs;
+      pairs.reserve(2);
+      pairs.push_back(std::pair<Item, Item>(
+        NoSqlDBModule::getItemFactory()->createString(String("value")), val));
+      pairs.push_back(std::pair<Item, Item>(
+        NoSqlDBModule::getItemFactory()->createString(String("version")), vers));
 
-      jclass versionClass = env->FindClass("oracle/kv/Version");
-      CHECK_EXCEPTION(env);
-      jmethodID midVerGetVer = env->GetMethodID(versionClass, "getVersion", "()J");
-      CHECK_EXCEPTION(env);
+      Item jsonObj = NoSqlDBModule::getItemFactory()->createJSONObject(pairs);
 
-      std::vector<Item> vec;
+      lTrace.setResults(1);
+      return ItemSequence_t(new SingletonItemSequence(jsonObj));
+    }
+    catch (zorba::jvm::VMOpenException&)
+    {
+        Item lQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
+                  "VM001");
+        throw USER_EXCEPTION(lQName, "Could not start the Java VM (is the classpath set?)");
+    }
+    catch (JavaException&)
+    {
+      // raised by CHECK_EXCEPTION or by createConsistency, still pending
+      throwJavaException(env, env->ExceptionOccurred());
+    }
+}
 
-      while( true )
+
+ItemSequence_t
+FlushFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                        const zorba::StaticContext* aStaticContext,
+                        const zorba::DynamicContext* aDynamicContext) const
+{
+    jthrowable lException = 0;
+    static JNIEnv* env;
+
+    try
+    {
+      // read input param 0
+      String lInstanceID = getOneStringArgument(args, 0);
+
+      InstanceMap* lInstanceMap;
+      if (!(lInstanceMap = dynamic_cast<InstanceMap*>(aDynamicContext->getExternalFunctionParameter("nosqldbInstanceMap"))))
       {
-          //    iterator.hasNext()
-          jboolean hasNext = env->CallBooleanMethod(iterator, midIterHasNext);
-          CHECK_EXCEPTION(env);
-          if ( !hasNext )
-              break;
+        throwError("NoInstanceMatch", "Not a NoSQL DB identifier.");
+      }
 
-          //    KeyValueVersion kvv = iterator.next()
-          jobject kvv = env->CallObjectMethod(iterator, midIterNext);
-          CHECK_EXCEPTION(env);
-          //    Key keyObj = kvv.getKey();
-          jobject keyObj = env->CallObjectMethod(kvv, midkvvGetKey);
-          CHECK_EXCEPTION(env);
-          //    Value valueObj = kvv.getValue();
-          jobject valueObj = env->CallObjectMethod(kvv, midkvvGetValue);
-          CHECK_EXCEPTION(env);
-          //    Version version = kvv.getVersion();
-          jobject versionObj = env->CallObjectMethod(kvv, midkvvGetVersion);
-          CHECK_EXCEPTION(env);
+      Connection* lConnection = lInstanceMap->getConnection(lInstanceID);
+      if (!lConnection)
+      {
+          throwError("NoInstanceMatch", "No instance of NoSQL DB with the given identifier was found.");
+      }
+      env = getEnv(lConnection, aStaticContext);
 
-          //    List<String> majorList = keyObj.getMajorPath();
-          jobject majorList = env->CallObjectMethod(keyObj, midKeyGetMajorPath);
-          CHECK_EXCEPTION(env);
-          //    List<String> minorList = keyObj.getMinorPath();
-          jobject minorList = env->CallObjectMethod(keyObj, midKeyGetMinorPath);
-          CHECK_EXCEPTION(env);
-          //    byte[] valueBA = valueObj.getValue();
-          jbyteArray jbaValue = (jbyteArray) env->CallObjectMethod(valueObj, midValGetVal);
-          CHECK_EXCEPTION(env);
-          jsize jbaSize = env->GetArrayLength(jbaValue);
-          CHECK_EXCEPTION(env);
-          char * buf = new char[jbaSize];
-          env->GetByteArrayRegion(jbaValue, 0, jbaSize, (jbyte *)buf);
-          CHECK_EXCEPTION(env);
+      Statistics& lStatistics = lConnection->getStatistics();
+      OperationTimer lTimer(env, lStatistics, Statistics::FLUSH);
+      TraceScope lTrace(lConnection->getTraceLog(), Statistics::FLUSH);
 
-          //    long version = versionObj.getVersion();
-          jlong version = env->CallLongMethod(versionObj, midVerGetVer);
-          CHECK_EXCEPTION(env);
+      size_t lSent = 0;
+      WriteBuffer* lWriteBuffer = lConnection->getWriteBuffer();
+      if (lWriteBuffer)
+      {
+        lSent = lWriteBuffer->flush(env, lConnection->getStore());
+        CHECK_EXCEPTION(env);
+        lTrace.setResults(lSent);
+      }
+
+      // the trace records of the calls so far are written out as well
+      if (TraceLog* lTraceLog = lConnection->getTraceLog())
+        lTraceLog->flush();
+
+      return ItemSequence_t(new SingletonItemSequence(
+          NoSqlDBModule::getItemFactory()->createInteger((long long)lSent)));
+    }
+    catch (zorba::jvm::VMOpenException&)
+    {
+        Item lQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
+                  "VM001");
+        throw USER_EXCEPTION(lQName, "Could not start the Java VM (is the classpath set?)");
+    }
+    catch (JavaException&)
+    {
+      throwJavaException(env, lException);
+    }
+}
+
+
+ItemSequence_t
+ImportFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                         const zorba::StaticContext* aStaticContext,
+                         const zorba::DynamicContext* aDynamicContext) const
+{
+    jthrowable lException = 0;
+    static JNIEnv* env;
+
+    try
+    {
+      env = zorba::jvm::JavaVMSingleton::getInstance(aStaticContext)->getEnv();
+
+      // read input param 0
+      String lInstanceID = getOneStringArgument(args, 0);
+
+      InstanceMap* lInstanceMap;
+      if (!(lInstanceMap = dynamic_cast<InstanceMap*>(aDynamicContext->getExternalFunctionParameter("nosqldbInstanceMap"))))
+      {
+        throwError("NoInstanceMatch", "Not a NoSQL DB identifier.");
+      }
+
+      Connection* lConnection = lInstanceMap->getConnection(lInstanceID);
+      if (!lConnection)
+      {
+          throwError("NoInstanceMatch", "No instance of NoSQL DB with the given identifier was found.");
+      }
+      requireKVStore(lConnection);
+
+      Statistics& lStatistics = lConnection->getStatistics();
+      OperationTimer lTimer(env, lStatistics, Statistics::IMPORT);
+      TraceScope lTrace(lConnection->getTraceLog(), Statistics::IMPORT);
+      jobject kvsObjRef = lConnection->getStore();
+
+      // buffered writes go first, the transfer bypasses the buffer
+      WriteBuffer* lWriteBuffer = lConnection->getWriteBuffer();
+      if (lWriteBuffer)
+      {
+        lWriteBuffer->flush(env, kvsObjRef);
+        CHECK_EXCEPTION(env);
+      }
+
+      // read input param 1 $path
+      std::string lPath = getOneStringArgument(args, 1).str();
+
+      // read input param 2 $options
+      Item lOptions = getOneItemArgument(args, 2);
+      long long lParallelism = getIntegerOption(lOptions, "parallelism", 4);
+      long long lBatchSize = getIntegerOption(lOptions, "batch-size", 100);
+      if (lParallelism < 1 || lParallelism > 256)
+        throwError("InvalidOption", "Option 'parallelism' must be between 1 and 256.");
+      if (lBatchSize < 1)
+        throwError("InvalidOption", "Option 'batch-size' must be positive.");
+
+      TransferStats lStats = importJSONLines(env,
+          zorba::jvm::JavaVMSingleton::getInstance(aStaticContext)->getVM(),
+          lConnection->getStoreHandles().getStores(), lPath, (unsigned)lParallelism,
+          (size_t)lBatchSize, lConnection->getReadYourWrites());
+      lTrace.setResults(lStats.theRecords);
+      lTrace.addBytes(lStats.theBytes);
+
+      return ItemSequence_t(new SingletonItemSequence(createTransferStatsItem(lStats)));
+    }
+    catch (zorba::jvm::VMOpenException&)
+    {
+        Item lQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
+                  "VM001");
+        throw USER_EXCEPTION(lQName, "Could not start the Java VM (is the classpath set?)");
+    }
+    catch (JavaException&)
+    {
+      throwJavaException(env, lException);
+    }
+}
+
+
+
+ItemSequence_t
+ExportFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                         const zorba::StaticContext* aStaticContext,
+                         const zorba::DynamicContext* aDynamicContext) const
+{
+    jthrowable lException = 0;
+    static JNIEnv* env;
+
+    try
+    {
+      env = zorba::jvm::JavaVMSingleton::getInstance(aStaticContext)->getEnv();
+
+      // read input param 0
+      String lInstanceID = getOneStringArgument(args, 0);
+
+      InstanceMap* lInstanceMap;
+      if (!(lInstanceMap = dynamic_cast<InstanceMap*>(aDynamicContext->getExternalFunctionParameter("nosqldbInstanceMap"))))
+      {
+        throwError("NoInstanceMatch", "Not a NoSQL DB identifier.");
+      }
+
+      Connection* lConnection = lInstanceMap->getConnection(lInstanceID);
+      if (!lConnection)
+      {
+          throwError("NoInstanceMatch", "No instance of NoSQL DB with the given identifier was found.");
+      }
+      requireKVStore(lConnection);
+
+      Statistics& lStatistics = lConnection->getStatistics();
+      OperationTimer lTimer(env, lStatistics, Statistics::EXPORT);
+      TraceScope lTrace(lConnection->getTraceLog(), Statistics::EXPORT);
+      jobject kvsObjRef = lConnection->getStore();
+
+      // buffered writes go first, the transfer bypasses the buffer
+      WriteBuffer* lWriteBuffer = lConnection->getWriteBuffer();
+      if (lWriteBuffer)
+      {
+        lWriteBuffer->flush(env, kvsObjRef);
+        CHECK_EXCEPTION(env);
+      }
+
+      // read input param 1 $parentKey, the whole store if empty
+      jobject k = NULL;
+      Item lKeyItem = getOneItemArgument(args, 1);
+      if (!lKeyItem.isNull())
+      {
+        KeyPath lKey = parseKeyItem(lKeyItem, lConnection->hasTypedKeys());
+        lTrace.setKey(lKey);
+        k = createJavaKey(env, lKey);
+        CHECK_EXCEPTION(env);
+      }
 
+      // read input param 2 $subRange, optional
+      jobject keyRangeObj = NULL;
+      Item lRangeItem = getOneItemArgument(args, 2);
+      if (!lRangeItem.isNull())
+      {
+        KeyRangeSpec lRange = parseKeyRangeItem(lRangeItem, lConnection->hasTypedKeys());
+        lTrace.setRange(lRange);
+        keyRangeObj = createJavaKeyRange(env, lRange);
+        CHECK_EXCEPTION(env);
+      }
 
-          std::vector<Item> majorVec;
-          jint majorListSize = env->CallIntMethod(majorList, midListSize);
-          for ( jint i=0; i<majorListSize; i++)
-          {
-              jstring majorJS = (jstring) env->CallObjectMethod(majorList, midListGet, i);
-              const char * majorCStr = env->GetStringUTFChars(majorJS, NULL);
-              String majorStr(majorCStr);
-              majorVec.push_back(NoSqlDBModule::getItemFactory()->createString(majorStr));
-          }
-          Item majorListItem =  NoSqlDBModule::getItemFactory()->createJSONArray(majorVec);
+      // read input param 3 $path
+      std::string lPath = getOneStringArgument(args, 3).str();
 
-          std::vector<Item> minorVec;
-          jint minorListSize = env->CallIntMethod(minorList, midListSize);
-          for ( jint i=0; i<minorListSize; i++)
-          {
-              jstring minorJS = (jstring) env->CallObjectMethod(minorList, midListGet, i);
-              const char * minorCStr = env->GetStringUTFChars(minorJS, NULL);
-              String minorStr(minorCStr);
-              minorVec.push_back(NoSqlDBModule::getItemFactory()->createString(minorStr));
-          }
-          Item minorListItem =  NoSqlDBModule::getItemFactory()->createJSONArray(minorVec);
-
-          std::vector<std::pair<Item, Item> > keyPairs;
-          keyPairs.reserve(2);
-          keyPairs.push_back(std::pair<Item, Item>(
-            NoSqlDBModule::getItemFactory()->createString(String("major")), majorListItem));
-          keyPairs.push_back(std::pair<Item, Item>(
-            NoSqlDBModule::getItemFactory()->createString(String("minor")), minorListItem));
-
-          Item keyJsonObj =  NoSqlDBModule::getItemFactory()->createJSONObject(keyPairs);
-
-          std::string ssString(buf, jbaSize);
-          Item val( NoSqlDBModule::getItemFactory()->createBase64Binary(ssString.c_str(), ssString.size(), false) );
-          Item vers = NoSqlDBModule::getItemFactory()->createLong(version);
-
-          std::vector<std::pair<Item, Item> > pairs;
-          pairs.reserve(3);
-          pairs.push_back(std::pair<Item, Item>(
-            NoSqlDBModule::getItemFactory()->createString(String("key")), keyJsonObj));
-          pairs.push_back(std::pair<Item, Item>(
-            NoSqlDBModule::getItemFactory()->createString(String("value")), val));
-          pairs.push_back(std::pair<Item, Item>(
-            NoSqlDBModule::getItemFactory()->createString(String("version")), vers));
-
-          Item lRes = NoSqlDBModule::getItemFactory()->createJSONObject(pairs);
-          vec.push_back(lRes);
-      }
+      TransferStats lStats;
+      exportJSONLines(env, kvsObjRef, k, keyRangeObj, lConnection->getBatchSizer(),
+                      lPath, lStats);
+      CHECK_EXCEPTION(env);
+      lTrace.setResults(lStats.theRecords);
+      lTrace.addBytes(lStats.theBytes);
 
-      return ItemSequence_t(new VectorItemSequence(vec));
+      return ItemSequence_t(new SingletonItemSequence(createTransferStatsItem(lStats)));
     }
     catch (zorba::jvm::VMOpenException&)
     {
@@ -1452,53 +2288,15 @@ std::cout << "  mg: start" << std::endl; std::cout.flush();
     }
     catch (JavaException&)
     {
-        // prints out to std err the stacktrace
-        //env->ExceptionDescribe();
-
-        jclass stringWriterClass = env->FindClass("java/io/StringWriter");
-        jclass printWriterClass = env->FindClass("java/io/PrintWriter");
-        jclass throwableClass = env->FindClass("java/lang/Throwable");
-        jobject stringWriter = env->NewObject(
-                  stringWriterClass,
-                  env->GetMethodID(stringWriterClass, "<init>", "()V"));
-
-        jobject printWriter = env->NewObject(
-                  printWriterClass,
-                  env->GetMethodID(printWriterClass, "<init>", "(Ljava/io/Writer;)V"),
-                  stringWriter);
-
-        env->CallObjectMethod(lException,
-                  env->GetMethodID(throwableClass, "printStackTrace",
-                          "(Ljava/io/PrintWriter;)V"),
-                  printWriter);
-
-        //env->CallObjectMethod(printWriter, env->GetMethodID(printWriterClass, "flush", "()V"));
-        jmethodID toStringMethod =
-              env->GetMethodID(stringWriterClass, "toString", "()Ljava/lang/String;");
-        jobject errorMessageObj = env->CallObjectMethod( stringWriter, toStringMethod);
-        jstring errorMessage = (jstring) errorMessageObj;
-        const char *errMsg = env->GetStringUTFChars(errorMessage, NULL);
-        std::stringstream s;
-        s << "A Java Exception was thrown:" << std::endl << errMsg;
-        String errDescription;
-        errDescription += s.str();
-        env->ExceptionClear();
-        env->ReleaseStringUTFChars(errorMessage, errMsg);
-
-        Item errQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
-                  "JAVA-EXCEPTION");
-
-        //std::cout << "  java exception:'" << errDescription << "'" << std::endl; std::cout.flush();
-
-        throw USER_EXCEPTION(errQName, errDescription );
+      throwJavaException(env, lException);
     }
 }
 
 
 ItemSequence_t
-MultiDelFunction::evaluate(const ExternalFunction::Arguments_t& args,
-                           const zorba::StaticContext* aStaticContext,
-                           const zorba::DynamicContext* aDynamicContext) const
+PurgeFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                        const zorba::StaticContext* aStaticContext,
+                        const zorba::DynamicContext* aDynamicContext) const
 {
     jthrowable lException = 0;
     static JNIEnv* env;
@@ -1516,191 +2314,361 @@ MultiDelFunction::evaluate(const ExternalFunction::Arguments_t& args,
         throwError("NoInstanceMatch", "Not a NoSQL DB identifier.");
       }
 
-      jobject kvsObjRef = lInstanceMap->getInstance(lInstanceID);
-      if (!kvsObjRef)
+      Connection* lConnection = lInstanceMap->getConnection(lInstanceID);
+      if (!lConnection)
       {
           throwError("NoInstanceMatch", "No instance of NoSQL DB with the given identifier was found.");
       }
+      requireKVStore(lConnection);
 
-      // read input param 1
-      Item keyParam = getOneItemArgument(args, 1);
-      if(!keyParam.isJSONItem())
-        throwError("InvalidKeyParam", "$key param must be a JSON object");
-
-      //    List majorList = new ArrayList();
-      jclass arrayListClass = env->FindClass("java/util/ArrayList");
-      CHECK_EXCEPTION(env);
-      jmethodID midALCons = env->GetMethodID(arrayListClass, "<init>", "()V");
-      CHECK_EXCEPTION(env);
-      jmethodID midALAdd = env->GetMethodID(arrayListClass, "add", "(Ljava/lang/Object;)Z");
-      CHECK_EXCEPTION(env);
-      jobject majorList = env->NewObject(arrayListClass, midALCons);
-      CHECK_EXCEPTION(env);
-      //    List minorList = new ArrayList();
-      jobject minorList = env->NewObject(arrayListClass, midALCons);
-      CHECK_EXCEPTION(env);
-
-      //    majorList.add("Mk1");
-      Item majorValues = keyParam.getObjectValue("major");
+      Statistics& lStatistics = lConnection->getStatistics();
+      OperationTimer lTimer(env, lStatistics, Statistics::PURGE);
+      TraceScope lTrace(lConnection->getTraceLog(), Statistics::PURGE);
+      jobject kvsObjRef = lConnection->getStore();
 
-      if ( majorValues.isNull() )
+      // buffered writes go first so that they are purged as well
+      WriteBuffer* lWriteBuffer = lConnection->getWriteBuffer();
+      if (lWriteBuffer)
       {
-          throwError("NoMajorKeyComponent", "JSON 'major' property must be specified as string or array.");
+        lWriteBuffer->flush(env, kvsObjRef);
+        CHECK_EXCEPTION(env);
       }
-      else if ( majorValues.isJSONItem() &&
-           majorValues.getJSONItemKind() == store::StoreConsts::jsonArray )
+
+      // read input param 1 $parentKey, the whole store if empty
+      jobject k = NULL;
+      Item lKeyItem = getOneItemArgument(args, 1);
+      if (!lKeyItem.isNull())
       {
-          uint64_t majorValueSize = majorValues.getArraySize();
-          for (uint64_t i = 1; i<=majorValueSize; i++)
-          {
-             Item mkItem = majorValues.getArrayValue(i);
-             if ( !mkItem.isAtomic() )
-                 throwError("InvalidMajorKeyComponent", "JSON 'major' property must be a string or an array.");
-             String mk = mkItem.getStringValue();
-             jstring jStrMk = env->NewStringUTF(mk.c_str());
-             CHECK_EXCEPTION(env);
-             env->CallBooleanMethod(majorList, midALAdd, jStrMk);
-             CHECK_EXCEPTION(env);
-          }
+        KeyPath lKey = parseKeyItem(lKeyItem, lConnection->hasTypedKeys());
+        lTrace.setKey(lKey);
+        k = createJavaKey(env, lKey);
+        CHECK_EXCEPTION(env);
       }
-      else if ( majorValues.isAtomic() )
+
+      // read input param 2 $subRange, optional
+      jobject keyRangeObj = NULL;
+      Item lRangeItem = getOneItemArgument(args, 2);
+      if (!lRangeItem.isNull())
       {
-          String mk = majorValues.getStringValue();
-          jstring jStrMk = env->NewStringUTF(mk.c_str());
-          CHECK_EXCEPTION(env);
-          env->CallBooleanMethod(majorList, midALAdd, jStrMk);
-          CHECK_EXCEPTION(env);
+        KeyRangeSpec lRange = parseKeyRangeItem(lRangeItem, lConnection->hasTypedKeys());
+        lTrace.setRange(lRange);
+        keyRangeObj = createJavaKeyRange(env, lRange);
+        CHECK_EXCEPTION(env);
       }
-      else
-          throwError("InvalidMajorKeyComponent", "JSON 'major' property must be specified as string or array.");
 
-      //    minorList.add("mk1");
-      Item minorValues = keyParam.getObjectValue("minor");
+      // read input param 3 $options
+      Item lOptions = getOneItemArgument(args, 3);
+      long long lParallelism = getIntegerOption(lOptions, "parallelism", 8);
+      double lMaxRate = getDoubleOption(lOptions, "max-rate", 0);
+      if (lParallelism < 1 || lParallelism > 256)
+        throwError("InvalidOption", "Option 'parallelism' must be between 1 and 256.");
+
+      // a key scan says nothing about the size of records, so it does not
+      // feed the estimates of the batch sizer
+      long long lDeleted = 0;
+      purgeMajorPaths(env,
+          zorba::jvm::JavaVMSingleton::getInstance(aStaticContext)->getVM(),
+          kvsObjRef, k, keyRangeObj, lConnection->getBatchSizer().size(),
+          (unsigned)lParallelism, lMaxRate, lDeleted);
+      CHECK_EXCEPTION(env);
+      lTrace.setResults(lDeleted);
+
+      return ItemSequence_t(new SingletonItemSequence(
+          NoSqlDBModule::getItemFactory()->createInteger(lDeleted)));
+    }
+    catch (zorba::jvm::VMOpenException&)
+    {
+        Item lQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
+                  "VM001");
+        throw USER_EXCEPTION(lQName, "Could not start the Java VM (is the classpath set?)");
+    }
+    catch (JavaException&)
+    {
+      throwJavaException(env, lException);
+    }
+}
+
+
+ItemSequence_t
+SnapshotFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                           const zorba::StaticContext* aStaticContext,
+                           const zorba::DynamicContext* aDynamicContext) const
+{
+    jthrowable lException = 0;
+    static JNIEnv* env;
+
+    try
+    {
+      // read input param 0
+      Connection* lConnection = getConnectionArgument(args, aDynamicContext);
+      env = getEnv(lConnection, aStaticContext);
+
+      Statistics& lStatistics = lConnection->getStatistics();
+      OperationTimer lTimer(env, lStatistics, Statistics::SNAPSHOT);
+      PhaseClock lClock(lConnection->getProfileTarget(), Statistics::SNAPSHOT);
+      TraceScope lTrace(lConnection->getTraceLog(), Statistics::SNAPSHOT);
 
-      if ( minorValues.isNull() )
+      // buffered writes go first so that the snapshot contains them
+      WriteBuffer* lWriteBuffer = lConnection->getWriteBuffer();
+      if (lWriteBuffer)
       {
-          // do nothing it's perfectly fine to have "minor" missing
+        lWriteBuffer->flush(env, lConnection->getStore());
+        CHECK_EXCEPTION(env);
+        lClock.lap(CallProfile::STORE);
       }
-      else if ( minorValues.isJSONItem() &&
-           minorValues.getJSONItemKind() == store::StoreConsts::jsonArray )
+
+      // read input param 1 $parentKey, a partial major path, the whole store
+      // if empty
+      KeyPath lKey;
+      Item lKeyItem = getOneItemArgument(args, 1);
+      if (!lKeyItem.isNull())
       {
-          uint64_t minorValueSize = minorValues.getArraySize();
-          for (uint64_t i = 1; i<=minorValueSize; i++)
-          {
-             Item mkItem = minorValues.getArrayValue(i);
-             if ( !mkItem.isAtomic() )
-                throwError("InvalidMinorKeyComponent", "JSON 'minor' property, if specified, must be a string or an array.");
-             String mk = mkItem.getStringValue();
-             jstring jStrMk = env->NewStringUTF(mk.c_str());
-             CHECK_EXCEPTION(env);
-             env->CallBooleanMethod(minorList, midALAdd, jStrMk);
-             CHECK_EXCEPTION(env);
-          }
+        lKey = parseKeyItem(lKeyItem, lConnection->hasTypedKeys());
+        if (!lKey.theMinor.empty())
+          throwError("InvalidKeyParam", "The parent key of a snapshot must not have a minor path.");
+        lTrace.setKey(lKey);
       }
-      else if ( minorValues.isAtomic() )
+
+      // read input param 2 $path
+      std::string lPath = getOneStringArgument(args, 2).str();
+      lClock.lap(CallProfile::PARSE);
+
+      TransferStats lStats = writeSnapshot(lConnection->getBackend(),
+                                           lKeyItem.isNull() ? 0 : &lKey, lPath, lClock);
+      lTrace.setResults(lStats.theRecords);
+      lTrace.addBytes(lStats.theBytes);
+
+      return ItemSequence_t(new SingletonItemSequence(createTransferStatsItem(lStats)));
+    }
+    catch (zorba::jvm::VMOpenException&)
+    {
+        Item lQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
+                  "VM001");
+        throw USER_EXCEPTION(lQName, "Could not start the Java VM (is the classpath set?)");
+    }
+    catch (JavaException&)
+    {
+      throwJavaException(env, env->ExceptionOccurred());
+    }
+}
+
+
+ItemSequence_t
+RebalanceFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                            const zorba::StaticContext* aStaticContext,
+                            const zorba::DynamicContext* aDynamicContext) const
+{
+    static JNIEnv* env;
+
+    try
+    {
+      // read input param 0
+      Connection* lConnection = getConnectionArgument(args, aDynamicContext);
+      env = getEnv(lConnection, aStaticContext);
+
+      ShardedBackend* lBackend = dynamic_cast<ShardedBackend*>(&lConnection->getBackend());
+      if (!lBackend)
+        throwError("UnsupportedOperation", "This function requires a connection with 'shards'.");
+
+      Statistics& lStatistics = lConnection->getStatistics();
+      OperationTimer lTimer(env, lStatistics, Statistics::REBALANCE);
+      PhaseClock lClock(lConnection->getProfileTarget(), Statistics::REBALANCE);
+      TraceScope lTrace(lConnection->getTraceLog(), Statistics::REBALANCE);
+
+      // read input param 1 $limit
+      long long lLimit = getOneItemArgument(args, 1).getLongValue();
+      if (lLimit < 0)
+        throwError("InvalidOption", "$limit must not be negative.");
+      lClock.lap(CallProfile::PARSE);
+
+      size_t lMoved;
+      size_t lRemaining;
+      lBackend->rebalance((size_t)lLimit, lMoved, lRemaining, lClock);
+      lTrace.setResults(lMoved);
+
+      ItemFactory* lFactory = NoSqlDBModule::getItemFactory();
+      std::vector<std::pair<Item, Item> > pairs;
+      pairs.push_back(std::pair<Item, Item>(lFactory->createString("moved"),
+          lFactory->createInteger((long long)lMoved)));
+      pairs.push_back(std::pair<Item, Item>(lFactory->createString("remaining"),
+          lFactory->createInteger((long long)lRemaining)));
+      return ItemSequence_t(new SingletonItemSequence(lFactory->createJSONObject(pairs)));
+    }
+    catch (zorba::jvm::VMOpenException&)
+    {
+        Item lQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
+                  "VM001");
+        throw USER_EXCEPTION(lQName, "Could not start the Java VM (is the classpath set?)");
+    }
+    catch (JavaException&)
+    {
+      throwJavaException(env, env->ExceptionOccurred());
+    }
+}
+
+
+ItemSequence_t
+IndexLookupFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                              const zorba::StaticContext* aStaticContext,
+                              const zorba::DynamicContext* aDynamicContext) const
+{
+    jthrowable lException = 0;
+    static JNIEnv* env;
+
+    try
+    {
+      // read input param 0
+      Connection* lConnection = getConnectionArgument(args, aDynamicContext);
+      env = getEnv(lConnection, aStaticContext);
+
+      Statistics& lStatistics = lConnection->getStatistics();
+      OperationTimer lTimer(env, lStatistics, Statistics::INDEX_LOOKUP);
+      PhaseClock lClock(lConnection->getProfileTarget(), Statistics::INDEX_LOOKUP);
+      TraceScope lTrace(lConnection->getTraceLog(), Statistics::INDEX_LOOKUP);
+
+      // read input param 1 $index
+      const SecondaryIndexes::Index& lIndex =
+          getIndex(lConnection, getOneStringArgument(args, 1).str());
+      lTrace.setKey(SecondaryIndexes::parentKey(lIndex));
+
+      // read input param 2 $value, the range of exactly this field value
+      KeyRangeSpec lRange;
+      lRange.theIsPrefix = false;
+      lRange.theStart = getOneStringArgument(args, 2).str();
+      lRange.theEnd = lRange.theStart;
+      lTrace.setRange(lRange);
+      lClock.lap(CallProfile::PARSE);
+
+      // index entries and records may both be buffered
+      WriteBuffer* lWriteBuffer = lConnection->getWriteBuffer();
+      if (lWriteBuffer)
       {
-          String mk = minorValues.getStringValue();
-          jstring jStrMk = env->NewStringUTF(mk.c_str());
-          CHECK_EXCEPTION(env);
-          env->CallBooleanMethod(majorList, midALAdd, jStrMk);
-          CHECK_EXCEPTION(env);
+        lWriteBuffer->flush(env, lConnection->getStore());
+        CHECK_EXCEPTION(env);
+        lClock.lap(CallProfile::STORE);
       }
-      else
-          throwError("InvalidMinorKeyComponent", "JSON 'minor' property, if specified, must be a string or an array.");
 
-      //    Key k = Key.createKey(majorList, minorList);
-      jclass keyClass = env->FindClass("oracle/kv/Key");
-      CHECK_EXCEPTION(env);
-      jmethodID midKeyCreate = env->GetStaticMethodID(keyClass, "createKey", "(Ljava/util/List;Ljava/util/List;)Loracle/kv/Key;");
-      CHECK_EXCEPTION(env);
-      jobject k = env->CallStaticObjectMethod(keyClass, midKeyCreate, majorList, minorList);
-      CHECK_EXCEPTION(env);
+      Admission lAdmission(lConnection->getThrottle(), lStatistics, lClock);
+      std::vector<Item> vec;
+      RecordItemsHandler lHandler(vec, lStatistics, lTrace, lClock,
+                                  lConnection->hasTypedKeys(), &lAdmission);
+      readIndex(lConnection, lIndex, lRange, lHandler, lClock);
 
-      // read input param 2 $subRange
-      Item subRangeParam = getOneItemArgument(args, 2);
-      if(!subRangeParam.isJSONItem())
-        throwError("NoKeyRange", "$subRange param must be a JSON object");
+      lTrace.setResults(vec.size());
+      return ItemSequence_t(new VectorItemSequence(vec));
+    }
+    catch (zorba::jvm::VMOpenException&)
+    {
+        Item lQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
+                  "VM001");
+        throw USER_EXCEPTION(lQName, "Could not start the Java VM (is the classpath set?)");
+    }
+    catch (JavaException&)
+    {
+      throwJavaException(env, env->ExceptionOccurred());
+    }
+}
 
-      Item prefix = subRangeParam.getObjectValue("prefix");
-      Item start = subRangeParam.getObjectValue("start");
-      Item end = subRangeParam.getObjectValue("end");
-      jobject keyRangeObj;
 
-      if ( !prefix.isNull() && start.isNull() && end.isNull() )
-      {
-          String prefixValue = prefix.getStringValue();
-          // create keyRange from prefix
+ItemSequence_t
+IndexRangeFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                             const zorba::StaticContext* aStaticContext,
+                             const zorba::DynamicContext* aDynamicContext) const
+{
+    jthrowable lException = 0;
+    static JNIEnv* env;
 
-          // KeyRange keyRange = new KeyRange(prefix);
-          jclass keyRangeClass = env->FindClass("oracle/kv/KeyRange");
-          CHECK_EXCEPTION(env);
-          jmethodID midKrCons = env->GetMethodID(keyRangeClass, "<init>", "(Ljava/lang/String;)V");
-          CHECK_EXCEPTION(env);
-          jstring jStrPrefix = env->NewStringUTF(prefixValue.c_str());
-          keyRangeObj = env->NewObject(keyRangeClass, midKrCons, jStrPrefix);
-          CHECK_EXCEPTION(env);
+    try
+    {
+      // read input param 0
+      Connection* lConnection = getConnectionArgument(args, aDynamicContext);
+      env = getEnv(lConnection, aStaticContext);
+
+      Statistics& lStatistics = lConnection->getStatistics();
+      OperationTimer lTimer(env, lStatistics, Statistics::INDEX_RANGE);
+      PhaseClock lClock(lConnection->getProfileTarget(), Statistics::INDEX_RANGE);
+      TraceScope lTrace(lConnection->getTraceLog(), Statistics::INDEX_RANGE);
+
+      // read input param 1 $index
+      const SecondaryIndexes::Index& lIndex =
+          getIndex(lConnection, getOneStringArgument(args, 1).str());
+      lTrace.setKey(SecondaryIndexes::parentKey(lIndex));
+
+      // read input param 2 $subRange, over the field values
+      KeyRangeSpec lRange = parseKeyRangeItem(getOneItemArgument(args, 2), lConnection->hasTypedKeys());
+      lTrace.setRange(lRange);
+      lClock.lap(CallProfile::PARSE);
+
+      // index entries and records may both be buffered
+      WriteBuffer* lWriteBuffer = lConnection->getWriteBuffer();
+      if (lWriteBuffer)
+      {
+        lWriteBuffer->flush(env, lConnection->getStore());
+        CHECK_EXCEPTION(env);
+        lClock.lap(CallProfile::STORE);
       }
-      else if (!start.isNull() && !end.isNull() && prefix.isNull() )
+
+      Admission lAdmission(lConnection->getThrottle(), lStatistics, lClock);
+      std::vector<Item> vec;
+      RecordItemsHandler lHandler(vec, lStatistics, lTrace, lClock,
+                                  lConnection->hasTypedKeys(), &lAdmission);
+      readIndex(lConnection, lIndex, lRange, lHandler, lClock);
+
+      lTrace.setResults(vec.size());
+      return ItemSequence_t(new VectorItemSequence(vec));
+    }
+    catch (zorba::jvm::VMOpenException&)
+    {
+        Item lQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
+                  "VM001");
+        throw USER_EXCEPTION(lQName, "Could not start the Java VM (is the classpath set?)");
+    }
+    catch (JavaException&)
+    {
+      throwJavaException(env, env->ExceptionOccurred());
+    }
+}
+
+
+ItemSequence_t
+StatisticsFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                             const zorba::StaticContext* aStaticContext,
+                             const zorba::DynamicContext* aDynamicContext) const
+{
+    jthrowable lException = 0;
+    static JNIEnv* env;
+
+    try
+    {
+      // read input param 0
+      String lInstanceID = getOneStringArgument(args, 0);
+
+      InstanceMap* lInstanceMap;
+      if (!(lInstanceMap = dynamic_cast<InstanceMap*>(aDynamicContext->getExternalFunctionParameter("nosqldbInstanceMap"))))
       {
-          String startValue = start.getStringValue();
-          String endValue = end.getStringValue();
-          bool startIncl = true;
-          bool endIncl = true;
-
-          Item startI = subRangeParam.getObjectValue("start-inclusive");
-          if ( !startI.isNull() )
-              startIncl = startI.getBooleanValue();
-
-          Item endI = subRangeParam.getObjectValue("end-inclusive");
-          if ( !endI.isNull() )
-              endIncl = endI.getBooleanValue();
-
-          // create keyRange from start end
-          // KeyRange keyRange = new KeyRange(start, startIncl, end, endIncl);
-          jclass keyRangeClass = env->FindClass("oracle/kv/KeyRange");
-          CHECK_EXCEPTION(env);
-          jmethodID midKrCons = env->GetMethodID(keyRangeClass, "<init>", "(Ljava/lang/String;ZLjava/lang/String;Z)V");
-          CHECK_EXCEPTION(env);
-          jstring jStrStart = env->NewStringUTF(startValue.c_str());
-          jstring jStrEnd = env->NewStringUTF(endValue.c_str());
-          keyRangeObj = env->NewObject(keyRangeClass, midKrCons, jStrStart, startIncl, jStrEnd, endIncl);
-          CHECK_EXCEPTION(env);
+        throwError("NoInstanceMatch", "Not a NoSQL DB identifier.");
       }
-      else
+
+      Connection* lConnection = lInstanceMap->getConnection(lInstanceID);
+      if (!lConnection)
       {
-          throwError("InvalidKeyRange", "$subRange param must contain either 'prefix' or 'start' and 'end' properties.");
+          throwError("NoInstanceMatch", "No instance of NoSQL DB with the given identifier was found.");
       }
+      env = getEnv(lConnection, aStaticContext);
 
-      // get param 3 $depth as xs:string
-      Item depthParam = getOneItemArgument(args, 3);
-      String depthStr = depthParam.getStringValue();
-      jclass depthClass = env->FindClass("oracle/kv/Depth");
-      CHECK_EXCEPTION(env);
-      jobject depth_CHILDREN_ONLY = env-> GetStaticObjectField(depthClass, env->GetStaticFieldID(depthClass,"CHILDREN_ONLY", "Loracle/kv/Depth;"));
-      jobject depth_PARENT_AND_CHILDREN = env-> GetStaticObjectField(depthClass, env->GetStaticFieldID(depthClass,"PARENT_AND_CHILDREN", "Loracle/kv/Depth;"));
-      jobject depth_DESCENDANTS_ONLY = env-> GetStaticObjectField(depthClass, env->GetStaticFieldID(depthClass,"DESCENDANTS_ONLY", "Loracle/kv/Depth;"));
-      jobject depth_PARENT_AND_DESCENDANTS = env-> GetStaticObjectField(depthClass, env->GetStaticFieldID(depthClass,"PARENT_AND_DESCENDANTS", "Loracle/kv/Depth;"));
-      jobject depthObj = depth_PARENT_AND_DESCENDANTS;
-
-      if ( depthStr.compare("CHILDREN_ONLY")==0 )
-          depthObj = depth_CHILDREN_ONLY;
-      else if ( depthStr.compare("PARENT_AND_CHILDREN")==0 )
-          depthObj = depth_PARENT_AND_CHILDREN;
-      else if ( depthStr.compare("DESCENDANTS_ONLY")==0 )
-          depthObj = depth_DESCENDANTS_ONLY;
-      else if ( depthStr.compare("PARENT_AND_DESCENDANTS")==0 )
-          depthObj = depth_PARENT_AND_DESCENDANTS;
-
-      //    ValueVersion valueVersion = store.delete(k);
-      jclass kvsClass = env->FindClass("oracle/kv/KVStore");
-      CHECK_EXCEPTION(env);
-      jmethodID midkvsMultiDelete = env->GetMethodID(kvsClass, "multiDelete", "(Loracle/kv/Key;Loracle/kv/KeyRange;Loracle/kv/Depth;)I");
-      CHECK_EXCEPTION(env);
-      jint result = env->CallIntMethod(kvsObjRef, midkvsMultiDelete, k, keyRangeObj, depthObj);
-      CHECK_EXCEPTION(env);
+      // read input param 1 $options
+      Item lOptions = getOneItemArgument(args, 1);
+      bool lReset = getBooleanOption(lOptions, "reset", false);
 
-      return ItemSequence_t(new SingletonItemSequence(
-          NoSqlDBModule::getItemFactory()->createInt(result)));
+      // not timed itself, reading the statistics is no store operation
+      Statistics& lStatistics = lConnection->getStatistics();
+      Item lResult = lStatistics.toJSON(env, lConnection->getStoreHandles().getStores(), lReset);
+      if (env)
+        CHECK_EXCEPTION(env);
+      if (lReset)
+        lStatistics.reset();
+
+      return ItemSequence_t(new SingletonItemSequence(lResult));
     }
     catch (zorba::jvm::VMOpenException&)
     {
@@ -1710,69 +2678,129 @@ MultiDelFunction::evaluate(const ExternalFunction::Arguments_t& args,
     }
     catch (JavaException&)
     {
-        // prints out to std err the stacktrace
-        //env->ExceptionDescribe();
-
-        jclass stringWriterClass = env->FindClass("java/io/StringWriter");
-        jclass printWriterClass = env->FindClass("java/io/PrintWriter");
-        jclass throwableClass = env->FindClass("java/lang/Throwable");
-        jobject stringWriter = env->NewObject(
-                  stringWriterClass,
-                  env->GetMethodID(stringWriterClass, "<init>", "()V"));
-
-        jobject printWriter = env->NewObject(
-                  printWriterClass,
-                  env->GetMethodID(printWriterClass, "<init>", "(Ljava/io/Writer;)V"),
-                  stringWriter);
-
-        env->CallObjectMethod(lException,
-                  env->GetMethodID(throwableClass, "printStackTrace",
-                          "(Ljava/io/PrintWriter;)V"),
-                  printWriter);
-
-        env->CallObjectMethod(printWriter, env->GetMethodID(printWriterClass, "flush", "()V"));
-        jmethodID toStringMethod =
-              env->GetMethodID(stringWriterClass, "toString", "()Ljava/lang/String;");
-        jobject errorMessageObj = env->CallObjectMethod( stringWriter, toStringMethod);
-        jstring errorMessage = (jstring) errorMessageObj;
-        const char *errMsg = env->GetStringUTFChars(errorMessage, NULL);
-        std::stringstream s;
-        s << "A Java Exception was thrown:" << std::endl << errMsg;
-        String errDescription;
-        errDescription += s.str();
-        env->ExceptionClear();
-        env->ReleaseStringUTFChars(errorMessage, errMsg);
+      throwJavaException(env, lException);
+    }
+}
+
+
+ItemSequence_t
+ProfileFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                          const zorba::StaticContext* /*aStaticContext*/,
+                          const zorba::DynamicContext* aDynamicContext) const
+{
+    // read input param 0
+    String lInstanceID = getOneStringArgument(args, 0);
+
+    InstanceMap* lInstanceMap;
+    if (!(lInstanceMap = dynamic_cast<InstanceMap*>(aDynamicContext->getExternalFunctionParameter("nosqldbInstanceMap"))))
+    {
+      throwError("NoInstanceMatch", "Not a NoSQL DB identifier.");
+    }
+
+    Connection* lConnection = lInstanceMap->getConnection(lInstanceID);
+    if (!lConnection)
+    {
+        throwError("NoInstanceMatch", "No instance of NoSQL DB with the given identifier was found.");
+    }
+
+    // read input param 1 $enabled
+    lConnection->setProfiling(getOneItemArgument(args, 1).getBooleanValue());
+
+    return ItemSequence_t(new EmptySequence());
+}
+
+
+ItemSequence_t
+LastProfileFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                              const zorba::StaticContext* /*aStaticContext*/,
+                              const zorba::DynamicContext* aDynamicContext) const
+{
+    // read input param 0
+    String lInstanceID = getOneStringArgument(args, 0);
+
+    InstanceMap* lInstanceMap;
+    if (!(lInstanceMap = dynamic_cast<InstanceMap*>(aDynamicContext->getExternalFunctionParameter("nosqldbInstanceMap"))))
+    {
+      throwError("NoInstanceMatch", "Not a NoSQL DB identifier.");
+    }
+
+    Connection* lConnection = lInstanceMap->getConnection(lInstanceID);
+    if (!lConnection)
+    {
+        throwError("NoInstanceMatch", "No instance of NoSQL DB with the given identifier was found.");
+    }
+
+    const CallProfile& lProfile = lConnection->getLastProfile();
+    if (!lProfile.theValid)
+      return ItemSequence_t(new EmptySequence());
 
-        Item errQName = NoSqlDBModule::getItemFactory()->createQName(NOSQLDB_MODULE_NAMESPACE,
-                  "JAVA-EXCEPTION");
+    return ItemSequence_t(new SingletonItemSequence(lProfile.toJSON()));
+}
+
+
+ItemSequence_t
+HotKeysFunction::evaluate(const ExternalFunction::Arguments_t& args,
+                          const zorba::StaticContext* /*aStaticContext*/,
+                          const zorba::DynamicContext* aDynamicContext) const
+{
+    // read input param 0
+    String lInstanceID = getOneStringArgument(args, 0);
 
-        //std::cout << "  java exception:'" << errDescription << "'" << std::endl; std::cout.flush();
+    InstanceMap* lInstanceMap;
+    if (!(lInstanceMap = dynamic_cast<InstanceMap*>(aDynamicContext->getExternalFunctionParameter("nosqldbInstanceMap"))))
+    {
+      throwError("NoInstanceMatch", "Not a NoSQL DB identifier.");
+    }
 
-        throw USER_EXCEPTION(errQName, errDescription );
+    Connection* lConnection = lInstanceMap->getConnection(lInstanceID);
+    if (!lConnection)
+    {
+        throwError("NoInstanceMatch", "No instance of NoSQL DB with the given identifier was found.");
     }
+
+    // read input param 1 $k
+    long long lCount = getOneItemArgument(args, 1).getLongValue();
+    if (lCount < 0)
+      throwError("InvalidOption", "$k must not be negative.");
+
+    HotKeys* lHotKeys = lConnection->getHotKeys();
+    if (!lHotKeys)
+      throwError("HotKeysDisabled", "Hot-key tracking requires the 'hot-keys' connect option.");
+
+    Item lResult = lHotKeys->toJSON((size_t)lCount, lConnection->hasTypedKeys());
+    return ItemSequence_t(new SingletonItemSequence(lResult));
 }
 
 /*****************************************************************************/
 
 bool
-InstanceMap::storeInstance(const String& aKeyName, jobject aInstance)
+InstanceMap::storeInstance(const String& aKeyName, Connection* aInstance)
 {
   std::pair<InstanceMap_t::iterator, bool> ret;
-  ret = instanceMap->insert(std::pair<String, jobject>(aKeyName, aInstance));
+  ret = instanceMap->insert(std::pair<String, Connection*>(aKeyName, aInstance));
   return ret.second;
 }
 
 jobject
 InstanceMap::getInstance(const String& aKeyName)
+{
+  Connection* lConnection = getConnection(aKeyName);
+
+  if (!lConnection)
+    return NULL;
+
+  return lConnection->getStore();
+}
+
+Connection*
+InstanceMap::getConnection(const String& aKeyName)
 {
   InstanceMap::InstanceMap_t::iterator lIter = instanceMap->find(aKeyName);
 
   if (lIter == instanceMap->end())
     return NULL;
 
-  jobject lInstance = lIter->second;
-
-  return lInstance;
+  return lIter->second;
 }
 
 bool
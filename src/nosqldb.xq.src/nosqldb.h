@@ -35,6 +35,7 @@
 #include <zorba/zorba.h>
 
 #include "JavaVMSingleton.h"
+#include "connection.h"
 
 
 #define NOSQLDB_MODULE_NAMESPACE "http://zorba.io/modules/oracle-nosqldb"
@@ -53,12 +54,36 @@ class PutFunction;
 class GetFunction;
 class DelFunction;
 class MultiGetFunction;
+class MultiGetManyFunction;
 class MultiDelFunction;
+class PutLOBFunction;
+class GetLOBFunction;
+class FlushFunction;
+class ImportFunction;
+class ExportFunction;
+class PurgeFunction;
+class SnapshotFunction;
+class RebalanceFunction;
+class IndexLookupFunction;
+class IndexRangeFunction;
+class StatisticsFunction;
+class ProfileFunction;
+class LastProfileFunction;
+class HotKeysFunction;
 class NoSqlDBOptions;
 class InstanceMap;
 
 class JavaException {};
-#define CHECK_EXCEPTION(env)  if ((lException = env->ExceptionOccurred())) throw JavaException()
+#define CHECK_EXCEPTION(env)  if ((COUNT_JNI_CALL(), lException = env->ExceptionOccurred())) throw JavaException()
+
+void
+throwError(const char *aLocalName, const char* aErrorMessage);
+
+Item
+createValueVersionItem(const std::string& aValue, jlong aVersion);
+
+Item
+createValueVersionItem(const char* aValue, size_t aSize, jlong aVersion);
 
 
 class ConnectFunction : public ContextualExternalFunction
@@ -227,6 +252,33 @@ class MultiGetFunction : public ContextualExternalFunction
                const zorba::DynamicContext*) const;
 };
 
+class MultiGetManyFunction : public ContextualExternalFunction
+{
+  private:
+    const ExternalModule* theModule;
+    XmlDataManager* theDataManager;
+
+  public:
+    MultiGetManyFunction(const ExternalModule* aModule) :
+      theModule(aModule),
+      theDataManager(Zorba::getInstance(0)->getXmlDataManager())
+    {}
+
+    ~MultiGetManyFunction()
+    {}
+
+    virtual String getURI() const
+    { return theModule->getURI(); }
+
+    virtual String getLocalName() const
+    { return "multi-get-many"; }
+
+    virtual ItemSequence_t
+      evaluate(const ExternalFunction::Arguments_t& args,
+               const zorba::StaticContext*,
+               const zorba::DynamicContext*) const;
+};
+
 class MultiDelFunction : public ContextualExternalFunction
 {
   private:
@@ -254,6 +306,384 @@ class MultiDelFunction : public ContextualExternalFunction
 };
 
 
+class PutLOBFunction : public ContextualExternalFunction
+{
+  private:
+    const ExternalModule* theModule;
+    XmlDataManager* theDataManager;
+
+  public:
+    PutLOBFunction(const ExternalModule* aModule) :
+      theModule(aModule),
+      theDataManager(Zorba::getInstance(0)->getXmlDataManager())
+    {}
+
+    ~PutLOBFunction()
+    {}
+
+    virtual String getURI() const
+    { return theModule->getURI(); }
+
+    virtual String getLocalName() const
+    { return "put-lob"; }
+
+    virtual ItemSequence_t
+      evaluate(const ExternalFunction::Arguments_t& args,
+               const zorba::StaticContext*,
+               const zorba::DynamicContext*) const;
+};
+
+class GetLOBFunction : public ContextualExternalFunction
+{
+  private:
+    const ExternalModule* theModule;
+    XmlDataManager* theDataManager;
+
+  public:
+    GetLOBFunction(const ExternalModule* aModule) :
+      theModule(aModule),
+      theDataManager(Zorba::getInstance(0)->getXmlDataManager())
+    {}
+
+    ~GetLOBFunction()
+    {}
+
+    virtual String getURI() const
+    { return theModule->getURI(); }
+
+    virtual String getLocalName() const
+    { return "get-lob"; }
+
+    virtual ItemSequence_t
+      evaluate(const ExternalFunction::Arguments_t& args,
+               const zorba::StaticContext*,
+               const zorba::DynamicContext*) const;
+};
+
+class FlushFunction : public ContextualExternalFunction
+{
+  private:
+    const ExternalModule* theModule;
+    XmlDataManager* theDataManager;
+
+  public:
+    FlushFunction(const ExternalModule* aModule) :
+      theModule(aModule),
+      theDataManager(Zorba::getInstance(0)->getXmlDataManager())
+    {}
+
+    ~FlushFunction()
+    {}
+
+    virtual String getURI() const
+    { return theModule->getURI(); }
+
+    virtual String getLocalName() const
+    { return "flush"; }
+
+    virtual ItemSequence_t
+      evaluate(const ExternalFunction::Arguments_t& args,
+               const zorba::StaticContext*,
+               const zorba::DynamicContext*) const;
+};
+
+class ImportFunction : public ContextualExternalFunction
+{
+  private:
+    const ExternalModule* theModule;
+    XmlDataManager* theDataManager;
+
+  public:
+    ImportFunction(const ExternalModule* aModule) :
+      theModule(aModule),
+      theDataManager(Zorba::getInstance(0)->getXmlDataManager())
+    {}
+
+    ~ImportFunction()
+    {}
+
+    virtual String getURI() const
+    { return theModule->getURI(); }
+
+    virtual String getLocalName() const
+    { return "import"; }
+
+    virtual ItemSequence_t
+      evaluate(const ExternalFunction::Arguments_t& args,
+               const zorba::StaticContext*,
+               const zorba::DynamicContext*) const;
+};
+
+class ExportFunction : public ContextualExternalFunction
+{
+  private:
+    const ExternalModule* theModule;
+    XmlDataManager* theDataManager;
+
+  public:
+    ExportFunction(const ExternalModule* aModule) :
+      theModule(aModule),
+      theDataManager(Zorba::getInstance(0)->getXmlDataManager())
+    {}
+
+    ~ExportFunction()
+    {}
+
+    virtual String getURI() const
+    { return theModule->getURI(); }
+
+    virtual String getLocalName() const
+    { return "export"; }
+
+    virtual ItemSequence_t
+      evaluate(const ExternalFunction::Arguments_t& args,
+               const zorba::StaticContext*,
+               const zorba::DynamicContext*) const;
+};
+
+class PurgeFunction : public ContextualExternalFunction
+{
+  private:
+    const ExternalModule* theModule;
+    XmlDataManager* theDataManager;
+
+  public:
+    PurgeFunction(const ExternalModule* aModule) :
+      theModule(aModule),
+      theDataManager(Zorba::getInstance(0)->getXmlDataManager())
+    {}
+
+    ~PurgeFunction()
+    {}
+
+    virtual String getURI() const
+    { return theModule->getURI(); }
+
+    virtual String getLocalName() const
+    { return "purge"; }
+
+    virtual ItemSequence_t
+      evaluate(const ExternalFunction::Arguments_t& args,
+               const zorba::StaticContext*,
+               const zorba::DynamicContext*) const;
+};
+
+class SnapshotFunction : public ContextualExternalFunction
+{
+  private:
+    const ExternalModule* theModule;
+    XmlDataManager* theDataManager;
+
+  public:
+    SnapshotFunction(const ExternalModule* aModule) :
+      theModule(aModule),
+      theDataManager(Zorba::getInstance(0)->getXmlDataManager())
+    {}
+
+    ~SnapshotFunction()
+    {}
+
+    virtual String getURI() const
+    { return theModule->getURI(); }
+
+    virtual String getLocalName() const
+    { return "snapshot"; }
+
+    virtual ItemSequence_t
+      evaluate(const ExternalFunction::Arguments_t& args,
+               const zorba::StaticContext*,
+               const zorba::DynamicContext*) const;
+};
+
+class RebalanceFunction : public ContextualExternalFunction
+{
+  private:
+    const ExternalModule* theModule;
+    XmlDataManager* theDataManager;
+
+  public:
+    RebalanceFunction(const ExternalModule* aModule) :
+      theModule(aModule),
+      theDataManager(Zorba::getInstance(0)->getXmlDataManager())
+    {}
+
+    ~RebalanceFunction()
+    {}
+
+    virtual String getURI() const
+    { return theModule->getURI(); }
+
+    virtual String getLocalName() const
+    { return "rebalance"; }
+
+    virtual ItemSequence_t
+      evaluate(const ExternalFunction::Arguments_t& args,
+               const zorba::StaticContext*,
+               const zorba::DynamicContext*) const;
+};
+
+class IndexLookupFunction : public ContextualExternalFunction
+{
+  private:
+    const ExternalModule* theModule;
+    XmlDataManager* theDataManager;
+
+  public:
+    IndexLookupFunction(const ExternalModule* aModule) :
+      theModule(aModule),
+      theDataManager(Zorba::getInstance(0)->getXmlDataManager())
+    {}
+
+    ~IndexLookupFunction()
+    {}
+
+    virtual String getURI() const
+    { return theModule->getURI(); }
+
+    virtual String getLocalName() const
+    { return "index-lookup"; }
+
+    virtual ItemSequence_t
+      evaluate(const ExternalFunction::Arguments_t& args,
+               const zorba::StaticContext*,
+               const zorba::DynamicContext*) const;
+};
+
+class IndexRangeFunction : public ContextualExternalFunction
+{
+  private:
+    const ExternalModule* theModule;
+    XmlDataManager* theDataManager;
+
+  public:
+    IndexRangeFunction(const ExternalModule* aModule) :
+      theModule(aModule),
+      theDataManager(Zorba::getInstance(0)->getXmlDataManager())
+    {}
+
+    ~IndexRangeFunction()
+    {}
+
+    virtual String getURI() const
+    { return theModule->getURI(); }
+
+    virtual String getLocalName() const
+    { return "index-range"; }
+
+    virtual ItemSequence_t
+      evaluate(const ExternalFunction::Arguments_t& args,
+               const zorba::StaticContext*,
+               const zorba::DynamicContext*) const;
+};
+
+class StatisticsFunction : public ContextualExternalFunction
+{
+  private:
+    const ExternalModule* theModule;
+    XmlDataManager* theDataManager;
+
+  public:
+    StatisticsFunction(const ExternalModule* aModule) :
+      theModule(aModule),
+      theDataManager(Zorba::getInstance(0)->getXmlDataManager())
+    {}
+
+    ~StatisticsFunction()
+    {}
+
+    virtual String getURI() const
+    { return theModule->getURI(); }
+
+    virtual String getLocalName() const
+    { return "statistics"; }
+
+    virtual ItemSequence_t
+      evaluate(const ExternalFunction::Arguments_t& args,
+               const zorba::StaticContext*,
+               const zorba::DynamicContext*) const;
+};
+
+class ProfileFunction : public ContextualExternalFunction
+{
+  private:
+    const ExternalModule* theModule;
+    XmlDataManager* theDataManager;
+
+  public:
+    ProfileFunction(const ExternalModule* aModule) :
+      theModule(aModule),
+      theDataManager(Zorba::getInstance(0)->getXmlDataManager())
+    {}
+
+    ~ProfileFunction()
+    {}
+
+    virtual String getURI() const
+    { return theModule->getURI(); }
+
+    virtual String getLocalName() const
+    { return "profile"; }
+
+    virtual ItemSequence_t
+      evaluate(const ExternalFunction::Arguments_t& args,
+               const zorba::StaticContext*,
+               const zorba::DynamicContext*) const;
+};
+
+class LastProfileFunction : public ContextualExternalFunction
+{
+  private:
+    const ExternalModule* theModule;
+    XmlDataManager* theDataManager;
+
+  public:
+    LastProfileFunction(const ExternalModule* aModule) :
+      theModule(aModule),
+      theDataManager(Zorba::getInstance(0)->getXmlDataManager())
+    {}
+
+    ~LastProfileFunction()
+    {}
+
+    virtual String getURI() const
+    { return theModule->getURI(); }
+
+    virtual String getLocalName() const
+    { return "last-profile"; }
+
+    virtual ItemSequence_t
+      evaluate(const ExternalFunction::Arguments_t& args,
+               const zorba::StaticContext*,
+               const zorba::DynamicContext*) const;
+};
+
+class HotKeysFunction : public ContextualExternalFunction
+{
+  private:
+    const ExternalModule* theModule;
+    XmlDataManager* theDataManager;
+
+  public:
+    HotKeysFunction(const ExternalModule* aModule) :
+      theModule(aModule),
+      theDataManager(Zorba::getInstance(0)->getXmlDataManager())
+    {}
+
+    ~HotKeysFunction()
+    {}
+
+    virtual String getURI() const
+    { return theModule->getURI(); }
+
+    virtual String getLocalName() const
+    { return "hot-keys"; }
+
+    virtual ItemSequence_t
+      evaluate(const ExternalFunction::Arguments_t& args,
+               const zorba::StaticContext*,
+               const zorba::DynamicContext*) const;
+};
+
 
 class NoSqlDBModule : public ExternalModule
 {
@@ -264,7 +694,22 @@ class NoSqlDBModule : public ExternalModule
     ExternalFunction* get;
     ExternalFunction* del;
     ExternalFunction* multiGet;
+    ExternalFunction* multiGetMany;
     ExternalFunction* multiDel;
+    ExternalFunction* putLOB;
+    ExternalFunction* getLOB;
+    ExternalFunction* flush;
+    ExternalFunction* bulkImport;
+    ExternalFunction* bulkExport;
+    ExternalFunction* purge;
+    ExternalFunction* snapshot;
+    ExternalFunction* rebalance;
+    ExternalFunction* indexLookup;
+    ExternalFunction* indexRange;
+    ExternalFunction* statistics;
+    ExternalFunction* profile;
+    ExternalFunction* lastProfile;
+    ExternalFunction* hotKeys;
 
   public:
     static ItemFactory* getItemFactory()
@@ -279,7 +724,22 @@ class NoSqlDBModule : public ExternalModule
         get(new GetFunction(this)),
         del(new DelFunction(this)),
         multiGet(new MultiGetFunction(this)),
-        multiDel(new MultiDelFunction(this))
+        multiGetMany(new MultiGetManyFunction(this)),
+        multiDel(new MultiDelFunction(this)),
+        putLOB(new PutLOBFunction(this)),
+        getLOB(new GetLOBFunction(this)),
+        flush(new FlushFunction(this)),
+        bulkImport(new ImportFunction(this)),
+        bulkExport(new ExportFunction(this)),
+        purge(new PurgeFunction(this)),
+        snapshot(new SnapshotFunction(this)),
+        rebalance(new RebalanceFunction(this)),
+        indexLookup(new IndexLookupFunction(this)),
+        indexRange(new IndexRangeFunction(this)),
+        statistics(new StatisticsFunction(this)),
+        profile(new ProfileFunction(this)),
+        lastProfile(new LastProfileFunction(this)),
+        hotKeys(new HotKeysFunction(this))
     {}
 
     ~NoSqlDBModule()
@@ -290,7 +750,22 @@ class NoSqlDBModule : public ExternalModule
         delete get;
         delete del;
         delete multiGet;
+        delete multiGetMany;
         delete multiDel;
+        delete putLOB;
+        delete getLOB;
+        delete flush;
+        delete bulkImport;
+        delete bulkExport;
+        delete purge;
+        delete snapshot;
+        delete rebalance;
+        delete indexLookup;
+        delete indexRange;
+        delete statistics;
+        delete profile;
+        delete lastProfile;
+        delete hotKeys;
     }
 
     virtual String getURI() const
@@ -308,22 +783,34 @@ class NoSqlDBModule : public ExternalModule
 class InstanceMap : public ExternalFunctionParameter
 {
   private:
-    typedef std::map<String, jobject> InstanceMap_t;
+    typedef std::map<String, Connection*> InstanceMap_t;
     JNIEnv* env;
     InstanceMap_t* instanceMap;
     void closeConnection(jobject kvsObjRef);
+    void flushConnection(Connection* aConnection) throw();
 
 
   public:
     InstanceMap(JNIEnv* aEnv) : env(aEnv), instanceMap(new InstanceMap_t())
     {}
 
+    /**
+     * The map may have been created by a connection to a native backend,
+     * without a JVM.
+     */
+    void
+    setEnv(JNIEnv* aEnv)
+    { env = aEnv; }
+
     bool
-    storeInstance(const String&, jobject);
+    storeInstance(const String&, Connection*);
 
     jobject
     getInstance(const String&);
 
+    Connection*
+    getConnection(const String&);
+
     bool
     deleteInstance(const String&);
 
@@ -335,11 +822,20 @@ class InstanceMap : public ExternalFunctionParameter
         for (InstanceMap_t::const_iterator lIter = instanceMap->begin();
              lIter != instanceMap->end(); ++lIter)
         {
-          jobject kvsObjRef = lIter->second;
+          Connection* lConnection = lIter->second;
+
+          // buffered writes are sent at the end of the query
+          flushConnection(lConnection);
 
-          closeConnection(kvsObjRef);
+          // also deletes the global references
+          for (size_t i = 0; i < lConnection->getShardCount(); ++i)
+          {
+            const std::vector<jobject>& lStores = lConnection->getStoreHandles(i).getStores();
+            for (size_t j = 0; j < lStores.size(); ++j)
+              closeConnection(lStores[j]);
+          }
 
-          env->DeleteGlobalRef(kvsObjRef);
+          delete lConnection;
         }
         instanceMap->clear();
         delete instanceMap;
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <cerrno>
+#include <cstdlib>
+#include <sstream>
+
+#include "options.h"
+#include "nosqldb.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+static void
+throwInvalidOption(const char* aName, const char* aExpected)
+{
+  std::stringstream s;
+  s << "Option '" << aName << "' must be " << aExpected << ".";
+  throwError("InvalidOption", s.str().c_str());
+}
+
+
+Item
+getOption(const Item& aOptions, const char* aName)
+{
+  if (aOptions.isNull())
+    return Item();
+
+  if (!aOptions.isJSONItem() ||
+      aOptions.getJSONItemKind() != store::StoreConsts::jsonObject)
+    throwError("InvalidOption", "$options param must be a JSON object");
+
+  return aOptions.getObjectValue(aName);
+}
+
+
+long long
+getIntegerOption(const Item& aOptions, const char* aName, long long aDefault)
+{
+  Item lValue = getOption(aOptions, aName);
+  if (lValue.isNull())
+    return aDefault;
+
+  if (!lValue.isAtomic())
+    throwInvalidOption(aName, "an integer");
+
+  String lString = lValue.getStringValue();
+  char* lEnd;
+  errno = 0;
+  long long lResult = strtoll(lString.c_str(), &lEnd, 10);
+  if (errno != 0 || lEnd == lString.c_str() || *lEnd != '\0')
+    throwInvalidOption(aName, "an integer");
+  return lResult;
+}
+
+
+double
+getDoubleOption(const Item& aOptions, const char* aName, double aDefault)
+{
+  Item lValue = getOption(aOptions, aName);
+  if (lValue.isNull())
+    return aDefault;
+
+  if (!lValue.isAtomic())
+    throwInvalidOption(aName, "a number");
+
+  String lString = lValue.getStringValue();
+  char* lEnd;
+  double lResult = strtod(lString.c_str(), &lEnd);
+  if (lEnd == lString.c_str() || *lEnd != '\0')
+    throwInvalidOption(aName, "a number");
+  return lResult;
+}
+
+
+bool
+getBooleanOption(const Item& aOptions, const char* aName, bool aDefault)
+{
+  Item lValue = getOption(aOptions, aName);
+  if (lValue.isNull())
+    return aDefault;
+
+  if (!lValue.isAtomic())
+    throwInvalidOption(aName, "a boolean");
+
+  String lString = lValue.getStringValue();
+  if (lString == "true")
+    return true;
+  if (lString == "false")
+    return false;
+
+  throwInvalidOption(aName, "a boolean");
+  return aDefault;
+}
+
+
+std::string
+getStringOption(const Item& aOptions, const char* aName, const std::string& aDefault)
+{
+  Item lValue = getOption(aOptions, aName);
+  if (lValue.isNull())
+    return aDefault;
+
+  if (!lValue.isAtomic())
+    throwInvalidOption(aName, "a string");
+
+  return lValue.getStringValue().str();
+}
+
+
+}} // namespace zorba, nosqldb
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_OPTIONS_H
+#define NOSQLDB_OPTIONS_H
+
+#include <string>
+
+#include <zorba/item.h>
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Accessors for the properties of JSON $options objects. A missing property
+ * (or a missing options object) yields aDefault, a property of the wrong
+ * type raises nosql:InvalidOption.
+ */
+long long
+getIntegerOption(const Item& aOptions, const char* aName, long long aDefault);
+
+double
+getDoubleOption(const Item& aOptions, const char* aName, double aDefault);
+
+bool
+getBooleanOption(const Item& aOptions, const char* aName, bool aDefault);
+
+std::string
+getStringOption(const Item& aOptions, const char* aName, const std::string& aDefault);
+
+/**
+ * The property aName if it is present, a null Item otherwise.
+ */
+Item
+getOption(const Item& aOptions, const char* aName);
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_OPTIONS_H
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <vector>
+
+#include "profile.h"
+#include "nosqldb.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+const char* const CallProfile::thePhaseNames[PHASE_COUNT] =
+{
+  "parse",
+  "jni",
+  "store",
+  "copy",
+  "items",
+  "queue"
+};
+
+
+static void
+addMicros(std::vector<std::pair<Item, Item> >& aPairs, const char* aName, uint64_t aNanos)
+{
+  ItemFactory* lFactory = NoSqlDBModule::getItemFactory();
+  aPairs.push_back(std::pair<Item, Item>(
+      lFactory->createString(aName), lFactory->createDouble(aNanos / 1000.0)));
+}
+
+
+Item
+CallProfile::toJSON() const
+{
+  ItemFactory* lFactory = NoSqlDBModule::getItemFactory();
+
+  std::vector<std::pair<Item, Item> > lPhases;
+  uint64_t lCovered = 0;
+  for (unsigned i = 0; i < PHASE_COUNT; ++i)
+  {
+    addMicros(lPhases, thePhaseNames[i], theNanos[i]);
+    lCovered += theNanos[i];
+  }
+  addMicros(lPhases, "other", theTotalNanos > lCovered ? theTotalNanos - lCovered : 0);
+
+  std::vector<std::pair<Item, Item> > lPairs;
+  lPairs.push_back(std::pair<Item, Item>(
+      lFactory->createString("operation"),
+      lFactory->createString(Statistics::theOperationNames[theOperation])));
+  addMicros(lPairs, "total-us", theTotalNanos);
+  lPairs.push_back(std::pair<Item, Item>(
+      lFactory->createString("records"), lFactory->createInteger((long long)theRecords)));
+  lPairs.push_back(std::pair<Item, Item>(
+      lFactory->createString("phases-us"), lFactory->createJSONObject(lPhases)));
+  return lFactory->createJSONObject(lPairs);
+}
+
+
+/*****************************************************************************
+ PhaseClock
+ *****************************************************************************/
+
+PhaseClock::PhaseClock(CallProfile* aProfile, Statistics::Operation aOperation)
+  : theProfile(aProfile)
+{
+  if (!theProfile)
+    return;
+
+  theProfile->theOperation = aOperation;
+  for (unsigned i = 0; i < CallProfile::PHASE_COUNT; ++i)
+    theProfile->theNanos[i] = 0;
+  theProfile->theTotalNanos = 0;
+  theProfile->theRecords = 0;
+  theProfile->theValid = false;
+  theStart = theLast = std::chrono::steady_clock::now();
+}
+
+
+PhaseClock::~PhaseClock()
+{
+  if (!theProfile)
+    return;
+
+  theProfile->theTotalNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - theStart).count();
+  theProfile->theValid = true;
+}
+
+
+void
+PhaseClock::charge(CallProfile::Phase aPhase)
+{
+  std::chrono::steady_clock::time_point lNow = std::chrono::steady_clock::now();
+  theProfile->theNanos[aPhase] +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(lNow - theLast).count();
+  theLast = lNow;
+}
+
+
+}} // namespace zorba, nosqldb
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_PROFILE_H
+#define NOSQLDB_PROFILE_H
+
+#include <chrono>
+#include <stdint.h>
+
+#include <zorba/item.h>
+
+#include "statistics.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Time spent by one call of a module function in each of its phases,
+ * reported by nosql:last-profile.
+ */
+class CallProfile
+{
+  public:
+    enum Phase
+    {
+      PARSE,     // reading the JSON arguments
+      JNI,       // class and method lookups, Java objects and accessors
+      STORE,     // KVStore calls, including iterator round trips
+      COPY,      // copying bytes between Java arrays and native buffers
+      ITEMS,     // building the result items
+      QUEUE,     // waiting for the admission to the store, see Admission
+      PHASE_COUNT
+    };
+
+    static const char* const thePhaseNames[PHASE_COUNT];
+
+    Statistics::Operation theOperation;
+    uint64_t theNanos[PHASE_COUNT];
+    uint64_t theTotalNanos;
+    uint64_t theRecords;
+    bool theValid;
+
+    CallProfile()
+      : theValid(false)
+    {}
+
+    /**
+     * { "operation" : .., "total-us" : .., "records" : ..,
+     *   "phases-us" : { "parse" : .., .. } }; the time not covered by any
+     * phase is reported as "other".
+     */
+    Item
+    toJSON() const;
+};
+
+
+/**
+ * Attributes the time of a call to its phases: every lap() charges the time
+ * since the previous lap to the given phase. Without a target profile,
+ * i.e. when profiling is off, a lap is a single branch.
+ */
+class PhaseClock
+{
+  private:
+    CallProfile* theProfile;
+    std::chrono::steady_clock::time_point theStart;
+    std::chrono::steady_clock::time_point theLast;
+
+    void
+    charge(CallProfile::Phase aPhase);
+
+  public:
+    PhaseClock(CallProfile* aProfile, Statistics::Operation aOperation);
+
+    ~PhaseClock();
+
+    void
+    lap(CallProfile::Phase aPhase)
+    {
+      if (theProfile)
+        charge(aPhase);
+    }
+
+    void
+    countRecord()
+    {
+      if (theProfile)
+        ++theProfile->theRecords;
+    }
+
+  private:
+    PhaseClock(const PhaseClock&);
+    PhaseClock& operator=(const PhaseClock&);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_PROFILE_H
@@ -0,0 +1,225 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <atomic>
+#include <unordered_set>
+
+#include "purge.h"
+#include "key_codec.h"
+#include "rate_limiter.h"
+#include "statistics.h"
+#include "work_queue.h"
+#include "worker_pool.h"
+
+#define RETURN_IF_EXCEPTION(env)  if ((COUNT_JNI_CALL(), env->ExceptionCheck())) return false
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+namespace
+{
+
+class Purger
+{
+  private:
+    jobject theStore;
+    WorkQueue<KeyPath> theQueue;
+    RateLimiter theLimiter;
+    std::atomic<long long> theDeleted;
+    WorkerPool thePool;
+
+    bool
+    deleteMajorPath(JNIEnv* env, const KeyPath& aMajor,
+                    jmethodID aMultiDelete, jobject aDepth)
+    {
+      //    int n = store.multiDelete(Key.createKey(majorPath), null,
+      //                              Depth.PARENT_AND_DESCENDANTS);
+      jobject k = createJavaKey(env, aMajor);
+      RETURN_IF_EXCEPTION(env);
+      jint n = env->CallIntMethod(theStore, aMultiDelete, k, (jobject)NULL, aDepth);
+      RETURN_IF_EXCEPTION(env);
+      env->DeleteLocalRef(k);
+      theDeleted += n;
+      return true;
+    }
+
+    void
+    run(JNIEnv* env)
+    {
+      jclass kvsClass = env->FindClass("oracle/kv/KVStore");
+      jmethodID midkvsMultiDelete = kvsClass ? env->GetMethodID(kvsClass, "multiDelete", "(Loracle/kv/Key;Loracle/kv/KeyRange;Loracle/kv/Depth;)I") : NULL;
+      jclass depthClass = env->FindClass("oracle/kv/Depth");
+      jobject depth_PARENT_AND_DESCENDANTS = depthClass ? env->GetStaticObjectField(depthClass,
+          env->GetStaticFieldID(depthClass, "PARENT_AND_DESCENDANTS", "Loracle/kv/Depth;")) : NULL;
+      if (env->ExceptionCheck())
+        thePool.fail(env);
+
+      KeyPath lMajor;
+      while (theQueue.pop(lMajor))
+      {
+        // keep draining so that the enumeration never blocks on a failure
+        if (thePool.failed())
+          continue;
+
+        theLimiter.acquire();
+        if (!deleteMajorPath(env, lMajor, midkvsMultiDelete, depth_PARENT_AND_DESCENDANTS))
+          thePool.fail(env);
+      }
+    }
+
+  public:
+    Purger(JavaVM* aVM, jobject aStore, unsigned aParallelism, double aMaxRate)
+      : theStore(aStore),
+        theQueue(aParallelism * 64),
+        theLimiter(aMaxRate),
+        theDeleted(0),
+        thePool(aVM)
+    {
+      thePool.start(aParallelism, [this](JNIEnv* env, unsigned)
+      {
+        run(env);
+      });
+    }
+
+    ~Purger()
+    {
+      finish();
+    }
+
+    bool
+    failed() const
+    { return thePool.failed(); }
+
+    void
+    submit(const KeyPath& aMajor)
+    { theQueue.push(aMajor); }
+
+    /**
+     * Waits until all submitted major paths are deleted.
+     */
+    void
+    finish()
+    {
+      theQueue.close();
+      thePool.join();
+    }
+
+    void
+    throwIfFailed(JNIEnv* env)
+    { thePool.throwIfFailed(env); }
+
+    long long
+    getDeleted() const
+    { return theDeleted; }
+};
+
+} // anonymous namespace
+
+
+static bool
+enumerateMajorPaths(JNIEnv* env, jobject aIterator, Purger& aPurger)
+{
+  jclass iterClass = env->FindClass("java/util/Iterator");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midIterHasNext = env->GetMethodID(iterClass, "hasNext", "()Z");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midIterNext = env->GetMethodID(iterClass, "next", "()Ljava/lang/Object;");
+  RETURN_IF_EXCEPTION(env);
+
+  // keys of one major path are mostly but not necessarily adjacent
+  std::unordered_set<std::string> lSeen;
+  KeyPath lKey;
+  Statistics* lStatistics = Statistics::current();
+
+  while (!aPurger.failed())
+  {
+    //    iterator.hasNext()
+    jboolean hasNext = env->CallBooleanMethod(aIterator, midIterHasNext);
+    RETURN_IF_EXCEPTION(env);
+    if (!hasNext)
+      return true;
+
+    //    Key key = iterator.next();
+    jobject keyObj = env->CallObjectMethod(aIterator, midIterNext);
+    RETURN_IF_EXCEPTION(env);
+    bool lOk = readJavaKey(env, keyObj, lKey);
+    env->DeleteLocalRef(keyObj);
+    if (!lOk)
+      return false;
+    if (lStatistics)
+      ++lStatistics->theRecordsScanned;
+
+    lKey.theMinor.clear();
+    if (lSeen.insert(lKey.majorToString()).second)
+      aPurger.submit(lKey);
+  }
+  return true;
+}
+
+
+bool
+purgeMajorPaths(JNIEnv* env,
+                JavaVM* aVM,
+                jobject aStore,
+                jobject aParentKey,
+                jobject aRange,
+                size_t aBatchSize,
+                unsigned aParallelism,
+                double aMaxRate,
+                long long& aDeleted)
+{
+  jclass dirClass = env->FindClass("oracle/kv/Direction");
+  RETURN_IF_EXCEPTION(env);
+  jfieldID fidDirUnordered = env->GetStaticFieldID(dirClass, "UNORDERED", "Loracle/kv/Direction;");
+  RETURN_IF_EXCEPTION(env);
+  jobject dir_UNORDERED = env->GetStaticObjectField(dirClass, fidDirUnordered);
+  RETURN_IF_EXCEPTION(env);
+
+  jclass depthClass = env->FindClass("oracle/kv/Depth");
+  RETURN_IF_EXCEPTION(env);
+  jfieldID fidDepth = env->GetStaticFieldID(depthClass, "PARENT_AND_DESCENDANTS", "Loracle/kv/Depth;");
+  RETURN_IF_EXCEPTION(env);
+  jobject depth_PARENT_AND_DESCENDANTS = env->GetStaticObjectField(depthClass, fidDepth);
+  RETURN_IF_EXCEPTION(env);
+
+  //    Iterator<Key> iterator = store.storeKeysIterator(
+  //        Direction.UNORDERED, batchSize, parentKey, range, Depth.PARENT_AND_DESCENDANTS);
+  jclass kvsClass = env->FindClass("oracle/kv/KVStore");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midStoreKeysIterator = env->GetMethodID(kvsClass, "storeKeysIterator", "(Loracle/kv/Direction;ILoracle/kv/Key;Loracle/kv/KeyRange;Loracle/kv/Depth;)Ljava/util/Iterator;");
+  RETURN_IF_EXCEPTION(env);
+  jobject iterator = env->CallObjectMethod(aStore, midStoreKeysIterator,
+      dir_UNORDERED, (jint)aBatchSize, aParentKey, aRange, depth_PARENT_AND_DESCENDANTS);
+  RETURN_IF_EXCEPTION(env);
+
+  Purger lPurger(aVM, aStore, aParallelism, aMaxRate);
+  bool lOk = enumerateMajorPaths(env, iterator, lPurger);
+  env->DeleteLocalRef(iterator);
+
+  lPurger.finish();
+  if (!lOk)
+    return false;
+  lPurger.throwIfFailed(env);
+
+  aDeleted = lPurger.getDeleted();
+  return true;
+}
+
+
+}} // namespace zorba, nosqldb
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_PURGE_H
+#define NOSQLDB_PURGE_H
+
+#include <cstddef>
+
+#include <jni.h>
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Deletes all key/value pairs under aParentKey and aRange, across any number
+ * of major paths. The query thread enumerates the matching major paths with
+ * KVStore.storeKeysIterator(), in batches of aBatchSize keys or the store's
+ * default if 0, and aParallelism worker threads run one
+ * KVStore.multiDelete() per major path, at most aMaxRate per second if
+ * aMaxRate is positive. aParentKey and aRange may be NULL.
+ * aDeleted is set to the number of deleted keys. Raises the error of the
+ * first failed worker, returns false if a Java exception is pending.
+ */
+bool
+purgeMajorPaths(JNIEnv* env,
+                JavaVM* aVM,
+                jobject aStore,
+                jobject aParentKey,
+                jobject aRange,
+                size_t aBatchSize,
+                unsigned aParallelism,
+                double aMaxRate,
+                long long& aDeleted);
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_PURGE_H
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_RATE_LIMITER_H
+#define NOSQLDB_RATE_LIMITER_H
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Spaces calls evenly to at most aRate per second across all threads that
+ * share the limiter. A rate of 0 or less disables the limit.
+ */
+class RateLimiter
+{
+  private:
+    typedef std::chrono::steady_clock Clock_t;
+
+    std::chrono::duration<double> theInterval;
+    bool theEnabled;
+    std::mutex theMutex;
+    Clock_t::time_point theNext;
+
+  public:
+    RateLimiter(double aRate)
+      : theInterval(aRate > 0 ? 1.0 / aRate : 0.0),
+        theEnabled(aRate > 0),
+        theNext(Clock_t::now())
+    {}
+
+    /**
+     * Blocks until the caller may proceed.
+     */
+    void
+    acquire()
+    {
+      if (!theEnabled)
+        return;
+
+      Clock_t::time_point lSlot;
+      {
+        std::lock_guard<std::mutex> lLock(theMutex);
+        Clock_t::time_point lNow = Clock_t::now();
+        lSlot = theNext > lNow ? theNext : lNow;
+        theNext = lSlot + std::chrono::duration_cast<Clock_t::duration>(theInterval);
+      }
+      std::this_thread::sleep_until(lSlot);
+    }
+
+  private:
+    RateLimiter(const RateLimiter&);
+    RateLimiter& operator=(const RateLimiter&);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_RATE_LIMITER_H
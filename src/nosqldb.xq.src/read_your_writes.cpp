@@ -0,0 +1,142 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nosqldb.h"
+#include "options.h"
+#include "read_your_writes.h"
+
+#define THROW_IF_EXCEPTION(env)  if ((COUNT_JNI_CALL(), env->ExceptionCheck())) throw JavaException()
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+ReadYourWrites::ReadYourWrites(const Item& aOptions)
+  : theEnabled(false),
+    theMaxPaths(10000),
+    theTimeout(5000),
+    theVM(0)
+{
+  Item lOption = getOption(aOptions, "read-your-writes");
+  if (lOption.isNull())
+    return;
+  if (lOption.isAtomic())
+  {
+    theEnabled = getBooleanOption(aOptions, "read-your-writes", false);
+    return;
+  }
+
+  long long lMaxPaths = getIntegerOption(lOption, "max-paths", (long long)theMaxPaths);
+  long long lTimeout = getIntegerOption(lOption, "timeout-ms", theTimeout);
+  if (lMaxPaths < 1 || lMaxPaths > 10000000)
+    throwError("InvalidOption", "Option 'max-paths' must be between 1 and 10000000.");
+  if (lTimeout < 1)
+    throwError("InvalidOption", "Option 'timeout-ms' must be positive.");
+  theEnabled = true;
+  theMaxPaths = (size_t)lMaxPaths;
+  theTimeout = (jlong)lTimeout;
+}
+
+
+ReadYourWrites::~ReadYourWrites()
+{
+  JNIEnv* env;
+  if (!theVM || theVM->GetEnv((void**)&env, JNI_VERSION_1_6) != JNI_OK)
+    return;
+  for (auto lIter = theVersions.begin(); lIter != theVersions.end(); ++lIter)
+    env->DeleteGlobalRef(lIter->second.theVersion);
+}
+
+
+void
+ReadYourWrites::written(JNIEnv* env, const KeyPath& aKey, jobject aVersion)
+{
+  if (!theEnabled || !aVersion)
+    return;
+
+  // out of memory, the OutOfMemoryError is pending
+  jobject lVersion = env->NewGlobalRef(aVersion);
+  if (!lVersion)
+    return;
+
+  std::string lMajor = aKey.majorToString();
+  std::lock_guard<std::mutex> lLock(theMutex);
+  if (!theVM && env->GetJavaVM(&theVM) != JNI_OK)
+    theVM = 0;
+
+  auto lIter = theVersions.find(lMajor);
+  if (lIter != theVersions.end())
+  {
+    env->DeleteGlobalRef(lIter->second.theVersion);
+    lIter->second.theVersion = lVersion;
+    theOrder.splice(theOrder.end(), theOrder, lIter->second.thePosition);
+    return;
+  }
+
+  if (theVersions.size() >= theMaxPaths)
+  {
+    auto lOldest = theVersions.find(theOrder.front());
+    env->DeleteGlobalRef(lOldest->second.theVersion);
+    theVersions.erase(lOldest);
+    theOrder.pop_front();
+  }
+  Entry& lEntry = theVersions[lMajor];
+  lEntry.theVersion = lVersion;
+  lEntry.thePosition = theOrder.insert(theOrder.end(), lMajor);
+}
+
+
+jobject
+ReadYourWrites::createConsistency(JNIEnv* env, const KeyPath& aKey)
+{
+  if (!theEnabled)
+    return NULL;
+
+  // a local reference of its own, the entry may be replaced meanwhile
+  jobject version;
+  {
+    std::string lMajor = aKey.majorToString();
+    std::lock_guard<std::mutex> lLock(theMutex);
+    auto lIter = theVersions.find(lMajor);
+    if (lIter == theVersions.end())
+      return NULL;
+    version = env->NewLocalRef(lIter->second.theVersion);
+  }
+
+  //    TimeUnit unit = TimeUnit.MILLISECONDS;
+  jclass timeUnitClass = env->FindClass("java/util/concurrent/TimeUnit");
+  THROW_IF_EXCEPTION(env);
+  jfieldID fidMillis = env->GetStaticFieldID(timeUnitClass, "MILLISECONDS", "Ljava/util/concurrent/TimeUnit;");
+  THROW_IF_EXCEPTION(env);
+  jobject unit = env->GetStaticObjectField(timeUnitClass, fidMillis);
+  THROW_IF_EXCEPTION(env);
+
+  //    Consistency c = new Consistency.Version(version, timeout, unit);
+  jclass cvClass = env->FindClass("oracle/kv/Consistency$Version");
+  THROW_IF_EXCEPTION(env);
+  jmethodID midCvCons = env->GetMethodID(cvClass, "<init>", "(Loracle/kv/Version;JLjava/util/concurrent/TimeUnit;)V");
+  THROW_IF_EXCEPTION(env);
+  jobject consistency = env->NewObject(cvClass, midCvCons, version, theTimeout, unit);
+  THROW_IF_EXCEPTION(env);
+
+  env->DeleteLocalRef(unit);
+  env->DeleteLocalRef(version);
+  return consistency;
+}
+
+
+}} // namespace zorba, nosqldb
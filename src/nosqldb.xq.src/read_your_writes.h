@@ -0,0 +1,103 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_READ_YOUR_WRITES_H
+#define NOSQLDB_READ_YOUR_WRITES_H
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <jni.h>
+
+#include <zorba/item.h>
+
+#include "key_codec.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * The oracle.kv.Version of the last write of a connection per major path,
+ * "read-your-writes" connect option. Reads under a major path that was
+ * written use Consistency.Version with it, so that any replica that caught
+ * up with the write can serve them. A version only orders the writes of
+ * its shard, and the keys of one major path always share a shard, hence
+ * the versions are kept per major path rather than per connection. The
+ * paths written longest ago are forgotten first.
+ */
+class ReadYourWrites
+{
+  private:
+    class Entry
+    {
+      public:
+        jobject theVersion;    // global reference
+        std::list<std::string>::iterator thePosition;
+    };
+
+    bool theEnabled;
+    size_t theMaxPaths;
+    jlong theTimeout;          // milliseconds
+
+    std::mutex theMutex;
+    JavaVM* theVM;
+    std::unordered_map<std::string, Entry> theVersions;
+    // the major paths from the least to the most recently written
+    std::list<std::string> theOrder;
+
+  public:
+    /**
+     * Reads "read-your-writes" : true or { "max-paths" : 10000,
+     * "timeout-ms" : 5000 } from the connect options. Raises
+     * nosql:InvalidOption.
+     */
+    ReadYourWrites(const Item& aOptions);
+
+    ~ReadYourWrites();
+
+    bool
+    isEnabled() const
+    { return theEnabled; }
+
+    /**
+     * Records the oracle.kv.Version aVersion returned by a write of aKey.
+     * Called from writer threads too, it leaves a failure to the caller's
+     * exception check.
+     */
+    void
+    written(JNIEnv* env, const KeyPath& aKey, jobject aVersion);
+
+    /**
+     * A local reference to a Consistency.Version for reading under the
+     * major path of aKey, NULL if it was not written. Raises JavaException.
+     */
+    jobject
+    createConsistency(JNIEnv* env, const KeyPath& aKey);
+
+  private:
+    ReadYourWrites(const ReadYourWrites&);
+    ReadYourWrites& operator=(const ReadYourWrites&);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_READ_YOUR_WRITES_H
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <thread>
+
+#include "retry_policy.h"
+#include "java_exception.h"
+#include "nosqldb.h"
+#include "options.h"
+#include "statistics.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+RetryPolicy::RetryPolicy(const Item& aOptions)
+  : theMaxAttempts(3),
+    theInitialBackoff(10),
+    theMaxBackoff(1000),
+    theRetryNonIdempotent(false),
+    theRandom((std::minstd_rand::result_type)
+        std::chrono::steady_clock::now().time_since_epoch().count())
+{
+  Item lRetry = getOption(aOptions, "retry");
+  if (lRetry.isNull())
+    return;
+
+  if (lRetry.isAtomic())
+  {
+    if (!getBooleanOption(aOptions, "retry", true))
+      theMaxAttempts = 1;
+    return;
+  }
+
+  long long lMaxAttempts = getIntegerOption(lRetry, "max-attempts", theMaxAttempts);
+  long long lInitial = getIntegerOption(lRetry, "initial-backoff-ms", theInitialBackoff.count());
+  long long lMax = getIntegerOption(lRetry, "max-backoff-ms", theMaxBackoff.count());
+  if (lMaxAttempts < 1)
+    throwError("InvalidOption", "Option 'max-attempts' must be positive.");
+  if (lInitial < 0 || lMax < lInitial)
+    throwError("InvalidOption", "Options 'initial-backoff-ms' and 'max-backoff-ms' must satisfy 0 <= initial <= max.");
+
+  theMaxAttempts = (unsigned)lMaxAttempts;
+  theInitialBackoff = std::chrono::milliseconds(lInitial);
+  theMaxBackoff = std::chrono::milliseconds(lMax);
+  theRetryNonIdempotent = getBooleanOption(lRetry, "retry-non-idempotent", false);
+}
+
+
+bool
+RetryPolicy::retry(JNIEnv* env, unsigned aAttempt, Idempotency aIdempotency)
+{
+  if (aAttempt >= theMaxAttempts || !env->ExceptionCheck())
+    return false;
+  if (aIdempotency == NON_IDEMPOTENT && !theRetryNonIdempotent)
+    return false;
+
+  jthrowable lException = env->ExceptionOccurred();
+  env->ExceptionClear();
+  if (!isTransientJavaException(env, lException))
+  {
+    env->Throw(lException);
+    env->DeleteLocalRef(lException);
+    return false;
+  }
+  env->DeleteLocalRef(lException);
+
+  if (Statistics::current())
+  {
+    ++Statistics::current()->theJavaExceptions;
+    ++Statistics::current()->theRetries;
+  }
+
+  // exponential backoff with "equal jitter": half of the delay is fixed,
+  // the other half random, so that retrying clients spread out
+  long long lDelay = theInitialBackoff.count();
+  for (unsigned i = 1; i < aAttempt && lDelay < theMaxBackoff.count(); ++i)
+    lDelay *= 2;
+  if (lDelay > theMaxBackoff.count())
+    lDelay = theMaxBackoff.count();
+
+  long long lHalf = lDelay / 2;
+  std::uniform_int_distribution<long long> lJitter(0, lDelay - lHalf);
+  std::this_thread::sleep_for(std::chrono::milliseconds(lHalf + lJitter(theRandom)));
+  return true;
+}
+
+
+}} // namespace zorba, nosqldb
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_RETRY_POLICY_H
+#define NOSQLDB_RETRY_POLICY_H
+
+#include <chrono>
+#include <random>
+
+#include <jni.h>
+
+#include <zorba/item.h>
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * When to repeat a store call that failed with a transient KV fault, see
+ * isTransientJavaException(). Configured by the "retry" connect option.
+ */
+class RetryPolicy
+{
+  public:
+    enum Idempotency
+    {
+      // repeating the call cannot change its result, e.g. get or put
+      IDEMPOTENT,
+      // a repeated call may report a different result, e.g. the return
+      // value of a delete that was applied before its reply was lost
+      NON_IDEMPOTENT
+    };
+
+  private:
+    unsigned theMaxAttempts;
+    std::chrono::milliseconds theInitialBackoff;
+    std::chrono::milliseconds theMaxBackoff;
+    bool theRetryNonIdempotent;
+    std::minstd_rand theRandom;
+
+  public:
+    /**
+     * Reads "retry" : false or { "max-attempts" : 3,
+     * "initial-backoff-ms" : 10, "max-backoff-ms" : 1000,
+     * "retry-non-idempotent" : false } from the connect options.
+     */
+    RetryPolicy(const Item& aOptions);
+
+    /**
+     * Call after each attempt with aAttempt counting from 1. Returns true if
+     * a transient Java exception is pending and the call should be repeated;
+     * the exception is then cleared and the backoff delay has been slept.
+     * Otherwise returns false and leaves any exception pending.
+     */
+    bool
+    retry(JNIEnv* env, unsigned aAttempt, Idempotency aIdempotency);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_RETRY_POLICY_H
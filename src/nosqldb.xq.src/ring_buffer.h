@@ -0,0 +1,130 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_RING_BUFFER_H
+#define NOSQLDB_RING_BUFFER_H
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Bounded lock-free queue for any number of producers and consumers. Every
+ * slot carries a sequence number telling whether it is free for the push or
+ * filled for the pop of the current lap. Unlike WorkQueue it never waits:
+ * tryPush() fails when the buffer is full and tryPop() when it is empty.
+ */
+template <class T>
+class RingBuffer
+{
+  private:
+    class Slot
+    {
+      public:
+        std::atomic<size_t> theSequence;
+        T theValue;
+    };
+
+    std::unique_ptr<Slot[]> theSlots;
+    size_t theMask;
+    // producers and consumers on separate cache lines
+    char thePad1[64];
+    std::atomic<size_t> theTail;
+    char thePad2[64];
+    std::atomic<size_t> theHead;
+
+  public:
+    /**
+     * The capacity is aCapacity rounded up to a power of two.
+     */
+    RingBuffer(size_t aCapacity)
+      : theTail(0),
+        theHead(0)
+    {
+      size_t lSize = 2;
+      while (lSize < aCapacity)
+        lSize <<= 1;
+      theSlots.reset(new Slot[lSize]);
+      theMask = lSize - 1;
+      for (size_t i = 0; i < lSize; ++i)
+        theSlots[i].theSequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool
+    tryPush(T& aValue)
+    {
+      size_t lPos = theTail.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        Slot& lSlot = theSlots[lPos & theMask];
+        size_t lSeq = lSlot.theSequence.load(std::memory_order_acquire);
+        ptrdiff_t lDiff = (ptrdiff_t)lSeq - (ptrdiff_t)lPos;
+        if (lDiff == 0)
+        {
+          if (theTail.compare_exchange_weak(lPos, lPos + 1, std::memory_order_relaxed))
+          {
+            lSlot.theValue = std::move(aValue);
+            lSlot.theSequence.store(lPos + 1, std::memory_order_release);
+            return true;
+          }
+        }
+        else if (lDiff < 0)
+          return false;
+        else
+          lPos = theTail.load(std::memory_order_relaxed);
+      }
+    }
+
+    bool
+    tryPop(T& aValue)
+    {
+      size_t lPos = theHead.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        Slot& lSlot = theSlots[lPos & theMask];
+        size_t lSeq = lSlot.theSequence.load(std::memory_order_acquire);
+        ptrdiff_t lDiff = (ptrdiff_t)lSeq - (ptrdiff_t)(lPos + 1);
+        if (lDiff == 0)
+        {
+          if (theHead.compare_exchange_weak(lPos, lPos + 1, std::memory_order_relaxed))
+          {
+            aValue = std::move(lSlot.theValue);
+            lSlot.theSequence.store(lPos + theMask + 1, std::memory_order_release);
+            return true;
+          }
+        }
+        else if (lDiff < 0)
+          return false;
+        else
+          lPos = theHead.load(std::memory_order_relaxed);
+      }
+    }
+
+  private:
+    RingBuffer(const RingBuffer&);
+    RingBuffer& operator=(const RingBuffer&);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_RING_BUFFER_H
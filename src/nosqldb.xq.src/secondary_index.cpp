@@ -0,0 +1,151 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "secondary_index.h"
+#include "json_lines.h"
+#include "nosqldb.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+const char* const SecondaryIndexes::theReservedMajor = "_idx";
+
+
+SecondaryIndexes::SecondaryIndexes(const Item& aIndexes)
+{
+  if (!aIndexes.isJSONItem() ||
+      aIndexes.getJSONItemKind() != store::StoreConsts::jsonObject)
+    throwError("InvalidOption", "Option 'indexes' must be an object.");
+
+  Iterator_t lNames = aIndexes.getObjectKeys();
+  Item lName;
+  lNames->open();
+  while (lNames->next(lName))
+  {
+    theIndexes.push_back(Index());
+    Index& lIndex = theIndexes.back();
+    lIndex.theName = lName.getStringValue().str();
+
+    // "name" : "field" or ["field", "nested-field"]
+    Item lField = aIndexes.getObjectValue(lName.getStringValue());
+    if (lField.isAtomic())
+    {
+      lIndex.theField.push_back(lField.getStringValue().str());
+    }
+    else if (lField.isJSONItem() &&
+             lField.getJSONItemKind() == store::StoreConsts::jsonArray)
+    {
+      uint64_t lSize = lField.getArraySize();
+      for (uint64_t i = 1; i <= lSize; ++i)
+        lIndex.theField.push_back(lField.getArrayValue(i).getStringValue().str());
+    }
+
+    if (lIndex.theField.empty())
+    {
+      lNames->close();
+      throwError("InvalidOption", ("Index '" + lIndex.theName +
+          "' must name a field or an array of nested fields.").c_str());
+    }
+  }
+  lNames->close();
+}
+
+
+const SecondaryIndexes::Index*
+SecondaryIndexes::find(const std::string& aName) const
+{
+  for (size_t i = 0; i < theIndexes.size(); ++i)
+    if (theIndexes[i].theName == aName)
+      return &theIndexes[i];
+  return 0;
+}
+
+
+KeyPath
+SecondaryIndexes::parentKey(const Index& aIndex)
+{
+  KeyPath lKey;
+  lKey.theMajor.push_back(theReservedMajor);
+  lKey.theMajor.push_back(aIndex.theName);
+  return lKey;
+}
+
+
+void
+SecondaryIndexes::entries(const KeyPath& aKey, const std::string& aValue,
+                          std::vector<KeyPath>& aResult) const
+{
+  if (!aKey.theMajor.empty() && aKey.theMajor[0] == theReservedMajor)
+    return;
+
+  std::string lFieldValue;
+  for (size_t i = 0; i < theIndexes.size(); ++i)
+  {
+    if (!readJSONField(aValue, theIndexes[i].theField, lFieldValue))
+      continue;
+
+    aResult.push_back(parentKey(theIndexes[i]));
+    aResult.back().theMinor.push_back(lFieldValue);
+    aResult.back().theMinor.push_back(aKey.toString());
+  }
+}
+
+
+static bool
+sameEntry(const KeyPath& aEntry1, const KeyPath& aEntry2)
+{
+  return aEntry1.theMajor == aEntry2.theMajor && aEntry1.theMinor == aEntry2.theMinor;
+}
+
+
+void
+SecondaryIndexes::diff(const KeyPath& aKey,
+                       const std::string* aOldValue,
+                       const std::string* aNewValue,
+                       std::vector<KeyPath>& aAdded,
+                       std::vector<KeyPath>& aRemoved) const
+{
+  std::vector<KeyPath> lOld;
+  std::vector<KeyPath> lNew;
+  if (aOldValue)
+    entries(aKey, *aOldValue, lOld);
+  if (aNewValue)
+    entries(aKey, *aNewValue, lNew);
+
+  // an unchanged field keeps its entry
+  for (size_t i = 0; i < lNew.size(); ++i)
+  {
+    bool lKept = false;
+    for (size_t j = 0; j < lOld.size() && !lKept; ++j)
+      lKept = sameEntry(lNew[i], lOld[j]);
+    if (!lKept)
+      aAdded.push_back(lNew[i]);
+  }
+  for (size_t i = 0; i < lOld.size(); ++i)
+  {
+    bool lKept = false;
+    for (size_t j = 0; j < lNew.size() && !lKept; ++j)
+      lKept = sameEntry(lOld[i], lNew[j]);
+    if (!lKept)
+      aRemoved.push_back(lOld[i]);
+  }
+}
+
+
+}} // namespace zorba, nosqldb
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_SECONDARY_INDEX_H
+#define NOSQLDB_SECONDARY_INDEX_H
+
+#include <string>
+#include <vector>
+
+#include <zorba/item.h>
+
+#include "key_codec.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Secondary indexes over fields of JSON values, declared by the "indexes"
+ * connect option, e.g.
+ *   "indexes" : { "by-city" : "city", "by-zip" : ["address", "zip"] }
+ * The entries of an index are records under the reserved major path
+ * ["_idx", <index name>], with the minor path
+ * [<field value>, <primary key as KeyPath::toString()>] and the
+ * encodeOrderedKey() of the primary key as value. Entries are sorted by
+ * field value, so a lookup is one multi-get over the index's major path.
+ */
+class SecondaryIndexes
+{
+  public:
+    class Index
+    {
+      public:
+        std::string theName;
+        // property names from the outermost object inwards
+        std::vector<std::string> theField;
+    };
+
+    // the first major component of all index entries
+    static const char* const theReservedMajor;
+
+  private:
+    std::vector<Index> theIndexes;
+
+  public:
+    /**
+     * Reads the "indexes" option, raises nosql:InvalidOption.
+     */
+    SecondaryIndexes(const Item& aIndexes);
+
+    const Index*
+    find(const std::string& aName) const;
+
+    /**
+     * The parent key of the entries of aIndex.
+     */
+    static KeyPath
+    parentKey(const Index& aIndex);
+
+    /**
+     * Adds the keys of the index entries of the record aKey with aValue to
+     * aResult. Index entries themselves and values that are not JSON
+     * objects have none.
+     */
+    void
+    entries(const KeyPath& aKey, const std::string& aValue,
+            std::vector<KeyPath>& aResult) const;
+
+    /**
+     * Splits the entries of aKey before (aOldValue) and after (aNewValue) a
+     * write into the ones to add and the ones to delete; either value may be
+     * 0 for a missing record.
+     */
+    void
+    diff(const KeyPath& aKey,
+         const std::string* aOldValue,
+         const std::string* aNewValue,
+         std::vector<KeyPath>& aAdded,
+         std::vector<KeyPath>& aRemoved) const;
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_SECONDARY_INDEX_H
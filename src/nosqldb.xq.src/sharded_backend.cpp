@@ -0,0 +1,435 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <map>
+
+#include "sharded_backend.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+// the points of each shard on the ring, enough to even out the shares of
+// a few shards
+static const unsigned theVirtualNodes = 128;
+
+
+namespace
+{
+
+// FNV-1a followed by the splitmix64 finalizer, the points of one shard
+// differ in their last characters only. Unlike std::hash the result is the
+// same in every process, which the placement of the records depends on.
+uint64_t
+hashString(const std::string& aString)
+{
+  uint64_t lHash = 14695981039346656037ULL;
+  for (size_t i = 0; i < aString.size(); ++i)
+  {
+    lHash ^= (unsigned char)aString[i];
+    lHash *= 1099511628211ULL;
+  }
+  lHash ^= lHash >> 30;
+  lHash *= 0xbf58476d1ce4e5b9ULL;
+  lHash ^= lHash >> 27;
+  lHash *= 0x94d049bb133111ebULL;
+  lHash ^= lHash >> 31;
+  return lHash;
+}
+
+
+// the number of records of each major path a scan passes that theFilter
+// selects
+class PathCounter : public RecordHandler
+{
+  public:
+    std::function<bool(const std::string&)> theFilter;
+    std::map<std::string, std::pair<KeyPath, size_t> > thePaths;
+    // the records of a path mostly come one after the other
+    std::string theLastPath;
+    bool theLastSelected;
+
+    PathCounter(const std::function<bool(const std::string&)>& aFilter)
+      : theFilter(aFilter),
+        theLastSelected(false)
+    {}
+
+    virtual void
+    record(const KeyPath& aKey, const char*, size_t, long long)
+    {
+      std::string lPath = aKey.majorToString();
+      if (lPath != theLastPath)
+      {
+        theLastSelected = theFilter(lPath);
+        theLastPath.swap(lPath);
+      }
+      if (!theLastSelected)
+        return;
+      std::pair<KeyPath, size_t>& lCount = thePaths[theLastPath];
+      if (lCount.second++ == 0)
+        lCount.first.theMajor = aKey.theMajor;
+    }
+};
+
+}
+
+
+ShardedBackend::ShardedBackend(const std::vector<Shard>& aShards)
+  : theShards(aShards),
+    theBalanced(false),
+    theScanned(false)
+{
+  buildRing(theShards, true, theRing);
+
+  for (size_t i = 0; i < theShards.size(); ++i)
+    if (theShards[i].theJoining)
+    {
+      buildRing(theShards, false, thePreviousRing);
+      break;
+    }
+
+  // a joining point takes over the paths just before it from the shard
+  // that owned its hash
+  for (size_t i = 0; i < theRing.size(); ++i)
+  {
+    if (!theShards[theRing[i].second].theJoining)
+      continue;
+    size_t lDonor = lookup(thePreviousRing, theRing[i].first);
+    if (std::find(theDonors.begin(), theDonors.end(), lDonor) == theDonors.end())
+      theDonors.push_back(lDonor);
+  }
+  std::sort(theDonors.begin(), theDonors.end());
+}
+
+
+void
+ShardedBackend::buildRing(const std::vector<Shard>& aShards, bool aWithJoining, Ring_t& aRing)
+{
+  for (size_t i = 0; i < aShards.size(); ++i)
+  {
+    if (aShards[i].theJoining && !aWithJoining)
+      continue;
+    for (unsigned j = 0; j < theVirtualNodes; ++j)
+      aRing.push_back(std::make_pair(
+          hashString(aShards[i].theName + '#' + std::to_string(j)), i));
+  }
+  std::sort(aRing.begin(), aRing.end());
+}
+
+
+size_t
+ShardedBackend::lookup(const Ring_t& aRing, uint64_t aHash)
+{
+  Ring_t::const_iterator lPoint = std::lower_bound(
+      aRing.begin(), aRing.end(), std::make_pair(aHash, (size_t)0));
+  if (lPoint == aRing.end())
+    lPoint = aRing.begin();
+  return lPoint->second;
+}
+
+
+size_t
+ShardedBackend::lookup(const Ring_t& aRing, const std::string& aMajorPath)
+{
+  return lookup(aRing, hashString(aMajorPath));
+}
+
+
+size_t
+ShardedBackend::move(size_t aFrom, size_t aTo, const KeyPath& aKey, PhaseClock& aClock)
+{
+  KeyPath lParent;
+  lParent.theMajor = aKey.theMajor;
+
+  std::vector<Record> lRecords;
+  RecordCollector lCollector(lRecords);
+  Backend& lFrom = *theShards[aFrom].theBackend;
+  lFrom.multiGet(lParent, 0, PARENT_AND_DESCENDANTS, FORWARD, lCollector, aClock);
+  if (lRecords.empty())
+    return 0;
+
+  // the records are removed only once all of them were written, a failed
+  // move leaves copies on the old owner that the next move overwrites
+  Backend& lTo = *theShards[aTo].theBackend;
+  for (size_t i = 0; i < lRecords.size(); ++i)
+    lTo.put(lRecords[i].theKey, lRecords[i].theValue, aClock);
+  lFrom.multiRemove(lParent, 0, PARENT_AND_DESCENDANTS, aClock);
+  return lRecords.size();
+}
+
+
+size_t
+ShardedBackend::moveOnce(size_t aFrom, size_t aTo, const KeyPath& aKey,
+                         const std::string& aPath, PhaseClock& aClock)
+{
+  std::unique_lock<std::mutex> lLock(theMutex);
+  theMoveDone.wait(lLock, [&] { return theMoving.count(aPath) == 0; });
+  if (theBalanced || theMoved.count(aPath) > 0)
+    return 0;
+  theMoving.insert(aPath);
+  lLock.unlock();
+
+  // the records are moved without the lock, a routed call of another path
+  // does not wait for them
+  size_t lMoved;
+  try
+  {
+    lMoved = move(aFrom, aTo, aKey, aClock);
+  }
+  catch (...)
+  {
+    lLock.lock();
+    theMoving.erase(aPath);
+    theMoveDone.notify_all();
+    throw;
+  }
+
+  lLock.lock();
+  theMoving.erase(aPath);
+  theMoved.insert(aPath);
+  theMoveDone.notify_all();
+  return lMoved;
+}
+
+
+size_t
+ShardedBackend::route(const KeyPath& aKey, PhaseClock& aClock)
+{
+  std::string lPath = aKey.majorToString();
+  size_t lOwner = lookup(theRing, lPath);
+  if (thePreviousRing.empty())
+    return lOwner;
+
+  size_t lPrevious = lookup(thePreviousRing, lPath);
+  if (lPrevious != lOwner)
+    moveOnce(lPrevious, lOwner, aKey, lPath, aClock);
+  return lOwner;
+}
+
+
+void
+ShardedBackend::rebalance(size_t aLimit, size_t& aMoved, size_t& aRemaining,
+                          PhaseClock& aClock)
+{
+  aMoved = 0;
+  aRemaining = 0;
+
+  std::lock_guard<std::mutex> lRebalanceLock(theRebalanceMutex);
+  if (!theScanned)
+  {
+    // the paths are collected first, a backend may not be written while it
+    // passes records; only the donors can hold records of another owner
+    for (size_t i = 0; i < theDonors.size(); ++i)
+    {
+      size_t lDonor = theDonors[i];
+      PathCounter lCounter([this, lDonor](const std::string& aPath)
+      {
+        return lookup(theRing, aPath) != lDonor;
+      });
+      theShards[lDonor].theBackend->scan(0, lCounter, aClock);
+
+      for (std::map<std::string, std::pair<KeyPath, size_t> >::iterator lIter =
+               lCounter.thePaths.begin();
+           lIter != lCounter.thePaths.end(); ++lIter)
+      {
+        Misplaced lMisplaced;
+        lMisplaced.theFrom = lDonor;
+        lMisplaced.theKey = lIter->second.first;
+        lMisplaced.thePath = lIter->first;
+        lMisplaced.theRecords = lIter->second.second;
+        theMisplaced.push_back(std::move(lMisplaced));
+      }
+    }
+    theScanned = true;
+  }
+
+  // a path is dropped from the list once it is moved, a failed move is
+  // tried again by the next call
+  while (!theMisplaced.empty() && aMoved < aLimit)
+  {
+    const Misplaced& lMisplaced = theMisplaced.front();
+    aMoved += moveOnce(lMisplaced.theFrom, lookup(theRing, lMisplaced.thePath),
+                       lMisplaced.theKey, lMisplaced.thePath, aClock);
+    theMisplaced.pop_front();
+  }
+
+  std::lock_guard<std::mutex> lLock(theMutex);
+  for (size_t i = 0; i < theMisplaced.size(); ++i)
+    if (theMoved.count(theMisplaced[i].thePath) == 0)
+      aRemaining += theMisplaced[i].theRecords;
+
+  if (aRemaining == 0 && theMoving.empty())
+  {
+    theBalanced = true;
+    theMisplaced.clear();
+    theMoved.clear();
+  }
+}
+
+
+long long
+ShardedBackend::put(const KeyPath& aKey, const std::string& aValue, PhaseClock& aClock)
+{
+  return theShards[route(aKey, aClock)].theBackend->put(aKey, aValue, aClock);
+}
+
+
+bool
+ShardedBackend::get(const KeyPath& aKey, RecordHandler& aHandler, PhaseClock& aClock)
+{
+  return theShards[route(aKey, aClock)].theBackend->get(aKey, aHandler, aClock);
+}
+
+
+void
+ShardedBackend::getMany(const std::vector<KeyPath>& aKeys, unsigned aParallelism,
+                        RecordHandler& aHandler, PhaseClock& aClock)
+{
+  std::vector<std::vector<KeyPath> > lGroups(theShards.size());
+  for (size_t i = 0; i < aKeys.size(); ++i)
+    lGroups[route(aKeys[i], aClock)].push_back(aKeys[i]);
+
+  size_t lUsed = 0;
+  size_t lLast = 0;
+  for (size_t i = 0; i < lGroups.size(); ++i)
+    if (!lGroups[i].empty())
+    {
+      ++lUsed;
+      lLast = i;
+    }
+  if (lUsed == 0)
+    return;
+  if (lUsed == 1)
+  {
+    theShards[lLast].theBackend->getMany(lGroups[lLast], aParallelism, aHandler, aClock);
+    return;
+  }
+
+  // the shards are read one after the other, the records are then passed
+  // in the order of aKeys
+  std::vector<Record> lRecords;
+  RecordCollector lCollector(lRecords);
+  for (size_t i = 0; i < lGroups.size(); ++i)
+    if (!lGroups[i].empty())
+      theShards[i].theBackend->getMany(lGroups[i], aParallelism, lCollector, aClock);
+
+  std::map<std::string, size_t> lFound;
+  for (size_t i = 0; i < lRecords.size(); ++i)
+    lFound[encodeOrderedKey(lRecords[i].theKey)] = i;
+  for (size_t i = 0; i < aKeys.size(); ++i)
+  {
+    std::map<std::string, size_t>::const_iterator lIter =
+        lFound.find(encodeOrderedKey(aKeys[i]));
+    if (lIter == lFound.end())
+      continue;
+    const Record& lRecord = lRecords[lIter->second];
+    aHandler.record(lRecord.theKey, lRecord.theValue.data(), lRecord.theValue.size(),
+                    lRecord.theVersion);
+  }
+}
+
+
+bool
+ShardedBackend::remove(const KeyPath& aKey, PhaseClock& aClock)
+{
+  return theShards[route(aKey, aClock)].theBackend->remove(aKey, aClock);
+}
+
+
+void
+ShardedBackend::multiGet(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                         Depth aDepth, Direction aDirection,
+                         RecordHandler& aHandler, PhaseClock& aClock)
+{
+  theShards[route(aParentKey, aClock)].theBackend->multiGet(
+      aParentKey, aRange, aDepth, aDirection, aHandler, aClock);
+}
+
+
+void
+ShardedBackend::multiGetPage(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                             Depth aDepth, Direction aDirection, size_t aLimit,
+                             RecordHandler& aHandler, PhaseClock& aClock)
+{
+  theShards[route(aParentKey, aClock)].theBackend->multiGetPage(
+      aParentKey, aRange, aDepth, aDirection, aLimit, aHandler, aClock);
+}
+
+
+std::unique_ptr<RecordCursor>
+ShardedBackend::openReadAhead(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                              Depth aDepth, Direction aDirection, unsigned aBatches,
+                              PhaseClock& aClock)
+{
+  return theShards[route(aParentKey, aClock)].theBackend->openReadAhead(
+      aParentKey, aRange, aDepth, aDirection, aBatches, aClock);
+}
+
+
+void
+ShardedBackend::multiGetParts(const KeyPath& aParentKey, const std::vector<KeyRangeSpec>& aParts,
+                              Depth aDepth, Direction aDirection, bool aOrdered,
+                              unsigned aParallelism, RecordHandler& aHandler, PhaseClock& aClock)
+{
+  theShards[route(aParentKey, aClock)].theBackend->multiGetParts(
+      aParentKey, aParts, aDepth, aDirection, aOrdered, aParallelism, aHandler, aClock);
+}
+
+
+std::unique_ptr<RecordCursor>
+ShardedBackend::openMerged(const std::vector<KeyPath>& aParentKeys, const KeyRangeSpec* aRange,
+                           Depth aDepth, Direction aDirection, unsigned aParallelism,
+                           PhaseClock& aClock)
+{
+  std::vector<std::vector<KeyPath> > lGroups(theShards.size());
+  for (size_t i = 0; i < aParentKeys.size(); ++i)
+    lGroups[route(aParentKeys[i], aClock)].push_back(aParentKeys[i]);
+
+  // every shard merges its own parents, the shards' cursors are then
+  // merged here
+  std::vector<std::unique_ptr<RecordCursor> > lCursors;
+  for (size_t i = 0; i < lGroups.size(); ++i)
+    if (!lGroups[i].empty())
+      lCursors.push_back(theShards[i].theBackend->openMerged(
+          lGroups[i], aRange, aDepth, aDirection, aParallelism, aClock));
+  if (lCursors.size() == 1)
+    return std::move(lCursors[0]);
+  return std::unique_ptr<RecordCursor>(new MergeCursor(lCursors, aDirection));
+}
+
+
+size_t
+ShardedBackend::multiRemove(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                            Depth aDepth, PhaseClock& aClock)
+{
+  return theShards[route(aParentKey, aClock)].theBackend->multiRemove(
+      aParentKey, aRange, aDepth, aClock);
+}
+
+
+void
+ShardedBackend::scan(const KeyPath* aParentKey, RecordHandler& aHandler, PhaseClock& aClock)
+{
+  // a partial major path may span every shard
+  for (size_t i = 0; i < theShards.size(); ++i)
+    theShards[i].theBackend->scan(aParentKey, aHandler, aClock);
+}
+
+
+}} // namespace zorba, nosqldb
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_SHARDED_BACKEND_H
+#define NOSQLDB_SHARDED_BACKEND_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "backend.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Client-side sharding over several stores, "shards" connect option. Each
+ * shard owns points on a ring of 64-bit hashes, derived from its store
+ * name; a major path belongs to the shard of the first point at or after
+ * the hash of the path. All records of a major path therefore live in one
+ * store and the multi-key operations keep their semantics, and a shard
+ * added to the ring only takes over the paths that fall just before its
+ * points. Key-based operations go to the owner of their major path, scans
+ * go to every shard.
+ *
+ * A shard that is "joining" was added to stores that already hold data:
+ * the records of a major path whose owner differs from its owner on the
+ * ring without the joining shards are moved to the new owner when the path
+ * is first used, and rebalance() moves the others a few at a time. A move
+ * reads the records of the path, writes them to the new owner and removes
+ * them from the old one; it is not atomic towards other connections. The
+ * moves of different paths run at the same time.
+ */
+class ShardedBackend : public Backend
+{
+  public:
+    class Shard
+    {
+      public:
+        std::string theName;
+        std::shared_ptr<Backend> theBackend;
+        bool theJoining;
+    };
+
+  private:
+    // the points of the ring in hash order, with the index of their shard
+    typedef std::vector<std::pair<uint64_t, size_t> > Ring_t;
+
+    std::vector<Shard> theShards;
+    Ring_t theRing;
+    // the ring without the joining shards, empty if there are none
+    Ring_t thePreviousRing;
+
+    // the shards that lost points to the joining shards, the only ones
+    // that can hold misplaced records
+    std::vector<size_t> theDonors;
+
+    // a major path found away from its owner by rebalance()
+    class Misplaced
+    {
+      public:
+        size_t theFrom;
+        KeyPath theKey;
+        std::string thePath;
+        size_t theRecords;
+    };
+
+    std::mutex theMutex;
+    std::condition_variable theMoveDone;
+    // the major paths that need no move anymore
+    std::unordered_set<std::string> theMoved;
+    // the major paths being moved
+    std::unordered_set<std::string> theMoving;
+    bool theBalanced;
+
+    // serializes rebalance(), which scans the donors on its first call
+    // only and then works off theMisplaced
+    std::mutex theRebalanceMutex;
+    bool theScanned;
+    std::deque<Misplaced> theMisplaced;
+
+    static void
+    buildRing(const std::vector<Shard>& aShards, bool aWithJoining, Ring_t& aRing);
+
+    static size_t
+    lookup(const Ring_t& aRing, uint64_t aHash);
+
+    static size_t
+    lookup(const Ring_t& aRing, const std::string& aMajorPath);
+
+    // moves the records of the major path of aKey from aFrom to aTo,
+    // returns their number
+    size_t
+    move(size_t aFrom, size_t aTo, const KeyPath& aKey, PhaseClock& aClock);
+
+    // move() unless the path aPath of aKey was moved already, waits for
+    // another thread moving it; returns the number of records moved
+    size_t
+    moveOnce(size_t aFrom, size_t aTo, const KeyPath& aKey,
+             const std::string& aPath, PhaseClock& aClock);
+
+    // the owner of the major path of aKey, after moving its records there
+    size_t
+    route(const KeyPath& aKey, PhaseClock& aClock);
+
+  public:
+    /**
+     * aShards must have distinct names, the first must not be joining.
+     */
+    ShardedBackend(const std::vector<Shard>& aShards);
+
+    /**
+     * Moves the records of major paths not stored on their owner until at
+     * least aLimit records were moved, whole major paths at a time. Returns
+     * the number moved in aMoved and the number still misplaced in
+     * aRemaining. The first call scans the shards that lost points to the
+     * joining shards for the misplaced paths, later calls resume with the
+     * paths left; paths written meanwhile are moved by their first use.
+     */
+    void
+    rebalance(size_t aLimit, size_t& aMoved, size_t& aRemaining, PhaseClock& aClock);
+
+    virtual long long
+    put(const KeyPath& aKey, const std::string& aValue, PhaseClock& aClock);
+
+    virtual bool
+    get(const KeyPath& aKey, RecordHandler& aHandler, PhaseClock& aClock);
+
+    virtual void
+    getMany(const std::vector<KeyPath>& aKeys, unsigned aParallelism,
+            RecordHandler& aHandler, PhaseClock& aClock);
+
+    virtual bool
+    remove(const KeyPath& aKey, PhaseClock& aClock);
+
+    virtual void
+    multiGet(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+             Depth aDepth, Direction aDirection,
+             RecordHandler& aHandler, PhaseClock& aClock);
+
+    virtual void
+    multiGetPage(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                 Depth aDepth, Direction aDirection, size_t aLimit,
+                 RecordHandler& aHandler, PhaseClock& aClock);
+
+    virtual std::unique_ptr<RecordCursor>
+    openReadAhead(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                  Depth aDepth, Direction aDirection, unsigned aBatches,
+                  PhaseClock& aClock);
+
+    virtual void
+    multiGetParts(const KeyPath& aParentKey, const std::vector<KeyRangeSpec>& aParts,
+                  Depth aDepth, Direction aDirection, bool aOrdered,
+                  unsigned aParallelism, RecordHandler& aHandler, PhaseClock& aClock);
+
+    virtual std::unique_ptr<RecordCursor>
+    openMerged(const std::vector<KeyPath>& aParentKeys, const KeyRangeSpec* aRange,
+               Depth aDepth, Direction aDirection, unsigned aParallelism,
+               PhaseClock& aClock);
+
+    virtual size_t
+    multiRemove(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                Depth aDepth, PhaseClock& aClock);
+
+    virtual void
+    scan(const KeyPath* aParentKey, RecordHandler& aHandler, PhaseClock& aClock);
+
+  private:
+    ShardedBackend(const ShardedBackend&);
+    ShardedBackend& operator=(const ShardedBackend&);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_SHARDED_BACKEND_H
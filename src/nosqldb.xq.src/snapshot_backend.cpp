@@ -0,0 +1,405 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot_backend.h"
+#include "nosqldb.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+static const char theSnapshotMagic[8] = { 'Z', 'N', 'O', 'S', 'Q', 'L', 'S', '1' };
+
+
+static int
+compareKeys(const char* aKey1, size_t aSize1, const char* aKey2, size_t aSize2)
+{
+  int lResult = memcmp(aKey1, aKey2, std::min(aSize1, aSize2));
+  if (lResult != 0)
+    return lResult;
+  return aSize1 < aSize2 ? -1 : (aSize1 > aSize2 ? 1 : 0);
+}
+
+
+// maps the whole file aPath read-only, raises nosql:FileError
+static const char*
+mapFile(const std::string& aPath, size_t& aSize)
+{
+  int lFile = ::open(aPath.c_str(), O_RDONLY);
+  if (lFile < 0)
+    throwError("FileError", ("Could not open " + aPath + " for reading.").c_str());
+
+  struct stat lStat;
+  void* lData = MAP_FAILED;
+  if (fstat(lFile, &lStat) == 0 && lStat.st_size > 0)
+  {
+    aSize = (size_t)lStat.st_size;
+    lData = mmap(0, aSize, PROT_READ, MAP_SHARED, lFile, 0);
+  }
+  // the mapping stays valid after the descriptor is closed
+  ::close(lFile);
+
+  if (lData == MAP_FAILED)
+    throwError("FileError", ("Could not map " + aPath + ".").c_str());
+  return (const char*)lData;
+}
+
+
+/*****************************************************************************
+ writeSnapshot
+ *****************************************************************************/
+
+namespace
+{
+
+// appends the records to the file as they come, only the index is kept in
+// memory until the end
+class SnapshotWriter : public RecordHandler
+{
+  public:
+    std::ofstream& theOut;
+    std::vector<SnapshotBackend::IndexEntry> theIndex;
+    uint64_t theOffset;
+    std::string theKey;
+
+    SnapshotWriter(std::ofstream& aOut)
+      : theOut(aOut),
+        theOffset(sizeof(SnapshotBackend::Header))
+    {}
+
+    virtual void
+    record(const KeyPath& aKey, const char* aValue, size_t aSize, long long aVersion)
+    {
+      theKey = encodeOrderedKey(aKey);
+      theOut.write(theKey.data(), theKey.size());
+      theOut.write(aValue, aSize);
+
+      SnapshotBackend::IndexEntry lEntry;
+      lEntry.theOffset = theOffset;
+      lEntry.theKeySize = (uint32_t)theKey.size();
+      lEntry.theValueSize = (uint32_t)aSize;
+      lEntry.theVersion = aVersion;
+      theIndex.push_back(lEntry);
+      theOffset += theKey.size() + aSize;
+    }
+};
+
+
+class KeyLess
+{
+  public:
+    const char* theData;
+
+    KeyLess(const char* aData) : theData(aData) {}
+
+    bool
+    operator()(const SnapshotBackend::IndexEntry& aEntry1,
+               const SnapshotBackend::IndexEntry& aEntry2) const
+    {
+      return compareKeys(theData + aEntry1.theOffset, aEntry1.theKeySize,
+                         theData + aEntry2.theOffset, aEntry2.theKeySize) < 0;
+    }
+};
+
+}
+
+
+TransferStats
+writeSnapshot(Backend& aSource, const KeyPath* aParentKey,
+              const std::string& aPath, PhaseClock& aClock)
+{
+  std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+
+  std::string lTmpPath = aPath + ".tmp";
+  std::ofstream lOut(lTmpPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!lOut)
+    throwError("FileError", ("Could not open " + lTmpPath + " for writing.").c_str());
+
+  TransferStats lStats;
+  try
+  {
+    SnapshotBackend::Header lHeader;
+    memcpy(lHeader.theMagic, theSnapshotMagic, sizeof(lHeader.theMagic));
+    lHeader.theRecords = 0;
+    lHeader.theIndexOffset = 0;
+    lOut.write((const char*)&lHeader, sizeof(lHeader));
+
+    SnapshotWriter lWriter(lOut);
+    aSource.scan(aParentKey, lWriter, aClock);
+    lOut.flush();
+    if (!lOut)
+      throwError("FileError", ("Could not write " + lTmpPath + ".").c_str());
+
+    // the records arrive unordered, the index is sorted by the keys as
+    // written to the file
+    size_t lSize;
+    const char* lData = mapFile(lTmpPath, lSize);
+    std::sort(lWriter.theIndex.begin(), lWriter.theIndex.end(), KeyLess(lData));
+    munmap((void*)lData, lSize);
+
+    // the index is aligned for direct use from the mapping
+    static const char thePadding[8] = { 0 };
+    size_t lPadding = (8 - lWriter.theOffset % 8) % 8;
+    lOut.write(thePadding, lPadding);
+    if (!lWriter.theIndex.empty())
+      lOut.write((const char*)&lWriter.theIndex[0],
+                 lWriter.theIndex.size() * sizeof(SnapshotBackend::IndexEntry));
+
+    lHeader.theRecords = lWriter.theIndex.size();
+    lHeader.theIndexOffset = lWriter.theOffset + lPadding;
+    lOut.seekp(0);
+    lOut.write((const char*)&lHeader, sizeof(lHeader));
+    lOut.seekp(0, std::ios::end);
+    lStats.theBytes = (unsigned long long)lOut.tellp();
+    lOut.close();
+    if (!lOut)
+      throwError("FileError", ("Could not write " + lTmpPath + ".").c_str());
+
+    if (std::rename(lTmpPath.c_str(), aPath.c_str()) != 0)
+      throwError("FileError", ("Could not replace " + aPath + ".").c_str());
+
+    lStats.theRecords = lHeader.theRecords;
+  }
+  catch (...)
+  {
+    lOut.close();
+    std::remove(lTmpPath.c_str());
+    throw;
+  }
+
+  lStats.theSeconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - lStart).count();
+  return lStats;
+}
+
+
+/*****************************************************************************
+ SnapshotBackend
+ *****************************************************************************/
+
+SnapshotBackend::SnapshotBackend(const std::string& aPath)
+  : thePath(aPath),
+    theData(0),
+    theSize(0),
+    theIndex(0),
+    theRecords(0),
+    theIndexOffset(0)
+{
+  theData = mapFile(aPath, theSize);
+
+  // only the header is checked here, the index entries are checked by
+  // recordOf() when they are used
+  bool lValid = theSize >= sizeof(Header) &&
+      memcmp(theData, theSnapshotMagic, sizeof(theSnapshotMagic)) == 0;
+  if (lValid)
+  {
+    const Header* lHeader = (const Header*)theData;
+    theIndexOffset = lHeader->theIndexOffset;
+    theRecords = (size_t)lHeader->theRecords;
+    lValid = theIndexOffset % 8 == 0 &&
+        theIndexOffset >= sizeof(Header) &&
+        theIndexOffset <= theSize &&
+        (theSize - theIndexOffset) == theRecords * sizeof(IndexEntry);
+  }
+  if (lValid)
+    theIndex = (const IndexEntry*)(theData + theIndexOffset);
+
+  if (!lValid)
+  {
+    munmap((void*)theData, theSize);
+    throwError("FileError", (aPath + " is not a snapshot file.").c_str());
+  }
+}
+
+
+SnapshotBackend::~SnapshotBackend()
+{
+  munmap((void*)theData, theSize);
+}
+
+
+const char*
+SnapshotBackend::recordOf(const IndexEntry* aEntry) const
+{
+  if (aEntry->theOffset < sizeof(Header) ||
+      aEntry->theOffset > theIndexOffset ||
+      (uint64_t)aEntry->theKeySize + aEntry->theValueSize > theIndexOffset - aEntry->theOffset)
+    throwError("FileError", (thePath + " is not a snapshot file.").c_str());
+  return theData + aEntry->theOffset;
+}
+
+
+const SnapshotBackend::IndexEntry*
+SnapshotBackend::lowerBound(const std::string& aKey) const
+{
+  const IndexEntry* lFirst = theIndex;
+  size_t lCount = theRecords;
+  while (lCount > 0)
+  {
+    size_t lHalf = lCount / 2;
+    const IndexEntry* lMiddle = lFirst + lHalf;
+    if (compareKeys(recordOf(lMiddle), lMiddle->theKeySize,
+                    aKey.data(), aKey.size()) < 0)
+    {
+      lFirst = lMiddle + 1;
+      lCount -= lHalf + 1;
+    }
+    else
+    {
+      lCount = lHalf;
+    }
+  }
+  return lFirst;
+}
+
+
+bool
+SnapshotBackend::startsWith(const IndexEntry* aEntry, const std::string& aPrefix) const
+{
+  return aEntry != theIndex + theRecords &&
+      aEntry->theKeySize >= aPrefix.size() &&
+      memcmp(recordOf(aEntry), aPrefix.data(), aPrefix.size()) == 0;
+}
+
+
+void
+SnapshotBackend::readKey(const IndexEntry* aEntry, KeyPath& aKey) const
+{
+  if (!decodeOrderedKey(recordOf(aEntry), aEntry->theKeySize, aKey))
+    throwError("FileError", (thePath + " is not a snapshot file.").c_str());
+}
+
+
+void
+SnapshotBackend::pass(const IndexEntry* aEntry, const KeyPath& aKey,
+                      RecordHandler& aHandler) const
+{
+  aHandler.record(aKey, recordOf(aEntry) + aEntry->theKeySize,
+                  aEntry->theValueSize, aEntry->theVersion);
+}
+
+
+long long
+SnapshotBackend::put(const KeyPath&, const std::string&, PhaseClock&)
+{
+  throwError("UnsupportedOperation", "Snapshot connections are read-only.");
+  return 0;
+}
+
+
+bool
+SnapshotBackend::get(const KeyPath& aKey, RecordHandler& aHandler, PhaseClock& aClock)
+{
+  std::string lEncoded = encodeOrderedKey(aKey);
+  const IndexEntry* lEntry = lowerBound(lEncoded);
+  aClock.lap(CallProfile::STORE);
+  if (!startsWith(lEntry, lEncoded) || lEntry->theKeySize != lEncoded.size())
+    return false;
+
+  pass(lEntry, aKey, aHandler);
+  return true;
+}
+
+
+bool
+SnapshotBackend::remove(const KeyPath&, PhaseClock&)
+{
+  throwError("UnsupportedOperation", "Snapshot connections are read-only.");
+  return false;
+}
+
+
+void
+SnapshotBackend::multiGet(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                          Depth aDepth, Direction aDirection,
+                          RecordHandler& aHandler, PhaseClock& aClock)
+{
+  RecordFilter lFilter(aParentKey, aRange, aDepth);
+
+  std::vector<std::pair<const IndexEntry*, KeyPath> > lSelected;
+  if (lFilter.theParentApart)
+  {
+    const IndexEntry* lParent = lowerBound(lFilter.thePrefix);
+    if (startsWith(lParent, lFilter.thePrefix) &&
+        lParent->theKeySize == lFilter.thePrefix.size())
+    {
+      lSelected.push_back(std::make_pair(lParent, KeyPath()));
+      readKey(lParent, lSelected.back().second);
+    }
+  }
+  for (const IndexEntry* lEntry = lowerBound(lFilter.theFirst);
+       startsWith(lEntry, lFilter.thePrefix); ++lEntry)
+  {
+    lSelected.push_back(std::make_pair(lEntry, KeyPath()));
+    readKey(lEntry, lSelected.back().second);
+
+    RecordFilter::Verdict lVerdict = lFilter.check(lSelected.back().second);
+    if (lVerdict != RecordFilter::SELECT)
+      lSelected.pop_back();
+    if (lVerdict == RecordFilter::STOP)
+      break;
+  }
+  aClock.lap(CallProfile::STORE);
+
+  for (size_t i = 0; i < lSelected.size(); ++i)
+  {
+    const std::pair<const IndexEntry*, KeyPath>& lRecord =
+        lSelected[aDirection == REVERSE ? lSelected.size() - 1 - i : i];
+    aClock.countRecord();
+    pass(lRecord.first, lRecord.second, aHandler);
+  }
+}
+
+
+size_t
+SnapshotBackend::multiRemove(const KeyPath&, const KeyRangeSpec*, Depth, PhaseClock&)
+{
+  throwError("UnsupportedOperation", "Snapshot connections are read-only.");
+  return 0;
+}
+
+
+void
+SnapshotBackend::scan(const KeyPath* aParentKey, RecordHandler& aHandler, PhaseClock& aClock)
+{
+  std::string lPrefix = aParentKey ? encodeOrderedMajorPrefix(*aParentKey) : std::string();
+
+  KeyPath lKey;
+  for (const IndexEntry* lEntry = lowerBound(lPrefix); startsWith(lEntry, lPrefix); ++lEntry)
+  {
+    readKey(lEntry, lKey);
+    aClock.countRecord();
+    pass(lEntry, lKey, aHandler);
+  }
+  aClock.lap(CallProfile::STORE);
+}
+
+
+}} // namespace zorba, nosqldb
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_SNAPSHOT_BACKEND_H
+#define NOSQLDB_SNAPSHOT_BACKEND_H
+
+#include <stdint.h>
+#include <string>
+
+#include "backend.h"
+#include "bulk_transfer.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Writes the records aSource->scan() returns for aParentKey to the snapshot
+ * file aPath, sorted by key. The file is written next to aPath and renamed
+ * when complete, so connections reading a former snapshot of aPath keep
+ * their copy. Raises nosql:FileError.
+ */
+TransferStats
+writeSnapshot(Backend& aSource, const KeyPath* aParentKey,
+              const std::string& aPath, PhaseClock& aClock);
+
+
+/**
+ * A snapshot file written by writeSnapshot(), "backend" : "snapshot". The
+ * file is memory-mapped read-only: keys are found by binary search over its
+ * sorted index and values are handed out of the mapping without a copy.
+ * put, remove and multi-remove raise nosql:UnsupportedOperation.
+ */
+class SnapshotBackend : public Backend
+{
+  public:
+    // the file starts with a Header, followed by the records, each an
+    // encodeOrderedKey() immediately followed by the value, and ends with
+    // theRecords IndexEntry in key order; all in host byte order
+    class Header
+    {
+      public:
+        char theMagic[8];
+        uint64_t theRecords;
+        uint64_t theIndexOffset;
+    };
+
+    class IndexEntry
+    {
+      public:
+        uint64_t theOffset;
+        uint32_t theKeySize;
+        uint32_t theValueSize;
+        int64_t theVersion;
+    };
+
+  private:
+    std::string thePath;
+    const char* theData;
+    size_t theSize;
+    const IndexEntry* theIndex;
+    size_t theRecords;
+    uint64_t theIndexOffset;
+
+    // the key of aEntry, followed by its value; raises nosql:FileError if
+    // they are not within the records, entries are checked when they are
+    // used so that opening a snapshot reads no more than its header
+    const char*
+    recordOf(const IndexEntry* aEntry) const;
+
+    // the first entry whose key is not less than aKey
+    const IndexEntry*
+    lowerBound(const std::string& aKey) const;
+
+    bool
+    startsWith(const IndexEntry* aEntry, const std::string& aPrefix) const;
+
+    void
+    readKey(const IndexEntry* aEntry, KeyPath& aKey) const;
+
+    void
+    pass(const IndexEntry* aEntry, const KeyPath& aKey, RecordHandler& aHandler) const;
+
+  public:
+    /**
+     * Maps the snapshot file aPath. Raises nosql:FileError if it cannot be
+     * read or its header is not that of a snapshot; an index entry that
+     * points outside of the records raises it when it is read.
+     */
+    SnapshotBackend(const std::string& aPath);
+
+    virtual ~SnapshotBackend();
+
+    virtual long long
+    put(const KeyPath& aKey, const std::string& aValue, PhaseClock& aClock);
+
+    virtual bool
+    get(const KeyPath& aKey, RecordHandler& aHandler, PhaseClock& aClock);
+
+    virtual bool
+    remove(const KeyPath& aKey, PhaseClock& aClock);
+
+    virtual void
+    multiGet(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+             Depth aDepth, Direction aDirection,
+             RecordHandler& aHandler, PhaseClock& aClock);
+
+    virtual size_t
+    multiRemove(const KeyPath& aParentKey, const KeyRangeSpec* aRange,
+                Depth aDepth, PhaseClock& aClock);
+
+    virtual void
+    scan(const KeyPath* aParentKey, RecordHandler& aHandler, PhaseClock& aClock);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_SNAPSHOT_BACKEND_H
@@ -0,0 +1,440 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <exception>
+#include <vector>
+
+#include "statistics.h"
+#include "nosqldb.h"
+
+#define RETURN_IF_EXCEPTION(env)  if ((COUNT_JNI_CALL(), env->ExceptionCheck())) return Item()
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/*****************************************************************************
+ LatencyHistogram
+ *****************************************************************************/
+
+unsigned
+LatencyHistogram::bucketOf(uint64_t aMicros)
+{
+  if (aMicros < 8)
+    return (unsigned)aMicros;
+
+  unsigned lBit = 63;
+  while (!(aMicros >> lBit))
+    --lBit;
+  unsigned lBucket = 8 + (lBit - 3) * 8 + (unsigned)((aMicros >> (lBit - 3)) & 7);
+  return lBucket < BUCKETS ? lBucket : BUCKETS - 1;
+}
+
+
+uint64_t
+LatencyHistogram::upperBoundOf(unsigned aBucket)
+{
+  if (aBucket < 8)
+    return aBucket;
+
+  unsigned lBit = (aBucket - 8) / 8 + 3;
+  uint64_t lSub = (aBucket - 8) % 8;
+  return ((8 + lSub + 1) << (lBit - 3)) - 1;
+}
+
+
+void
+LatencyHistogram::record(uint64_t aMicros)
+{
+  theCounts[bucketOf(aMicros)].fetch_add(1, std::memory_order_relaxed);
+  theCount.fetch_add(1, std::memory_order_relaxed);
+  theSum.fetch_add(aMicros, std::memory_order_relaxed);
+
+  uint64_t lMax = theMax.load(std::memory_order_relaxed);
+  while (aMicros > lMax &&
+         !theMax.compare_exchange_weak(lMax, aMicros, std::memory_order_relaxed))
+    ;
+}
+
+
+void
+LatencyHistogram::reset()
+{
+  for (unsigned i = 0; i < BUCKETS; ++i)
+    theCounts[i] = 0;
+  theCount = 0;
+  theSum = 0;
+  theMax = 0;
+}
+
+
+uint64_t
+LatencyHistogram::getPercentile(double aFraction) const
+{
+  uint64_t lCount = theCount;
+  if (lCount == 0)
+    return 0;
+
+  uint64_t lRank = (uint64_t)(aFraction * lCount + 0.5);
+  if (lRank < 1)
+    lRank = 1;
+
+  uint64_t lSeen = 0;
+  for (unsigned i = 0; i < BUCKETS; ++i)
+  {
+    lSeen += theCounts[i];
+    if (lSeen >= lRank)
+    {
+      uint64_t lBound = upperBoundOf(i);
+      return lBound < theMax ? lBound : (uint64_t)theMax;
+    }
+  }
+  return theMax;
+}
+
+
+/*****************************************************************************
+ Statistics
+ *****************************************************************************/
+
+const char* const Statistics::theOperationNames[OPERATION_COUNT] =
+{
+  "get",
+  "put",
+  "remove",
+  "multi-get",
+  "multi-get-many",
+  "multi-remove",
+  "put-lob",
+  "get-lob",
+  "flush",
+  "import",
+  "export",
+  "purge",
+  "snapshot",
+  "rebalance",
+  "index-lookup",
+  "index-range"
+};
+
+thread_local uint64_t Statistics::theThreadJNICalls = 0;
+thread_local Statistics* Statistics::theCurrent = 0;
+std::atomic<uint64_t> Statistics::theFailedFlushes(0);
+std::atomic<uint64_t> Statistics::theLostWrites(0);
+
+
+void
+Statistics::reset()
+{
+  for (unsigned i = 0; i < OPERATION_COUNT; ++i)
+  {
+    theOperations[i].theErrors = 0;
+    theOperations[i].theLatency.reset();
+  }
+  for (size_t i = 0; i < theMaxHandles; ++i)
+  {
+    theHandles[i].theRequests = 0;
+    theHandles[i].theMicros = 0;
+  }
+  theJNICalls = 0;
+  theBytesRead = 0;
+  theBytesWritten = 0;
+  theRecordsScanned = 0;
+  theJavaExceptions = 0;
+  theRetries = 0;
+  theSizedScans = 0;
+  theBatchSizeSum = 0;
+  theLastBatchSize = 0;
+  theHedges = 0;
+  theHedgeWins = 0;
+  theQueueWaits = 0;
+  theQueueMicros = 0;
+  theMaxQueueMicros = 0;
+  theYields = 0;
+  theResetTime = std::chrono::steady_clock::now();
+}
+
+
+static void
+addPair(std::vector<std::pair<Item, Item> >& aPairs, const char* aName, const Item& aValue)
+{
+  aPairs.push_back(std::pair<Item, Item>(
+      NoSqlDBModule::getItemFactory()->createString(String(aName)), aValue));
+}
+
+
+static void
+addInteger(std::vector<std::pair<Item, Item> >& aPairs, const char* aName, uint64_t aValue)
+{
+  addPair(aPairs, aName, NoSqlDBModule::getItemFactory()->createInteger((long long)aValue));
+}
+
+
+// looks up a getter that returns long in newer clients and int in older ones
+static jmethodID
+getNumberMethod(JNIEnv* env, jclass aClass, const char* aName, bool& aIsLong)
+{
+  aIsLong = true;
+  jmethodID lMethod = env->GetMethodID(aClass, aName, "()J");
+  if (!env->ExceptionCheck())
+    return lMethod;
+  env->ExceptionClear();
+
+  aIsLong = false;
+  lMethod = env->GetMethodID(aClass, aName, "()I");
+  if (!env->ExceptionCheck())
+    return lMethod;
+  env->ExceptionClear();
+  return NULL;
+}
+
+
+static jlong
+callNumberMethod(JNIEnv* env, jobject aObject, jmethodID aMethod, bool aIsLong)
+{
+  if (!aMethod)
+    return 0;
+  return aIsLong ? env->CallLongMethod(aObject, aMethod)
+                 : (jlong)env->CallIntMethod(aObject, aMethod);
+}
+
+
+// [ { "operation" : .., "total-ops" : .., "average-latency-ms" : ..,
+//     "min-latency-ms" : .., "max-latency-ms" : .. } ]
+static Item
+readClientStatistics(JNIEnv* env, jobject aStore, bool aReset)
+{
+  ItemFactory* lFactory = NoSqlDBModule::getItemFactory();
+
+  //    KVStats stats = store.getStats(clear);
+  jclass kvsClass = env->FindClass("oracle/kv/KVStore");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midGetStats = env->GetMethodID(kvsClass, "getStats", "(Z)Loracle/kv/KVStats;");
+  RETURN_IF_EXCEPTION(env);
+  jobject stats = env->CallObjectMethod(aStore, midGetStats, (jboolean)aReset);
+  RETURN_IF_EXCEPTION(env);
+
+  //    List<OperationMetrics> metrics = stats.getOpMetrics();
+  jclass statsClass = env->FindClass("oracle/kv/KVStats");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midGetOpMetrics = env->GetMethodID(statsClass, "getOpMetrics", "()Ljava/util/List;");
+  RETURN_IF_EXCEPTION(env);
+  jobject metrics = env->CallObjectMethod(stats, midGetOpMetrics);
+  RETURN_IF_EXCEPTION(env);
+
+  jclass listClass = env->FindClass("java/util/List");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midListSize = env->GetMethodID(listClass, "size", "()I");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midListGet = env->GetMethodID(listClass, "get", "(I)Ljava/lang/Object;");
+  RETURN_IF_EXCEPTION(env);
+
+  jclass metricsClass = env->FindClass("oracle/kv/stats/OperationMetrics");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midGetName = env->GetMethodID(metricsClass, "getOperationName", "()Ljava/lang/String;");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midGetAverage = env->GetMethodID(metricsClass, "getAverageLatencyMs", "()F");
+  RETURN_IF_EXCEPTION(env);
+  bool lTotalIsLong, lMinIsLong, lMaxIsLong;
+  jmethodID midGetTotal = getNumberMethod(env, metricsClass, "getTotalOps", lTotalIsLong);
+  jmethodID midGetMin = getNumberMethod(env, metricsClass, "getMinLatencyMs", lMinIsLong);
+  jmethodID midGetMax = getNumberMethod(env, metricsClass, "getMaxLatencyMs", lMaxIsLong);
+
+  std::vector<Item> lOperations;
+  jint lSize = env->CallIntMethod(metrics, midListSize);
+  RETURN_IF_EXCEPTION(env);
+  for (jint i = 0; i < lSize; ++i)
+  {
+    jobject metric = env->CallObjectMethod(metrics, midListGet, i);
+    RETURN_IF_EXCEPTION(env);
+
+    jlong lTotal = callNumberMethod(env, metric, midGetTotal, lTotalIsLong);
+    RETURN_IF_EXCEPTION(env);
+    if (lTotal == 0)
+    {
+      env->DeleteLocalRef(metric);
+      continue;
+    }
+
+    jstring jName = (jstring)env->CallObjectMethod(metric, midGetName);
+    RETURN_IF_EXCEPTION(env);
+    const char* lName = env->GetStringUTFChars(jName, NULL);
+    Item lNameItem = lFactory->createString(String(lName));
+    env->ReleaseStringUTFChars(jName, lName);
+
+    jfloat lAverage = env->CallFloatMethod(metric, midGetAverage);
+    RETURN_IF_EXCEPTION(env);
+    jlong lMin = callNumberMethod(env, metric, midGetMin, lMinIsLong);
+    RETURN_IF_EXCEPTION(env);
+    jlong lMax = callNumberMethod(env, metric, midGetMax, lMaxIsLong);
+    RETURN_IF_EXCEPTION(env);
+
+    std::vector<std::pair<Item, Item> > lPairs;
+    addPair(lPairs, "operation", lNameItem);
+    addInteger(lPairs, "total-ops", lTotal);
+    addPair(lPairs, "average-latency-ms", lFactory->createDouble(lAverage));
+    if (midGetMin)
+      addInteger(lPairs, "min-latency-ms", lMin);
+    if (midGetMax)
+      addInteger(lPairs, "max-latency-ms", lMax);
+    lOperations.push_back(lFactory->createJSONObject(lPairs));
+
+    env->DeleteLocalRef(jName);
+    env->DeleteLocalRef(metric);
+  }
+
+  env->DeleteLocalRef(metrics);
+  env->DeleteLocalRef(stats);
+  return lFactory->createJSONArray(lOperations);
+}
+
+
+Item
+Statistics::toJSON(JNIEnv* env, const std::vector<jobject>& aStores, bool aReset) const
+{
+  ItemFactory* lFactory = NoSqlDBModule::getItemFactory();
+
+  // "operations" : { "get" : { "calls" : .., "errors" : ..,
+  //                            "latency-us" : { "mean", "p50", .. } }, .. }
+  std::vector<std::pair<Item, Item> > lOperations;
+  for (unsigned i = 0; i < OPERATION_COUNT; ++i)
+  {
+    const LatencyHistogram& lLatency = theOperations[i].theLatency;
+    if (lLatency.getCount() == 0)
+      continue;
+
+    std::vector<std::pair<Item, Item> > lLatencyPairs;
+    addPair(lLatencyPairs, "mean", lFactory->createDouble(lLatency.getMean()));
+    addInteger(lLatencyPairs, "p50", lLatency.getPercentile(0.50));
+    addInteger(lLatencyPairs, "p95", lLatency.getPercentile(0.95));
+    addInteger(lLatencyPairs, "p99", lLatency.getPercentile(0.99));
+    addInteger(lLatencyPairs, "max", lLatency.getMax());
+
+    std::vector<std::pair<Item, Item> > lPairs;
+    addInteger(lPairs, "calls", lLatency.getCount());
+    addInteger(lPairs, "errors", theOperations[i].theErrors);
+    addPair(lPairs, "latency-us", lFactory->createJSONObject(lLatencyPairs));
+
+    addPair(lOperations, theOperationNames[i], lFactory->createJSONObject(lPairs));
+  }
+
+  // native backends have no client statistics
+  Item lClient;
+  if (aStores.size() == 1)
+  {
+    lClient = readClientStatistics(env, aStores[0], aReset);
+    if (lClient.isNull())
+      return Item();
+  }
+
+  // "handles" : [ { "requests" : .., "mean-latency-us" : .., "client" : .. } ]
+  std::vector<Item> lHandles;
+  for (size_t i = 0; aStores.size() > 1 && i < aStores.size(); ++i)
+  {
+    const HandleStats& lHandle = theHandles[i];
+    Item lHandleClient = readClientStatistics(env, aStores[i], aReset);
+    if (lHandleClient.isNull())
+      return Item();
+
+    std::vector<std::pair<Item, Item> > lHandlePairs;
+    addInteger(lHandlePairs, "requests", lHandle.theRequests);
+    addPair(lHandlePairs, "mean-latency-us", lFactory->createDouble(lHandle.theRequests > 0
+        ? (double)lHandle.theMicros / (double)lHandle.theRequests : 0.0));
+    addPair(lHandlePairs, "client", lHandleClient);
+    lHandles.push_back(lFactory->createJSONObject(lHandlePairs));
+  }
+
+  std::vector<std::pair<Item, Item> > lPairs;
+  addPair(lPairs, "seconds", lFactory->createDouble(
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - theResetTime).count()));
+  addPair(lPairs, "operations", lFactory->createJSONObject(lOperations));
+  addInteger(lPairs, "jni-calls", theJNICalls);
+  addInteger(lPairs, "bytes-read", theBytesRead);
+  addInteger(lPairs, "bytes-written", theBytesWritten);
+  addInteger(lPairs, "records-scanned", theRecordsScanned);
+  addInteger(lPairs, "java-exceptions", theJavaExceptions);
+  addInteger(lPairs, "retries", theRetries);
+  if (theSizedScans > 0)
+  {
+    // "batch-size" : { "scans" : .., "mean" : .., "last" : .. }
+    std::vector<std::pair<Item, Item> > lBatchPairs;
+    addInteger(lBatchPairs, "scans", theSizedScans);
+    addPair(lBatchPairs, "mean", lFactory->createDouble(
+        (double)theBatchSizeSum / (double)theSizedScans));
+    addInteger(lBatchPairs, "last", theLastBatchSize);
+    addPair(lPairs, "batch-size", lFactory->createJSONObject(lBatchPairs));
+  }
+  if (theHedges > 0)
+  {
+    // "hedges" : { "fired" : .., "won" : .. }
+    std::vector<std::pair<Item, Item> > lHedgePairs;
+    addInteger(lHedgePairs, "fired", theHedges);
+    addInteger(lHedgePairs, "won", theHedgeWins);
+    addPair(lPairs, "hedges", lFactory->createJSONObject(lHedgePairs));
+  }
+  if (theQueueWaits > 0)
+  {
+    // "queue" : { "waits" : .., "mean-us" : .., "max-us" : .., "yields" : .. }
+    std::vector<std::pair<Item, Item> > lQueuePairs;
+    addInteger(lQueuePairs, "waits", theQueueWaits);
+    addPair(lQueuePairs, "mean-us", lFactory->createDouble(
+        (double)theQueueMicros / (double)theQueueWaits));
+    addInteger(lQueuePairs, "max-us", theMaxQueueMicros);
+    addInteger(lQueuePairs, "yields", theYields);
+    addPair(lPairs, "queue", lFactory->createJSONObject(lQueuePairs));
+  }
+  if (theFailedFlushes > 0)
+  {
+    // "lost-writes" : { "flushes" : .., "writes" : .. }
+    std::vector<std::pair<Item, Item> > lLostPairs;
+    addInteger(lLostPairs, "flushes", theFailedFlushes);
+    addInteger(lLostPairs, "writes", theLostWrites);
+    addPair(lPairs, "lost-writes", lFactory->createJSONObject(lLostPairs));
+  }
+  if (!lHandles.empty())
+    addPair(lPairs, "handles", lFactory->createJSONArray(lHandles));
+  if (!lClient.isNull())
+    addPair(lPairs, "client", lClient);
+  return lFactory->createJSONObject(lPairs);
+}
+
+
+/*****************************************************************************
+ OperationTimer
+ *****************************************************************************/
+
+OperationTimer::~OperationTimer()
+{
+  uint64_t lMicros = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - theStart).count();
+
+  Statistics::OperationStats& lOperation = theStatistics.theOperations[theOperation];
+  lOperation.theLatency.record(lMicros);
+  if (std::uncaught_exception())
+  {
+    ++lOperation.theErrors;
+    if (theEnv && theEnv->ExceptionCheck())
+      ++theStatistics.theJavaExceptions;
+  }
+
+  theStatistics.theJNICalls += Statistics::theThreadJNICalls - theJNICallsAtStart;
+  Statistics::setCurrent(thePrevious);
+}
+
+
+}} // namespace zorba, nosqldb
@@ -0,0 +1,241 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_STATISTICS_H
+#define NOSQLDB_STATISTICS_H
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <vector>
+
+#include <jni.h>
+
+#include <zorba/item.h>
+
+
+// counts the JNI calls of the current thread, placed in the exception checks
+// that follow every JNI call
+#define COUNT_JNI_CALL() (++zorba::nosqldb::Statistics::theThreadJNICalls)
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Latency histogram in microseconds with 8 log-linear sub-buckets per power
+ * of two, so reported percentiles are within 12.5% of the exact value.
+ * Recording is lock free.
+ */
+class LatencyHistogram
+{
+  public:
+    static const unsigned BUCKETS = 8 + 41 * 8;
+
+  private:
+    std::atomic<uint64_t> theCounts[BUCKETS];
+    std::atomic<uint64_t> theCount;
+    std::atomic<uint64_t> theSum;
+    std::atomic<uint64_t> theMax;
+
+    static unsigned
+    bucketOf(uint64_t aMicros);
+
+    static uint64_t
+    upperBoundOf(unsigned aBucket);
+
+  public:
+    LatencyHistogram()
+    { reset(); }
+
+    void
+    record(uint64_t aMicros);
+
+    void
+    reset();
+
+    uint64_t
+    getCount() const
+    { return theCount; }
+
+    uint64_t
+    getMax() const
+    { return theMax; }
+
+    double
+    getMean() const
+    { return theCount ? (double)theSum / theCount : 0; }
+
+    /**
+     * The latency below which aFraction of the recorded calls fall.
+     */
+    uint64_t
+    getPercentile(double aFraction) const;
+};
+
+
+/**
+ * Counters of a connection, reported by nosql:statistics.
+ */
+class Statistics
+{
+  public:
+    enum Operation
+    {
+      GET,
+      PUT,
+      REMOVE,
+      MULTI_GET,
+      MULTI_GET_MANY,
+      MULTI_REMOVE,
+      PUT_LOB,
+      GET_LOB,
+      FLUSH,
+      IMPORT,
+      EXPORT,
+      PURGE,
+      SNAPSHOT,
+      REBALANCE,
+      INDEX_LOOKUP,
+      INDEX_RANGE,
+      OPERATION_COUNT
+    };
+
+    static const char* const theOperationNames[OPERATION_COUNT];
+
+    static thread_local uint64_t theThreadJNICalls;
+
+    class OperationStats
+    {
+      public:
+        std::atomic<uint64_t> theErrors;
+        LatencyHistogram theLatency;
+    };
+
+    OperationStats theOperations[OPERATION_COUNT];
+
+    // the most KVStore handles of a connection, see StoreHandles
+    static const size_t theMaxHandles = 64;
+
+    class HandleStats
+    {
+      public:
+        std::atomic<uint64_t> theRequests;
+        std::atomic<uint64_t> theMicros;
+    };
+
+    HandleStats theHandles[theMaxHandles];
+    std::atomic<uint64_t> theJNICalls;
+    std::atomic<uint64_t> theBytesRead;
+    std::atomic<uint64_t> theBytesWritten;
+    std::atomic<uint64_t> theRecordsScanned;
+    std::atomic<uint64_t> theJavaExceptions;
+    std::atomic<uint64_t> theRetries;
+    // the store iterators opened with a BatchSizer batch size
+    std::atomic<uint64_t> theSizedScans;
+    std::atomic<uint64_t> theBatchSizeSum;
+    std::atomic<uint64_t> theLastBatchSize;
+    // the hedged reads started and those that completed first
+    std::atomic<uint64_t> theHedges;
+    std::atomic<uint64_t> theHedgeWins;
+    // the calls that waited for their admission, see Admission
+    std::atomic<uint64_t> theQueueWaits;
+    std::atomic<uint64_t> theQueueMicros;
+    std::atomic<uint64_t> theMaxQueueMicros;
+    std::atomic<uint64_t> theYields;
+    std::chrono::steady_clock::time_point theResetTime;
+
+    // the write buffer flushes that failed at the end of a query and the
+    // buffered writes they lost, in the process; the connection is gone by
+    // then, so every connection reports them and reset() keeps them
+    static std::atomic<uint64_t> theFailedFlushes;
+    static std::atomic<uint64_t> theLostWrites;
+
+    Statistics()
+    { reset(); }
+
+    void
+    reset();
+
+    /**
+     * The statistics of the operation running on the calling thread, NULL
+     * outside of an operation. Worker threads inherit it from their pool.
+     */
+    static Statistics*
+    current()
+    { return theCurrent; }
+
+    static void
+    setCurrent(Statistics* aStatistics)
+    { theCurrent = aStatistics; }
+
+    /**
+     * The counters as a JSON object. KVStore.getStats(aReset) of a single
+     * handle in aStores is merged in as "client"; with several handles each
+     * entry of "handles" has its own. aStores is empty for native backends.
+     * Returns a null Item if a Java exception is pending.
+     */
+    Item
+    toJSON(JNIEnv* env, const std::vector<jobject>& aStores, bool aReset) const;
+
+  private:
+    static thread_local Statistics* theCurrent;
+
+    Statistics(const Statistics&);
+    Statistics& operator=(const Statistics&);
+};
+
+
+/**
+ * Times one call of a module function and makes its Statistics current
+ * for the calling thread. A call left by an exception counts as an error,
+ * and as a Java exception if one is pending on env at that point; env is 0
+ * for native backends.
+ */
+class OperationTimer
+{
+  private:
+    JNIEnv* theEnv;
+    Statistics& theStatistics;
+    Statistics::Operation theOperation;
+    Statistics* thePrevious;
+    uint64_t theJNICallsAtStart;
+    std::chrono::steady_clock::time_point theStart;
+
+  public:
+    OperationTimer(JNIEnv* env, Statistics& aStatistics, Statistics::Operation aOperation)
+      : theEnv(env),
+        theStatistics(aStatistics),
+        theOperation(aOperation),
+        thePrevious(Statistics::current()),
+        theJNICallsAtStart(Statistics::theThreadJNICalls),
+        theStart(std::chrono::steady_clock::now())
+    {
+      Statistics::setCurrent(&aStatistics);
+    }
+
+    ~OperationTimer();
+
+  private:
+    OperationTimer(const OperationTimer&);
+    OperationTimer& operator=(const OperationTimer&);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_STATISTICS_H
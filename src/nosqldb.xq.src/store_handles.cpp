@@ -0,0 +1,79 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <functional>
+#include <string>
+
+#include "nosqldb.h"
+#include "options.h"
+#include "store_handles.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+StoreHandles::StoreHandles(const Item& aOptions)
+  : theCount(1),
+    theStriping(ROUND_ROBIN),
+    theNext(0)
+{
+  Item lOption = getOption(aOptions, "store-handles");
+  if (lOption.isNull())
+    return;
+
+  long long lCount;
+  if (lOption.isAtomic())
+    lCount = getIntegerOption(aOptions, "store-handles", 1);
+  else
+  {
+    lCount = getIntegerOption(lOption, "count", 1);
+    std::string lStriping = getStringOption(lOption, "striping", "round-robin");
+    if (lStriping == "key-hash")
+      theStriping = KEY_HASH;
+    else if (lStriping != "round-robin")
+      throwError("InvalidOption", "Option 'striping' must be \"round-robin\" or \"key-hash\".");
+  }
+  if (lCount < 1 || lCount > (long long)Statistics::theMaxHandles)
+    throwError("InvalidOption", "Option 'store-handles' must be between 1 and 64.");
+  theCount = (size_t)lCount;
+}
+
+
+size_t
+StoreHandles::select(const KeyPath* aKey)
+{
+  if (theStores.size() < 2)
+    return 0;
+  if (theStriping == KEY_HASH && aKey)
+    return std::hash<std::string>()(aKey->majorToString()) % theStores.size();
+  return theNext.fetch_add(1, std::memory_order_relaxed) % theStores.size();
+}
+
+
+StoreCall::~StoreCall()
+{
+  if (Statistics* lStatistics = Statistics::current())
+  {
+    Statistics::HandleStats& lHandle = lStatistics->theHandles[theHandle];
+    ++lHandle.theRequests;
+    lHandle.theMicros += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - theStart).count();
+  }
+}
+
+
+}} // namespace zorba, nosqldb
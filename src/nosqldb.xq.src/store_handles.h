@@ -0,0 +1,144 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_STORE_HANDLES_H
+#define NOSQLDB_STORE_HANDLES_H
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include <jni.h>
+
+#include <zorba/item.h>
+
+#include "key_codec.h"
+#include "statistics.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * The oracle.kv.KVStore handles of a connection, "store-handles" connect
+ * option. Every handle has a request dispatcher of its own; the requests
+ * of the connection are striped across them, round-robin or by the hash
+ * of the major path, to spread the contention in the client.
+ */
+class StoreHandles
+{
+  public:
+    enum Striping
+    {
+      ROUND_ROBIN,
+      KEY_HASH
+    };
+
+  private:
+    size_t theCount;
+    Striping theStriping;
+    std::vector<jobject> theStores;
+    std::atomic<size_t> theNext;
+
+  public:
+    /**
+     * Reads "store-handles" : 1 or { "count" : 1, "striping" :
+     * "round-robin" or "key-hash" } from the connect options. Raises
+     * nosql:InvalidOption.
+     */
+    StoreHandles(const Item& aOptions);
+
+    /**
+     * The number of handles to open.
+     */
+    size_t
+    getCount() const
+    { return theCount; }
+
+    /**
+     * Adds an opened handle, a global reference owned by the connection.
+     */
+    void
+    add(jobject aStore)
+    { theStores.push_back(aStore); }
+
+    /**
+     * The opened handles, empty for native backends.
+     */
+    const std::vector<jobject>&
+    getStores() const
+    { return theStores; }
+
+    /**
+     * The handle of the operations that are not striped, 0 for native
+     * backends.
+     */
+    jobject
+    getFirst() const
+    { return theStores.empty() ? 0 : theStores[0]; }
+
+    /**
+     * The index of the handle for the next request, by the major path of
+     * aKey if the striping is "key-hash" and aKey is not 0.
+     */
+    size_t
+    select(const KeyPath* aKey);
+
+    jobject
+    get(size_t aHandle) const
+    { return theStores[aHandle]; }
+
+  private:
+    StoreHandles(const StoreHandles&);
+    StoreHandles& operator=(const StoreHandles&);
+};
+
+
+/**
+ * A request on the handle StoreHandles::select() picks, counted and timed
+ * in the per-handle statistics of the current operation.
+ */
+class StoreCall
+{
+  private:
+    size_t theHandle;
+    jobject theStore;
+    std::chrono::steady_clock::time_point theStart;
+
+  public:
+    StoreCall(StoreHandles& aHandles, const KeyPath* aKey = 0)
+      : theHandle(aHandles.select(aKey)),
+        theStore(aHandles.get(theHandle)),
+        theStart(std::chrono::steady_clock::now())
+    {}
+
+    ~StoreCall();
+
+    size_t
+    getHandle() const
+    { return theHandle; }
+
+    jobject
+    getStore() const
+    { return theStore; }
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_STORE_HANDLES_H
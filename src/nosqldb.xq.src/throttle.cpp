@@ -0,0 +1,252 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <thread>
+
+#include "nosqldb.h"
+#include "options.h"
+#include "throttle.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+// the sets of call limits kept although no call holds them
+static const size_t theMaxCallBuckets = 64;
+
+
+/*****************************************************************************
+ TokenBucket
+ *****************************************************************************/
+
+TokenBucket::Clock_t::duration
+TokenBucket::take(double aTokens)
+{
+  if (theRate <= 0)
+    return Clock_t::duration::zero();
+
+  std::lock_guard<std::mutex> lLock(theMutex);
+  Clock_t::time_point lNow = Clock_t::now();
+  theTokens = std::min(theCapacity,
+      theTokens + std::chrono::duration<double>(lNow - theLast).count() * theRate);
+  theLast = lNow;
+
+  theTokens -= aTokens;
+  if (theTokens >= 0)
+    return Clock_t::duration::zero();
+  return std::chrono::duration_cast<Clock_t::duration>(
+      std::chrono::duration<double>(-theTokens / theRate));
+}
+
+
+/*****************************************************************************
+ RateLimits
+ *****************************************************************************/
+
+RateLimits::RateLimits(const Item& aLimit)
+  : theOperations(getDoubleOption(aLimit, "operations-per-second", 0)),
+    theBytes(getDoubleOption(aLimit, "bytes-per-second", 0)),
+    theBurst(getDoubleOption(aLimit, "burst-seconds", 1))
+{
+  if (theOperations < 0)
+    throwError("InvalidOption", "Option 'operations-per-second' must not be negative.");
+  if (theBytes < 0)
+    throwError("InvalidOption", "Option 'bytes-per-second' must not be negative.");
+  if (theBurst <= 0 || theBurst > 3600)
+    throwError("InvalidOption", "Option 'burst-seconds' must be greater than 0 and at most 3600.");
+}
+
+
+bool
+RateLimits::operator<(const RateLimits& aOther) const
+{
+  if (theOperations != aOther.theOperations)
+    return theOperations < aOther.theOperations;
+  if (theBytes != aOther.theBytes)
+    return theBytes < aOther.theBytes;
+  return theBurst < aOther.theBurst;
+}
+
+
+// a bucket holds at least one operation or byte, or nothing would pass
+RateBuckets::RateBuckets(const RateLimits& aLimits)
+  : theOperations(aLimits.theOperations,
+                  std::max(aLimits.theOperations * aLimits.theBurst, 1.0)),
+    theBytes(aLimits.theBytes, std::max(aLimits.theBytes * aLimits.theBurst, 1.0))
+{}
+
+
+/*****************************************************************************
+ PriorityScheduler
+ *****************************************************************************/
+
+PriorityScheduler&
+PriorityScheduler::getInstance()
+{
+  static PriorityScheduler theInstance;
+  return theInstance;
+}
+
+
+void
+PriorityScheduler::endInteractive()
+{
+  // a waiter counts itself before it looks at theRunning, so either it
+  // sees 0 or it is seen here
+  if (--theRunning == 0 && theWaiting > 0)
+  {
+    std::lock_guard<std::mutex> lLock(theMutex);
+    theCondition.notify_all();
+  }
+}
+
+
+bool
+PriorityScheduler::yield(std::chrono::milliseconds aMaxWait)
+{
+  if (theRunning == 0)
+    return false;
+
+  std::unique_lock<std::mutex> lLock(theMutex);
+  ++theWaiting;
+  theCondition.wait_for(lLock, aMaxWait, [this] { return theRunning == 0; });
+  --theWaiting;
+  return true;
+}
+
+
+/*****************************************************************************
+ Throttle
+ *****************************************************************************/
+
+Throttle::Throttle(const Item& aOptions)
+  : theBatch(false),
+    theMaxYield(100),
+    theBuckets(std::make_shared<RateBuckets>(RateLimits(getOption(aOptions, "rate-limit"))))
+{
+  Item lPriority = getOption(aOptions, "priority");
+  if (lPriority.isNull())
+    return;
+
+  std::string lClass;
+  if (lPriority.isAtomic())
+    lClass = getStringOption(aOptions, "priority", "interactive");
+  else
+  {
+    lClass = getStringOption(lPriority, "class", "batch");
+    long long lMaxYield = getIntegerOption(lPriority, "max-yield-ms", 100);
+    if (lMaxYield < 0 || lMaxYield > 60000)
+      throwError("InvalidOption", "Option 'max-yield-ms' must be between 0 and 60000.");
+    theMaxYield = std::chrono::milliseconds(lMaxYield);
+  }
+
+  if (lClass == "batch")
+    theBatch = true;
+  else if (lClass != "interactive")
+    throwError("InvalidOption", "Option 'priority' must be \"interactive\" or \"batch\".");
+}
+
+
+std::shared_ptr<RateBuckets>
+Throttle::getBuckets(const Item& aCallLimit)
+{
+  if (aCallLimit.isNull())
+    return theBuckets;
+
+  RateLimits lLimits(aCallLimit);
+  std::lock_guard<std::mutex> lLock(theMutex);
+  std::shared_ptr<RateBuckets>& lBuckets = theCallBuckets[lLimits];
+  if (lBuckets)
+    return lBuckets;
+  lBuckets = std::make_shared<RateBuckets>(lLimits);
+  std::shared_ptr<RateBuckets> lResult = lBuckets;
+
+  // the limits no call holds are dropped once there are too many, e.g.
+  // from limits computed per call
+  if (theCallBuckets.size() > theMaxCallBuckets)
+    for (std::map<RateLimits, std::shared_ptr<RateBuckets> >::iterator lIter =
+             theCallBuckets.begin();
+         lIter != theCallBuckets.end(); )
+    {
+      if (lIter->second.use_count() == 1)
+        lIter = theCallBuckets.erase(lIter);
+      else
+        ++lIter;
+    }
+  return lResult;
+}
+
+
+/*****************************************************************************
+ Admission
+ *****************************************************************************/
+
+Admission::Admission(Throttle& aThrottle, Statistics& aStatistics, PhaseClock& aClock,
+                     const Item& aCallLimit)
+  : theBuckets(aThrottle.getBuckets(aCallLimit)),
+    theInteractive(false),
+    theBytes(0)
+{
+  TokenBucket::Clock_t::time_point lStart = TokenBucket::Clock_t::now();
+
+  // the operation token is taken even if the bytes are in debt, it is
+  // spent once the debt is paid
+  TokenBucket::Clock_t::duration lWait = std::max(theBuckets->theOperations.take(1),
+                                                  theBuckets->theBytes.take(0));
+  bool lWaited = lWait > TokenBucket::Clock_t::duration::zero();
+  if (lWaited)
+    std::this_thread::sleep_for(lWait);
+
+  PriorityScheduler& lScheduler = PriorityScheduler::getInstance();
+  if (!aThrottle.isBatch())
+  {
+    lScheduler.beginInteractive();
+    theInteractive = true;
+  }
+  else if (lScheduler.yield(aThrottle.getMaxYield()))
+  {
+    ++aStatistics.theYields;
+    lWaited = true;
+  }
+
+  if (lWaited)
+  {
+    uint64_t lMicros = std::chrono::duration_cast<std::chrono::microseconds>(
+        TokenBucket::Clock_t::now() - lStart).count();
+    ++aStatistics.theQueueWaits;
+    aStatistics.theQueueMicros += lMicros;
+    uint64_t lMax = aStatistics.theMaxQueueMicros;
+    while (lMicros > lMax &&
+           !aStatistics.theMaxQueueMicros.compare_exchange_weak(lMax, lMicros))
+      ;
+  }
+  aClock.lap(CallProfile::QUEUE);
+}
+
+
+Admission::~Admission()
+{
+  if (theInteractive)
+    PriorityScheduler::getInstance().endInteractive();
+
+  if (theBytes > 0)
+    theBuckets->theBytes.take((double)theBytes);
+}
+
+
+}} // namespace zorba, nosqldb
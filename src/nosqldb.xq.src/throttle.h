@@ -0,0 +1,238 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_THROTTLE_H
+#define NOSQLDB_THROTTLE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+
+#include <zorba/item.h>
+
+#include "profile.h"
+#include "statistics.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * A token bucket filled at theRate tokens per second up to its capacity.
+ * A taker may overdraw it, the debt is paid by the takers after it.
+ */
+class TokenBucket
+{
+  public:
+    typedef std::chrono::steady_clock Clock_t;
+
+  private:
+    double theRate;
+    double theCapacity;
+    std::mutex theMutex;
+    double theTokens;
+    Clock_t::time_point theLast;
+
+  public:
+    /**
+     * A rate of 0 disables the bucket.
+     */
+    TokenBucket(double aRate, double aCapacity)
+      : theRate(aRate),
+        theCapacity(aCapacity),
+        theTokens(aCapacity),
+        theLast(Clock_t::now())
+    {}
+
+    /**
+     * Takes aTokens and returns how long the caller has to wait until the
+     * bucket is out of debt again, 0 if it is not in debt.
+     */
+    Clock_t::duration
+    take(double aTokens);
+
+  private:
+    TokenBucket(const TokenBucket&);
+    TokenBucket& operator=(const TokenBucket&);
+};
+
+
+/**
+ * The "rate-limit" of a connection or of a call: { "operations-per-second"
+ * : .., "bytes-per-second" : .., "burst-seconds" : 1 }, 0 for no limit.
+ */
+class RateLimits
+{
+  public:
+    double theOperations;
+    double theBytes;
+    double theBurst;
+
+    /**
+     * Reads aLimit, raises nosql:InvalidOption. A null Item gives no limits.
+     */
+    RateLimits(const Item& aLimit);
+
+    bool
+    operator<(const RateLimits& aOther) const;
+};
+
+
+/**
+ * The buckets of one set of RateLimits, each holding the tokens of
+ * theBurst seconds.
+ */
+class RateBuckets
+{
+  public:
+    TokenBucket theOperations;
+    TokenBucket theBytes;
+
+    RateBuckets(const RateLimits& aLimits);
+};
+
+
+/**
+ * The operations of the "interactive" connections of the process that
+ * are running; "batch" operations wait for them to complete.
+ */
+class PriorityScheduler
+{
+  private:
+    std::atomic<size_t> theRunning;
+    std::atomic<size_t> theWaiting;
+    std::mutex theMutex;
+    std::condition_variable theCondition;
+
+    PriorityScheduler()
+      : theRunning(0),
+        theWaiting(0)
+    {}
+
+  public:
+    static PriorityScheduler&
+    getInstance();
+
+    void
+    beginInteractive()
+    { ++theRunning; }
+
+    void
+    endInteractive();
+
+    /**
+     * Waits until no interactive operation is running, at most aMaxWait;
+     * returns false if there was none.
+     */
+    bool
+    yield(std::chrono::milliseconds aMaxWait);
+
+  private:
+    PriorityScheduler(const PriorityScheduler&);
+    PriorityScheduler& operator=(const PriorityScheduler&);
+};
+
+
+/**
+ * The admission of the calls of a connection to the store, configured by
+ * the "rate-limit" and "priority" connect options. The calls that give a
+ * "rate-limit" of their own share buckets with the other calls that give
+ * the same limits instead of using those of the connection. At most
+ * theMaxCallBuckets sets of limits are kept beyond those held by calls;
+ * a set dropped starts with full buckets when it is given again.
+ */
+class Throttle
+{
+  private:
+    bool theBatch;
+    std::chrono::milliseconds theMaxYield;
+    std::shared_ptr<RateBuckets> theBuckets;
+
+    std::mutex theMutex;
+    std::map<RateLimits, std::shared_ptr<RateBuckets> > theCallBuckets;
+
+  public:
+    /**
+     * Reads "rate-limit" and "priority" : "interactive", "batch" or
+     * { "class" : "batch", "max-yield-ms" : 100 } from the connect options.
+     * Raises nosql:InvalidOption.
+     */
+    Throttle(const Item& aOptions);
+
+    bool
+    isBatch() const
+    { return theBatch; }
+
+    std::chrono::milliseconds
+    getMaxYield() const
+    { return theMaxYield; }
+
+    /**
+     * The buckets of a call with the "rate-limit" aCallLimit, those of the
+     * connection if it is a null Item. The caller keeps them for as long
+     * as it takes tokens. Raises nosql:InvalidOption.
+     */
+    std::shared_ptr<RateBuckets>
+    getBuckets(const Item& aCallLimit);
+
+  private:
+    Throttle(const Throttle&);
+    Throttle& operator=(const Throttle&);
+};
+
+
+/**
+ * Admits one call of a module function: waits for an operation token and
+ * for the byte debt of earlier calls, then, for a batch connection, for
+ * the running interactive operations. The waiting time is counted in the
+ * queue statistics and charged to the queue phase of aClock. The bytes
+ * the call reports with addBytes() are charged when it completes, so a
+ * call over its budget delays the calls after it.
+ */
+class Admission
+{
+  private:
+    std::shared_ptr<RateBuckets> theBuckets;
+    bool theInteractive;
+    uint64_t theBytes;
+
+  public:
+    Admission(Throttle& aThrottle, Statistics& aStatistics, PhaseClock& aClock,
+              const Item& aCallLimit = Item());
+
+    ~Admission();
+
+    // the bytes the call read or wrote, not those of other calls of the
+    // connection running at the same time
+    void
+    addBytes(uint64_t aBytes)
+    { theBytes += aBytes; }
+
+  private:
+    Admission(const Admission&);
+    Admission& operator=(const Admission&);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_THROTTLE_H
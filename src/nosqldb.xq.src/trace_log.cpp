@@ -0,0 +1,216 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <exception>
+#include <functional>
+#include <ostream>
+
+#include "trace_log.h"
+#include "json_lines.h"
+#include "nosqldb.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/*****************************************************************************
+ TraceRecord
+ *****************************************************************************/
+
+static void
+writeString(std::ostream& aOut, const std::string& aString)
+{
+  writeJSONString(aOut, aString.data(), aString.size());
+}
+
+
+void
+TraceRecord::write(std::ostream& aOut) const
+{
+  aOut << "{\"ts\":" << theTimestamp << ",\"op\":\""
+       << Statistics::theOperationNames[theOperation] << '"';
+
+  if (theHasKey)
+  {
+    aOut << ",\"key\":";
+    writeJSONKey(aOut, theKey);
+  }
+
+  if (theHasRange)
+  {
+    aOut << ",\"range\":{";
+    if (theRange.theIsPrefix)
+    {
+      aOut << "\"prefix\":";
+      writeString(aOut, theRange.thePrefix);
+    }
+    else
+    {
+      aOut << "\"start\":";
+      writeString(aOut, theRange.theStart);
+      aOut << ",\"end\":";
+      if (theRange.theHasEnd)
+        writeString(aOut, theRange.theEnd);
+      else
+        aOut << "null";
+      aOut << ",\"start-inclusive\":" << (theRange.theStartInclusive ? "true" : "false")
+           << ",\"end-inclusive\":" << (theRange.theEndInclusive ? "true" : "false");
+    }
+    aOut.put('}');
+  }
+
+  if (!theDepth.empty())
+  {
+    aOut << ",\"depth\":";
+    writeString(aOut, theDepth);
+  }
+  if (!theDirection.empty())
+  {
+    aOut << ",\"direction\":";
+    writeString(aOut, theDirection);
+  }
+
+  aOut << ",\"results\":" << theResults
+       << ",\"bytes\":" << theBytes
+       << ",\"latency-us\":" << theLatency
+       << ",\"outcome\":\"" << (theFailed ? "error" : "ok") << "\"}\n";
+}
+
+
+/*****************************************************************************
+ TraceLog
+ *****************************************************************************/
+
+TraceLog::TraceLog(const std::string& aPath, double aSampleRate, size_t aCapacity)
+  : theBuffer(aCapacity),
+    theOut(aPath.c_str(), std::ios::out | std::ios::app),
+    theSampleThreshold((uint64_t)(aSampleRate * 4294967296.0)),
+    theStopping(false),
+    theSubmitted(0),
+    theDropped(0),
+    theWritten(0),
+    theReportedDropped(0)
+{
+  if (!theOut)
+    throwError("FileError", ("Could not open " + aPath + " for writing.").c_str());
+
+  theWriter = std::thread(&TraceLog::run, this);
+}
+
+
+TraceLog::~TraceLog()
+{
+  theStopping = true;
+  theWriter.join();
+}
+
+
+bool
+TraceLog::sample() const
+{
+  if (theSampleThreshold >= ((uint64_t)1 << 32))
+    return true;
+
+  // xorshift, one generator per thread
+  static thread_local uint32_t lState =
+      (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+  lState ^= lState << 13;
+  lState ^= lState >> 17;
+  lState ^= lState << 5;
+  return lState < theSampleThreshold;
+}
+
+
+void
+TraceLog::flush()
+{
+  uint64_t lSubmitted = theSubmitted;
+  uint64_t lDropped = theDropped;
+  while (theWritten < lSubmitted || theReportedDropped < lDropped)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+
+void
+TraceLog::run()
+{
+  TraceRecord lRecord;
+  uint64_t lWritten = 0;
+  for (;;)
+  {
+    // read the flag before draining, records submitted before the stop are
+    // still written
+    bool lStopping = theStopping;
+    uint64_t lBefore = lWritten;
+    while (theBuffer.tryPop(lRecord))
+    {
+      lRecord.write(theOut);
+      ++lWritten;
+    }
+
+    // the records dropped since the last marker
+    uint64_t lDropped = theDropped;
+    bool lDrops = lDropped > theReportedDropped;
+    if (lDrops)
+      theOut << "{\"dropped\":" << lDropped - theReportedDropped << "}\n";
+
+    if (lWritten > lBefore || lDrops)
+    {
+      theOut.flush();
+      theWritten = lWritten;
+      theReportedDropped = lDropped;
+    }
+
+    if (lStopping)
+      break;
+    if (lWritten == lBefore)
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+}
+
+
+/*****************************************************************************
+ TraceScope
+ *****************************************************************************/
+
+TraceScope::TraceScope(TraceLog* aLog, Statistics::Operation aOperation)
+  : theLog(aLog && aLog->sample() ? aLog : 0)
+{
+  if (!theLog)
+    return;
+
+  theRecord.theOperation = aOperation;
+  theRecord.theTimestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  theStart = std::chrono::steady_clock::now();
+}
+
+
+TraceScope::~TraceScope()
+{
+  if (!theLog)
+    return;
+
+  theRecord.theLatency = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - theStart).count();
+  theRecord.theFailed = std::uncaught_exception();
+  theLog->submit(theRecord);
+}
+
+
+}} // namespace zorba, nosqldb
@@ -0,0 +1,212 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_TRACE_LOG_H
+#define NOSQLDB_TRACE_LOG_H
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "key_codec.h"
+#include "ring_buffer.h"
+#include "statistics.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * One store operation as written to the trace file.
+ */
+class TraceRecord
+{
+  public:
+    Statistics::Operation theOperation;
+    int64_t theTimestamp;        // microseconds since the epoch
+    bool theHasKey;
+    KeyPath theKey;
+    bool theHasRange;
+    KeyRangeSpec theRange;
+    std::string theDepth;
+    std::string theDirection;
+    uint64_t theResults;
+    uint64_t theBytes;
+    uint64_t theLatency;         // microseconds
+    bool theFailed;
+
+    TraceRecord()
+      : theOperation(Statistics::GET),
+        theTimestamp(0),
+        theHasKey(false),
+        theHasRange(false),
+        theResults(0),
+        theBytes(0),
+        theLatency(0),
+        theFailed(false)
+    {}
+
+    /**
+     * Writes the record as one JSON line. Keys and ranges use the form of
+     * the key and sub-range parameters, so that a trace can be replayed.
+     */
+    void
+    write(std::ostream& aOut) const;
+};
+
+
+/**
+ * Asynchronous JSON-lines trace sink of a connection. Query threads hand
+ * their records to a lock-free ring buffer and never wait; a record that
+ * finds the buffer full is dropped and counted. A writer thread drains the
+ * buffer into the file, followed by a { "dropped" : n } line for the
+ * records dropped since its last one.
+ */
+class TraceLog
+{
+  private:
+    RingBuffer<TraceRecord> theBuffer;
+    std::ofstream theOut;
+    uint64_t theSampleThreshold;   // out of 2^32
+    std::atomic<bool> theStopping;
+    std::atomic<uint64_t> theSubmitted;
+    std::atomic<uint64_t> theDropped;
+    // what the writer has written to the file, see flush()
+    std::atomic<uint64_t> theWritten;
+    std::atomic<uint64_t> theReportedDropped;
+    std::thread theWriter;
+
+    void
+    run();
+
+  public:
+    /**
+     * Opens aPath for appending, raises nosql:FileError. aSampleRate is the
+     * fraction of operations traced, between 0 and 1.
+     */
+    TraceLog(const std::string& aPath, double aSampleRate, size_t aCapacity);
+
+    /**
+     * Writes the buffered records and closes the file.
+     */
+    ~TraceLog();
+
+    /**
+     * Decides whether the operation about to start is traced.
+     */
+    bool
+    sample() const;
+
+    void
+    submit(TraceRecord& aRecord)
+    {
+      if (theBuffer.tryPush(aRecord))
+        ++theSubmitted;
+      else
+        ++theDropped;
+    }
+
+    /**
+     * Waits until the records submitted so far, and the count of those
+     * dropped, are in the file.
+     */
+    void
+    flush();
+
+  private:
+    TraceLog(const TraceLog&);
+    TraceLog& operator=(const TraceLog&);
+};
+
+
+/**
+ * Collects the trace record of one call of a module function and submits it
+ * when the call ends. Without a trace log, or when the call is not sampled,
+ * all setters are a single branch.
+ */
+class TraceScope
+{
+  private:
+    TraceLog* theLog;
+    TraceRecord theRecord;
+    std::chrono::steady_clock::time_point theStart;
+
+  public:
+    TraceScope(TraceLog* aLog, Statistics::Operation aOperation);
+
+    ~TraceScope();
+
+    void
+    setKey(const KeyPath& aKey)
+    {
+      if (theLog)
+      {
+        theRecord.theHasKey = true;
+        theRecord.theKey = aKey;
+      }
+    }
+
+    void
+    setRange(const KeyRangeSpec& aRange)
+    {
+      if (theLog)
+      {
+        theRecord.theHasRange = true;
+        theRecord.theRange = aRange;
+      }
+    }
+
+    void
+    setDepth(const std::string& aDepth)
+    {
+      if (theLog)
+        theRecord.theDepth = aDepth;
+    }
+
+    void
+    setDirection(const std::string& aDirection)
+    {
+      if (theLog)
+        theRecord.theDirection = aDirection;
+    }
+
+    void
+    setResults(uint64_t aResults)
+    {
+      if (theLog)
+        theRecord.theResults = aResults;
+    }
+
+    void
+    addBytes(uint64_t aBytes)
+    {
+      if (theLog)
+        theRecord.theBytes += aBytes;
+    }
+
+  private:
+    TraceScope(const TraceScope&);
+    TraceScope& operator=(const TraceScope&);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_TRACE_LOG_H
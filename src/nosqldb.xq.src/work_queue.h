@@ -0,0 +1,100 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_WORK_QUEUE_H
+#define NOSQLDB_WORK_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Bounded blocking queue handing work from the query thread to worker
+ * threads, or read-ahead batches back to it. push() waits while the queue is full, pop() waits while it is
+ * empty and returns false once the queue is closed and drained.
+ */
+template <class T>
+class WorkQueue
+{
+  private:
+    std::deque<T> theItems;
+    size_t theCapacity;
+    bool theClosed;
+    std::mutex theMutex;
+    std::condition_variable theNotEmpty;
+    std::condition_variable theNotFull;
+
+  public:
+    WorkQueue(size_t aCapacity) : theCapacity(aCapacity), theClosed(false)
+    {}
+
+    /**
+     * Returns false, dropping aItem, if the queue was closed.
+     */
+    bool
+    push(T aItem)
+    {
+      std::unique_lock<std::mutex> lLock(theMutex);
+      while (!theClosed && theItems.size() >= theCapacity)
+        theNotFull.wait(lLock);
+      if (theClosed)
+        return false;
+      theItems.push_back(std::move(aItem));
+      theNotEmpty.notify_one();
+      return true;
+    }
+
+    bool
+    pop(T& aItem)
+    {
+      std::unique_lock<std::mutex> lLock(theMutex);
+      while (!theClosed && theItems.empty())
+        theNotEmpty.wait(lLock);
+      if (theItems.empty())
+        return false;
+      aItem = std::move(theItems.front());
+      theItems.pop_front();
+      theNotFull.notify_one();
+      return true;
+    }
+
+    /**
+     * No more items will be pushed; waiting threads are woken up.
+     */
+    void
+    close()
+    {
+      std::lock_guard<std::mutex> lLock(theMutex);
+      theClosed = true;
+      theNotEmpty.notify_all();
+      theNotFull.notify_all();
+    }
+
+  private:
+    WorkQueue(const WorkQueue&);
+    WorkQueue& operator=(const WorkQueue&);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_WORK_QUEUE_H
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "worker_pool.h"
+#include "java_exception.h"
+#include "nosqldb.h"
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+WorkerPool::~WorkerPool()
+{
+  join();
+
+  if (theException)
+  {
+    JNIEnv* env = 0;
+    theVM->GetEnv((void**)&env, JNI_VERSION_1_6);
+    if (env)
+      env->DeleteGlobalRef(theException);
+  }
+}
+
+
+void
+WorkerPool::fail(const std::string& aError)
+{
+  std::lock_guard<std::mutex> lLock(theErrorMutex);
+  if (!theFailed)
+    theError = aError;
+  theFailed = true;
+}
+
+
+void
+WorkerPool::fail(JNIEnv* env)
+{
+  jthrowable lException = env->ExceptionOccurred();
+  env->ExceptionClear();
+  if (theStatistics)
+    ++theStatistics->theJavaExceptions;
+
+  std::lock_guard<std::mutex> lLock(theErrorMutex);
+  if (!theFailed && lException)
+    theException = (jthrowable)env->NewGlobalRef(lException);
+  theFailed = true;
+  if (lException)
+    env->DeleteLocalRef(lException);
+}
+
+
+void
+WorkerPool::throwIfFailed(JNIEnv* env)
+{
+  if (!theFailed)
+    return;
+
+  if (theException)
+  {
+    jthrowable lException = (jthrowable)env->NewLocalRef(theException);
+    env->DeleteGlobalRef(theException);
+    theException = 0;
+    throwJavaException(env, lException);
+  }
+
+  throwError("VM001", theError.c_str());
+}
+
+
+}} // namespace zorba, nosqldb
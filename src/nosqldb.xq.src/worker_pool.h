@@ -0,0 +1,136 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NOSQLDB_WORKER_POOL_H
+#define NOSQLDB_WORKER_POOL_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <jni.h>
+
+#include "jvm_thread.h"
+#include "statistics.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Native threads attached to the JVM for the bulk operations. The first
+ * failure of any worker is kept so that the query thread can raise it
+ * after join(); workers are expected to check failed() and stop early.
+ * Java exceptions are kept as such and raised by the query thread through
+ * throwJavaException().
+ */
+class WorkerPool
+{
+  private:
+    JavaVM* theVM;
+    Statistics* theStatistics;
+    std::vector<std::thread> theThreads;
+    std::atomic<bool> theFailed;
+    std::mutex theErrorMutex;
+    std::string theError;
+    jthrowable theException;
+
+    template <class F>
+    void
+    run(F aTask, unsigned aIndex)
+    {
+      JVMThreadScope lScope(theVM);
+      if (!lScope.getEnv())
+      {
+        fail("could not attach a worker thread to the Java VM");
+        return;
+      }
+
+      // workers count into the statistics of the operation that started them
+      Statistics::setCurrent(theStatistics);
+      uint64_t lJNICalls = Statistics::theThreadJNICalls;
+      aTask(lScope.getEnv(), aIndex);
+      if (theStatistics)
+        theStatistics->theJNICalls += Statistics::theThreadJNICalls - lJNICalls;
+      Statistics::setCurrent(0);
+    }
+
+  public:
+    WorkerPool(JavaVM* aVM)
+      : theVM(aVM),
+        theStatistics(Statistics::current()),
+        theFailed(false),
+        theException(0)
+    {}
+
+    ~WorkerPool();
+
+    /**
+     * Starts aCount threads calling aTask(JNIEnv*, unsigned aIndex).
+     */
+    template <class F>
+    void
+    start(unsigned aCount, F aTask)
+    {
+      for (unsigned i = 0; i < aCount; ++i)
+        theThreads.push_back(std::thread(&WorkerPool::run<F>, this, aTask, i));
+    }
+
+    void
+    join()
+    {
+      for (size_t i = 0; i < theThreads.size(); ++i)
+        if (theThreads[i].joinable())
+          theThreads[i].join();
+    }
+
+    /**
+     * Records aError unless an earlier failure was recorded.
+     */
+    void
+    fail(const std::string& aError);
+
+    /**
+     * Records and clears the Java exception pending on env, the calling
+     * worker's environment.
+     */
+    void
+    fail(JNIEnv* env);
+
+    bool
+    failed() const
+    { return theFailed; }
+
+    /**
+     * Raises the recorded failure, env is the query thread's environment.
+     * Call after join().
+     */
+    void
+    throwIfFailed(JNIEnv* env);
+
+  private:
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_WORKER_POOL_H
@@ -0,0 +1,251 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "write_buffer.h"
+#include "statistics.h"
+
+#define RETURN_IF_EXCEPTION(env)  if ((COUNT_JNI_CALL(), env->ExceptionCheck())) return false
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+void
+WriteBuffer::add(const KeyPath& aKey, bool aIsDelete, const std::string& aValue)
+{
+  if (theOperations == 0)
+    theOldest = std::chrono::steady_clock::now();
+
+  std::string lMinor = aKey.toString();
+  Group_t& lGroup = theGroups[aKey.majorToString()];
+  Group_t::iterator lIter = lGroup.find(lMinor);
+
+  if (lIter == lGroup.end())
+  {
+    Entry& lEntry = lGroup[lMinor];
+    lEntry.theKey = aKey;
+    lEntry.theIsDelete = aIsDelete;
+    lEntry.theValue = aValue;
+    ++theOperations;
+    theBytes += lMinor.size() + aValue.size();
+  }
+  else
+  {
+    // coalesce, only the last write to a key is sent
+    theBytes -= lIter->second.theValue.size();
+    lIter->second.theIsDelete = aIsDelete;
+    lIter->second.theValue = aValue;
+    theBytes += aValue.size();
+  }
+}
+
+
+WriteBuffer::Lookup
+WriteBuffer::lookup(const KeyPath& aKey, std::string& aValue) const
+{
+  Groups_t::const_iterator lGroup = theGroups.find(aKey.majorToString());
+  if (lGroup == theGroups.end())
+    return NOT_BUFFERED;
+
+  Group_t::const_iterator lIter = lGroup->second.find(aKey.toString());
+  if (lIter == lGroup->second.end())
+    return NOT_BUFFERED;
+
+  if (lIter->second.theIsDelete)
+    return BUFFERED_DELETE;
+
+  aValue = lIter->second.theValue;
+  return BUFFERED_PUT;
+}
+
+
+bool
+WriteBuffer::needsFlush() const
+{
+  if (theOperations == 0)
+    return false;
+
+  return theOperations >= theMaxOperations ||
+         theBytes >= theMaxBytes ||
+         std::chrono::steady_clock::now() - theOldest >= theMaxDelay;
+}
+
+
+bool
+WriteBuffer::flushGroup(JNIEnv* env, jobject aStore, const Group_t& aGroup)
+{
+  // the local references of a batch are dropped with the frame, also when
+  // the batch fails
+  if (env->PushLocalFrame(16) < 0)
+    return false;
+  bool lSent = sendGroup(env, aStore, aGroup);
+  env->PopLocalFrame(NULL);
+  return lSent;
+}
+
+
+bool
+WriteBuffer::sendGroup(JNIEnv* env, jobject aStore, const Group_t& aGroup)
+{
+  //    OperationFactory of = store.getOperationFactory();
+  jclass kvsClass = env->FindClass("oracle/kv/KVStore");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midGetOpFactory = env->GetMethodID(kvsClass, "getOperationFactory", "()Loracle/kv/OperationFactory;");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midExecute = env->GetMethodID(kvsClass, "execute", "(Ljava/util/List;)Ljava/util/List;");
+  RETURN_IF_EXCEPTION(env);
+  jobject opFactory = env->CallObjectMethod(aStore, midGetOpFactory);
+  RETURN_IF_EXCEPTION(env);
+
+  jclass opFactoryClass = env->FindClass("oracle/kv/OperationFactory");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midCreatePut = env->GetMethodID(opFactoryClass, "createPut", "(Loracle/kv/Key;Loracle/kv/Value;)Loracle/kv/Operation;");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midCreateDelete = env->GetMethodID(opFactoryClass, "createDelete", "(Loracle/kv/Key;)Loracle/kv/Operation;");
+  RETURN_IF_EXCEPTION(env);
+
+  jclass valueClass = env->FindClass("oracle/kv/Value");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midValueCreate = env->GetStaticMethodID(valueClass, "createValue", "([B)Loracle/kv/Value;");
+  RETURN_IF_EXCEPTION(env);
+
+  //    List ops = new ArrayList(n);
+  jclass arrayListClass = env->FindClass("java/util/ArrayList");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midALCons = env->GetMethodID(arrayListClass, "<init>", "(I)V");
+  RETURN_IF_EXCEPTION(env);
+  jmethodID midALAdd = env->GetMethodID(arrayListClass, "add", "(Ljava/lang/Object;)Z");
+  RETURN_IF_EXCEPTION(env);
+  jobject ops = env->NewObject(arrayListClass, midALCons, (jint)aGroup.size());
+  RETURN_IF_EXCEPTION(env);
+
+  for (Group_t::const_iterator lIter = aGroup.begin(); lIter != aGroup.end(); ++lIter)
+  {
+    const Entry& lEntry = lIter->second;
+    jobject k = createJavaKey(env, lEntry.theKey);
+    RETURN_IF_EXCEPTION(env);
+
+    jobject op;
+    if (lEntry.theIsDelete)
+    {
+      //    ops.add(of.createDelete(k));
+      op = env->CallObjectMethod(opFactory, midCreateDelete, k);
+      RETURN_IF_EXCEPTION(env);
+    }
+    else
+    {
+      //    ops.add(of.createPut(k, Value.createValue(bytes)));
+      jsize bufSize = lEntry.theValue.size();
+      jbyteArray jbyteArrayValue = env->NewByteArray(bufSize);
+      RETURN_IF_EXCEPTION(env);
+      env->SetByteArrayRegion(jbyteArrayValue, 0, bufSize, (const jbyte*)lEntry.theValue.data());
+      RETURN_IF_EXCEPTION(env);
+      jobject v = env->CallStaticObjectMethod(valueClass, midValueCreate, jbyteArrayValue);
+      RETURN_IF_EXCEPTION(env);
+      op = env->CallObjectMethod(opFactory, midCreatePut, k, v);
+      RETURN_IF_EXCEPTION(env);
+      env->DeleteLocalRef(v);
+      env->DeleteLocalRef(jbyteArrayValue);
+    }
+    env->CallBooleanMethod(ops, midALAdd, op);
+    RETURN_IF_EXCEPTION(env);
+    env->DeleteLocalRef(op);
+    env->DeleteLocalRef(k);
+  }
+
+  //    List<OperationResult> results = store.execute(ops);
+  jobject results = env->CallObjectMethod(aStore, midExecute, ops);
+  RETURN_IF_EXCEPTION(env);
+
+  // the batch commits at once, the version of its last put covers it
+  if (theReadYourWrites.isEnabled())
+  {
+    //    Version version = results.get(i).getNewVersion();
+    jclass listClass = env->FindClass("java/util/List");
+    RETURN_IF_EXCEPTION(env);
+    jmethodID midListGet = env->GetMethodID(listClass, "get", "(I)Ljava/lang/Object;");
+    RETURN_IF_EXCEPTION(env);
+    jclass opResultClass = env->FindClass("oracle/kv/OperationResult");
+    RETURN_IF_EXCEPTION(env);
+    jmethodID midGetNewVersion = env->GetMethodID(opResultClass, "getNewVersion", "()Loracle/kv/Version;");
+    RETURN_IF_EXCEPTION(env);
+    for (jint i = (jint)aGroup.size() - 1; i >= 0; --i)
+    {
+      jobject result = env->CallObjectMethod(results, midListGet, i);
+      RETURN_IF_EXCEPTION(env);
+      jobject version = env->CallObjectMethod(result, midGetNewVersion);
+      RETURN_IF_EXCEPTION(env);
+      env->DeleteLocalRef(result);
+      if (version)
+      {
+        theReadYourWrites.written(env, aGroup.begin()->second.theKey, version);
+        env->DeleteLocalRef(version);
+        break;
+      }
+    }
+  }
+
+  if (Statistics* lStatistics = Statistics::current())
+    for (Group_t::const_iterator lIter = aGroup.begin(); lIter != aGroup.end(); ++lIter)
+      lStatistics->theBytesWritten += lIter->second.theValue.size();
+  return true;
+}
+
+
+size_t
+WriteBuffer::erase(Groups_t::iterator aGroup)
+{
+  for (Group_t::const_iterator lIter = aGroup->second.begin();
+       lIter != aGroup->second.end(); ++lIter)
+    theBytes -= lIter->first.size() + lIter->second.theValue.size();
+
+  size_t lErased = aGroup->second.size();
+  theOperations -= lErased;
+  theGroups.erase(aGroup);
+  return lErased;
+}
+
+
+size_t
+WriteBuffer::flush(JNIEnv* env, jobject aStore)
+{
+  size_t lSent = 0;
+  while (!theGroups.empty())
+  {
+    Groups_t::iterator lGroup = theGroups.begin();
+    if (!flushGroup(env, aStore, lGroup->second))
+      return lSent;
+    lSent += erase(lGroup);
+  }
+  return lSent;
+}
+
+
+size_t
+WriteBuffer::flushMajor(JNIEnv* env, jobject aStore, const KeyPath& aKey)
+{
+  Groups_t::iterator lGroup = theGroups.find(aKey.majorToString());
+  if (lGroup == theGroups.end())
+    return 0;
+
+  if (!flushGroup(env, aStore, lGroup->second))
+    return 0;
+  return erase(lGroup);
+}
+
+
+}} // namespace zorba, nosqldb
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2006-2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NOSQLDB_WRITE_BUFFER_H
+#define NOSQLDB_WRITE_BUFFER_H
+
+#include <chrono>
+#include <map>
+#include <string>
+
+#include <jni.h>
+
+#include "key_codec.h"
+#include "read_your_writes.h"
+
+
+namespace zorba
+{
+namespace nosqldb
+{
+
+/**
+ * Write-behind buffer of a connection. Puts and deletes are held back,
+ * repeated writes to the same key replace each other, and a flush sends one
+ * KVStore.execute() batch per major path.
+ */
+class WriteBuffer
+{
+  public:
+    enum Lookup
+    {
+      NOT_BUFFERED,
+      BUFFERED_PUT,
+      BUFFERED_DELETE
+    };
+
+  private:
+    class Entry
+    {
+      public:
+        KeyPath theKey;
+        bool theIsDelete;
+        std::string theValue;
+    };
+
+    // minor path -> pending write, all sharing one major path
+    typedef std::map<std::string, Entry> Group_t;
+    // major path -> group
+    typedef std::map<std::string, Group_t> Groups_t;
+
+    Groups_t theGroups;
+    size_t theOperations;
+    size_t theBytes;
+    std::chrono::steady_clock::time_point theOldest;
+
+    size_t theMaxOperations;
+    size_t theMaxBytes;
+    std::chrono::milliseconds theMaxDelay;
+    ReadYourWrites& theReadYourWrites;
+
+    void
+    add(const KeyPath& aKey, bool aIsDelete, const std::string& aValue);
+
+    bool
+    flushGroup(JNIEnv* env, jobject aStore, const Group_t& aGroup);
+
+    bool
+    sendGroup(JNIEnv* env, jobject aStore, const Group_t& aGroup);
+
+    size_t
+    erase(Groups_t::iterator aGroup);
+
+  public:
+    /**
+     * The versions of the batches sent are recorded in aReadYourWrites.
+     */
+    WriteBuffer(size_t aMaxOperations, size_t aMaxBytes, long aMaxDelayMs,
+                ReadYourWrites& aReadYourWrites)
+      : theOperations(0),
+        theBytes(0),
+        theMaxOperations(aMaxOperations),
+        theMaxBytes(aMaxBytes),
+        theMaxDelay(aMaxDelayMs),
+        theReadYourWrites(aReadYourWrites)
+    {}
+
+    void
+    put(const KeyPath& aKey, const std::string& aValue)
+    { add(aKey, false, aValue); }
+
+    void
+    remove(const KeyPath& aKey)
+    { add(aKey, true, std::string()); }
+
+    /**
+     * Read-your-writes: the pending write for aKey, if any.
+     */
+    Lookup
+    lookup(const KeyPath& aKey, std::string& aValue) const;
+
+    bool
+    empty() const
+    { return theOperations == 0; }
+
+    // the pending puts and removes
+    size_t
+    size() const
+    { return theOperations; }
+
+    /**
+     * True once the operation count, byte size or age of the buffer reached
+     * its configured limit.
+     */
+    bool
+    needsFlush() const;
+
+    /**
+     * Sends all pending writes. Stops at the first Java exception, which is
+     * left pending; the failed and remaining groups stay buffered.
+     * Returns the number of operations sent.
+     */
+    size_t
+    flush(JNIEnv* env, jobject aStore);
+
+    /**
+     * Sends the pending writes under the major path of aKey only.
+     */
+    size_t
+    flushMajor(JNIEnv* env, jobject aStore, const KeyPath& aKey);
+};
+
+
+}} // namespace zorba, nosqldb
+#endif // NOSQLDB_WRITE_BUFFER_H
@@ -0,0 +1 @@
+200 200 200 | 100 10 10 | invalid m1 true
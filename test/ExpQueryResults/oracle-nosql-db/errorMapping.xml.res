@@ -0,0 +1 @@
+mapped InvalidArgument
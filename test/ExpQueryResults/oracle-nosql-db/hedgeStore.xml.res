@@ -0,0 +1 @@
+200 true | 50 true | invalid native
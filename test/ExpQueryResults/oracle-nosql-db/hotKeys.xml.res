@@ -0,0 +1 @@
+7 1 hot1 6 6 1 disabled
@@ -0,0 +1 @@
+2 2 value one value two
@@ -0,0 +1 @@
+V m2 V m2 V m31 | V m4 V m2 V m1 | 2 V m2
@@ -0,0 +1 @@
+d1e1 d1e3 d2e1 d3e2 | d3e2 d2x9 d2e1 d1e3 d1e1 | true v9
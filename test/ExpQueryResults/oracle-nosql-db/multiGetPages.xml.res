@@ -0,0 +1 @@
+p a ax ay ayz b bx c 8 | p a ax ay ayz b bx c 4 | c bx b ayz ay ax a p 3 | p a b c 2
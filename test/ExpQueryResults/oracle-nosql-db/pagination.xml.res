@@ -0,0 +1 @@
+c1 c2 | c3 c4 | c5 false | c5 c4 | invalid | p a ax ay ayz b bx c 8 | p a ax ay ayz b bx c 3 | c bx b ayz ay ax a p 8 | c bx b ayz ay ax a p 3 | p a ax ay ayz 3 | p a b c 4
@@ -0,0 +1 @@
+a f m1 m5 s z zz | z s m5 m1 f | m1 m5
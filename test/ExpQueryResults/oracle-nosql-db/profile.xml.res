@@ -0,0 +1 @@
+true multi-get 2 true
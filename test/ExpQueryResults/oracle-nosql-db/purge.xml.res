@@ -0,0 +1 @@
+10 true kept
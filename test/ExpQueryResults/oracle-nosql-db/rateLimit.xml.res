@@ -0,0 +1 @@
+true true 1 v invalid
@@ -0,0 +1 @@
+m3 m2 m1 | invalid
@@ -0,0 +1 @@
+250 true 250 invalid
@@ -0,0 +1 @@
+r1 r2 r2 true | 2 w1 w1 w2 | invalid native
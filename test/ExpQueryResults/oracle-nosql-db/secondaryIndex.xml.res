@@ -0,0 +1 @@
+u1 u3 | u1 | u3 u1 unknown
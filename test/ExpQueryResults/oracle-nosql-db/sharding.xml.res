@@ -0,0 +1 @@
+20 11 9 | 6 4 0 0 6 v6 invalid unsharded
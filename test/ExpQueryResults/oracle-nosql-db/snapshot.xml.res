@@ -0,0 +1 @@
+4 V m2 true V m2 V m31 | V m2 V m1 read-only
@@ -0,0 +1 @@
+9 2 true | 1 true 2 true | invalid native
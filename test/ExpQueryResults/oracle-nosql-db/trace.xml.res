@@ -0,0 +1 @@
+traced true | put tracekey1 1 ok get tracekey1 1 ok remove tracekey1 1 ok | 0 200
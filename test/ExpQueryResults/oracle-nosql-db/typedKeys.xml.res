@@ -0,0 +1 @@
+V 9 V 10 true | V 2013-12-01 V 2014-01-15 | mixed
@@ -0,0 +1 @@
+second 1 second true 1